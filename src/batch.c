@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "command.h"
+#include "line.h"
+#include "stats.h"
+#include "yank.h"
+
+static void
+batch_file_process(const struct command_script* script, struct batch_file* f)
+{
+    long start = stats_now();
+
+    struct stat st;
+    if (stat(f->path, &st) == 0) f->bytes = st.st_size;
+
+    struct line* head = line_new();
+    struct line* tail = head;
+    long count = 1;
+    if (head == NULL || lines_init(&head, &tail, &count, f->path) != LINE_OK) {
+        f->error = "failed to read file";
+        lines_free(&head, &tail);
+        f->nanos = stats_now() - start;
+        return;
+    }
+
+    // registers only live as long as the file's run
+    struct yank registers[YANK_REGISTER_COUNT];
+    for (long i = 0; i < YANK_REGISTER_COUNT; i++) yank_init(&registers[i]);
+
+    struct command_buffer b = { 0 };
+    command_buffer_init(&b, head, tail, count);
+    b.registers = registers;
+
+    // the files already keep every cpu busy, so sort stays on this thread
+    b.threads = 1;
+    if (command_run(script, &b, &f->error) == COMMAND_OK && b.modified && !b.discard) {
+        if (lines_save(b.head, f->path) == LINE_OK) {
+            f->saved = true;
+        } else {
+            f->error = "failed to save file";
+        }
+    }
+    f->lines = b.count;
+
+    lines_free(&b.head, &b.tail);
+    for (long i = 0; i < YANK_REGISTER_COUNT; i++) yank_free(&registers[i]);
+    f->nanos = stats_now() - start;
+}
+
+static void*
+batch_worker(void* arg)
+{
+    struct batch* b = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&b->mutex);
+        long index = b->next < b->count ? b->next++ : -1;
+        pthread_mutex_unlock(&b->mutex);
+        if (index < 0) break;
+
+        batch_file_process(b->script, &b->files[index]);
+    }
+
+    return NULL;
+}
+
+int
+batch_run(const struct command_script* script, struct batch_file* files, long count, long threads)
+{
+    assert(script != NULL);
+    assert(files != NULL || count == 0);
+
+    struct batch b = {
+        .script = script,
+        .files = files,
+        .count = count,
+        .next = 0,
+    };
+    pthread_mutex_init(&b.mutex, NULL);
+
+    if (threads > count) threads = count;
+    pthread_t* workers = calloc(threads > 0 ? threads : 1, sizeof(pthread_t));
+    long started = 0;
+    for (; workers != NULL && started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, batch_worker, &b) != 0) break;
+    }
+
+    // with no threads at all, do the work right here
+    if (started == 0) batch_worker(&b);
+    for (long i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+    free(workers);
+    pthread_mutex_destroy(&b.mutex);
+
+    for (long i = 0; i < count; i++) {
+        if (files[i].error != NULL) return BATCH_ERROR;
+    }
+    return BATCH_OK;
+}
+
+int
+batch_report(FILE* fp, const struct batch_file* files, long count, long nanos)
+{
+    assert(fp != NULL);
+
+    long bytes = 0;
+    long saved = 0;
+    long failed = 0;
+    for (long i = 0; i < count; i++) {
+        const struct batch_file* f = &files[i];
+        fprintf(fp, "%-40s %10ld lines %12ld bytes %10.3f ms  %s\n",
+            f->path, f->lines, f->bytes, f->nanos / 1e6,
+            f->error != NULL ? f->error : f->saved ? "saved" : "unchanged");
+
+        bytes += f->bytes;
+        if (f->saved) saved++;
+        if (f->error != NULL) failed++;
+    }
+
+    double seconds = nanos / 1e9;
+    fprintf(fp, "%ld files (%ld saved, %ld failed), %.1f MB in %.3f s: %.1f MB/s, %.0f files/s\n",
+        count, saved, failed, bytes / 1048576.0, seconds,
+        seconds > 0 ? bytes / 1048576.0 / seconds : 0.0,
+        seconds > 0 ? count / seconds : 0.0);
+
+    return BATCH_OK;
+}
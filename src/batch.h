@@ -0,0 +1,40 @@
+#ifndef DERZVIM_BATCH_H_INCLUDED
+#define DERZVIM_BATCH_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <pthread.h>
+
+#include "command.h"
+
+// the outcome of running the script on one file
+struct batch_file {
+    const char* path;
+    long nanos;
+    long bytes;
+    long lines;
+    bool saved;
+    const char* error;
+};
+
+// Runs one ex script over many files on a pool of threads. Each file is
+// loaded, edited and saved by a single worker, so the only shared state
+// is the (read-only) script and the index of the next file to claim.
+struct batch {
+    const struct command_script* script;
+    struct batch_file* files;
+    long count;
+    long next;
+    pthread_mutex_t mutex;
+};
+
+enum batch_status {
+    BATCH_OK = 0,
+    BATCH_ERROR,
+};
+
+int batch_run(const struct command_script* script, struct batch_file* files, long count, long threads);
+int batch_report(FILE* fp, const struct batch_file* files, long count, long nanos);
+
+#endif
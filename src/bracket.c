@@ -0,0 +1,707 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bracket.h"
+#include "line.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum {
+    BRACKET_DEFAULT_CAPACITY = 16,
+    BRACKET_CAPACITY_GROWTH = 2,
+
+    // chunks are only filled this far up front, so inserts don't split them at once
+    BRACKET_CHUNK_FILL = BRACKET_CHUNK_LINES * 3 / 4,
+
+    // lines longer than two of these are searched a block at a time
+    BRACKET_BLOCK = 64 * 1024,
+};
+
+static long
+bracket_delta(char c)
+{
+    switch (c) {
+        case '(':
+        case '[':
+        case '{':
+            return 1;
+        case ')':
+        case ']':
+        case '}':
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+static struct bracket_depth
+bracket_scan(const char* buf, long size)
+{
+    struct bracket_depth d = { 0 };
+    for (long i = 0; i < size; i++) {
+        d.net += bracket_delta(buf[i]);
+        if (d.net < d.min) d.min = d.net;
+    }
+    return d;
+}
+
+static struct bracket_node
+bracket_combine(struct bracket_node a, struct bracket_node b)
+{
+    return (struct bracket_node){
+        .lines = a.lines + b.lines,
+        .net = a.net + b.net,
+        .min = MIN(a.min, a.net + b.min),
+    };
+}
+
+static void
+bracket_chunk_total(struct bracket_chunk* c)
+{
+    struct bracket_node total = { 0 };
+    for (long i = 0; i < c->count; i++) {
+        struct bracket_node line = { 1, c->depths[i].net, c->depths[i].min };
+        total = bracket_combine(total, line);
+    }
+    c->total = total;
+}
+
+static void
+bracket_tree_set(struct bracket* b, long chunk)
+{
+    long node = b->leaves + chunk;
+    b->tree[node] = b->chunks[chunk]->total;
+    for (node /= 2; node > 0; node /= 2) {
+        b->tree[node] = bracket_combine(b->tree[2 * node], b->tree[2 * node + 1]);
+    }
+}
+
+// lay the tree out again after chunks were added or removed in the middle
+static int
+bracket_tree_build(struct bracket* b)
+{
+    long leaves = b->leaves > 0 ? b->leaves : 1;
+    while (leaves < b->chunk_count) leaves *= BRACKET_CAPACITY_GROWTH;
+
+    if (leaves != b->leaves || b->tree == NULL) {
+        struct bracket_node* tree = realloc(b->tree, 2 * leaves * sizeof(struct bracket_node));
+        if (tree == NULL) {
+            fprintf(stderr, "bracket: failed to grow tree\n");
+            return BRACKET_ERROR;
+        }
+        b->tree = tree;
+        b->leaves = leaves;
+    }
+
+    for (long i = 0; i < leaves; i++) {
+        b->tree[leaves + i] = i < b->chunk_count ? b->chunks[i]->total : (struct bracket_node){ 0 };
+    }
+    for (long node = leaves - 1; node > 0; node--) {
+        b->tree[node] = bracket_combine(b->tree[2 * node], b->tree[2 * node + 1]);
+    }
+
+    return BRACKET_OK;
+}
+
+// make room for count new chunks from index on (the tree is left to the
+// caller)
+static struct bracket_chunk*
+bracket_chunk_add(struct bracket* b, long index, long count)
+{
+    if (b->chunk_count + count > b->chunk_capacity) {
+        long capacity = b->chunk_capacity > 0 ? b->chunk_capacity : BRACKET_DEFAULT_CAPACITY;
+        while (capacity < b->chunk_count + count) capacity *= BRACKET_CAPACITY_GROWTH;
+
+        struct bracket_chunk** chunks = realloc(b->chunks, capacity * sizeof(struct bracket_chunk*));
+        if (chunks == NULL) {
+            fprintf(stderr, "bracket: failed to grow chunk list\n");
+            return NULL;
+        }
+        b->chunks = chunks;
+        b->chunk_capacity = capacity;
+    }
+
+    memmove(&b->chunks[index + count], &b->chunks[index], (b->chunk_count - index) * sizeof(struct bracket_chunk*));
+    for (long i = 0; i < count; i++) {
+        struct bracket_chunk* c = calloc(1, sizeof(struct bracket_chunk));
+        if (c == NULL) {
+            fprintf(stderr, "bracket: failed to allocate chunk\n");
+            for (long j = 0; j < i; j++) free(b->chunks[index + j]);
+            memmove(&b->chunks[index], &b->chunks[index + count], (b->chunk_count - index) * sizeof(struct bracket_chunk*));
+            return NULL;
+        }
+        b->chunks[index + i] = c;
+    }
+    b->chunk_count += count;
+
+    return b->chunks[index];
+}
+
+static long
+bracket_total_lines(const struct bracket* b)
+{
+    return b->chunk_count > 0 ? b->tree[1].lines : 0;
+}
+
+// the chunk holding line index, and where in it the line is
+static long
+bracket_locate(const struct bracket* b, long index, long* offset)
+{
+    long node = 1;
+    while (node < b->leaves) {
+        const struct bracket_node* left = &b->tree[2 * node];
+        if (index < left->lines) {
+            node = 2 * node;
+        } else {
+            index -= left->lines;
+            node = 2 * node + 1;
+        }
+    }
+
+    *offset = index;
+    return node - b->leaves;
+}
+
+// all the chunks before chunk, added up
+static struct bracket_node
+bracket_before(const struct bracket* b, long chunk)
+{
+    struct bracket_node sum = { 0 };
+    for (long node = b->leaves + chunk; node > 1; node /= 2) {
+        if (node & 1) {
+            sum.lines += b->tree[node - 1].lines;
+            sum.net += b->tree[node - 1].net;
+        }
+    }
+    return sum;
+}
+
+// the depth at the start of line index (which may be one past the end)
+static long
+bracket_depth_at(const struct bracket* b, long index)
+{
+    if (index >= bracket_total_lines(b)) return b->tree[1].net;
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    long depth = bracket_before(b, chunk).net;
+    for (long i = 0; i < offset; i++) depth += b->chunks[chunk]->depths[i].net;
+    return depth;
+}
+
+// The first line from index on where the depth drops below level, or -1
+// if there is none. depth is set to the depth at the start of that line.
+static long
+bracket_find_forward(const struct bracket* b, long index, long level, long* depth)
+{
+    if (index >= bracket_total_lines(b)) return -1;
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    *depth = bracket_depth_at(b, index);
+
+    for (;;) {
+        const struct bracket_chunk* c = b->chunks[chunk];
+        for (long i = offset; i < c->count; i++) {
+            if (*depth + c->depths[i].min < level) return index + i - offset;
+            *depth += c->depths[i].net;
+        }
+
+        // go up until a chunk to the right dips low enough, then down to it
+        long node = b->leaves + chunk;
+        while (node > 1 && ((node & 1) || *depth + b->tree[node + 1].min >= level)) {
+            if (!(node & 1)) *depth += b->tree[node + 1].net;
+            node /= 2;
+        }
+        if (node <= 1) return -1;
+
+        for (node++; node < b->leaves;) {
+            if (*depth + b->tree[2 * node].min < level) {
+                node = 2 * node;
+            } else {
+                *depth += b->tree[2 * node].net;
+                node = 2 * node + 1;
+            }
+        }
+
+        chunk = node - b->leaves;
+        index = bracket_before(b, chunk).lines;
+        offset = 0;
+    }
+}
+
+// The last line up to index where the depth (at the start or inside it)
+// drops below level, or -1. depth is set to the depth at the end of it.
+static long
+bracket_find_backward(const struct bracket* b, long index, long level, long* depth)
+{
+    if (index < 0) return -1;
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    *depth = bracket_depth_at(b, index + 1);
+
+    for (;;) {
+        const struct bracket_chunk* c = b->chunks[chunk];
+        for (long i = offset; i >= 0; i--) {
+            long start = *depth - c->depths[i].net;
+            if (start + c->depths[i].min < level) return index - (offset - i);
+            *depth = start;
+        }
+
+        // go up until a chunk to the left dips low enough, then down to it
+        long node = b->leaves + chunk;
+        while (node > 1 && (!(node & 1) || *depth - b->tree[node - 1].net + b->tree[node - 1].min >= level)) {
+            if (node & 1) *depth -= b->tree[node - 1].net;
+            node /= 2;
+        }
+        if (node <= 1) return -1;
+
+        for (node--; node < b->leaves;) {
+            const struct bracket_node* right = &b->tree[2 * node + 1];
+            if (*depth - right->net + right->min < level) {
+                node = 2 * node + 1;
+            } else {
+                *depth -= right->net;
+                node = 2 * node;
+            }
+        }
+
+        chunk = node - b->leaves;
+        offset = b->chunks[chunk]->count - 1;
+        index = bracket_before(b, chunk).lines + offset;
+    }
+}
+
+// summaries for each block of a long line, kept until it changes
+static bool
+bracket_blocks(struct bracket* b, const struct line* line)
+{
+    if (line->size <= 2 * BRACKET_BLOCK) return false;
+    if (b->block_line == line) return true;
+
+    long count = (line->size + BRACKET_BLOCK - 1) / BRACKET_BLOCK;
+    struct bracket_depth* blocks = realloc(b->blocks, count * sizeof(struct bracket_depth));
+    if (blocks == NULL) return false;
+
+    for (long i = 0; i < count; i++) {
+        long start = i * BRACKET_BLOCK;
+        blocks[i] = bracket_scan(&line->buf[start], MIN(BRACKET_BLOCK, line->size - start));
+    }
+    b->blocks = blocks;
+    b->block_count = count;
+    b->block_line = line;
+
+    return true;
+}
+
+// Look for where need more closing brackets than opening ones have gone
+// by, from pos on. Returns where, or -1 with need left for what's after.
+static long
+bracket_line_forward(struct bracket* b, const struct line* line, long pos, long* need)
+{
+    bool blocks = bracket_blocks(b, line);
+    long end = blocks ? MIN((pos / BRACKET_BLOCK + 1) * BRACKET_BLOCK, line->size) : line->size;
+
+    for (;;) {
+        for (; pos < end; pos++) {
+            *need += bracket_delta(line->buf[pos]);
+            if (*need == 0) return pos;
+        }
+        if (end >= line->size) return -1;
+
+        // whole blocks the depth doesn't get low enough in are skipped
+        long block = end / BRACKET_BLOCK;
+        while (block < b->block_count && *need + b->blocks[block].min > 0) {
+            *need += b->blocks[block].net;
+            block++;
+        }
+        if (block >= b->block_count) return -1;
+
+        pos = block * BRACKET_BLOCK;
+        end = MIN(pos + BRACKET_BLOCK, line->size);
+    }
+}
+
+// the same going back from just before pos, looking for opening brackets
+static long
+bracket_line_backward(struct bracket* b, const struct line* line, long pos, long* need)
+{
+    bool blocks = bracket_blocks(b, line);
+    long start = blocks && pos > 0 ? (pos - 1) / BRACKET_BLOCK * BRACKET_BLOCK : 0;
+
+    for (;;) {
+        for (pos--; pos >= start; pos--) {
+            *need -= bracket_delta(line->buf[pos]);
+            if (*need == 0) return pos;
+        }
+        if (start <= 0) return -1;
+
+        // a block has a run at its end with net - min more opens than closes
+        long block = start / BRACKET_BLOCK - 1;
+        while (block >= 0 && b->blocks[block].net - b->blocks[block].min < *need) {
+            *need -= b->blocks[block].net;
+            block--;
+        }
+        if (block < 0) return -1;
+
+        start = block * BRACKET_BLOCK;
+        pos = MIN(start + BRACKET_BLOCK, line->size);
+    }
+}
+
+// find the opening bracket that leaves need unmatched ones before pos
+static int
+bracket_search_backward(struct bracket* b, long index, long pos, long need, long* match_index, long* match_pos)
+{
+    struct line* line = bracket_line(b, index);
+    long found = bracket_line_backward(b, line, pos, &need);
+    if (found < 0) {
+        long level = bracket_depth_at(b, index) - need + 1;
+        long depth = 0;
+        index = bracket_find_backward(b, index - 1, level, &depth);
+        if (index < 0) return BRACKET_ERROR;
+
+        line = bracket_line(b, index);
+        need = depth - level + 1;
+        found = bracket_line_backward(b, line, line->size, &need);
+        if (found < 0) return BRACKET_ERROR;
+    }
+
+    *match_index = index;
+    *match_pos = found;
+    return BRACKET_OK;
+}
+
+static int
+bracket_search_forward(struct bracket* b, long index, long pos, long need, long* match_index, long* match_pos)
+{
+    struct line* line = bracket_line(b, index);
+    long found = bracket_line_forward(b, line, pos, &need);
+    if (found < 0) {
+        long level = bracket_depth_at(b, index + 1) - need + 1;
+        long depth = 0;
+        index = bracket_find_forward(b, index + 1, level, &depth);
+        if (index < 0) return BRACKET_ERROR;
+
+        line = bracket_line(b, index);
+        need = depth - level + 1;
+        found = bracket_line_forward(b, line, 0, &need);
+        if (found < 0) return BRACKET_ERROR;
+    }
+
+    *match_index = index;
+    *match_pos = found;
+    return BRACKET_OK;
+}
+
+int
+bracket_init(struct bracket* b)
+{
+    assert(b != NULL);
+
+    b->chunks = NULL;
+    b->chunk_count = 0;
+    b->chunk_capacity = 0;
+
+    b->tree = NULL;
+    b->leaves = 0;
+
+    b->built = false;
+
+    b->block_line = NULL;
+    b->blocks = NULL;
+    b->block_count = 0;
+
+    return BRACKET_OK;
+}
+
+int
+bracket_free(struct bracket* b)
+{
+    assert(b != NULL);
+
+    for (long i = 0; i < b->chunk_count; i++) free(b->chunks[i]);
+    free(b->chunks);
+    free(b->tree);
+    free(b->blocks);
+    bracket_init(b);
+
+    return BRACKET_OK;
+}
+
+int
+bracket_build(struct bracket* b, struct line* head, long count)
+{
+    assert(b != NULL);
+
+    bracket_free(b);
+    b->built = true;
+
+    if (bracket_chunk_add(b, 0, 1) == NULL || bracket_tree_build(b) != BRACKET_OK) {
+        bracket_free(b);
+        return BRACKET_ERROR;
+    }
+    if (bracket_append(b, head, count) != BRACKET_OK) {
+        bracket_free(b);
+        return BRACKET_ERROR;
+    }
+
+    return BRACKET_OK;
+}
+
+int
+bracket_invalidate(struct bracket* b)
+{
+    assert(b != NULL);
+
+    bracket_free(b);
+    return BRACKET_OK;
+}
+
+int
+bracket_update(struct bracket* b, long index, struct line* line)
+{
+    assert(b != NULL);
+    assert(line != NULL);
+
+    return bracket_update_lines(b, &index, &line, 1);
+}
+
+// bracket_update for many lines at once, given in order of index: the
+// chunks they are in are only added up again once each
+int
+bracket_update_lines(struct bracket* b, const long* indices, struct line* const* lines, long count)
+{
+    assert(b != NULL);
+    assert(count == 0 || (indices != NULL && lines != NULL));
+
+    if (!b->built) return BRACKET_OK;
+
+    long last = -1;
+    for (long i = 0; i < count; i++) {
+        if (b->block_line == lines[i]) b->block_line = NULL;
+
+        long offset = 0;
+        long chunk = bracket_locate(b, indices[i], &offset);
+        struct bracket_chunk* c = b->chunks[chunk];
+        c->lines[offset] = lines[i];
+        c->depths[offset] = bracket_scan(lines[i]->buf, lines[i]->size);
+
+        if (last >= 0 && chunk != last) {
+            bracket_chunk_total(b->chunks[last]);
+            bracket_tree_set(b, last);
+        }
+        last = chunk;
+    }
+    if (last >= 0) {
+        bracket_chunk_total(b->chunks[last]);
+        bracket_tree_set(b, last);
+    }
+
+    return BRACKET_OK;
+}
+
+int
+bracket_insert(struct bracket* b, long index, struct line* line)
+{
+    assert(b != NULL);
+    assert(line != NULL);
+
+    if (!b->built) return BRACKET_OK;
+    if (index >= bracket_total_lines(b)) return bracket_append(b, line, 1);
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    struct bracket_chunk* c = b->chunks[chunk];
+
+    // a full chunk gives its second half to a new one after it
+    if (c->count >= BRACKET_CHUNK_LINES) {
+        struct bracket_chunk* next = bracket_chunk_add(b, chunk + 1, 1);
+        if (next == NULL) return BRACKET_ERROR;
+
+        long half = c->count / 2;
+        next->count = c->count - half;
+        memcpy(next->lines, &c->lines[half], next->count * sizeof(struct line*));
+        memcpy(next->depths, &c->depths[half], next->count * sizeof(struct bracket_depth));
+        c->count = half;
+        bracket_chunk_total(c);
+        bracket_chunk_total(next);
+
+        if (offset >= half) {
+            c = next;
+            chunk++;
+            offset -= half;
+        }
+        if (bracket_tree_build(b) != BRACKET_OK) return BRACKET_ERROR;
+    }
+
+    memmove(&c->lines[offset + 1], &c->lines[offset], (c->count - offset) * sizeof(struct line*));
+    memmove(&c->depths[offset + 1], &c->depths[offset], (c->count - offset) * sizeof(struct bracket_depth));
+    c->count++;
+    c->lines[offset] = line;
+    c->depths[offset] = bracket_scan(line->buf, line->size);
+    bracket_chunk_total(c);
+    bracket_tree_set(b, chunk);
+
+    return BRACKET_OK;
+}
+
+// count lines from line on were linked in at index
+int
+bracket_insert_lines(struct bracket* b, long index, struct line* line, long count)
+{
+    assert(b != NULL);
+    assert(line != NULL || count == 0);
+
+    if (!b->built || count == 0) return BRACKET_OK;
+    if (count == 1) return bracket_insert(b, index, line);
+    if (index >= bracket_total_lines(b)) return bracket_append(b, line, count);
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    struct bracket_chunk* c = b->chunks[chunk];
+
+    // lines that fit go in among the rest of the chunk
+    if (c->count + count <= BRACKET_CHUNK_LINES) {
+        memmove(&c->lines[offset + count], &c->lines[offset], (c->count - offset) * sizeof(struct line*));
+        memmove(&c->depths[offset + count], &c->depths[offset], (c->count - offset) * sizeof(struct bracket_depth));
+        for (long i = 0; i < count; i++, line = line->next) {
+            c->lines[offset + i] = line;
+            c->depths[offset + i] = bracket_scan(line->buf, line->size);
+        }
+        c->count += count;
+        bracket_chunk_total(c);
+        bracket_tree_set(b, chunk);
+        return BRACKET_OK;
+    }
+
+    // otherwise the chunk is cut at offset, the lines fill it up and as
+    // many new chunks as they need, and the rest of it goes in one behind
+    long room = MAX(BRACKET_CHUNK_FILL - offset, 0);
+    long added = (count > room ? (count - room + BRACKET_CHUNK_FILL - 1) / BRACKET_CHUNK_FILL : 0) + 1;
+    if (bracket_chunk_add(b, chunk + 1, added) == NULL) return BRACKET_ERROR;
+
+    struct bracket_chunk* rest = b->chunks[chunk + added];
+    rest->count = c->count - offset;
+    memcpy(rest->lines, &c->lines[offset], rest->count * sizeof(struct line*));
+    memcpy(rest->depths, &c->depths[offset], rest->count * sizeof(struct bracket_depth));
+    bracket_chunk_total(rest);
+    c->count = offset;
+
+    for (long i = 0; i < count; i++, line = line->next) {
+        if (c->count >= BRACKET_CHUNK_FILL) {
+            bracket_chunk_total(c);
+            c = b->chunks[++chunk];
+        }
+        c->lines[c->count] = line;
+        c->depths[c->count] = bracket_scan(line->buf, line->size);
+        c->count++;
+    }
+    bracket_chunk_total(c);
+
+    return bracket_tree_build(b);
+}
+
+int
+bracket_remove(struct bracket* b, long index)
+{
+    assert(b != NULL);
+
+    if (!b->built) return BRACKET_OK;
+
+    // the line is most likely about to be freed
+    b->block_line = NULL;
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    struct bracket_chunk* c = b->chunks[chunk];
+
+    c->count--;
+    memmove(&c->lines[offset], &c->lines[offset + 1], (c->count - offset) * sizeof(struct line*));
+    memmove(&c->depths[offset], &c->depths[offset + 1], (c->count - offset) * sizeof(struct bracket_depth));
+
+    if (c->count == 0 && b->chunk_count > 1) {
+        free(c);
+        b->chunk_count--;
+        memmove(&b->chunks[chunk], &b->chunks[chunk + 1], (b->chunk_count - chunk) * sizeof(struct bracket_chunk*));
+        return bracket_tree_build(b);
+    }
+
+    bracket_chunk_total(c);
+    bracket_tree_set(b, chunk);
+
+    return BRACKET_OK;
+}
+
+int
+bracket_append(struct bracket* b, struct line* line, long count)
+{
+    assert(b != NULL);
+
+    if (!b->built) return BRACKET_OK;
+
+    long chunk = b->chunk_count - 1;
+    struct bracket_chunk* c = b->chunks[chunk];
+    for (long i = 0; i < count && line != NULL; i++, line = line->next) {
+        if (c->count >= BRACKET_CHUNK_FILL) {
+            bracket_chunk_total(c);
+            bracket_tree_set(b, chunk);
+
+            c = bracket_chunk_add(b, ++chunk, 1);
+            if (c == NULL) return BRACKET_ERROR;
+            if (b->chunk_count > b->leaves && bracket_tree_build(b) != BRACKET_OK) return BRACKET_ERROR;
+        }
+        c->lines[c->count] = line;
+        c->depths[c->count] = bracket_scan(line->buf, line->size);
+        c->count++;
+    }
+    bracket_chunk_total(c);
+    bracket_tree_set(b, chunk);
+
+    return BRACKET_OK;
+}
+
+struct line*
+bracket_line(const struct bracket* b, long index)
+{
+    assert(b != NULL);
+    assert(b->built);
+    assert(index >= 0 && index < bracket_total_lines(b));
+
+    long offset = 0;
+    long chunk = bracket_locate(b, index, &offset);
+    return b->chunks[chunk]->lines[offset];
+}
+
+// the bracket matching the one at pos on line index
+int
+bracket_match(struct bracket* b, long index, long pos, long* match_index, long* match_pos)
+{
+    assert(b != NULL);
+    assert(match_index != NULL);
+    assert(match_pos != NULL);
+
+    const struct line* line = bracket_line(b, index);
+    if (pos >= line->size) return BRACKET_ERROR;
+
+    long delta = bracket_delta(line->buf[pos]);
+    if (delta > 0) return bracket_search_forward(b, index, pos + 1, 1, match_index, match_pos);
+    if (delta < 0) return bracket_search_backward(b, index, pos, 1, match_index, match_pos);
+    return BRACKET_ERROR;
+}
+
+// the opening bracket of the innermost block around pos on line index
+int
+bracket_enclosing(struct bracket* b, long index, long pos, long* open_index, long* open_pos)
+{
+    assert(b != NULL);
+    assert(open_index != NULL);
+    assert(open_pos != NULL);
+
+    return bracket_search_backward(b, index, pos, 1, open_index, open_pos);
+}
@@ -0,0 +1,84 @@
+#ifndef DERZVIM_BRACKET_H_INCLUDED
+#define DERZVIM_BRACKET_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum {
+    BRACKET_CHUNK_LINES = 512,
+};
+
+// How a run of text changes the bracket depth: opens minus closes, and
+// the lowest the depth gets along the way (relative to where it starts)
+struct bracket_depth {
+    long net;
+    long min;
+};
+
+// the same for a run of lines, with how many there are
+struct bracket_node {
+    long lines;
+    long net;
+    long min;
+};
+
+struct bracket_chunk {
+    long count;
+    struct bracket_node total;
+    struct line* lines[BRACKET_CHUNK_LINES];
+    struct bracket_depth depths[BRACKET_CHUNK_LINES];
+};
+
+// Bracket nesting index for jumping between matching brackets. Lines
+// are kept in chunks of up to a few hundred, each line with its depth
+// summary, and the chunk totals sit in a tree. Finding the line where
+// the depth first drops below some level (which is where the matching
+// bracket is) walks down the tree in O(log n) and only scans inside one
+// chunk and one line. Editing a line redoes its summary and one path of
+// the tree, inserting a line only moves the rest of its chunk. Many
+// lines inserted at once cut their chunk in two and fill new ones in
+// between, laying the tree out again once.
+//
+// Nothing is tracked until the first query builds the index, and after
+// changes that weren't tracked it is built again on the next one.
+// Lines too long to scan on every query get a summary per block, kept
+// for the last one that was searched.
+struct bracket {
+    struct bracket_chunk** chunks;
+    long chunk_count;
+    long chunk_capacity;
+
+    struct bracket_node* tree;
+    long leaves;
+
+    bool built;
+
+    const struct line* block_line;
+    struct bracket_depth* blocks;
+    long block_count;
+};
+
+enum bracket_status {
+    BRACKET_OK = 0,
+    BRACKET_ERROR,
+};
+
+int bracket_init(struct bracket* b);
+int bracket_free(struct bracket* b);
+
+int bracket_build(struct bracket* b, struct line* head, long count);
+int bracket_invalidate(struct bracket* b);
+
+int bracket_update(struct bracket* b, long index, struct line* line);
+int bracket_update_lines(struct bracket* b, const long* indices, struct line* const* lines, long count);
+int bracket_insert(struct bracket* b, long index, struct line* line);
+int bracket_insert_lines(struct bracket* b, long index, struct line* line, long count);
+int bracket_remove(struct bracket* b, long index);
+int bracket_append(struct bracket* b, struct line* line, long count);
+
+struct line* bracket_line(const struct bracket* b, long index);
+int bracket_match(struct bracket* b, long index, long pos, long* match_index, long* match_pos);
+int bracket_enclosing(struct bracket* b, long index, long pos, long* open_index, long* open_pos);
+
+#endif
@@ -0,0 +1,453 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cold.h"
+#include "line.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum {
+    COLD_HASH_BITS = 12,
+    COLD_MIN_MATCH = 4,
+    COLD_MAX_OFFSET = 65535,
+    COLD_RUN_MASK = 15,
+};
+
+// Each sequence is a token (literal count in the high nibble, match
+// length minus 4 in the low one, 15 meaning more follow in 255 steps),
+// the literals, and a 2 byte offset back to the match. The last one has
+// literals only.
+static long
+cold_length(char* dst, long out, long length)
+{
+    for (; length >= 255; length -= 255) dst[out++] = (char)255;
+    dst[out++] = (char)length;
+    return out;
+}
+
+static long
+cold_sequence(char* dst, long out, const char* literals, long count, long offset, long length)
+{
+    long match = length > 0 ? length - COLD_MIN_MATCH : 0;
+    dst[out++] = (char)((MIN(count, COLD_RUN_MASK) << 4) | MIN(match, COLD_RUN_MASK));
+    if (count >= COLD_RUN_MASK) out = cold_length(dst, out, count - COLD_RUN_MASK);
+    memcpy(dst + out, literals, count);
+    out += count;
+
+    if (length == 0) return out;
+    dst[out++] = (char)(offset & 0xff);
+    dst[out++] = (char)(offset >> 8);
+    if (match >= COLD_RUN_MASK) out = cold_length(dst, out, match - COLD_RUN_MASK);
+    return out;
+}
+
+// read a 255-step length extension, or -1 if the input ends first
+static long
+cold_extend(const unsigned char* src, long packed, long* in)
+{
+    long length = 0;
+    for (;;) {
+        if (*in >= packed) return -1;
+        unsigned char b = src[(*in)++];
+        length += b;
+        if (b != 255) return length;
+    }
+}
+
+// the most size bytes can take up once compressed
+long
+cold_bound(long size)
+{
+    return size + size / 255 + 16;
+}
+
+// LZ77 with a single-entry hash table, much like LZ4: quick rather than
+// small. dst needs room for cold_bound(size) bytes.
+long
+cold_compress(const char* src, long size, char* dst)
+{
+    assert(src != NULL || size == 0);
+    assert(dst != NULL);
+
+    // where each 4 byte prefix was last seen, plus one (0 is never)
+    long table[1 << COLD_HASH_BITS] = { 0 };
+
+    long out = 0;
+    long anchor = 0;
+    long i = 0;
+    while (i + COLD_MIN_MATCH <= size) {
+        uint32_t v = 0;
+        memcpy(&v, src + i, sizeof(v));
+        uint32_t hash = (v * 2654435761u) >> (32 - COLD_HASH_BITS);
+        long candidate = table[hash] - 1;
+        table[hash] = i + 1;
+
+        if (candidate < 0 || i - candidate > COLD_MAX_OFFSET || memcmp(src + candidate, src + i, COLD_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        long length = COLD_MIN_MATCH;
+        while (i + length < size && src[candidate + length] == src[i + length]) length++;
+        out = cold_sequence(dst, out, src + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+
+    return cold_sequence(dst, out, src + anchor, size - anchor, 0, 0);
+}
+
+// unpack into exactly size bytes, failing on anything malformed
+int
+cold_decompress(const char* src, long packed, char* dst, long size)
+{
+    assert(src != NULL || packed == 0);
+    assert(dst != NULL || size == 0);
+
+    const unsigned char* in_buf = (const unsigned char*)src;
+    long in = 0;
+    long out = 0;
+    while (in < packed) {
+        unsigned char token = in_buf[in++];
+
+        long count = token >> 4;
+        if (count == COLD_RUN_MASK) {
+            long more = cold_extend(in_buf, packed, &in);
+            if (more < 0) return COLD_ERROR;
+            count += more;
+        }
+        if (count > packed - in || count > size - out) return COLD_ERROR;
+        memcpy(dst + out, src + in, count);
+        in += count;
+        out += count;
+        if (in >= packed) break;
+
+        if (packed - in < 2) return COLD_ERROR;
+        long offset = in_buf[in] | (in_buf[in + 1] << 8);
+        in += 2;
+        long length = (token & COLD_RUN_MASK) + COLD_MIN_MATCH;
+        if ((token & COLD_RUN_MASK) == COLD_RUN_MASK) {
+            long more = cold_extend(in_buf, packed, &in);
+            if (more < 0) return COLD_ERROR;
+            length += more;
+        }
+        if (offset == 0 || offset > out || length > size - out) return COLD_ERROR;
+
+        // matches can overlap what they copy, so go a byte at a time
+        for (long k = 0; k < length; k++, out++) dst[out] = dst[out - offset];
+    }
+
+    return out == size ? COLD_OK : COLD_ERROR;
+}
+
+// Pack count lines from first (none of them frozen) into one block. On
+// failure the lines are left as they were.
+int
+cold_freeze(struct line* first, long count)
+{
+    assert(first != NULL);
+    assert(count > 0);
+
+    long size = 0;
+    struct line* line = first;
+    for (long i = 0; i < count; i++, line = line->next) {
+        assert(!line_frozen(line));
+        size += line->size;
+    }
+
+    char* raw = malloc(size > 0 ? size : 1);
+    struct line_text* text = malloc(sizeof(struct line_text) + sizeof(struct cold_block) + cold_bound(size));
+    if (raw == NULL || text == NULL) {
+        free(raw);
+        free(text);
+        return COLD_ERROR;
+    }
+
+    long offset = 0;
+    line = first;
+    for (long i = 0; i < count; i++, line = line->next) {
+        if (line->size > 0) memcpy(raw + offset, line->buf, line->size);
+        offset += line->size;
+    }
+
+    struct cold_block* block = (struct cold_block*)text->buf;
+    char* data = (char*)(block + 1);
+    block->size = size;
+    block->packed = cold_compress(raw, size, data);
+    if (block->packed >= size) {
+        memcpy(data, raw, size);
+        block->packed = size;
+    }
+    free(raw);
+
+    // give back what the worst case didn't need
+    struct line_text* shrunk = realloc(text, sizeof(struct line_text) + sizeof(struct cold_block) + block->packed);
+    if (shrunk != NULL) text = shrunk;
+    text->refs = 0;
+
+    line = first;
+    for (long i = 0; i < count; i++, line = line->next) {
+        line_free(line);
+        text->refs++;
+        line->text = text;
+        line->buf = NULL;
+        line->capacity = 0;
+    }
+
+    return COLD_OK;
+}
+
+// Unpack the run line is frozen in, giving its first line, how many
+// lines of it come before line and how many there are
+int
+cold_thaw(struct line* line, struct line** first, long* before, long* count)
+{
+    assert(line != NULL);
+    assert(line_frozen(line));
+    assert(first != NULL && before != NULL && count != NULL);
+
+    struct line_text* frozen = line->text;
+    const struct cold_block* block = (const struct cold_block*)frozen->buf;
+
+    *first = line;
+    *before = 0;
+    while ((*first)->prev != NULL && (*first)->prev->text == frozen) {
+        *first = (*first)->prev;
+        (*before)++;
+    }
+
+    struct line_text* text = malloc(sizeof(struct line_text) + (block->size > 0 ? block->size : 1));
+    if (text == NULL) return COLD_ERROR;
+    const char* data = (const char*)(block + 1);
+    bool packed = block->packed < block->size;
+    if (packed && cold_decompress(data, block->packed, text->buf, block->size) != COLD_OK) {
+        fprintf(stderr, "cold: corrupt block\n");
+        free(text);
+        return COLD_ERROR;
+    }
+    if (!packed) memcpy(text->buf, data, block->size);
+    text->refs = 0;
+
+    // every line of the run holds a reference, so that's how many there are
+    *count = frozen->refs;
+    long offset = 0;
+    line = *first;
+    for (long i = 0; i < *count; i++, line = line->next) {
+        line_text_release(frozen);
+        line_init_shared(line, text, text->buf + offset, line->size);
+        offset += line->size;
+    }
+
+    return COLD_OK;
+}
+
+// unpack a frozen block's text into a scratch buffer, without thawing
+int
+cold_read(const struct line_text* text, char** buf, long* capacity)
+{
+    assert(text != NULL);
+    assert(buf != NULL && capacity != NULL);
+
+    const struct cold_block* block = (const struct cold_block*)text->buf;
+    if (block->size > *capacity) {
+        char* grown = realloc(*buf, block->size);
+        if (grown == NULL) return COLD_ERROR;
+        *buf = grown;
+        *capacity = block->size;
+    }
+
+    const char* data = (const char*)(block + 1);
+    if (block->packed == block->size) {
+        memcpy(*buf, data, block->size);
+        return COLD_OK;
+    }
+    return cold_decompress(data, block->packed, *buf, block->size);
+}
+
+// freeze every line that isn't yet of the count from first, in runs of
+// about COLD_BLOCK_BYTES
+int
+cold_pack(struct line* first, long count)
+{
+    struct line* line = first;
+    for (long i = 0; i < count && line != NULL;) {
+        if (line_frozen(line)) {
+            line = line->next;
+            i++;
+            continue;
+        }
+
+        struct line* start = line;
+        long lines = 0;
+        long size = 0;
+        while (i < count && line != NULL && !line_frozen(line) && (lines == 0 || size + line->size <= COLD_BLOCK_BYTES)) {
+            size += line->size;
+            lines++;
+            line = line->next;
+            i++;
+        }
+        if (cold_freeze(start, lines) != COLD_OK) return COLD_ERROR;
+    }
+
+    return COLD_OK;
+}
+
+// thaw every frozen line from head on, for work that reads all of them
+int
+cold_thaw_all(struct cold* c, struct line* head)
+{
+    assert(c != NULL);
+
+    // none of the runs are worth tracking once everything is warm
+    cold_reset(c);
+
+    for (struct line* line = head; line != NULL; line = line->next) {
+        if (!line_frozen(line)) continue;
+
+        struct line* first = NULL;
+        long before = 0;
+        long count = 0;
+        if (cold_thaw(line, &first, &before, &count) != COLD_OK) return COLD_ERROR;
+    }
+
+    return COLD_OK;
+}
+
+int
+cold_init(struct cold* c)
+{
+    assert(c != NULL);
+
+    c->count = 0;
+    c->clock = 0;
+
+    return COLD_OK;
+}
+
+// About to read line (at index): thaw it if it's frozen, packing the
+// run used longest ago again if that makes too many
+int
+cold_touch(struct cold* c, struct line* line, long index)
+{
+    assert(c != NULL);
+    assert(line != NULL);
+
+    c->clock++;
+    if (!line_frozen(line)) {
+        for (long i = 0; i < c->count; i++) {
+            struct cold_run* r = &c->runs[i];
+            if (index >= r->start && index < r->start + r->count) {
+                r->used = c->clock;
+                break;
+            }
+        }
+        return COLD_OK;
+    }
+
+    if (c->count == COLD_WARM_BLOCKS) {
+        long oldest = 0;
+        for (long i = 1; i < c->count; i++) {
+            if (c->runs[i].used < c->runs[oldest].used) oldest = i;
+        }
+        struct cold_run r = c->runs[oldest];
+        c->runs[oldest] = c->runs[--c->count];
+        cold_pack(r.first, r.count);
+    }
+
+    struct cold_run r = { 0 };
+    long before = 0;
+    if (cold_thaw(line, &r.first, &before, &r.count) != COLD_OK) return COLD_ERROR;
+    r.start = index - before;
+    r.used = c->clock;
+    c->runs[c->count++] = r;
+
+    return COLD_OK;
+}
+
+// count lines were linked in at index: runs after them move down and
+// one they landed inside of grows
+int
+cold_insert(struct cold* c, long index, long count)
+{
+    assert(c != NULL);
+
+    for (long i = 0; i < c->count; i++) {
+        struct cold_run* r = &c->runs[i];
+        if (r->start >= index) r->start += count;
+        else if (index < r->start + r->count) r->count += count;
+    }
+
+    return COLD_OK;
+}
+
+// The line at index was unlinked, joined onto prev: runs after it move
+// up, one it was in shrinks and one it started takes prev instead
+int
+cold_remove(struct cold* c, long index, struct line* prev)
+{
+    assert(c != NULL);
+    assert(index > 0);
+    assert(prev != NULL);
+
+    for (long i = 0; i < c->count; i++) {
+        struct cold_run* r = &c->runs[i];
+        if (r->start > index) {
+            r->start--;
+        } else if (r->start == index) {
+            r->start = index - 1;
+            r->first = prev;
+        } else if (index < r->start + r->count) {
+            r->count--;
+        }
+    }
+
+    return COLD_OK;
+}
+
+// Lines [index, index + count) were swapped for added others, line being
+// the one at index now: runs after them move, one they were inside of
+// grows or shrinks to match and one that lost all its lines is dropped
+int
+cold_replace(struct cold* c, long index, long count, long added, struct line* line)
+{
+    assert(c != NULL);
+    assert(line != NULL || added == 0);
+
+    for (long i = 0; i < c->count;) {
+        struct cold_run* r = &c->runs[i];
+        long end = r->start + r->count;
+        long after = MAX(end - index - count, 0);
+        if (r->start >= index + count) {
+            r->start += added - count;
+        } else if (end > index && r->start < index) {
+            r->count = index - r->start + added + after;
+        } else if (end > index) {
+            r->start = index;
+            r->first = line;
+            r->count = added + after;
+            if (r->count == 0) {
+                *r = c->runs[--c->count];
+                continue;
+            }
+        }
+        i++;
+    }
+
+    return COLD_OK;
+}
+
+// forget the thawed runs after changes that weren't tracked (their
+// lines just stay thawed)
+int
+cold_reset(struct cold* c)
+{
+    assert(c != NULL);
+
+    c->count = 0;
+    return COLD_OK;
+}
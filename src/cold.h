@@ -0,0 +1,69 @@
+#ifndef DERZVIM_COLD_H_INCLUDED
+#define DERZVIM_COLD_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum {
+    // lines are packed in runs of about this much text
+    COLD_BLOCK_BYTES = 64 * 1024,
+
+    // how many thawed runs are kept before the oldest is packed again
+    COLD_WARM_BLOCKS = 256,
+};
+
+// What a frozen line's text points to: size bytes of text (the lines of
+// the run one after the other) packed into packed bytes that follow the
+// header. A run that doesn't get smaller is stored as it is.
+struct cold_block {
+    long size;
+    long packed;
+};
+
+// a thawed run: count lines from first (at index start)
+struct cold_run {
+    long start;
+    long count;
+    struct line* first;
+    long used;
+};
+
+// Cold storage for the lines of a buffer. Runs of lines are packed into
+// compressed blocks (see cold_pack, the loader does it on its workers),
+// which leaves each line with its size but no text. Before anything
+// reads a frozen line it has to be thawed, which unpacks the whole run
+// into one block of text the lines share (like registers do, so an
+// edit copies the line out). The runs thawed last are kept around,
+// with the index of their first line kept up to date through line
+// inserts and removes, and the one used longest ago is packed again
+// once there are too many.
+struct cold {
+    struct cold_run runs[COLD_WARM_BLOCKS];
+    long count;
+    long clock;
+};
+
+enum cold_status {
+    COLD_OK = 0,
+    COLD_ERROR,
+};
+
+long cold_bound(long size);
+long cold_compress(const char* src, long size, char* dst);
+int cold_decompress(const char* src, long packed, char* dst, long size);
+
+int cold_freeze(struct line* first, long count);
+int cold_thaw(struct line* line, struct line** first, long* before, long* count);
+int cold_read(const struct line_text* text, char** buf, long* capacity);
+int cold_pack(struct line* first, long count);
+int cold_thaw_all(struct cold* c, struct line* head);
+
+int cold_init(struct cold* c);
+int cold_touch(struct cold* c, struct line* line, long index);
+int cold_insert(struct cold* c, long index, long count);
+int cold_remove(struct cold* c, long index, struct line* prev);
+int cold_replace(struct cold* c, long index, long count, long added, struct line* line);
+int cold_reset(struct cold* c);
+
+#endif
@@ -0,0 +1,1093 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <regex.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "cursors.h"
+#include "fold.h"
+#include "line.h"
+#include "mark.h"
+#include "sort.h"
+#include "yank.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+enum {
+    COMMAND_DEFAULT_CAPACITY = 16,
+    COMMAND_CAPACITY_GROWTH = 2,
+    COMMAND_MAX_GROUPS = 10,
+};
+
+struct command_names {
+    const char* name;
+    int command;
+};
+
+static const struct command_names COMMAND_NAMES[] = {
+    { "d",          COMMAND_DELETE },
+    { "delete",     COMMAND_DELETE },
+    { "s",          COMMAND_SUBSTITUTE },
+    { "substitute", COMMAND_SUBSTITUTE },
+    { "a",          COMMAND_APPEND },
+    { "append",     COMMAND_APPEND },
+    { "i",          COMMAND_INSERT },
+    { "insert",     COMMAND_INSERT },
+    { "c",          COMMAND_CHANGE },
+    { "change",     COMMAND_CHANGE },
+    { "w",          COMMAND_WRITE },
+    { "write",      COMMAND_WRITE },
+    { "wq",         COMMAND_WRITE },
+    { "x",          COMMAND_WRITE },
+    { "xit",        COMMAND_WRITE },
+    { "q",          COMMAND_QUIT },
+    { "quit",       COMMAND_QUIT },
+    { "q!",         COMMAND_DISCARD },
+    { "quit!",      COMMAND_DISCARD },
+    { "y",          COMMAND_YANK },
+    { "yank",       COMMAND_YANK },
+    { "pu",         COMMAND_PUT },
+    { "put",        COMMAND_PUT },
+    { "fo",         COMMAND_FOLD },
+    { "fold",       COMMAND_FOLD },
+    { "foldo",      COMMAND_FOLD_OPEN },
+    { "foldopen",   COMMAND_FOLD_OPEN },
+    { "foldi",      COMMAND_FOLD_INDENT },
+    { "foldindent", COMMAND_FOLD_INDENT },
+    { "k",          COMMAND_MARK },
+    { "mark",       COMMAND_MARK },
+    { "cu",         COMMAND_CURSORS },
+    { "cursors",    COMMAND_CURSORS },
+    { "sor",        COMMAND_SORT },
+    { "sort",       COMMAND_SORT },
+    { "sor!",       COMMAND_SORT },
+    { "sort!",      COMMAND_SORT },
+    { "g",          COMMAND_GLOBAL },
+    { "global",     COMMAND_GLOBAL },
+    { "g!",         COMMAND_VGLOBAL },
+    { "global!",    COMMAND_VGLOBAL },
+    { "v",          COMMAND_VGLOBAL },
+    { "vglobal",    COMMAND_VGLOBAL },
+};
+
+// growable scratch string
+struct command_text {
+    char* buf;
+    long size;
+    long capacity;
+};
+
+static int
+command_text_append(struct command_text* t, const char* buf, long size)
+{
+    if (t->size + size + 1 > t->capacity) {
+        long capacity = t->capacity > 0 ? t->capacity : COMMAND_DEFAULT_CAPACITY;
+        while (capacity < t->size + size + 1) capacity *= COMMAND_CAPACITY_GROWTH;
+        char* grown = realloc(t->buf, capacity);
+        if (grown == NULL) return COMMAND_ERROR;
+        t->buf = grown;
+        t->capacity = capacity;
+    }
+
+    memcpy(t->buf + t->size, buf, size);
+    t->size += size;
+    t->buf[t->size] = '\0';
+    return COMMAND_OK;
+}
+
+static void
+command_free(struct command* c)
+{
+    if (c->from.kind == COMMAND_ADDRESS_SEARCH) regfree(&c->from.regex);
+    if (c->to.kind == COMMAND_ADDRESS_SEARCH) regfree(&c->to.regex);
+    if (c->has_pattern) regfree(&c->pattern);
+    free(c->replacement);
+    free(c->text);
+}
+
+// read up to an unescaped delim, dropping the escapes in front of delims
+static const char*
+command_parse_delimited(const char* p, const char* end, char delim, struct command_text* out)
+{
+    out->size = 0;
+    command_text_append(out, "", 0);
+
+    while (p < end && *p != delim) {
+        if (*p == '\\' && p + 1 < end && p[1] == delim) p++;
+        else if (*p == '\\' && p + 1 < end) command_text_append(out, p++, 1);
+        command_text_append(out, p++, 1);
+    }
+
+    return p < end ? p + 1 : NULL;
+}
+
+static const char*
+command_parse_address(const char* p, const char* end, struct command_address* a, bool* ok)
+{
+    *ok = true;
+    a->kind = COMMAND_ADDRESS_NONE;
+    a->number = 0;
+    a->offset = 0;
+
+    if (p < end && isdigit((unsigned char)*p)) {
+        a->kind = COMMAND_ADDRESS_NUMBER;
+        while (p < end && isdigit((unsigned char)*p)) a->number = a->number * 10 + (*p++ - '0');
+    } else if (p < end && *p == '.') {
+        a->kind = COMMAND_ADDRESS_CURRENT;
+        p++;
+    } else if (p < end && *p == '$') {
+        a->kind = COMMAND_ADDRESS_LAST;
+        p++;
+    } else if (p < end && *p == '/') {
+        struct command_text pattern = { 0 };
+        p = command_parse_delimited(p + 1, end, '/', &pattern);
+        if (p == NULL) p = end;
+        *ok = pattern.size > 0 && regcomp(&a->regex, pattern.buf, 0) == 0;
+        free(pattern.buf);
+        if (!*ok) return p;
+        a->kind = COMMAND_ADDRESS_SEARCH;
+    } else if (p < end && *p == '\'') {
+        p++;
+        a->number = p < end ? mark_name(*p++) : -1;
+        *ok = a->number >= 0;
+        if (!*ok) return p;
+        a->kind = COMMAND_ADDRESS_MARK;
+    }
+
+    // any number of +N and -N (a bare + or - means one line)
+    while (p < end && (*p == '+' || *p == '-')) {
+        long sign = *p++ == '+' ? 1 : -1;
+        long n = 0;
+        bool digits = false;
+        while (p < end && isdigit((unsigned char)*p)) {
+            n = n * 10 + (*p++ - '0');
+            digits = true;
+        }
+        a->offset += sign * (digits ? n : 1);
+        if (a->kind == COMMAND_ADDRESS_NONE) a->kind = COMMAND_ADDRESS_CURRENT;
+    }
+
+    return p;
+}
+
+// parse the command on one line, taking any text lines that follow it
+static int
+command_parse_line(struct command* c, const char* p, const char* end,
+    const char** next, const char* text_end, const char** error)
+{
+    // range
+    bool ok = true;
+    if (p < end && *p == '%') {
+        c->address_count = 2;
+        c->from = (struct command_address){ .kind = COMMAND_ADDRESS_NUMBER, .number = 1 };
+        c->to = (struct command_address){ .kind = COMMAND_ADDRESS_LAST };
+        p++;
+    } else {
+        const char* address = p;
+        p = command_parse_address(p, end, &c->from, &ok);
+        if (!ok) {
+            *error = *address == '\'' ? "bad mark name" : "bad search pattern";
+            return COMMAND_ERROR;
+        }
+        if (c->from.kind != COMMAND_ADDRESS_NONE) c->address_count = 1;
+        if (p < end && *p == ',') {
+            p = command_parse_address(p + 1, end, &c->to, &ok);
+            if (!ok || c->to.kind == COMMAND_ADDRESS_NONE) {
+                *error = "bad range";
+                return COMMAND_ERROR;
+            }
+            if (c->from.kind == COMMAND_ADDRESS_NONE) c->from.kind = COMMAND_ADDRESS_CURRENT;
+            c->address_count = 2;
+        }
+    }
+
+    while (p < end && isspace((unsigned char)*p)) p++;
+
+    // name (a trailing ! is part of it)
+    const char* name = p;
+    while (p < end && isalpha((unsigned char)*p)) p++;
+    if (p < end && *p == '!') p++;
+    long length = p - name;
+
+    c->name = COMMAND_NONE;
+    if (length > 0) {
+        long num_names = sizeof(COMMAND_NAMES) / sizeof(*COMMAND_NAMES);
+        long i = 0;
+        for (; i < num_names; i++) {
+            const char* known = COMMAND_NAMES[i].name;
+            if ((long)strlen(known) == length && memcmp(known, name, length) == 0) break;
+        }
+        if (i == num_names) {
+            *error = "unknown command";
+            return COMMAND_ERROR;
+        }
+        c->name = COMMAND_NAMES[i].command;
+    }
+
+    if (c->name == COMMAND_SUBSTITUTE) {
+        if (p >= end || isalnum((unsigned char)*p) || isspace((unsigned char)*p)) {
+            *error = "bad substitute delimiter";
+            return COMMAND_ERROR;
+        }
+        char delim = *p++;
+
+        struct command_text part = { 0 };
+        p = command_parse_delimited(p, end, delim, &part);
+        if (p == NULL || part.size == 0 || regcomp(&c->pattern, part.buf, 0) != 0) {
+            free(part.buf);
+            *error = "bad substitute pattern";
+            return COMMAND_ERROR;
+        }
+        c->has_pattern = true;
+
+        // the closing delimiter of the replacement is optional
+        p = command_parse_delimited(p, end, delim, &part);
+        c->replacement = part.buf;
+        if (p == NULL) p = end;
+
+        for (; p < end && !isspace((unsigned char)*p); p++) {
+            if (*p != 'g') {
+                *error = "bad substitute flag";
+                return COMMAND_ERROR;
+            }
+            c->global = true;
+        }
+    }
+
+    // g/pattern/d and v/pattern/d (d is the only command they can run)
+    if (c->name == COMMAND_GLOBAL || c->name == COMMAND_VGLOBAL) {
+        if (p >= end || isalnum((unsigned char)*p) || isspace((unsigned char)*p)) {
+            *error = "bad global delimiter";
+            return COMMAND_ERROR;
+        }
+        char delim = *p++;
+
+        struct command_text part = { 0 };
+        p = command_parse_delimited(p, end, delim, &part);
+        ok = p != NULL && part.size > 0 && regcomp(&c->pattern, part.buf, 0) == 0;
+        free(part.buf);
+        if (!ok) {
+            *error = "bad global pattern";
+            return COMMAND_ERROR;
+        }
+        c->has_pattern = true;
+
+        while (p < end && isspace((unsigned char)*p)) p++;
+        const char* command = p;
+        while (p < end && isalpha((unsigned char)*p)) p++;
+        bool d = (p - command == 1 && memcmp(command, "d", 1) == 0)
+            || (p - command == 6 && memcmp(command, "delete", 6) == 0);
+        if (!d) {
+            *error = "only d works after global";
+            return COMMAND_ERROR;
+        }
+    }
+
+    // sort takes n (by the first number on each line) and u (drop
+    // repeated lines), sort! sorts backwards
+    if (c->name == COMMAND_SORT) {
+        if (name[length - 1] == '!') c->sort_flags |= SORT_REVERSE;
+        for (; p < end; p++) {
+            if (*p == 'n') {
+                c->sort_flags |= SORT_NUMERIC;
+            } else if (*p == 'u') {
+                c->unique = true;
+            } else if (!isspace((unsigned char)*p)) {
+                *error = "bad sort flag";
+                return COMMAND_ERROR;
+            }
+        }
+    }
+
+    // d, y and pu take a register name: d a, y b, pu c
+    bool takes_register = c->name == COMMAND_DELETE
+        || c->name == COMMAND_YANK
+        || c->name == COMMAND_PUT;
+    c->register_index = 0;
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (takes_register && p < end) {
+        c->register_index = yank_register(*p++);
+        if (c->register_index < 0) {
+            *error = "bad register name";
+            return COMMAND_ERROR;
+        }
+    }
+
+    // k takes a mark name: k a
+    c->mark = -1;
+    if (c->name == COMMAND_MARK) {
+        c->mark = p < end ? mark_name(*p++) : -1;
+        if (c->mark < 0) {
+            *error = "bad mark name";
+            return COMMAND_ERROR;
+        }
+    }
+
+    bool takes_text = c->name == COMMAND_APPEND
+        || c->name == COMMAND_INSERT
+        || c->name == COMMAND_CHANGE;
+
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (p < end && !takes_text) {
+        *error = "trailing characters";
+        return COMMAND_ERROR;
+    }
+
+    *next = end < text_end ? end + 1 : text_end;
+    if (!takes_text) return COMMAND_OK;
+
+    struct command_text text = { 0 };
+    command_text_append(&text, "", 0);
+    if (p < end) {
+        // "a some text" adds just that one line
+        command_text_append(&text, p, end - p);
+    } else {
+        // otherwise every line up to a lone "." is text
+        const char* line = *next;
+        bool first = true;
+        while (line < text_end) {
+            const char* nl = memchr(line, '\n', text_end - line);
+            const char* line_end = nl != NULL ? nl : text_end;
+            if (line_end - line == 1 && *line == '.') {
+                line = line_end < text_end ? line_end + 1 : text_end;
+                break;
+            }
+            if (!first) command_text_append(&text, "\n", 1);
+            command_text_append(&text, line, line_end - line);
+            first = false;
+            line = line_end < text_end ? line_end + 1 : text_end;
+        }
+        *next = line;
+    }
+    c->text = text.buf;
+    c->text_size = text.size;
+
+    return COMMAND_OK;
+}
+
+static long
+command_seek(struct command_buffer* b, long index)
+{
+    // the column only means something on the line it was taken on
+    if (index != b->index) b->pos = 0;
+
+    // walk from whichever known line is closest
+    long from_line = labs(index - b->index);
+    if (index < from_line) {
+        b->line = b->head;
+        b->index = 0;
+    } else if (b->count - 1 - index < from_line) {
+        b->line = b->tail;
+        b->index = b->count - 1;
+    }
+
+    while (b->index < index) {
+        b->line = b->line->next;
+        b->index++;
+    }
+    while (b->index > index) {
+        b->line = b->line->prev;
+        b->index--;
+    }
+
+    return index;
+}
+
+static void
+command_changed(struct command_buffer* b, long index)
+{
+    b->modified = true;
+    if (b->first_changed < 0 || index < b->first_changed) b->first_changed = index;
+}
+
+// resolve an address to a line number (1-based, 0 is before the first)
+static bool
+command_resolve(struct command_buffer* b, const struct command_address* a, long* number,
+    const char** error)
+{
+
+    switch (a->kind) {
+        case COMMAND_ADDRESS_NUMBER:
+            *number = a->number;
+            break;
+        case COMMAND_ADDRESS_CURRENT:
+        case COMMAND_ADDRESS_NONE:
+            *number = b->index + 1;
+            break;
+        case COMMAND_ADDRESS_LAST:
+            *number = b->count;
+            break;
+        case COMMAND_ADDRESS_MARK: {
+            struct line* line = NULL;
+            long index = 0;
+            long pos = 0;
+            if (b->marks == NULL || mark_get(b->marks, a->number, &line, &index, &pos) != MARK_OK) {
+                *error = "mark not set";
+                return false;
+            }
+            *number = index + 1;
+            break;
+        }
+        case COMMAND_ADDRESS_SEARCH: {
+            // search forward from the line after the current one, wrapping
+            struct command_text scratch = { 0 };
+            struct line* line = b->line;
+            long index = b->index;
+            bool found = false;
+            for (long i = 0; i < b->count && !found; i++) {
+                line = line->next;
+                index++;
+                if (line == NULL) {
+                    line = b->head;
+                    index = 0;
+                }
+                scratch.size = 0;
+                command_text_append(&scratch, line->buf, line->size);
+                found = regexec(&a->regex, scratch.buf, 0, NULL, 0) == 0;
+            }
+            free(scratch.buf);
+            if (!found) {
+                *error = "pattern not found";
+                return false;
+            }
+            *number = index + 1;
+            break;
+        }
+    }
+
+    *number += a->offset;
+    if (*number < 0 || *number > b->count) {
+        *error = "invalid address";
+        return false;
+    }
+    return true;
+}
+
+// unlink and free lines [from, to] (0-based, inclusive), keeping them
+// in a register if there is one (that only takes a reference to each)
+static void
+command_delete(struct command_buffer* b, long from, long to, struct yank* y)
+{
+    command_seek(b, from);
+    if (y != NULL) yank_lines(y, b->line, to - from + 1);
+    struct line* before = b->line->prev;
+    struct line* line = b->line;
+    for (long i = from; i <= to; i++) {
+        struct line* next = line->next;
+        line_free(line);
+        free(line);
+        line = next;
+    }
+
+    if (before != NULL) before->next = line; else b->head = line;
+    if (line != NULL) line->prev = before; else b->tail = before;
+    b->count -= to - from + 1;
+
+    // a buffer always has at least one line
+    if (b->count == 0) {
+        b->head = line_new();
+        b->tail = b->head;
+        b->count = 1;
+        line = b->head;
+    }
+
+    b->line = line != NULL ? line : before;
+    b->index = line != NULL ? from : from - 1;
+    command_changed(b, from);
+}
+
+// link the lines of text in after line number after (0 is the top)
+static int
+command_insert(struct command_buffer* b, long after, const char* text, long size)
+{
+    if (size == 0) return COMMAND_OK;
+
+    struct line* head = line_new();
+    if (head == NULL) return COMMAND_ERROR;
+    struct line* tail = head;
+    long count = 1;
+    bool newline = false;
+    if (lines_append(&tail, &count, &newline, text, size) != LINE_OK) {
+        lines_free(&head, &tail);
+        return COMMAND_ERROR;
+    }
+
+    struct line* before = NULL;
+    if (after > 0) {
+        command_seek(b, after - 1);
+        before = b->line;
+    }
+    struct line* next = before != NULL ? before->next : b->head;
+
+    head->prev = before;
+    tail->next = next;
+    if (before != NULL) before->next = head; else b->head = head;
+    if (next != NULL) next->prev = tail; else b->tail = tail;
+    b->count += count;
+
+    b->line = tail;
+    b->index = after + count - 1;
+    command_changed(b, after);
+
+    return COMMAND_OK;
+}
+
+// put the lines of a register after line number after (0 is the top),
+// sharing their text instead of copying it
+static int
+command_put(struct command_buffer* b, long after, const struct yank* y)
+{
+    struct line* before = NULL;
+    if (after > 0) {
+        command_seek(b, after - 1);
+        before = b->line;
+    }
+
+    long added = 0;
+    int status = yank_put_lines(y, &b->head, &b->tail, before, &added);
+    b->count += added;
+    if (added == 0) return status == YANK_OK ? COMMAND_OK : COMMAND_ERROR;
+
+    // the current line ends up on the last line put
+    b->line = before != NULL ? before->next : b->head;
+    b->index = after;
+    command_seek(b, after + added - 1);
+    command_changed(b, after);
+
+    return status == YANK_OK ? COMMAND_OK : COMMAND_ERROR;
+}
+
+// lines [from, to] (0-based, inclusive) as an array of pointers to them
+static struct line**
+command_lines(struct command_buffer* b, long from, long to)
+{
+    struct line** lines = malloc((to - from + 1) * sizeof(*lines));
+    if (lines == NULL) return NULL;
+
+    command_seek(b, from);
+    struct line* line = b->line;
+    for (long i = 0; i <= to - from; i++, line = line->next) lines[i] = line;
+    return lines;
+}
+
+// Link the count lines in the array in between before and after (all in
+// one pass), in place of lines [from, to] which used to be there. The
+// cursor goes to the first of them.
+static void
+command_relink(struct command_buffer* b, long from, long to, struct line* before, struct line* after,
+    struct line** lines, long count)
+{
+    struct line* prev = before;
+    for (long i = 0; i < count; i++) {
+        lines[i]->prev = prev;
+        if (prev != NULL) prev->next = lines[i]; else b->head = lines[i];
+        prev = lines[i];
+    }
+    if (prev != NULL) prev->next = after; else b->head = after;
+    if (after != NULL) after->prev = prev; else b->tail = prev;
+    b->count += count - (to - from + 1);
+
+    // a buffer always has at least one line
+    if (b->count == 0) {
+        b->head = line_new();
+        b->tail = b->head;
+        b->count = 1;
+        after = b->head;
+    }
+
+    b->line = count > 0 ? lines[0] : after != NULL ? after : before;
+    b->index = count > 0 || after != NULL ? from : from - 1;
+    b->pos = 0;
+}
+
+// sort lines [from, to], dropping repeats of a line when unique
+static int
+command_sort(struct command_buffer* b, long from, long to, int flags, bool unique)
+{
+    struct line** lines = command_lines(b, from, to);
+    if (lines == NULL) return COMMAND_ERROR;
+    long count = to - from + 1;
+    struct line* before = lines[0]->prev;
+    struct line* after = lines[count - 1]->next;
+    if (sort_lines(lines, count, flags, b->threads) != SORT_OK) {
+        free(lines);
+        return COMMAND_ERROR;
+    }
+
+    // the lines are still linked up in the old order, so the first one
+    // to move is where they part ways
+    long first = count;
+    struct line* line = before != NULL ? before->next : b->head;
+    for (long i = 0; i < count && first == count; i++, line = line->next) {
+        if (lines[i] != line) first = i;
+    }
+
+    long kept = count;
+    if (unique) {
+        kept = 0;
+        for (long i = 0; i < count; i++) {
+            if (kept > 0 && sort_compare(lines[kept - 1], lines[i], flags) == 0) {
+                first = MIN(first, kept);
+                line_free(lines[i]);
+                free(lines[i]);
+            } else {
+                lines[kept++] = lines[i];
+            }
+        }
+    }
+
+    command_relink(b, from, to, before, after, lines, kept);
+    if (first < count) command_changed(b, from + first);
+    free(lines);
+    return COMMAND_OK;
+}
+
+// delete the lines in [from, to] that match the pattern (or that don't)
+static int
+command_global(struct command_buffer* b, long from, long to, const regex_t* pattern, bool match,
+    struct command_text* scratch)
+{
+    struct line** lines = command_lines(b, from, to);
+    if (lines == NULL) return COMMAND_ERROR;
+    long count = to - from + 1;
+    struct line* before = lines[0]->prev;
+    struct line* after = lines[count - 1]->next;
+
+    long first = count;
+    long kept = 0;
+    for (long i = 0; i < count; i++) {
+        scratch->size = 0;
+        command_text_append(scratch, lines[i]->buf, lines[i]->size);
+        if ((regexec(pattern, scratch->buf, 0, NULL, 0) == 0) == match) {
+            first = MIN(first, i);
+            line_free(lines[i]);
+            free(lines[i]);
+        } else {
+            lines[kept++] = lines[i];
+        }
+    }
+
+    command_relink(b, from, to, before, after, lines, kept);
+    if (first < count) command_changed(b, from + first);
+    free(lines);
+    return COMMAND_OK;
+}
+
+// s/pattern/replacement/ on one line, returns true if anything matched
+static bool
+command_substitute_line(const struct command* c, struct line* line,
+    struct command_text* in, struct command_text* out)
+{
+    in->size = 0;
+    command_text_append(in, line->buf, line->size);
+    out->size = 0;
+
+    regmatch_t m[COMMAND_MAX_GROUPS];
+    long pos = 0;
+    long last = -1;
+    bool matched = false;
+    int flags = 0;
+    while (pos <= in->size && regexec(&c->pattern, in->buf + pos, COMMAND_MAX_GROUPS, m, flags) == 0) {
+        long start = pos + m[0].rm_so;
+        long end = pos + m[0].rm_eo;
+        command_text_append(out, in->buf + pos, start - pos);
+
+        // an empty match right after the previous match doesn't count
+        if (start != end || start != last) {
+            for (const char* r = c->replacement; *r != '\0'; r++) {
+                long group = -1;
+                if (*r == '&') {
+                    group = 0;
+                } else if (*r == '\\' && r[1] >= '0' && r[1] <= '9') {
+                    group = *++r - '0';
+                } else if (*r == '\\' && r[1] != '\0') {
+                    r++;
+                }
+
+                if (group < 0) {
+                    command_text_append(out, r, 1);
+                } else if (m[group].rm_so != -1) {
+                    command_text_append(out, in->buf + pos + m[group].rm_so,
+                        m[group].rm_eo - m[group].rm_so);
+                }
+            }
+            matched = true;
+        }
+
+        if (start == end) {
+            if (start < in->size) command_text_append(out, in->buf + start, 1);
+            pos = start + 1;
+        } else {
+            pos = end;
+            last = end;
+        }
+
+        flags = REG_NOTBOL;
+        if (!c->global) break;
+    }
+    if (!matched) return false;
+    if (pos < in->size) command_text_append(out, in->buf + pos, in->size - pos);
+
+    line->size = 0;
+    line_append_buf(line, out->buf, out->size);
+    return true;
+}
+
+int
+command_script_init(struct command_script* s)
+{
+    assert(s != NULL);
+
+    s->commands = NULL;
+    s->count = 0;
+    s->capacity = 0;
+
+    return COMMAND_OK;
+}
+
+int
+command_script_free(struct command_script* s)
+{
+    assert(s != NULL);
+
+    for (long i = 0; i < s->count; i++) command_free(&s->commands[i]);
+    free(s->commands);
+    command_script_init(s);
+
+    return COMMAND_OK;
+}
+
+int
+command_parse(struct command_script* s, const char* text, long size, const char** error, long* line)
+{
+    assert(s != NULL);
+    assert(text != NULL);
+    assert(error != NULL);
+    assert(line != NULL);
+
+    const char* text_end = text + size;
+    long line_number = 1;
+    for (const char* p = text; p < text_end;) {
+        const char* nl = memchr(p, '\n', text_end - p);
+        const char* end = nl != NULL ? nl : text_end;
+
+        // skip the colons and blanks in front, and comments
+        const char* start = p;
+        while (start < end && (*start == ':' || isspace((unsigned char)*start))) start++;
+        if (start == end || *start == '"') {
+            p = end < text_end ? end + 1 : text_end;
+            line_number++;
+            continue;
+        }
+
+        if (s->count >= s->capacity) {
+            long capacity = s->capacity > 0 ? s->capacity * COMMAND_CAPACITY_GROWTH : COMMAND_DEFAULT_CAPACITY;
+            struct command* commands = realloc(s->commands, capacity * sizeof(struct command));
+            if (commands == NULL) return COMMAND_ERROR;
+            s->commands = commands;
+            s->capacity = capacity;
+        }
+
+        struct command* c = &s->commands[s->count];
+        memset(c, 0, sizeof(*c));
+
+        const char* next = NULL;
+        if (command_parse_line(c, start, end, &next, text_end, error) != COMMAND_OK) {
+            *line = line_number;
+            command_free(c);
+            return COMMAND_ERROR;
+        }
+        s->count++;
+
+        for (const char* q = p; q < next; q++) {
+            if (*q == '\n') line_number++;
+        }
+        p = next;
+    }
+
+    return COMMAND_OK;
+}
+
+// Whether running the script needs the text of lines (rather than only
+// how many there are): searches, and anything that changes lines or
+// keeps them in a register
+bool
+command_script_needs_text(const struct command_script* s)
+{
+    assert(s != NULL);
+
+    for (long i = 0; i < s->count; i++) {
+        const struct command* c = &s->commands[i];
+        if (c->address_count > 0 && c->from.kind == COMMAND_ADDRESS_SEARCH) return true;
+        if (c->address_count > 1 && c->to.kind == COMMAND_ADDRESS_SEARCH) return true;
+
+        switch (c->name) {
+            case COMMAND_NONE:
+            case COMMAND_WRITE:
+            case COMMAND_QUIT:
+            case COMMAND_DISCARD:
+            case COMMAND_FOLD:
+            case COMMAND_FOLD_OPEN:
+            case COMMAND_MARK:
+            case COMMAND_CURSORS:
+                break;
+            default:
+                return true;
+        }
+    }
+
+    return false;
+}
+
+int
+command_buffer_init(struct command_buffer* b, struct line* head, struct line* tail, long count)
+{
+    assert(b != NULL);
+    assert(head != NULL);
+    assert(count > 0);
+
+    b->head = head;
+    b->tail = tail;
+    b->count = count;
+
+    // like ex, start out on the last line
+    b->line = tail;
+    b->index = count - 1;
+
+    b->pos = 0;
+
+    b->registers = NULL;
+    b->folds = NULL;
+    b->marks = NULL;
+    b->cursors = NULL;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    b->threads = cpus > 0 ? cpus : 1;
+
+    b->modified = false;
+    b->first_changed = -1;
+    b->write = false;
+    b->discard = false;
+
+    return COMMAND_OK;
+}
+
+int
+command_run(const struct command_script* s, struct command_buffer* b, const char** error)
+{
+    assert(s != NULL);
+    assert(b != NULL);
+    assert(error != NULL);
+
+    struct command_text in = { 0 };
+    struct command_text out = { 0 };
+    int status = COMMAND_OK;
+
+    for (long i = 0; i < s->count && status == COMMAND_OK && !b->discard; i++) {
+        const struct command* c = &s->commands[i];
+
+        long from = b->index + 1;
+        long to = from;
+        if (c->address_count > 0 && !command_resolve(b, &c->from, &from, error)) {
+            status = COMMAND_ERROR;
+            break;
+        }
+        to = from;
+        if (c->address_count > 1 && !command_resolve(b, &c->to, &to, error)) {
+            status = COMMAND_ERROR;
+            break;
+        }
+        if (from > to) {
+            *error = "backwards range";
+            status = COMMAND_ERROR;
+            break;
+        }
+
+        // only appending, inserting and putting can happen at line 0
+        bool top = c->name == COMMAND_APPEND
+            || c->name == COMMAND_INSERT
+            || c->name == COMMAND_PUT;
+        if (from == 0 && !top && c->address_count > 0) {
+            *error = "invalid address";
+            status = COMMAND_ERROR;
+            break;
+        }
+
+        // without registers (like in batch runs) y and pu can't work
+        struct yank* reg = b->registers != NULL ? &b->registers[c->register_index] : NULL;
+        bool uses_register = c->name == COMMAND_YANK || c->name == COMMAND_PUT;
+        if (uses_register && reg == NULL) {
+            *error = "no registers";
+            status = COMMAND_ERROR;
+            break;
+        }
+        bool uses_folds = c->name == COMMAND_FOLD
+            || c->name == COMMAND_FOLD_OPEN
+            || c->name == COMMAND_FOLD_INDENT;
+        if (uses_folds && b->folds == NULL) {
+            *error = "no folds";
+            status = COMMAND_ERROR;
+            break;
+        }
+        if (c->name == COMMAND_MARK && b->marks == NULL) {
+            *error = "no marks";
+            status = COMMAND_ERROR;
+            break;
+        }
+        if (c->name == COMMAND_CURSORS && b->cursors == NULL) {
+            *error = "no cursors";
+            status = COMMAND_ERROR;
+            break;
+        }
+
+        switch (c->name) {
+            case COMMAND_NONE: {
+                command_seek(b, to > 0 ? to - 1 : 0);
+
+                // going to a mark (and nowhere else) goes to its column too,
+                // unless lines changed under it since
+                const struct command_address* a = c->address_count > 1 ? &c->to : &c->from;
+                struct line* line = NULL;
+                long index = 0;
+                if (a->kind == COMMAND_ADDRESS_MARK && a->offset == 0 && !b->modified) {
+                    mark_get(b->marks, a->number, &line, &index, &b->pos);
+                }
+                break;
+            }
+            case COMMAND_DELETE:
+                command_delete(b, from - 1, to - 1, reg);
+                break;
+            case COMMAND_SUBSTITUTE: {
+                command_seek(b, from - 1);
+                struct line* line = b->line;
+                long last = -1;
+                for (long index = from - 1; index < to; index++, line = line->next) {
+                    if (command_substitute_line(c, line, &in, &out)) {
+                        command_changed(b, index);
+                        last = index;
+                    }
+                }
+                if (last >= 0) command_seek(b, last);
+                break;
+            }
+            case COMMAND_APPEND:
+                status = command_insert(b, to, c->text, c->text_size);
+                break;
+            case COMMAND_INSERT:
+                status = command_insert(b, from > 0 ? from - 1 : 0, c->text, c->text_size);
+                break;
+            case COMMAND_CHANGE: {
+                bool all = to - from + 1 == b->count;
+                command_delete(b, from - 1, to - 1, NULL);
+                status = command_insert(b, from - 1, c->text, c->text_size);
+
+                // deleting everything left an empty line behind, drop it
+                if (status == COMMAND_OK && all && c->text_size > 0) {
+                    command_delete(b, b->count - 1, b->count - 1, NULL);
+                }
+                break;
+            }
+            case COMMAND_WRITE:
+                b->write = true;
+                break;
+            case COMMAND_QUIT:
+                break;
+            case COMMAND_DISCARD:
+                b->discard = true;
+                break;
+            case COMMAND_YANK:
+                command_seek(b, from - 1);
+                status = yank_lines(reg, b->line, to - from + 1) == YANK_OK ? COMMAND_OK : COMMAND_ERROR;
+                break;
+            case COMMAND_PUT:
+                if (reg->count == 0) {
+                    *error = "nothing in register";
+                    status = COMMAND_ERROR;
+                    break;
+                }
+                status = command_put(b, to, reg);
+                break;
+            case COMMAND_FOLD: {
+                if (from == to) {
+                    *error = "nothing to fold";
+                    status = COMMAND_ERROR;
+                    break;
+                }
+
+                command_seek(b, to - 1);
+                struct line* last = b->line;
+                command_seek(b, from - 1);
+                status = fold_add(b->folds, from - 1, to - 1, b->line, last) == FOLD_OK ? COMMAND_OK : COMMAND_ERROR;
+
+                // its first line is all that still shows (of any it joined
+                // up with too), the cursor goes there
+                long fold = fold_find(b->folds, from - 1);
+                if (fold >= 0) command_seek(b, b->folds->ranges[fold].start);
+                break;
+            }
+            case COMMAND_FOLD_OPEN:
+                fold_open(b->folds, from - 1, to - 1);
+                break;
+            case COMMAND_FOLD_INDENT: {
+                // without a range the whole buffer is folded
+                if (c->address_count == 0) {
+                    from = 1;
+                    to = b->count;
+                }
+
+                // the cursor stays put, or on the fold that hides it
+                long index = b->index;
+                command_seek(b, from - 1);
+                status = fold_indent(b->folds, b->line, from - 1, to - from + 1) == FOLD_OK ? COMMAND_OK : COMMAND_ERROR;
+                long fold = fold_find(b->folds, index);
+                command_seek(b, fold >= 0 ? b->folds->ranges[fold].start : index);
+                break;
+            }
+            case COMMAND_MARK:
+                command_seek(b, to > 0 ? to - 1 : 0);
+                mark_set(b->marks, c->mark, b->line, b->index, b->pos);
+                break;
+
+            case COMMAND_CURSORS: {
+                // one on every line of the range, in the column the cursor
+                // was in (or at the end of lines too short for it)
+                long column = b->pos;
+                command_seek(b, from - 1);
+                for (;;) {
+                    if (cursors_add(b->cursors, b->line, b->index, MIN(column, b->line->size)) != CURSORS_OK) {
+                        status = COMMAND_ERROR;
+                        break;
+                    }
+                    if (b->index >= to - 1) break;
+                    command_seek(b, b->index + 1);
+                }
+                b->pos = MIN(column, b->line->size);
+                break;
+            }
+            case COMMAND_SORT:
+            case COMMAND_GLOBAL:
+            case COMMAND_VGLOBAL:
+                // without a range they go over the whole buffer
+                if (c->address_count == 0) {
+                    from = 1;
+                    to = b->count;
+                }
+
+                if (c->name == COMMAND_SORT) {
+                    status = command_sort(b, from - 1, to - 1, c->sort_flags, c->unique);
+                } else {
+                    status = command_global(b, from - 1, to - 1, &c->pattern, c->name == COMMAND_GLOBAL, &in);
+                }
+                break;
+        }
+        if (status != COMMAND_OK && *error == NULL) *error = "out of memory";
+    }
+
+    free(in.buf);
+    free(out.buf);
+    return status;
+}
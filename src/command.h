@@ -0,0 +1,140 @@
+#ifndef DERZVIM_COMMAND_H_INCLUDED
+#define DERZVIM_COMMAND_H_INCLUDED
+
+#include <stdbool.h>
+
+#include <regex.h>
+
+#include "cursors.h"
+#include "fold.h"
+#include "line.h"
+#include "mark.h"
+#include "yank.h"
+
+enum command_name {
+    COMMAND_NONE = 0,
+    COMMAND_DELETE,
+    COMMAND_SUBSTITUTE,
+    COMMAND_APPEND,
+    COMMAND_INSERT,
+    COMMAND_CHANGE,
+    COMMAND_WRITE,
+    COMMAND_QUIT,
+    COMMAND_DISCARD,
+    COMMAND_YANK,
+    COMMAND_PUT,
+    COMMAND_FOLD,
+    COMMAND_FOLD_OPEN,
+    COMMAND_FOLD_INDENT,
+    COMMAND_MARK,
+    COMMAND_CURSORS,
+    COMMAND_SORT,
+    COMMAND_GLOBAL,
+    COMMAND_VGLOBAL,
+};
+
+enum command_address_kind {
+    COMMAND_ADDRESS_NONE = 0,
+    COMMAND_ADDRESS_NUMBER,
+    COMMAND_ADDRESS_CURRENT,
+    COMMAND_ADDRESS_LAST,
+    COMMAND_ADDRESS_SEARCH,
+    COMMAND_ADDRESS_MARK,
+};
+
+// a line number, ".", "$", "/pattern/" or "'x" (number is the mark id),
+// plus or minus an offset
+struct command_address {
+    int kind;
+    long number;
+    long offset;
+    regex_t regex;
+};
+
+// One parsed ex command. Patterns are compiled once when the script is
+// parsed, so running the same script on many buffers (even from many
+// threads at once) costs nothing extra.
+struct command {
+    int name;
+    long address_count;
+    struct command_address from;
+    struct command_address to;
+
+    // s/pattern/replacement/g, and g/pattern/d (v/pattern/d)
+    bool has_pattern;
+    regex_t pattern;
+    char* replacement;
+    bool global;
+
+    // d, y and pu: which register (0 is the unnamed one)
+    long register_index;
+
+    // k: which mark
+    long mark;
+
+    // sort! n u: SORT_* flags, and whether to drop repeated lines
+    int sort_flags;
+    bool unique;
+
+    // the lines given to a, i and c (NL separated)
+    char* text;
+    long text_size;
+};
+
+struct command_script {
+    struct command* commands;
+    long count;
+    long capacity;
+};
+
+// The lines a script runs against, along with the current line. The
+// results of running it (what changed, whether to write) end up here.
+struct command_buffer {
+    struct line* head;
+    struct line* tail;
+    long count;
+
+    struct line* line;
+    long index;
+
+    // the cursor column, kept while the current line doesn't change and
+    // set by going to a mark
+    long pos;
+
+    // YANK_REGISTER_COUNT registers for d, y and pu (or NULL for none)
+    struct yank* registers;
+
+    // closed folds for fo, foldo and foldi (or NULL for none)
+    struct fold* folds;
+
+    // named marks for k and 'x (or NULL for none)
+    struct mark* marks;
+
+    // cursors for cu (or NULL for none)
+    struct cursors* cursors;
+
+    // how many threads sort can use
+    long threads;
+
+    bool modified;
+    long first_changed;
+    bool write;
+    bool discard;
+};
+
+enum command_status {
+    COMMAND_OK = 0,
+    COMMAND_ERROR,
+};
+
+int command_script_init(struct command_script* s);
+int command_script_free(struct command_script* s);
+
+// on failure error and line say what went wrong and where
+int command_parse(struct command_script* s, const char* text, long size, const char** error, long* line);
+int command_run(const struct command_script* s, struct command_buffer* b, const char** error);
+bool command_script_needs_text(const struct command_script* s);
+
+int command_buffer_init(struct command_buffer* b, struct line* head, struct line* tail, long count);
+
+#endif
@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cursors.h"
+#include "line.h"
+
+enum {
+    CURSORS_DEFAULT_CAPACITY = 16,
+    CURSORS_CAPACITY_GROWTH = 2,
+};
+
+static int
+cursors_reserve(struct cursors* c, long count)
+{
+    if (count <= c->capacity) return CURSORS_OK;
+
+    long capacity = c->capacity > 0 ? c->capacity : CURSORS_DEFAULT_CAPACITY;
+    while (capacity < count) capacity *= CURSORS_CAPACITY_GROWTH;
+
+    struct line** lines = realloc(c->lines, capacity * sizeof(struct line*));
+    if (lines == NULL) return CURSORS_ERROR;
+    c->lines = lines;
+
+    long* indices = realloc(c->indices, capacity * sizeof(long));
+    if (indices == NULL) return CURSORS_ERROR;
+    c->indices = indices;
+
+    long* positions = realloc(c->positions, capacity * sizeof(long));
+    if (positions == NULL) return CURSORS_ERROR;
+    c->positions = positions;
+
+    c->capacity = capacity;
+    return CURSORS_OK;
+}
+
+// the first cursor on line index or below it, or count
+static long
+cursors_lower(const struct cursors* c, long index)
+{
+    long lo = 0;
+    long hi = c->count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (c->indices[mid] < index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int
+cursors_init(struct cursors* c)
+{
+    assert(c != NULL);
+
+    c->lines = NULL;
+    c->indices = NULL;
+    c->positions = NULL;
+    c->count = 0;
+    c->capacity = 0;
+
+    return CURSORS_OK;
+}
+
+int
+cursors_free(struct cursors* c)
+{
+    assert(c != NULL);
+
+    free(c->lines);
+    free(c->indices);
+    free(c->positions);
+    cursors_init(c);
+
+    return CURSORS_OK;
+}
+
+int
+cursors_clear(struct cursors* c)
+{
+    assert(c != NULL);
+
+    c->count = 0;
+    return CURSORS_OK;
+}
+
+// put a cursor at pos on line (at index), moving the one already there
+int
+cursors_add(struct cursors* c, struct line* line, long index, long pos)
+{
+    assert(c != NULL);
+    assert(line != NULL);
+    assert(index >= 0 && pos >= 0);
+
+    // blocks are added top to bottom, so the end is the usual place
+    long i = c->count > 0 && c->indices[c->count - 1] < index ? c->count : cursors_lower(c, index);
+    if (i < c->count && c->indices[i] == index) {
+        c->lines[i] = line;
+        c->positions[i] = pos;
+        return CURSORS_OK;
+    }
+
+    if (cursors_reserve(c, c->count + 1) != CURSORS_OK) return CURSORS_ERROR;
+    long after = c->count - i;
+    memmove(&c->lines[i + 1], &c->lines[i], after * sizeof(struct line*));
+    memmove(&c->indices[i + 1], &c->indices[i], after * sizeof(long));
+    memmove(&c->positions[i + 1], &c->positions[i], after * sizeof(long));
+    c->lines[i] = line;
+    c->indices[i] = index;
+    c->positions[i] = pos;
+    c->count++;
+
+    return CURSORS_OK;
+}
+
+// the cursor on line index, or -1
+long
+cursors_find(const struct cursors* c, long index)
+{
+    assert(c != NULL);
+
+    long i = cursors_lower(c, index);
+    return i < c->count && c->indices[i] == index ? i : -1;
+}
@@ -0,0 +1,35 @@
+#ifndef DERZVIM_CURSORS_H_INCLUDED
+#define DERZVIM_CURSORS_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+// Cursors for editing many lines at once (ctrl-d adds one on the line
+// below, :[range]cu one on every line of a range). There is at most one
+// per line and they're kept in order of line index, in parallel arrays
+// so they can be handed to the per-line indexes as they are. A key goes
+// to all of them in one pass down the buffer, and each index gets its
+// updates for the whole pass in one batch. The cursor the editor shows
+// is one of them. Anything that moves lines around drops them all.
+struct cursors {
+    struct line** lines;
+    long* indices;
+    long* positions;
+    long count;
+    long capacity;
+};
+
+enum cursors_status {
+    CURSORS_OK = 0,
+    CURSORS_ERROR,
+};
+
+int cursors_init(struct cursors* c);
+int cursors_free(struct cursors* c);
+int cursors_clear(struct cursors* c);
+
+int cursors_add(struct cursors* c, struct line* line, long index, long pos);
+long cursors_find(const struct cursors* c, long index);
+
+#endif
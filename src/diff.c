@@ -0,0 +1,553 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cold.h"
+#include "diff.h"
+#include "line.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+enum {
+    DIFF_DEFAULT_CAPACITY = 64,
+    DIFF_CAPACITY_GROWTH = 2,
+    DIFF_BLOCK = 1024 * 1024,
+
+    // past this many edits in one search, give up and replace the range
+    DIFF_MAX_EDITS = 8192,
+
+    // fewer lines than this per thread aren't worth starting one for
+    DIFF_HASH_CHUNK = 64 * 1024,
+    DIFF_MAX_THREADS = 16,
+};
+
+static const uint64_t DIFF_HASH_SEED = 14695981039346656037ULL;
+static const uint64_t DIFF_HASH_PRIME = 1099511628211ULL;
+
+// mixes in eight bytes at a time, the tail padded with zeros
+static uint64_t
+diff_hash_words(const char* buf, long size)
+{
+    uint64_t hash = DIFF_HASH_SEED ^ (uint64_t)size;
+
+    long i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, buf + i, 8);
+        hash = (hash ^ word) * DIFF_HASH_PRIME;
+        hash ^= hash >> 32;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, buf + i, size - i);
+        hash = (hash ^ word) * DIFF_HASH_PRIME;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+// gather bytes of a line that need copying (tabs, or block boundaries)
+struct diff_scratch {
+    char* buf;
+    long size;
+    long capacity;
+};
+
+static int
+diff_scratch_append(struct diff_scratch* s, const char* buf, long size)
+{
+    // the loader expands each tab into four spaces
+    long tabs = 0;
+    for (const char* t = buf; (t = memchr(t, '\t', buf + size - t)) != NULL; t++) tabs++;
+
+    long needed = s->size + size + tabs * 3;
+    if (needed > s->capacity) {
+        long capacity = s->capacity > 0 ? s->capacity : DIFF_DEFAULT_CAPACITY;
+        while (capacity < needed) capacity *= DIFF_CAPACITY_GROWTH;
+        char* grown = realloc(s->buf, capacity);
+        if (grown == NULL) return DIFF_ERROR;
+        s->buf = grown;
+        s->capacity = capacity;
+    }
+
+    for (long i = 0; i < size; i++) {
+        if (buf[i] == '\t') {
+            memcpy(s->buf + s->size, "    ", 4);
+            s->size += 4;
+        } else {
+            s->buf[s->size++] = buf[i];
+        }
+    }
+
+    return DIFF_OK;
+}
+
+static int
+diff_hunk_add(struct diff* d, long a_start, long a_count, long b_start, long b_count)
+{
+    if (a_count == 0 && b_count == 0) return DIFF_OK;
+
+    // merge with the previous hunk when they touch
+    if (d->count > 0) {
+        struct diff_hunk* last = &d->hunks[d->count - 1];
+        if (last->a_start + last->a_count == a_start && last->b_start + last->b_count == b_start) {
+            last->a_count += a_count;
+            last->b_count += b_count;
+            return DIFF_OK;
+        }
+    }
+
+    if (d->count >= d->capacity) {
+        long capacity = d->capacity > 0 ? d->capacity * DIFF_CAPACITY_GROWTH : DIFF_DEFAULT_CAPACITY;
+        struct diff_hunk* hunks = realloc(d->hunks, capacity * sizeof(struct diff_hunk));
+        if (hunks == NULL) return DIFF_ERROR;
+        d->hunks = hunks;
+        d->capacity = capacity;
+    }
+
+    d->hunks[d->count++] = (struct diff_hunk){ a_start, a_count, b_start, b_count };
+    return DIFF_OK;
+}
+
+// Find the middle snake of a[a0, a1) against b[b0, b1) by searching
+// forward and backward at once. Returns false if the edit distance is
+// beyond DIFF_MAX_EDITS, otherwise the split point goes in x and y.
+static bool
+diff_bisect(struct diff* d, const uint64_t* a, long a0, long a1,
+    const uint64_t* b, long b0, long b1, long* x, long* y)
+{
+    long n = a1 - a0;
+    long m = b1 - b0;
+    long max = (n + m + 1) / 2;
+    long offset = max;
+    long length = 2 * max;
+
+    long* v1 = d->v;
+    long* v2 = d->v + length;
+    for (long i = 0; i < length; i++) {
+        v1[i] = -1;
+        v2[i] = -1;
+    }
+    v1[offset + 1] = 0;
+    v2[offset + 1] = 0;
+
+    long delta = n - m;
+    bool front = delta % 2 != 0;
+
+    // k ranges that ran off the edge of the grid are trimmed
+    long k1_start = 0;
+    long k1_end = 0;
+    long k2_start = 0;
+    long k2_end = 0;
+
+    for (long e = 0; e < MIN(max, DIFF_MAX_EDITS); e++) {
+        for (long k1 = -e + k1_start; k1 <= e - k1_end; k1 += 2) {
+            long k1_offset = offset + k1;
+            long x1 = 0;
+            if (k1 == -e || (k1 != e && v1[k1_offset - 1] < v1[k1_offset + 1])) {
+                x1 = v1[k1_offset + 1];
+            } else {
+                x1 = v1[k1_offset - 1] + 1;
+            }
+            long y1 = x1 - k1;
+            while (x1 < n && y1 < m && a[a0 + x1] == b[b0 + y1]) {
+                x1++;
+                y1++;
+            }
+            v1[k1_offset] = x1;
+
+            if (x1 > n) {
+                k1_end += 2;
+            } else if (y1 > m) {
+                k1_start += 2;
+            } else if (front) {
+                long k2_offset = offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < length && v2[k2_offset] != -1) {
+                    if (x1 >= n - v2[k2_offset]) {
+                        *x = x1;
+                        *y = y1;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        for (long k2 = -e + k2_start; k2 <= e - k2_end; k2 += 2) {
+            long k2_offset = offset + k2;
+            long x2 = 0;
+            if (k2 == -e || (k2 != e && v2[k2_offset - 1] < v2[k2_offset + 1])) {
+                x2 = v2[k2_offset + 1];
+            } else {
+                x2 = v2[k2_offset - 1] + 1;
+            }
+            long y2 = x2 - k2;
+            while (x2 < n && y2 < m && a[a1 - x2 - 1] == b[b1 - y2 - 1]) {
+                x2++;
+                y2++;
+            }
+            v2[k2_offset] = x2;
+
+            if (x2 > n) {
+                k2_end += 2;
+            } else if (y2 > m) {
+                k2_start += 2;
+            } else if (!front) {
+                long k1_offset = offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < length && v1[k1_offset] != -1) {
+                    long x1 = v1[k1_offset];
+                    if (x1 >= n - x2) {
+                        *x = x1;
+                        *y = x1 - (k1_offset - offset);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+static int
+diff_recurse(struct diff* d, const uint64_t* a, long a0, long a1,
+    const uint64_t* b, long b0, long b1)
+{
+    // equal lines at either end aren't part of any hunk
+    while (a0 < a1 && b0 < b1 && a[a0] == b[b0]) {
+        a0++;
+        b0++;
+    }
+    while (a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]) {
+        a1--;
+        b1--;
+    }
+
+    if (a0 == a1 || b0 == b1) {
+        return diff_hunk_add(d, a0, a1 - a0, b0, b1 - b0);
+    }
+
+    long x = 0;
+    long y = 0;
+    if (!diff_bisect(d, a, a0, a1, b, b0, b1, &x, &y)) {
+        return diff_hunk_add(d, a0, a1 - a0, b0, b1 - b0);
+    }
+
+    if (diff_recurse(d, a, a0, a0 + x, b, b0, b0 + y) != DIFF_OK) return DIFF_ERROR;
+    return diff_recurse(d, a, a0 + x, a1, b, b0 + y, b1);
+}
+
+int
+diff_init(struct diff* d)
+{
+    assert(d != NULL);
+
+    d->hunks = NULL;
+    d->count = 0;
+    d->capacity = 0;
+    d->v = NULL;
+    d->v_capacity = 0;
+
+    return DIFF_OK;
+}
+
+int
+diff_free(struct diff* d)
+{
+    assert(d != NULL);
+
+    free(d->hunks);
+    free(d->v);
+    diff_init(d);
+
+    return DIFF_OK;
+}
+
+// every bisect fits in the space needed by the first one
+static int
+diff_reserve(struct diff* d, long a_count, long b_count)
+{
+    long needed = 2 * (a_count + b_count + 2);
+    if (needed <= d->v_capacity) return DIFF_OK;
+
+    long* v = realloc(d->v, needed * sizeof(long));
+    if (v == NULL) {
+        fprintf(stderr, "diff: failed to allocate search space\n");
+        return DIFF_ERROR;
+    }
+    d->v = v;
+    d->v_capacity = needed;
+
+    return DIFF_OK;
+}
+
+int
+diff_compute(struct diff* d, const uint64_t* a, long a_count, const uint64_t* b, long b_count)
+{
+    assert(d != NULL);
+    assert(a_count == 0 || a != NULL);
+    assert(b_count == 0 || b != NULL);
+
+    d->count = 0;
+    if (diff_reserve(d, a_count, b_count) != DIFF_OK) return DIFF_ERROR;
+
+    return diff_recurse(d, a, 0, a_count, b, 0, b_count);
+}
+
+// Lines a[start, old_end) were replaced by a[start, end) since the hunks
+// were computed (a is the new one). Only the stretch between the equal
+// lines around them, along with any hunks it touches, is diffed again;
+// the hunks after it just move.
+int
+diff_update(struct diff* d, const uint64_t* a, long a_count, const uint64_t* b, long b_count,
+    long start, long old_end, long end)
+{
+    assert(d != NULL);
+    assert(start >= 0 && start <= old_end && start <= end && end <= a_count);
+
+    // the hunks from i up to j touch the changed lines
+    long i = 0;
+    long j = d->count;
+    while (i < j) {
+        long mid = i + (j - i) / 2;
+        if (d->hunks[mid].a_start + d->hunks[mid].a_count < start) i = mid + 1;
+        else j = mid;
+    }
+    j = i;
+    while (j < d->count && d->hunks[j].a_start <= old_end) j++;
+
+    // lines outside the hunks pair up with a fixed shift between a and b
+    long before = 0;
+    if (i > 0) {
+        const struct diff_hunk* h = &d->hunks[i - 1];
+        before = (h->b_start + h->b_count) - (h->a_start + h->a_count);
+    }
+    long after = before;
+    long a0 = start;
+    long a1 = old_end;
+    if (j > i) {
+        const struct diff_hunk* first = &d->hunks[i];
+        const struct diff_hunk* last = &d->hunks[j - 1];
+        a0 = MIN(a0, first->a_start);
+        if (last->a_start + last->a_count > a1) a1 = last->a_start + last->a_count;
+        after = (last->b_start + last->b_count) - (last->a_start + last->a_count);
+    }
+    long b0 = a0 + before;
+    long b1 = a1 + after;
+    long delta = end - old_end;
+    assert(b1 <= b_count);
+
+    // set the hunks past the region aside while it is diffed again
+    long tail_count = d->count - j;
+    struct diff_hunk* tail = NULL;
+    if (tail_count > 0) {
+        tail = malloc(tail_count * sizeof(struct diff_hunk));
+        if (tail == NULL) return DIFF_ERROR;
+        memcpy(tail, &d->hunks[j], tail_count * sizeof(struct diff_hunk));
+    }
+    d->count = i;
+
+    int status = diff_reserve(d, a1 + delta - a0, b1 - b0);
+    if (status == DIFF_OK) status = diff_recurse(d, a, a0, a1 + delta, b, b0, b1);
+    for (long k = 0; status == DIFF_OK && k < tail_count; k++) {
+        const struct diff_hunk* h = &tail[k];
+        status = diff_hunk_add(d, h->a_start + delta, h->a_count, h->b_start, h->b_count);
+    }
+
+    free(tail);
+    return status;
+}
+
+uint64_t
+diff_hash(const char* buf, long size)
+{
+    assert(size == 0 || buf != NULL);
+    return diff_hash_words(buf, size);
+}
+
+// lines to hash on one thread, into hashes[0, count)
+struct diff_job {
+    const struct line* first;
+    long count;
+    uint64_t* hashes;
+    int status;
+};
+
+static void*
+diff_hash_worker(void* arg)
+{
+    struct diff_job* job = arg;
+
+    char* scratch = NULL;
+    long capacity = 0;
+    const struct line_text* block = NULL;
+    long offset = 0;
+
+    const struct line* line = job->first;
+    for (long i = 0; i < job->count; i++, line = line->next) {
+        if (!line_frozen(line)) {
+            job->hashes[i] = diff_hash(line->buf, line->size);
+            continue;
+        }
+
+        // packed runs are read out (not thawed) once, the job may start
+        // partway into one
+        if (line->text != block) {
+            block = line->text;
+            if (cold_read(block, &scratch, &capacity) != COLD_OK) {
+                job->status = DIFF_ERROR;
+                break;
+            }
+            offset = 0;
+            for (const struct line* p = line->prev; p != NULL && p->text == block; p = p->prev) {
+                offset += p->size;
+            }
+        }
+        job->hashes[i] = diff_hash(scratch + offset, line->size);
+        offset += line->size;
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+// Hash count lines from first into hashes, split into runs over up to
+// threads threads. Each one starts as soon as the walk down the lines
+// gets to its first line, so hashing overlaps with the walk.
+int
+diff_hash_lines(const struct line* first, long count, uint64_t* hashes, long threads)
+{
+    assert(first != NULL || count == 0);
+    assert(hashes != NULL || count == 0);
+
+    long jobs = (count + DIFF_HASH_CHUNK - 1) / DIFF_HASH_CHUNK;
+    jobs = MIN(jobs, MIN(threads, DIFF_MAX_THREADS));
+    if (jobs < 1) jobs = 1;
+
+    struct diff_job job[DIFF_MAX_THREADS];
+    pthread_t workers[DIFF_MAX_THREADS];
+    bool started[DIFF_MAX_THREADS] = { false };
+
+    const struct line* line = first;
+    long done = 0;
+    for (long k = 0; k < jobs; k++) {
+        long next = count * (k + 1) / jobs;
+        job[k] = (struct diff_job){ line, next - done, hashes + done, DIFF_OK };
+        for (long i = done; i < next; i++) line = line->next;
+        done = next;
+
+        // the first run is hashed here once the others are going
+        if (k > 0) started[k] = pthread_create(&workers[k], NULL, diff_hash_worker, &job[k]) == 0;
+    }
+
+    int status = DIFF_OK;
+    for (long k = 0; k < jobs; k++) {
+        if (started[k]) pthread_join(workers[k], NULL);
+        else diff_hash_worker(&job[k]);
+        if (job[k].status != DIFF_OK) status = DIFF_ERROR;
+    }
+
+    return status;
+}
+
+struct diff_file {
+    uint64_t* hashes;
+    long* offsets;
+    long count;
+    long capacity;
+};
+
+static int
+diff_file_push(struct diff_file* f, uint64_t hash, long start)
+{
+    if (f->count >= f->capacity) {
+        long capacity = f->capacity > 0 ? f->capacity * DIFF_CAPACITY_GROWTH : DIFF_DEFAULT_CAPACITY;
+
+        uint64_t* hashes = realloc(f->hashes, capacity * sizeof(uint64_t));
+        if (hashes == NULL) return DIFF_ERROR;
+        f->hashes = hashes;
+
+        // one extra offset for the end of the last line
+        long* offsets = realloc(f->offsets, (capacity + 1) * sizeof(long));
+        if (offsets == NULL) return DIFF_ERROR;
+        f->offsets = offsets;
+
+        f->capacity = capacity;
+    }
+
+    f->hashes[f->count] = hash;
+    f->offsets[f->count] = start;
+    f->count++;
+
+    return DIFF_OK;
+}
+
+// Hash every line of an open file (from its start, whatever the offset
+// of fd) without building any lines. Lines are split exactly like
+// lines_append splits them, and offsets[i] is where line i starts
+// (offsets[count] is the file size).
+int
+diff_hash_fd(int fd, uint64_t** hashes, long** offsets, long* count)
+{
+    assert(fd >= 0);
+    assert(hashes != NULL);
+    assert(offsets != NULL);
+    assert(count != NULL);
+
+    char* block = malloc(DIFF_BLOCK);
+    if (block == NULL) return DIFF_ERROR;
+
+    struct diff_file f = { 0 };
+    struct diff_scratch scratch = { 0 };
+    int status = DIFF_OK;
+    long pos = 0;
+    long start = 0;
+
+    long size = 0;
+    while (status == DIFF_OK && (size = pread(fd, block, DIFF_BLOCK, pos)) > 0) {
+        for (long i = 0; status == DIFF_OK && i < size;) {
+            char* nl = memchr(block + i, '\n', size - i);
+            long end = nl != NULL ? nl - block : size;
+
+            // lines split across blocks or holding tabs get copied first
+            bool copy = scratch.size > 0 || nl == NULL || memchr(block + i, '\t', end - i) != NULL;
+            if (copy) status = diff_scratch_append(&scratch, block + i, end - i);
+            if (nl == NULL || status != DIFF_OK) break;
+
+            uint64_t hash = copy ? diff_hash(scratch.buf, scratch.size) : diff_hash(block + i, end - i);
+            status = diff_file_push(&f, hash, start);
+            scratch.size = 0;
+
+            start = pos + end + 1;
+            i = end + 1;
+        }
+        pos += size;
+    }
+    if (size < 0) status = DIFF_ERROR;
+
+    // text after the last NL is a line, and so is an empty file
+    if (status == DIFF_OK && (start < pos || f.count == 0)) {
+        status = diff_file_push(&f, diff_hash(scratch.buf, scratch.size), start);
+    }
+
+    free(scratch.buf);
+    free(block);
+
+    if (status != DIFF_OK) {
+        free(f.hashes);
+        free(f.offsets);
+        return DIFF_ERROR;
+    }
+
+    f.offsets[f.count] = pos;
+    *hashes = f.hashes;
+    *offsets = f.offsets;
+    *count = f.count;
+    return DIFF_OK;
+}
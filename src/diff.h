@@ -0,0 +1,45 @@
+#ifndef DERZVIM_DIFF_H_INCLUDED
+#define DERZVIM_DIFF_H_INCLUDED
+
+#include <stdint.h>
+
+#include "line.h"
+
+// Lines a[a_start, a_start + a_count) were replaced by lines
+// b[b_start, b_start + b_count). Either side can be empty.
+struct diff_hunk {
+    long a_start;
+    long a_count;
+    long b_start;
+    long b_count;
+};
+
+// Line diff over per-line hashes (Myers, linear space). Hunks are
+// sorted and never touch each other.
+struct diff {
+    struct diff_hunk* hunks;
+    long count;
+    long capacity;
+
+    // scratch space for the forward and reverse searches
+    long* v;
+    long v_capacity;
+};
+
+enum diff_status {
+    DIFF_OK = 0,
+    DIFF_ERROR,
+};
+
+int diff_init(struct diff* d);
+int diff_free(struct diff* d);
+
+int diff_compute(struct diff* d, const uint64_t* a, long a_count, const uint64_t* b, long b_count);
+int diff_update(struct diff* d, const uint64_t* a, long a_count, const uint64_t* b, long b_count,
+    long start, long old_end, long end);
+
+uint64_t diff_hash(const char* buf, long size);
+int diff_hash_lines(const struct line* first, long count, uint64_t* hashes, long threads);
+int diff_hash_fd(int fd, uint64_t** hashes, long** offsets, long* count);
+
+#endif
@@ -1,235 +1,2474 @@
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <termios.h>
+#include <unistd.h>
 
+#include "bracket.h"
+#include "cold.h"
+#include "command.h"
+#include "cursors.h"
+#include "diff.h"
 #include "editor.h"
+#include "fold.h"
+#include "follow.h"
 #include "line.h"
+#include "load.h"
+#include "macro.h"
+#include "mark.h"
+#include "split.h"
+#include "stats.h"
+#include "syntax.h"
 #include "term.h"
+#include "words.h"
+#include "wrap.h"
+#include "yank.h"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+enum {
+    EDITOR_LOAD_POLL_MS = 50,
+    EDITOR_CHECK_POLL_MS = 1000,
+    EDITOR_RELOAD_BLOCK = 1024 * 1024,
+    EDITOR_STREAM_BLOCK = 1024 * 1024,
+    EDITOR_STREAM_BUDGET = 16 * 1024 * 1024,
+    EDITOR_BUFFER_BUDGET = 512 * 1024 * 1024,
+    EDITOR_BUFFER_DEFAULT_CAPACITY = 8,
+    EDITOR_BUFFER_CAPACITY_GROWTH = 2,
+    EDITOR_MACRO_DEPTH = 16,
+};
+
+static const int EDITOR_SYNTAX_COLORS[SYNTAX_CLASS_COUNT] = {
+    [SYNTAX_CLASS_NORMAL]  = COLOR_RESET,
+    [SYNTAX_CLASS_KEYWORD] = COLOR_YELLOW,
+    [SYNTAX_CLASS_TYPE]    = COLOR_GREEN,
+    [SYNTAX_CLASS_STRING]  = COLOR_MAGENTA,
+    [SYNTAX_CLASS_NUMBER]  = COLOR_RED,
+    [SYNTAX_CLASS_COMMENT] = COLOR_CYAN,
+    [SYNTAX_CLASS_PREPROC] = COLOR_BLUE,
+    [SYNTAX_CLASS_ERROR]   = COLOR_RED,
+    [SYNTAX_CLASS_WARNING] = COLOR_YELLOW,
+    [SYNTAX_CLASS_INFO]    = COLOR_GREEN,
+};
+
+// keep the per-line indexes in sync after the text of a line changes
+static void
+editor_notify_line(struct editor* e, struct line* line, long index)
+{
+    struct buffer* b = e->buffer;
+    b->modified = true;
+    if (e->wrap_enabled) wrap_update(&b->wrap, index, line->size);
+    syntax_line_changed(&b->syntax, index);
+    bracket_update(&b->brackets, index, line);
+    split_change(&e->split, index, index + 1);
+}
+
+// editor_notify_line for the lines of every cursor at once (in order)
+static void
+editor_notify_cursors(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    const struct cursors* c = &e->cursors;
+
+    // thawing later cursor lines may have packed earlier ones away again
+    bool frozen = false;
+    b->modified = true;
+    for (long i = 0; i < c->count; i++) {
+        if (e->wrap_enabled) wrap_update(&b->wrap, c->indices[i], c->lines[i]->size);
+        syntax_line_changed(&b->syntax, c->indices[i]);
+        frozen = frozen || line_frozen(c->lines[i]);
+    }
+    if (frozen) bracket_invalidate(&b->brackets);
+    else bracket_update_lines(&b->brackets, c->indices, c->lines, c->count);
+    if (c->count > 0) split_change(&e->split, c->indices[0], c->indices[c->count - 1] + 1);
+}
+
+// keep the per-line indexes in sync after count lines from line on are
+// linked in at index, broken off the end of the one before it (or put
+// in after it)
+static void
+editor_notify_insert(struct editor* e, struct line* line, long index, long count)
+{
+    struct buffer* b = e->buffer;
+    b->modified = true;
+    if (e->wrap_enabled) wrap_insert_lines(&b->wrap, index, line, count);
+    syntax_line_split(&b->syntax, index - 1, count);
+    bracket_insert_lines(&b->brackets, index, line, count);
+    fold_insert(&b->folds, index, count);
+    cold_insert(&b->cold, index, count);
+    split_insert(&e->split, index, count);
+}
+
+// keep the per-line indexes in sync after the line at index is unlinked,
+// joined onto the end of the one before it (prev)
+static void
+editor_notify_remove(struct editor* e, long index, struct line* prev)
+{
+    struct buffer* b = e->buffer;
+    b->modified = true;
+    if (e->wrap_enabled) wrap_remove(&b->wrap, index);
+    syntax_line_join(&b->syntax, index - 1);
+    bracket_remove(&b->brackets, index);
+    fold_remove(&b->folds, index, 1);
+    cold_remove(&b->cold, index, prev);
+    split_remove(&e->split, index, 1);
+}
+
+// keep the per-line indexes in sync after count lines land on the end
+static void
+editor_notify_append(struct editor* e, struct line* line, long index, long count)
+{
+    struct buffer* b = e->buffer;
+    if (e->wrap_enabled) wrap_append(&b->wrap, line, count);
+    syntax_lines_changed(&b->syntax, index);
+
+    // packed lines can't be scanned, the index is built again when needed
+    if (line_frozen(line)) bracket_invalidate(&b->brackets);
+    else bracket_append(&b->brackets, line, count);
+    split_insert(&e->split, index, count);
+}
+
+// keep the per-line indexes in sync after text from outside the editor
+// lands on the end of the last line (which isn't an edit)
+static void
+editor_notify_grow(struct editor* e, struct line* line, long index)
+{
+    struct buffer* b = e->buffer;
+    if (e->wrap_enabled) wrap_update(&b->wrap, index, line->size);
+    syntax_line_changed(&b->syntax, index);
+    bracket_update(&b->brackets, index, line);
+    split_change(&e->split, index, index + 1);
+}
+
+// keep the per-line indexes in sync after text from outside the editor
+// (a reload) swapped the count lines at index for added others. line is
+// the one at index now, the first new one if there are any.
+static void
+editor_notify_replace(struct editor* e, struct line* line, long index, long count, long added)
+{
+    struct buffer* b = e->buffer;
+    for (long i = 0; e->wrap_enabled && i < count; i++) wrap_remove(&b->wrap, index);
+    if (e->wrap_enabled) wrap_insert_lines(&b->wrap, index, line, added);
+    syntax_lines_replace(&b->syntax, index, count, added);
+    for (long i = 0; i < count; i++) bracket_remove(&b->brackets, index);
+    bracket_insert_lines(&b->brackets, index, line, added);
+    if (count > 0) fold_remove(&b->folds, index, count);
+    if (added > 0) fold_insert(&b->folds, index, added);
+    cold_replace(&b->cold, index, count, added, line);
+    split_replace(&e->split, index, count, added);
+}
+
+// rebuild the per-line indexes after arbitrary changes from index on
+static void
+editor_notify_reset(struct editor* e, long index)
+{
+    struct buffer* b = e->buffer;
+    if (e->wrap_enabled) wrap_build(&b->wrap, b->head, b->line_count, e->width);
+    syntax_lines_changed(&b->syntax, index);
+    bracket_invalidate(&b->brackets);
+    fold_relink(&b->folds, b->head, b->line_count);
+    mark_relink(&b->marks, b->head, b->line_count);
+    cold_reset(&b->cold);
+    cursors_clear(&e->cursors);
+    split_reset(&e->split);
+}
+
+// link finished chunks onto the end of the buffer, in file order. When
+// waiting, this blocks until at least the next chunk has been linked.
+static bool
+editor_load_stitch(struct editor* e, bool wait)
+{
+    struct buffer* b = e->buffer;
+    bool stitched = false;
+    while (e->loading) {
+        if (load_done(&e->load)) {
+            stats_record(&e->stats, STATS_TIMER_LOAD, stats_now() - e->load.started);
+            load_free(&e->load);
+            e->loading = false;
+            break;
+        }
+
+        struct line* head = NULL;
+        struct line* tail = NULL;
+        long count = 0;
+
+        int status = load_take(&e->load, wait && !stitched, &head, &tail, &count, &b->words);
+        if (status == LOAD_PENDING) break;
+        if (status == LOAD_ERROR) {
+            fprintf(stderr, "IO error while reading file: %s\n", b->path);
+        }
+
+        // chunks parsed before -z took effect are packed here instead
+        if (count > 0 && e->cold_enabled) cold_pack(head, count);
+
+        if (count > 0) {
+            long index = b->line_count;
+            head->prev = b->tail;
+            b->tail->next = head;
+            b->tail = tail;
+            b->line_count += count;
+            editor_notify_append(e, head, index, count);
+        }
+        stitched = true;
+    }
+
+    return stitched;
+}
+
+// make sure the line after the cursor exists if the file has one
+static void
+editor_load_next(struct editor* e)
+{
+    while (e->loading && e->buffer->line->next == NULL) {
+        editor_load_stitch(e, true);
+    }
+}
+
+// about to read the text of line (at index), see cold.h
+static void
+editor_cold_touch(struct editor* e, struct line* line, long index)
+{
+    if (e->cold_enabled && line != NULL) cold_touch(&e->buffer->cold, line, index);
+}
+
+// Unpack every line, for work that reads the whole buffer. Nothing is
+// packed again until editor_cold_repack.
+static void
+editor_cold_thaw(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (!e->cold_enabled) return;
+
+    while (e->loading) editor_load_stitch(e, true);
+    cold_thaw_all(&b->cold, b->head);
+}
+
+// pack the whole buffer again, except around the cursor
+static void
+editor_cold_repack(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (!e->cold_enabled) return;
+
+    cold_reset(&b->cold);
+    cold_pack(b->head, b->line_count);
+    editor_cold_touch(e, b->line, b->line_index);
+    editor_cold_touch(e, b->line->prev, b->line_index - 1);
+}
+
+// Like syntax_sync, but a frozen run on the way is only unpacked while
+// it is lexed, so scrolling far down doesn't thaw everything above
+static void
+editor_cold_sync(struct editor* e, struct line* line, long index)
+{
+    struct syntax* s = &e->buffer->syntax;
+    long start = syntax_sync_start(s, index);
+    if (!e->cold_enabled || start >= index) {
+        syntax_sync(s, line, index);
+        return;
+    }
+
+    // the first line to lex
+    for (long i = index; i > start; i--) line = line->prev;
+
+    for (long at = start; at < index && s->valid < index;) {
+        // lex to the end of the frozen run, or up to the next one
+        struct line* end = line;
+        long stop = at;
+        struct line* first = NULL;
+        long count = 0;
+        if (line_frozen(line)) {
+            long before = 0;
+            if (cold_thaw(line, &first, &before, &count) != COLD_OK) return;
+            for (; stop < index && stop < at - before + count; stop++) end = end->next;
+        } else {
+            for (; stop < index && !line_frozen(end); stop++) end = end->next;
+        }
+
+        int status = syntax_sync(s, end, stop);
+        if (first != NULL) cold_pack(first, count);
+        if (status != SYNTAX_OK) return;
+
+        // a convergence can skip over many lines at once
+        long next = stop > s->valid ? stop : s->valid;
+        for (; at < next && at < index; at++) line = line->next;
+    }
+}
+
+static void editor_cursor_goto(struct editor* e, struct line* line, long index, long pos);
+static bool editor_cursors_key(struct editor* e, int c);
+
+// Text was added to the end of the buffer from outside: tail (size
+// bytes long) was the last of count lines before. Keeps the indexes in
+// sync and returns true if the new text shows up on screen. With stick
+// a cursor on the last line moves down with it.
+static bool
+editor_tail_grew(struct editor* e, struct line* tail, long count, long size, bool stick)
+{
+    struct buffer* b = e->buffer;
+    bool at_tail = b->line == tail;
+    bool grew = b->line_count > count;
+
+    // the last word of the old tail may have been cut short
+    if (tail->size != size) {
+        words_remove(&b->words, tail->buf, size, size, size);
+        words_add(&b->words, tail->buf, tail->size, size, tail->size);
+        editor_notify_grow(e, tail, count - 1);
+    }
+    if (grew) {
+        words_add_lines(&b->words, tail->next, b->line_count - count);
+        editor_notify_append(e, tail->next, count, b->line_count - count);
+    }
+    if (tail->size == size && !grew) return false;
+
+    // a cursor sitting on the last line sticks to it, like tail -f
+    if (stick && at_tail && grew) {
+        editor_cursor_goto(e, b->tail, b->line_count - 1, 0);
+        return true;
+    }
+
+    // otherwise only redraw if the old last line is on screen
+    long bottom = b->scroll_y + e->height - 2;
+    if (e->wrap_enabled) return wrap_row(&b->wrap, count - 1) <= bottom;
+    return fold_row(&b->folds, count - 1) <= bottom;
+}
+
+// read whatever has been appended to the followed file. Returns true
+// if the screen needs to be redrawn.
+static bool
+editor_follow_poll(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    editor_cold_touch(e, b->tail, b->line_count - 1);
+
+    struct line* tail = b->tail;
+    long count = b->line_count;
+    long size = tail->size;
+
+    int events = 0;
+    if (follow_read(&b->follow, &b->tail, &b->line_count, &events) != FOLLOW_OK) {
+        follow_free(&b->follow);
+        b->following = false;
+        e->message = "-- stopped following: read error --";
+        return true;
+    }
+
+    if (events & FOLLOW_EVENT_TRUNCATED) e->message = "-- file truncated --";
+    if (events & FOLLOW_EVENT_ROTATED) e->message = "-- file rotated --";
+
+    return editor_tail_grew(e, tail, count, size, true) || events != 0;
+}
+
+// Read from the pipe until it runs dry (or enough has been read to be
+// worth showing). Returns true if the screen needs to be redrawn.
+static bool
+editor_stream_read(struct editor* e, bool* more)
+{
+    struct buffer* b = e->buffer;
+    editor_cold_touch(e, b->tail, b->line_count - 1);
+
+    struct line* tail = b->tail;
+    long count = b->line_count;
+    long size = tail->size;
+
+    *more = false;
+    bool done = false;
+    for (long total = 0; total < EDITOR_STREAM_BUDGET;) {
+        long n = read(b->stream_fd, b->stream_block, EDITOR_STREAM_BLOCK);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+        if (n <= 0) {
+            done = true;
+            break;
+        }
+        lines_append(&b->tail, &b->line_count, &b->stream_newline, b->stream_block, n);
+        b->stream_bytes += n;
+        total += n;
+        *more = total >= EDITOR_STREAM_BUDGET;
+    }
+
+    bool redraw = editor_tail_grew(e, tail, count, size, false);
+    if (done) {
+        stats_record(&e->stats, STATS_TIMER_LOAD, stats_now() - b->stream_started);
+        free(b->stream_block);
+        b->stream_block = NULL;
+        b->streaming = false;
+        redraw = true;
+    }
+
+    return redraw;
+}
+
+
+// write part of a line, only switching colors where the attributes change
+static void
+editor_draw_text(const struct editor* e, char* buf, const unsigned char* classes,
+    long start, long size, int* color)
+{
+    if (classes == NULL) {
+        term_write(e->output_fd, buf + start, size);
+        return;
+    }
+
+    long end = start + size;
+    for (long i = start; i < end;) {
+        int want = EDITOR_SYNTAX_COLORS[classes[i]];
+
+        // extend the run while the color stays the same
+        long run = i + 1;
+        while (run < end && EDITOR_SYNTAX_COLORS[classes[run]] == want) run++;
+
+        if (want != *color) {
+            term_color_set(e->output_fd, want);
+            *color = want;
+        }
+        term_write(e->output_fd, buf + i, run - i);
+        i = run;
+    }
+}
+
+// show the cursor at pos on line (one of several, see cursors.h) at
+// screen column x of row y
+static void
+editor_draw_cursor(const struct editor* e, const struct line* line, long pos, long x, long y, int* color)
+{
+    char c = pos < line->size ? line->buf[pos] : ' ';
+    term_cursor_pos_set(e->output_fd, x, y);
+    term_color_set(e->output_fd, COLOR_BG_WHITE);
+    term_write(e->output_fd, &c, 1);
+    term_color_set(e->output_fd, COLOR_RESET);
+    *color = COLOR_RESET;
+}
+
+// in soft-wrap mode the screen position is derived from the row index
+static void
+editor_wrap_scroll(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (!e->wrap_enabled) return;
+
+    long row = wrap_row(&b->wrap, b->line_index) + b->line_pos / e->width;
+
+    // keep the cursor row on screen (the bottom row is the status line)
+    if (row < b->scroll_y) b->scroll_y = row;
+    if (row > b->scroll_y + e->height - 2) b->scroll_y = row - (e->height - 2);
+
+    b->scroll_x = 0;
+    b->cursor_x = b->line_pos % e->width;
+    b->cursor_y = row - b->scroll_y;
+}
+
+// move the cursor line by index, walking from wherever it is now
+static void
+editor_line_seek(struct editor* e, long index)
+{
+    struct buffer* b = e->buffer;
+    while (b->line_index < index && b->line->next != NULL) {
+        b->line = b->line->next;
+        b->line_index++;
+    }
+    while (b->line_index > index && b->line->prev != NULL) {
+        b->line = b->line->prev;
+        b->line_index--;
+    }
+}
+
+// the cursor line can't be hidden, so the fold around it opens
+static void
+editor_fold_reveal(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    long fold = fold_find(&b->folds, b->line_index);
+    if (fold >= 0 && b->folds.ranges[fold].start < b->line_index) {
+        fold_open(&b->folds, b->line_index, b->line_index);
+    }
+}
+
+// jump the cursor to pos on the given line, scrolling as little as possible
+static void
+editor_cursor_goto(struct editor* e, struct line* line, long index, long pos)
+{
+    struct buffer* b = e->buffer;
+    b->line = line;
+    b->line_index = index;
+    b->line_pos = MIN(pos, line->size);
+    b->line_affinity = b->line_pos;
+
+    if (e->wrap_enabled) {
+        editor_wrap_scroll(e);
+        return;
+    }
+
+    // without wrapping scroll_y is the top visible row, where a closed
+    // fold takes up one row however many lines it hides
+    editor_fold_reveal(e);
+    long row = fold_row(&b->folds, index);
+    if (row < b->scroll_y) b->scroll_y = row;
+    if (row > b->scroll_y + e->height - 2) b->scroll_y = row - (e->height - 2);
+    b->cursor_y = row - b->scroll_y;
+
+    if (b->line_pos < b->scroll_x) b->scroll_x = b->line_pos;
+    if (b->line_pos > b->scroll_x + e->width - 1) b->scroll_x = b->line_pos - e->width + 1;
+    b->cursor_x = b->line_pos - b->scroll_x;
+}
+
+// put the cursor at pos on the cursor line, showing it on screen row y
+// (or as close to it as the top of the buffer allows)
+static void
+editor_cursor_place(struct editor* e, long pos, long y)
+{
+    struct buffer* b = e->buffer;
+    pos = MIN(pos, b->line->size);
+    if (e->wrap_enabled) {
+        long row = wrap_row(&b->wrap, b->line_index) + pos / e->width;
+        b->scroll_y = MAX(row - y, 0);
+    } else {
+        editor_fold_reveal(e);
+        long row = fold_row(&b->folds, b->line_index);
+        b->cursor_y = MIN(y, row);
+        b->scroll_y = row - b->cursor_y;
+    }
+    editor_cursor_goto(e, b->line, b->line_index, pos);
+}
+
+// in soft-wrap mode page motions jump by screen rows via the row index
+static void
+editor_wrap_page(struct editor* e, long rows)
+{
+    struct buffer* b = e->buffer;
+    long page = e->height - 1;
+    long row = wrap_row(&b->wrap, b->line_index) + b->line_pos / e->width;
+
+    // only wait for as much of the file as the target row needs
+    while (e->loading && row + rows >= wrap_total(&b->wrap)) {
+        editor_load_stitch(e, true);
+    }
+    long total = wrap_total(&b->wrap);
+
+    b->scroll_y = MAX(MIN(b->scroll_y + rows, total - page), 0);
+
+    long offset = 0;
+    long index = wrap_find(&b->wrap, row + rows, &offset);
+    editor_line_seek(e, index);
+
+    b->line_pos = MIN(offset * e->width + b->cursor_x, b->line->size);
+    b->line_affinity = b->line_pos;
+
+    editor_wrap_scroll(e);
+}
+
+// remember what the file looks like (st) now that the buffer matches it
+static void
+editor_file_remember(struct editor* e, const struct stat* st)
+{
+    struct buffer* b = e->buffer;
+    b->file_size = st->st_size;
+    b->file_inode = st->st_ino;
+    b->file_mtime = st->st_mtim;
+}
+
+static void
+editor_file_stat(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    struct stat st;
+    if (b->path != NULL && stat(b->path, &st) == 0) editor_file_remember(e, &st);
+}
+
+// has something other than us touched the file since we last looked?
+static bool
+editor_file_changed(const struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    struct stat st;
+    if (b->path == NULL || stat(b->path, &st) == -1) return false;
+
+    return st.st_size != b->file_size
+        || (long)st.st_ino != b->file_inode
+        || st.st_mtim.tv_sec != b->file_mtime.tv_sec
+        || st.st_mtim.tv_nsec != b->file_mtime.tv_nsec;
+}
+
+// Read the lines found in bytes [start, end) of the file into a list of
+// their own, counting them. The file coming up short is an error.
+static int
+editor_file_read_lines(int fd, long start, long end, struct line** head, struct line** tail, long* count)
+{
+    char* block = malloc(EDITOR_RELOAD_BLOCK);
+    *head = line_new();
+    *tail = *head;
+    *count = 1;
+    if (block == NULL || *head == NULL) {
+        free(block);
+        lines_free(head, tail);
+        return EDITOR_ERROR;
+    }
+
+    bool newline = false;
+    long pos = start;
+    while (pos < end) {
+        long n = pread(fd, block, MIN(end - pos, EDITOR_RELOAD_BLOCK), pos);
+        if (n <= 0 || lines_append(tail, count, &newline, block, n) != LINE_OK) break;
+        pos += n;
+    }
+
+    free(block);
+    if (pos < end) {
+        lines_free(head, tail);
+        return EDITOR_ERROR;
+    }
+    return EDITOR_OK;
+}
+
+// did the file change between two looks at it?
+static bool
+editor_file_moved(const struct stat* a, const struct stat* b)
+{
+    return a->st_size != b->st_size
+        || a->st_mtim.tv_sec != b->st_mtim.tv_sec
+        || a->st_mtim.tv_nsec != b->st_mtim.tv_nsec;
+}
+
+// a hunk of a reload: its new lines in a list of their own, the old line
+// at its start and the lines [start, end) around it to pack again
+struct editor_reload_hunk {
+    struct line* head;
+    struct line* tail;
+    struct line* line;
+    struct line* first;
+    long start;
+    long end;
+};
+
+// Before the lines of hunk h (old line at its start, or NULL past the
+// end) are taken out or others go in between them, unpack the frozen
+// runs that would be cut. The lines [*start, *end) around it are the
+// ones to pack again afterwards, *first being the one at *start if
+// that's above the hunk.
+static int
+editor_reload_thaw(struct editor* e, const struct diff_hunk* h, struct line* line,
+    long* start, long* end, struct line** first)
+{
+    *start = h->a_start;
+    *end = h->a_start + h->a_count;
+    *first = NULL;
+    if (!e->cold_enabled) return EDITOR_OK;
+
+    // new lines going in inside of a run cut it too
+    struct line* prev = line != NULL ? line->prev : NULL;
+    bool inside = h->a_count == 0 && prev != NULL && line_frozen(prev) && prev->text == line->text;
+    long index = inside ? h->a_start - 1 : h->a_start;
+    long count = inside ? 1 : h->a_count;
+    line = inside ? prev : line;
+
+    for (long i = 0; i < count; i++, line = line->next) {
+        if (!line_frozen(line)) continue;
+
+        struct line* run = NULL;
+        long before = 0;
+        long size = 0;
+        if (cold_thaw(line, &run, &before, &size) != COLD_OK) return EDITOR_ERROR;
+        if (index + i - before < *start) {
+            *start = index + i - before;
+            *first = run;
+        }
+        *end = MAX(*end, index + i - before + size);
+    }
+
+    return EDITOR_OK;
+}
+
+// Bring the buffer back in line with the file on disk. Both sides are
+// hashed line by line (packed lines are read, not thawed) and only the
+// hunks that differ are swapped out, so unchanged lines and everything
+// pointing at them stay put, and the indexes only hear about the hunks.
+// The new lines of every hunk are read in (through the fd that was
+// hashed) before the buffer is touched, so if any of it fails, or the
+// file changes again meanwhile, the buffer is left as it was.
+static int
+editor_file_reload(struct editor* e)
+{
+    assert(!e->loading);
+
+    struct buffer* b = e->buffer;
+    int fd = open(b->path, O_RDONLY);
+    if (fd == -1) return EDITOR_ERROR;
+
+    struct stat st = { 0 };
+    uint64_t* hashes = NULL;
+    long* offsets = NULL;
+    long count = 0;
+    if (fstat(fd, &st) == -1 || diff_hash_fd(fd, &hashes, &offsets, &count) != DIFF_OK) {
+        close(fd);
+        return EDITOR_ERROR;
+    }
+
+    long start = stats_now();
+    struct diff d = { 0 };
+    diff_init(&d);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long n = b->line_count;
+    uint64_t* old = malloc(n * sizeof(uint64_t));
+    bool ok = old != NULL && offsets[count] == st.st_size;
+    ok = ok && diff_hash_lines(b->head, n, old, cpus > 0 ? cpus : 1) == DIFF_OK;
+    ok = ok && diff_compute(&d, old, n, hashes, count) == DIFF_OK;
+
+    struct editor_reload_hunk* hunks = ok ? calloc(d.count + 1, sizeof(struct editor_reload_hunk)) : NULL;
+    ok = ok && hunks != NULL;
+
+    // read the new lines of every hunk, each into a list of its own
+    for (long i = 0; ok && i < d.count; i++) {
+        const struct diff_hunk* h = &d.hunks[i];
+        if (h->b_count == 0) continue;
+
+        long got = 0;
+        long end = offsets[h->b_start + h->b_count];
+        ok = editor_file_read_lines(fd, offsets[h->b_start], end, &hunks[i].head, &hunks[i].tail, &got) == EDITOR_OK
+            && got == h->b_count;
+    }
+
+    // what was hashed and read has to be what's still there
+    struct stat now = { 0 };
+    ok = ok && fstat(fd, &now) == 0 && !editor_file_moved(&st, &now);
+
+    // find where each hunk starts in one walk down, unpacking what it cuts
+    struct line* line = b->head;
+    for (long i = 0, index = 0; ok && i < d.count; i++) {
+        struct editor_reload_hunk* k = &hunks[i];
+        for (; index < d.hunks[i].a_start; index++) line = line->next;
+        k->line = line;
+        ok = editor_reload_thaw(e, &d.hunks[i], line, &k->start, &k->end, &k->first) == EDITOR_OK;
+    }
+
+    // the cursor follows its line, or lands in whatever replaced it
+    const struct diff_hunk* hit = NULL;
+    long cursor_index = b->line_index;
+    for (long i = 0; ok && i < d.count; i++) {
+        const struct diff_hunk* h = &d.hunks[i];
+        if (b->line_index < h->a_start) break;
+        if (b->line_index < h->a_start + h->a_count) {
+            hit = h;
+            cursor_index = h->b_count > 0
+                ? h->b_start + MIN(b->line_index - h->a_start, h->b_count - 1)
+                : MIN(h->b_start, count - 1);
+            break;
+        }
+        cursor_index += h->b_count - h->a_count;
+    }
+    struct line* cursor = b->line;
+
+    // nothing can fail from here on. Earlier hunks are in already, so the
+    // old lines of this one start at b_start.
+    struct line* pack = NULL;
+    long pack_start = 0;
+    long pack_end = 0;
+    for (long i = 0; ok && i < d.count; i++) {
+        const struct diff_hunk* h = &d.hunks[i];
+        struct editor_reload_hunk* k = &hunks[i];
+        long index = h->b_start;
+        long delta = h->b_start - h->a_start;
+        line = k->line;
+
+        words_remove_lines(&b->words, line, h->a_count);
+        words_add_lines(&b->words, k->head, h->b_count);
+
+        // unlink the old lines and free them
+        struct line* before = line != NULL ? line->prev : b->tail;
+        for (long j = 0; j < h->a_count; j++) {
+            struct line* next = line->next;
+            line_free(line);
+            free(line);
+            line = next;
+        }
+
+        // and link the new ones in their place
+        struct line* first = k->head != NULL ? k->head : line;
+        struct line* last = k->tail != NULL ? k->tail : before;
+        if (before != NULL) before->next = first; else b->head = first;
+        if (line != NULL) line->prev = last; else b->tail = last;
+        if (k->head != NULL) k->head->prev = before;
+        if (k->tail != NULL) k->tail->next = line;
+
+        // marks on the old lines go to the new ones, or next to them
+        if (h->b_count > 0) mark_lines_replace(&b->marks, index, h->a_count, h->b_count, k->head);
+        else if (line != NULL) mark_lines_replace(&b->marks, index, h->a_count + 1, 1, line);
+        else mark_lines_replace(&b->marks, index - 1, h->a_count + 1, 1, before);
+        editor_notify_replace(e, first, index, h->a_count, h->b_count);
+
+        if (h == hit) {
+            cursor = first != NULL ? first : last;
+            for (long j = cursor_index - h->b_start; j > 0; j--) cursor = cursor->next;
+        }
+
+        k->head = NULL;
+
+        // the runs cut open are packed again, with the new lines, once
+        // past the last hunk reaching into them
+        if (!e->cold_enabled) continue;
+        if (pack != NULL && k->start >= pack_end) {
+            cold_pack(pack, pack_end + delta - pack_start);
+            pack = NULL;
+        }
+        if (pack == NULL) {
+            pack = k->first != NULL ? k->first : first;
+            pack_start = k->start + delta;
+        }
+        pack_end = MAX(pack_end, k->end);
+    }
+    if (pack != NULL) cold_pack(pack, pack_end + count - n - pack_start);
+
+    if (ok) {
+        b->line_count = count;
+        b->line = cursor;
+        b->line_index = cursor_index;
+        b->modified = false;
+        e->message = "-- file changed on disk, reloaded --";
+        if (d.count > 0) cursors_clear(&e->cursors);
+        editor_file_remember(e, &st);
+
+        // keep the cursor on the same screen row
+        editor_cold_touch(e, b->line, b->line_index);
+        editor_cold_touch(e, b->line->prev, b->line_index - 1);
+        editor_cursor_place(e, b->line_pos, b->cursor_y);
+        stats_record(&e->stats, STATS_TIMER_LOAD, stats_now() - start);
+    }
+
+    // the lists of a reload that didn't go through
+    for (long i = 0; hunks != NULL && i < d.count; i++) lines_free(&hunks[i].head, &hunks[i].tail);
+
+    close(fd);
+    free(hunks);
+    free(old);
+    free(hashes);
+    free(offsets);
+    diff_free(&d);
+
+    return ok ? EDITOR_OK : EDITOR_ERROR;
+}
+
+// Look for changes made to the file by other programs. An untouched
+// buffer is reloaded. One with edits is left alone, but quitting won't
+// write over the other changes. Returns true if a redraw is needed.
+static bool
+editor_file_check(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (e->loading || b->following || b->conflict) return false;
+    if (!editor_file_changed(e)) return false;
+
+    if (b->modified) {
+        b->conflict = true;
+        e->message = "-- file changed on disk, edits will be saved alongside it --";
+        return true;
+    }
+
+    // if it fails, try again next time around
+    editor_file_reload(e);
+    return true;
+}
+
+// Write the shown buffer out. If the file changed under us the edits go
+// next to it instead, and the buffer stays modified.
+static int
+editor_buffer_write(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (b->path == NULL) {
+        e->message = "-- no file name --";
+        return EDITOR_ERROR;
+    }
+
+    // a followed file belongs to whoever is appending to it
+    if (b->following) {
+        e->message = "-- not writing a followed file --";
+        return EDITOR_ERROR;
+    }
+
+    // don't write out a partial file
+    while (e->loading) editor_load_stitch(e, true);
+
+    char* path = NULL;
+    if (b->conflict || editor_file_changed(e)) {
+        long size = strlen(b->path) + sizeof(".derzvim");
+        path = malloc(size);
+        snprintf(path, size, "%s.derzvim", b->path);
+    }
+
+    long start = stats_now();
+    int status = lines_save(b->head, path != NULL ? path : b->path);
+    stats_record(&e->stats, STATS_TIMER_SAVE, stats_now() - start);
+
+    if (status != LINE_OK) {
+        e->message = "-- write failed --";
+    } else if (path != NULL) {
+        snprintf(e->message_text, sizeof(e->message_text),
+            "-- changed on disk, saved to %s --", path);
+        e->message = e->message_text;
+    } else {
+        b->modified = false;
+        editor_file_stat(e);
+        e->message = "-- written --";
+    }
+
+    free(path);
+    return status == LINE_OK ? EDITOR_OK : EDITOR_ERROR;
+}
+
+// free what a buffer holds of its text, the marks and folds stay (by
+// line index) for when it's read in again
+static void
+editor_buffer_drop(struct buffer* b)
+{
+    lines_free(&b->head, &b->tail);
+    wrap_free(&b->wrap);
+    syntax_free(&b->syntax);
+    words_free(&b->words);
+    bracket_free(&b->brackets);
+    b->loaded = false;
+}
+
+// save the edits in the shown buffer (unless told not to) and free it
+static void
+editor_buffer_close(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+
+    // an untouched file that is still loading doesn't need the rest
+    if (e->loading && !b->modified) {
+        load_free(&e->load);
+        e->loading = false;
+    }
+
+    if (b->following) follow_free(&b->follow);
+    free(b->stream_block);
+
+    if (b->modified && !b->following && !e->discard && b->path != NULL) {
+        if (editor_buffer_write(e) == EDITOR_OK && b->modified) {
+            fprintf(stderr, "%s changed on disk, edits saved to %s.derzvim\n", b->path, b->path);
+        }
+    }
+
+    editor_buffer_drop(b);
+}
+
+// switch away from the shown buffer
+static void
+editor_buffer_hide(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+
+    // half a file with edits can't be read again, so finish it off
+    if (b->modified) {
+        while (e->loading) editor_load_stitch(e, true);
+    }
+
+    b->wrapped = e->wrap_enabled;
+    cursors_clear(&e->cursors);
+    b->loaded = true;
+
+    // otherwise it's cheaper to read it again later than to wait for it
+    if (e->loading) {
+        load_free(&e->load);
+        e->loading = false;
+        editor_buffer_drop(b);
+    }
+}
+
+// Drop the text of the buffers that were shown least recently while
+// everything together is over budget. Only buffers that can be read
+// back from disk exactly as they were are dropped.
+static void
+editor_buffer_evict(struct editor* e)
+{
+    for (;;) {
+        long total = lines_memory(e->buffer->line_count, MAX(e->buffer->file_size, e->buffer->stream_bytes));
+        struct buffer* oldest = NULL;
+        for (long i = 0; i < e->buffer_count; i++) {
+            struct buffer* b = &e->buffers[i];
+            if (i == e->buffer_current || !b->loaded) continue;
+
+            // both sides of a diff are on screen
+            if (e->diffing && (i == e->diff_other || i == e->diff_shown)) continue;
+
+            total += lines_memory(b->line_count, MAX(b->file_size, b->stream_bytes));
+            bool clean = !b->modified && !b->streaming && !b->following && b->path != NULL;
+            if (clean && (oldest == NULL || b->last_shown < oldest->last_shown)) oldest = b;
+        }
+        if (total <= e->buffer_budget || oldest == NULL) return;
+
+        editor_buffer_drop(oldest);
+    }
+}
+
+// set up the shown buffer's text fresh and start loading it from its path
+static int
+editor_buffer_open(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    b->file_size = 0;
+    b->file_inode = 0;
+    b->file_mtime = (struct timespec){ 0 };
+    b->modified = false;
+    b->conflict = false;
+
+    b->scroll_x = 0;
+    b->scroll_y = 0;
+    b->cursor_x = 0;
+    b->cursor_y = 0;
+
+    b->line = line_new();
+    if (b->line == NULL) return EDITOR_ERROR;
+
+    b->head = b->line;
+    b->tail = b->line;
+
+    b->line_count = 1;
+    b->line_affinity = 0;
+    b->line_index = 0;
+    b->line_pos = 0;
+
+    wrap_init(&b->wrap);
+    syntax_init(&b->syntax, b->path);
+    words_init(&b->words);
+    bracket_init(&b->brackets);
+    cold_init(&b->cold);
+    b->loaded = true;
+
+    b->following = false;
+    b->streaming = false;
+    b->stream_block = NULL;
+
+    e->loading = false;
+    if (b->path != NULL && load_init(&e->load, b->path) == LOAD_OK) {
+        e->loading = true;
+        if (e->cold_enabled) load_cold(&e->load);
+        editor_file_stat(e);
+        b->file_size = e->load.size;
+
+        // the first chunk is small: wait for it so the first screen is ready
+        struct line* head = NULL;
+        struct line* tail = NULL;
+        long count = 0;
+        load_take(&e->load, true, &head, &tail, &count, &b->words);
+        if (count > 0) {
+            line_free(b->line);
+            free(b->line);
+            b->line = head;
+            b->head = head;
+            b->tail = tail;
+            b->line_count = count;
+        }
+        editor_cold_repack(e);
+    }
+
+    // later chunks keep the row index up to date as they are linked in
+    if (e->wrap_enabled) wrap_build(&b->wrap, b->head, b->line_count, e->width);
+
+    // the rest of the file keeps loading in the background
+    if (e->loading) editor_load_stitch(e, false);
+
+    return EDITOR_OK;
+}
+
+// Read the shown buffer back in after it was dropped and put the cursor
+// where it was. Only as much of the file as it takes to get there, and
+// to the last mark and fold, is waited for.
+static int
+editor_buffer_reopen(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    long line_index = b->line_index;
+    long line_pos = b->line_pos;
+    long scroll_x = b->scroll_x;
+    long cursor_x = b->cursor_x;
+    long cursor_y = b->cursor_y;
+    if (editor_buffer_open(e) != EDITOR_OK) return EDITOR_ERROR;
+
+    long last = mark_last(&b->marks);
+    if (b->folds.count > 0) last = MAX(last, b->folds.ranges[b->folds.count - 1].end);
+    while (e->loading && b->line_count <= MAX(line_index, last)) editor_load_stitch(e, true);
+
+    // they kept their line numbers, the lines are new
+    mark_relink(&b->marks, b->head, b->line_count);
+    fold_relink(&b->folds, b->head, b->line_count);
+
+    editor_line_seek(e, line_index);
+    b->scroll_x = scroll_x;
+    b->cursor_x = cursor_x;
+    editor_cursor_place(e, line_pos, cursor_y);
+    return EDITOR_OK;
+}
+
+// everything but the terminal setup, shared by normal and headless editors
+static int
+editor_init_buffer(struct editor* e, int input_fd, int output_fd, const char* path)
+{
+    e->headless = false;
+
+    e->input_fd = input_fd;
+    e->output_fd = output_fd;
+
+    e->wrap_enabled = false;
+    e->cold_enabled = false;
+    cursors_init(&e->cursors);
+    e->diffing = false;
+    split_init(&e->split);
+    e->diff_line = NULL;
+    stats_init(&e->stats);
+    e->message = NULL;
+
+    e->buffers = NULL;
+    e->buffer_count = 0;
+    e->buffer_capacity = 0;
+    e->buffer_current = 0;
+    e->buffer_clock = 0;
+    e->buffer_budget = EDITOR_BUFFER_BUDGET;
+
+    for (long i = 0; i < YANK_REGISTER_COUNT; i++) yank_init(&e->registers[i]);
+    for (long i = 0; i < MACRO_REGISTER_COUNT; i++) macro_init(&e->macros[i]);
+    e->recording = -1;
+    e->record_pending = false;
+    e->replaying = 0;
+    e->replay_last = -1;
+
+    e->completing = false;
+    e->completion_count = 0;
+
+    e->prompting = false;
+    e->prompt_size = 0;
+    e->quit = false;
+    e->discard = false;
+
+    if (editor_buffer_add(e, path) != EDITOR_OK) return EDITOR_ERROR;
+    e->buffers[0].last_shown = ++e->buffer_clock;
+
+    return editor_buffer_open(e);
+}
+
+// Run the keys of a macro count times through the same dispatch typed
+// keys go through, without drawing anything in between. The first key
+// that fails (a motion that hits the end of the buffer, a search that
+// finds nothing) stops the whole replay, so huge counts are safe.
+static int
+editor_macro_run(struct editor* e, long index, long count)
+{
+    if (index < 0) {
+        e->message = "-- bad macro name --";
+        return EDITOR_ERROR;
+    }
+    if (e->replaying >= EDITOR_MACRO_DEPTH) {
+        e->message = "-- macros nested too deep --";
+        return EDITOR_ERROR;
+    }
+    e->replay_last = index;
+
+    // recording into the same register while replaying it only appends
+    // keys past the end, which this never gets to
+    const struct macro* m = &e->macros[index];
+    long size = m->count;
+    int status = EDITOR_OK;
+
+    e->replaying++;
+    for (long n = 0; n < count && status == EDITOR_OK; n++) {
+        for (long i = 0; i < size && status == EDITOR_OK; i++) {
+            status = editor_key_process(e, m->keys[i]);
+        }
+    }
+    e->replaying--;
+
+    return status;
+}
+
+// does the command name match the short or the long spelling?
+static bool
+editor_command_is(const char* name, long size, const char* brief, const char* full)
+{
+    return (size == (long)strlen(brief) && strncmp(name, brief, size) == 0)
+        || (size == (long)strlen(full) && strncmp(name, full, size) == 0);
+}
+
+// :e path shows the buffer for path, adding one if it's new
+static int
+editor_command_edit(struct editor* e, const char* path)
+{
+    if (*path == '\0') {
+        e->message = "-- no file name --";
+        return EDITOR_ERROR;
+    }
+
+    for (long i = 0; i < e->buffer_count; i++) {
+        const char* other = e->buffers[i].path;
+        if (other != NULL && strcmp(other, path) == 0) return editor_buffer_show(e, i);
+    }
+
+    if (editor_buffer_add(e, path) != EDITOR_OK) return EDITOR_ERROR;
+    return editor_buffer_show(e, e->buffer_count - 1);
+}
+
+// :diffs path shows the buffer for path next to the shown one
+static int
+editor_command_diff(struct editor* e, const char* path)
+{
+    if (*path == '\0') {
+        e->message = "-- no file name --";
+        return EDITOR_ERROR;
+    }
+
+    long index = 0;
+    while (index < e->buffer_count) {
+        const char* other = e->buffers[index].path;
+        if (other != NULL && strcmp(other, path) == 0) break;
+        index++;
+    }
+    if (index == e->buffer_count && editor_buffer_add(e, path) != EDITOR_OK) return EDITOR_ERROR;
+
+    return editor_diff(e, index);
+}
+
+// :ls lists the buffers in the status line: % is shown, + has edits
+// and - has been dropped from memory
+static void
+editor_command_list(struct editor* e)
+{
+    long size = 0;
+    for (long i = 0; i < e->buffer_count; i++) {
+        const struct buffer* b = &e->buffers[i];
+        size += snprintf(e->message_text + size, sizeof(e->message_text) - size,
+            "%s%ld%s %s%s",
+            i > 0 ? " | " : "",
+            i + 1,
+            i == e->buffer_current ? "%" : b->loaded ? "" : "-",
+            b->path != NULL ? b->path : "[stdin]",
+            b->modified ? " +" : "");
+        if (size >= (long)sizeof(e->message_text)) break;
+    }
+    e->message = e->message_text;
+}
+
+// :reg shows what each register holds and how much of it is shared
+// with the text it came from (or was put into)
+static void
+editor_command_registers(struct editor* e)
+{
+    long size = snprintf(e->message_text, sizeof(e->message_text), "--");
+    for (long i = 0; i < YANK_REGISTER_COUNT && size < (long)sizeof(e->message_text); i++) {
+        const struct yank* y = &e->registers[i];
+        if (y->count == 0) continue;
+
+        long bytes = 0;
+        long shared = 0;
+        yank_memory(y, &bytes, &shared);
+        size += snprintf(e->message_text + size, sizeof(e->message_text) - size,
+            " \"%c %ld %s, %ld B (%ld shared) --",
+            i == 0 ? '"' : (char)('a' + i - 1),
+            y->count,
+            y->mode == YANK_LINEWISE ? "lines" : "pieces",
+            bytes,
+            shared);
+    }
+    e->message = e->message_text;
+}
+
+static void
+editor_command_error(struct editor* e, const char* error)
+{
+    snprintf(e->message_text, sizeof(e->message_text), "-- %s --", error);
+    e->message = e->message_text;
+}
+
+// anything else is an ex command (see command.c) run on the shown buffer
+static int
+editor_command_ex(struct editor* e, const char* text)
+{
+    struct command_script script = { 0 };
+    command_script_init(&script);
+
+    const char* error = NULL;
+    long error_line = 0;
+    if (command_parse(&script, text, strlen(text), &error, &error_line) != COMMAND_OK) {
+        editor_command_error(e, error);
+        command_script_free(&script);
+        return EDITOR_ERROR;
+    }
+
+    // ranges and searches see the whole file
+    while (e->loading) editor_load_stitch(e, true);
+    bool thawed = e->cold_enabled && command_script_needs_text(&script);
+    if (thawed) editor_cold_thaw(e);
+
+    struct command_buffer b = { 0 };
+    command_buffer_init(&b, e->buffer->head, e->buffer->tail, e->buffer->line_count);
+    b.line = e->buffer->line;
+    b.index = e->buffer->line_index;
+    b.pos = e->buffer->line_pos;
+    b.registers = e->registers;
+    b.folds = &e->buffer->folds;
+    b.marks = &e->buffer->marks;
+    b.cursors = &e->cursors;
+
+    error = NULL;
+    int status = command_run(&script, &b, &error);
+    command_script_free(&script);
+
+    // going somewhere else without changing anything is a jump
+    if (!b.modified && b.index != e->buffer->line_index) {
+        mark_jump_push(&e->buffer->marks, e->buffer->line, e->buffer->line_index, e->buffer->line_pos);
+    }
+
+    long pos = b.modified ? 0 : b.pos;
+    e->buffer->head = b.head;
+    e->buffer->tail = b.tail;
+    e->buffer->line_count = b.count;
+    e->buffer->line = b.line;
+    e->buffer->line_index = b.index;
+    if (b.modified) {
+        e->buffer->modified = true;
+        editor_notify_reset(e, MAX(b.first_changed, 0));
+        words_invalidate(&e->buffer->words);
+    }
+    editor_cursor_place(e, pos, e->buffer->cursor_y);
+    if (thawed) editor_cold_repack(e);
+
+    if (b.write) editor_buffer_write(e);
+    if (b.discard) {
+        e->quit = true;
+        e->discard = true;
+    }
+
+    if (status != COMMAND_OK) {
+        editor_command_error(e, error);
+        return EDITOR_ERROR;
+    }
+
+    return EDITOR_OK;
+}
+
+// keys typed at the : prompt
+static int
+editor_prompt_key(struct editor* e, int c)
+{
+    int status = EDITOR_OK;
+    switch (c) {
+        case KEY_ESCAPE:
+            e->prompting = false;
+            break;
+        case KEY_BACKSPACE:
+            if (e->prompt_size == 0) e->prompting = false;
+            else e->prompt_size--;
+            break;
+        case KEY_ENTER:
+            e->prompting = false;
+            e->prompt[e->prompt_size] = '\0';
+            status = editor_command(e, e->prompt);
+            break;
+        default:
+            if (c < 32 || c > 126) break;
+            if (e->prompt_size < EDITOR_PROMPT_CAPACITY - 1) e->prompt[e->prompt_size++] = c;
+            break;
+    }
+
+    return status;
+}
+
+int
+editor_init(struct editor* e, int input_fd, int output_fd, const char* path)
+{
+    assert(e != NULL);
+
+    editor_init_buffer(e, input_fd, output_fd, path);
+
+    term_cursor_save(e->output_fd);
+    term_screen_save(e->output_fd);
+
+    // capture original termios config to restore upon exit
+    if (tcgetattr(input_fd, &e->original_termios) == -1) {
+        fprintf(stderr, "error capturing original termios: %s\n", strerror(errno));
+        return EDITOR_ERROR;
+    }
+
+    if (!term_mode_raw(input_fd)) {
+        fprintf(stderr, "error setting terminal to raw mode: %s\n", strerror(errno));
+        return EDITOR_ERROR;
+    }
+
+    // TODO: allow for updating size via sigwinch handler
+    if (!term_size(output_fd, &e->width, &e->height)) {
+        fprintf(stderr, "error getting terminal size: %s\n", strerror(errno));
+        return EDITOR_ERROR;
+    }
+
+    return EDITOR_OK;
+}
+
+int
+editor_init_headless(struct editor* e, int input_fd, int output_fd, const char* path,
+    long width, long height)
+{
+    assert(e != NULL);
+    assert(width > 0);
+    assert(height > 1);
+
+    editor_init_buffer(e, input_fd, output_fd, path);
+
+    e->headless = true;
+    e->width = width;
+    e->height = height;
+
+    return EDITOR_OK;
+}
+
+int
+editor_free(struct editor* e)
+{
+    assert(e != NULL);
+
+    if (!e->headless) {
+        // restore original termios config
+        tcsetattr(e->input_fd, TCSAFLUSH, &e->original_termios);
+
+        // restore the terminal before exiting
+        term_screen_restore(e->output_fd);
+        term_cursor_restore(e->output_fd);
+    }
+
+    for (long i = 0; i < e->buffer_count; i++) {
+        struct buffer* b = &e->buffers[i];
+        e->buffer = b;
+        if (b->loaded) editor_buffer_close(e);
+        fold_free(&b->folds);
+        free(b->path);
+    }
+    free(e->buffers);
+    for (long i = 0; i < YANK_REGISTER_COUNT; i++) yank_free(&e->registers[i]);
+    for (long i = 0; i < MACRO_REGISTER_COUNT; i++) macro_free(&e->macros[i]);
+    cursors_free(&e->cursors);
+    split_free(&e->split);
+
+    if (e->stats.enabled) stats_dump(&e->stats);
+
+    return EDITOR_OK;
+}
+
+// make sure both sides of the diff are there in full
+static int
+editor_diff_load(struct editor* e)
+{
+    while (e->loading) editor_load_stitch(e, true);
+    if (e->buffers[e->diff_other].loaded) return EDITOR_OK;
+
+    // the other side is read in by showing it until it's all there
+    long current = e->buffer_current;
+    if (editor_buffer_show(e, e->diff_other) != EDITOR_OK) return EDITOR_ERROR;
+    while (e->loading) editor_load_stitch(e, true);
+    if (editor_buffer_show(e, current) != EDITOR_OK) return EDITOR_ERROR;
+    while (e->loading) editor_load_stitch(e, true);
+    return EDITOR_OK;
+}
+
+static void
+editor_diff_off(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    if (!e->diffing) return;
+
+    e->diffing = false;
+    e->width = e->diff_width;
+    editor_cursor_place(e, b->line_pos, b->cursor_y);
+}
+
+// bring the diff up to date with the shown buffer before drawing it
+static int
+editor_diff_sync(struct editor* e)
+{
+    // after switching to the other side the two swap places
+    if (e->buffer_current != e->diff_shown) {
+        if (e->buffer_current == e->diff_other) e->diff_other = e->diff_shown;
+        e->diff_shown = e->buffer_current;
+        split_reset(&e->split);
+    }
+
+    // every line gets a row of its own
+    if (e->buffer->folds.count > 0) fold_open(&e->buffer->folds, 0, e->buffer->line_count - 1);
+
+    int status = SPLIT_OK;
+    if (e->split.stale) {
+        status = editor_diff_load(e) == EDITOR_OK ? SPLIT_OK : SPLIT_ERROR;
+        // loading the other side may have moved the buffers
+        const struct buffer* a = e->buffer;
+        const struct buffer* b = &e->buffers[e->diff_other];
+        if (status == SPLIT_OK) status = split_build(&e->split, a->head, a->line_count, b->head, b->line_count);
+        e->diff_line = NULL;
+    } else {
+        status = split_sync(&e->split, e->buffer->line, e->buffer->line_index, e->buffer->line_count);
+    }
+
+    if (status != SPLIT_OK) {
+        editor_diff_off(e);
+        e->message = "-- diff failed --";
+        return EDITOR_ERROR;
+    }
+    return EDITOR_OK;
+}
+
+// line index of the other side of the diff, walking from the one drawn
+// last or whichever end is closer
+static struct line*
+editor_diff_line(struct editor* e, long index)
+{
+    struct buffer* b = &e->buffers[e->diff_other];
+    struct line* line = b->head;
+    long at = 0;
+    if (b->line_count - 1 - index < index) {
+        line = b->tail;
+        at = b->line_count - 1;
+    }
+    if (e->diff_line != NULL && labs(e->diff_index - index) < labs(at - index)) {
+        line = e->diff_line;
+        at = e->diff_index;
+    }
+
+    for (; at < index; at++) line = line->next;
+    for (; at > index; at--) line = line->prev;
+    e->diff_line = line;
+    e->diff_index = index;
+
+    cold_touch(&b->cold, line, index);
+    return line;
+}
+
+// one side of a row of the diff at column x: fillers are dashes and
+// lines that differ are drawn on blue
+static void
+editor_draw_side(const struct editor* e, struct line* line, const unsigned char* classes,
+    bool changed, long x, long y, long width, int* color)
+{
+    struct buffer* b = e->buffer;
+    term_cursor_pos_set(e->output_fd, x, y);
+    if (line == NULL || changed) {
+        int want = line == NULL ? COLOR_CYAN : COLOR_BG_BLUE;
+        if (want != *color) {
+            term_color_set(e->output_fd, want);
+            *color = want;
+        }
+    }
+
+    if (line == NULL) {
+        for (long i = 0; i < width; i++) term_write(e->output_fd, "-", 1);
+        return;
+    }
+
+    long size = MAX(MIN(line->size - b->scroll_x, width), 0);
+    if (size > 0) editor_draw_text(e, line->buf, changed ? NULL : classes, b->scroll_x, size, color);
+}
+
+// Both sides of the diff, row by row, with the cursor line staying on
+// the screen row it would be on by itself. Filler rows above it only
+// push lines off the top.
+static void
+editor_draw_split(struct editor* e, int* color, unsigned char** classes)
+{
+    struct buffer* b = &e->buffers[e->diff_other];
+    long right = e->width + 1;
+    long right_width = e->diff_width - right;
+
+    long top = split_row(&e->split, e->buffer->line_index) - e->buffer->cursor_y;
+    struct line* line = e->buffer->line;
+    long index = e->buffer->line_index;
+    for (long i = 0; i < e->height - 1; i++) {
+        long a = 0;
+        long other = 0;
+        bool changed = split_line(&e->split, top + i, &a, &other);
+        if (a < 0 && other < 0) continue;
+
+        struct line* left = NULL;
+        if (a >= 0) {
+            for (; index < a; index++) line = line->next;
+            for (; index > a; index--) line = line->prev;
+            editor_cold_touch(e, line, index);
+            syntax_highlight(&e->buffer->syntax, line, index, classes);
+            left = line;
+        }
+        editor_draw_side(e, left, *classes, changed, 0, i, e->width, color);
+
+        if (*color != COLOR_RESET) {
+            term_color_set(e->output_fd, COLOR_RESET);
+            *color = COLOR_RESET;
+        }
+        term_cursor_pos_set(e->output_fd, e->width, i);
+        term_write(e->output_fd, "|", 1);
+
+        struct line* line_b = other >= 0 ? editor_diff_line(e, other) : NULL;
+        if (line_b != NULL) syntax_highlight(&b->syntax, line_b, other, classes);
+        editor_draw_side(e, line_b, *classes, changed, right, i, right_width, color);
+
+        if (a >= 0 && a != e->buffer->line_index) {
+            long k = cursors_find(&e->cursors, a);
+            long x = k >= 0 ? e->cursors.positions[k] - e->buffer->scroll_x : -1;
+            if (x >= 0 && x < e->width) editor_draw_cursor(e, left, e->cursors.positions[k], x, i, color);
+        }
+    }
+}
+
+int
+editor_draw(struct editor* e)
+{
+    assert(e != NULL);
+
+    long draw_start = e->stats.enabled ? stats_now() : 0;
+
+    // TODO optimize this to not redraw everything upon every key input
+    // thats probs too slow. its def inefficient
+    term_erase_screen(e->output_fd);
+    term_cursor_pos_set(e->output_fd, 0, 0);
+    term_cursor_hide(e->output_fd);
+
+    // this is our iterator
+    struct line* line = e->buffer->line;
+
+    // colors only change at run boundaries and are reset after the text
+    int color = COLOR_RESET;
+    unsigned char* classes = NULL;
+
+    if (e->diffing) editor_diff_sync(e);
+
+    if (e->diffing) {
+        editor_draw_split(e, &color, &classes);
+    } else if (e->wrap_enabled) {
+        // find the line holding the top row (always at or above the cursor)
+        long offset = 0;
+        long index = wrap_find(&e->buffer->wrap, e->buffer->scroll_y, &offset);
+        for (long s = e->buffer->line_index - index; s > 0; s--) line = line->prev;
+
+        editor_cold_sync(e, line, index);
+        editor_cold_touch(e, line, index);
+        syntax_highlight(&e->buffer->syntax, line, index, &classes);
+
+        // draw the text lines, one width-sized chunk per row
+        for (long i = 0; i < e->height - 1; i++) {
+            if (line == NULL) break;
+            long start = offset * e->width;
+            if (start < line->size) {
+                term_cursor_pos_set(e->output_fd, 0, i);
+                editor_draw_text(e, line->buf, classes,
+                    start, MIN(line->size - start, e->width), &color);
+            }
+            long k = index != e->buffer->line_index ? cursors_find(&e->cursors, index) : -1;
+            if (k >= 0 && e->cursors.positions[k] / e->width == offset) {
+                long pos = e->cursors.positions[k];
+                editor_draw_cursor(e, line, pos, pos - start, i, &color);
+            }
+            if (++offset >= wrap_line_rows(&e->buffer->wrap, line->size)) {
+                line = line->next;
+                offset = 0;
+                index++;
+                editor_cold_touch(e, line, index);
+                if (line != NULL) syntax_highlight(&e->buffer->syntax, line, index, &classes);
+            }
+        }
+    } else {
+        // walk back from the cursor line to the top of the screen, going
+        // straight to the first line of any closed fold on the way
+        long index = e->buffer->line_index;
+        for (long s = e->buffer->cursor_y; s > 0; s--) {
+            line = line->prev;
+            index--;
+            long fold = fold_find(&e->buffer->folds, index);
+            if (fold >= 0) {
+                line = e->buffer->folds.ranges[fold].first;
+                index = e->buffer->folds.ranges[fold].start;
+            }
+        }
+
+        editor_cold_sync(e, line, index);
+
+        // draw the text lines
+        for (long i = 0; i < e->height - 1; i++) {
+            if (line == NULL) break;
+            editor_cold_touch(e, line, index);
+            syntax_highlight(&e->buffer->syntax, line, index, &classes);
+            term_cursor_pos_set(e->output_fd, 0, i);
+            long size = MAX(MIN(line->size - e->buffer->scroll_x, e->width), 0);
+            if (size > 0) {
+                editor_draw_text(e, line->buf, classes, e->buffer->scroll_x, size, &color);
+            }
+            long k = index != e->buffer->line_index ? cursors_find(&e->cursors, index) : -1;
+            long x = k >= 0 ? e->cursors.positions[k] - e->buffer->scroll_x : -1;
+            if (x >= 0 && x < e->width) editor_draw_cursor(e, line, e->cursors.positions[k], x, i, &color);
+
+            // a closed fold shows its first line and how many it hides,
+            // the lines after it need the lexer state at its end
+            long fold = fold_find(&e->buffer->folds, index);
+            if (fold >= 0) {
+                const struct fold_range* r = &e->buffer->folds.ranges[fold];
+                if (color != COLOR_RESET) {
+                    term_color_set(e->output_fd, COLOR_RESET);
+                    color = COLOR_RESET;
+                }
+                char marker[64] = { 0 };
+                long marker_size = snprintf(marker, sizeof(marker),
+                    " +-- %ld lines --", r->end - r->start + 1);
+                term_write(e->output_fd, marker, MIN(marker_size, e->width - size));
+
+                line = r->last;
+                index = r->end;
+                if (line->next != NULL) editor_cold_sync(e, line->next, index + 1);
+            }
+            line = line->next;
+            index++;
+        }
+    }
+
+    if (color != COLOR_RESET) term_color_set(e->output_fd, COLOR_RESET);
+
+    // draw the status message (or the numbers from the previous frame)
+    char status[EDITOR_PROMPT_CAPACITY + 128] = { 0 };
+    if (e->prompting) {
+        snprintf(status, sizeof(status), ":%.*s", (int)e->prompt_size, e->prompt);
+    } else if (e->message != NULL) {
+        snprintf(status, sizeof(status), "%s", e->message);
+    } else if (e->stats.overlay) {
+        snprintf(status, sizeof(status),
+            "-- frame p50 %ldus p99 %ldus | draw p99 %ldus | %ld B %ld writes %ld allocs --",
+            stats_percentile(&e->stats, STATS_TIMER_FRAME, 50) / 1000,
+            stats_percentile(&e->stats, STATS_TIMER_FRAME, 99) / 1000,
+            stats_percentile(&e->stats, STATS_TIMER_DRAW, 99) / 1000,
+            e->stats.frame_bytes,
+            e->stats.frame_writes,
+            e->stats.frame_allocations);
+    } else {
+        snprintf(status, sizeof(status),
+            "-- cx: %3ld | cy: %3ld | lp: %3ld | ls: %3ld | la: %3ld | sx: %3ld | sy %3ld --",
+            e->buffer->cursor_x,
+            e->buffer->cursor_y,
+            e->buffer->line_pos,
+            e->buffer->line->size,
+            e->buffer->line_affinity,
+            e->buffer->scroll_x,
+            e->buffer->scroll_y);
+    }
+    if (e->buffer_count > 1 && !e->prompting) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " buffer %ld/%ld --", e->buffer_current + 1, e->buffer_count);
+    }
+    if (e->diffing && !e->prompting) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " diff %ld hunks --", e->split.diff.count);
+    }
+    if (e->cursors.count > 1 && !e->prompting) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " %ld cursors --", e->cursors.count);
+    }
+    if (e->loading) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " loading %ld%% --", load_progress(&e->load));
+    }
+    if (e->buffer->streaming) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " reading %ld MB --", e->buffer->stream_bytes / (1024 * 1024));
+    }
+    if (e->buffer->following) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size, " following --");
+    }
+    if (e->recording >= 0) {
+        long size = strlen(status);
+        snprintf(status + size, sizeof(status) - size,
+            " recording @%c --", (char)('a' + e->recording));
+    }
+    term_cursor_pos_set(e->output_fd, 1, e->height - 1);
+    term_write(e->output_fd, status, strlen(status));
+
+    // draw the cursor pos indicator
+    char curpos[64] = { 0 };
+    long curpos_size = snprintf(curpos, sizeof(curpos),
+        "%8ld,%-8ld", e->buffer->line_index + 1, e->buffer->line_pos + 1);
+    term_cursor_pos_set(e->output_fd, e->width - curpos_size - 1, e->height - 1);
+    term_write(e->output_fd, curpos, strlen(curpos));
+
+    // while typing a command the cursor sits at the end of it
+    if (e->prompting) {
+        term_cursor_pos_set(e->output_fd, 2 + e->prompt_size, e->height - 1);
+    } else {
+        term_cursor_pos_set(e->output_fd, e->buffer->cursor_x, e->buffer->cursor_y);
+    }
+    term_cursor_show(e->output_fd);
+
+    if (e->stats.enabled) {
+        long now = stats_now();
+        stats_record(&e->stats, STATS_TIMER_DRAW, now - draw_start);
+        if (e->stats.key_time != 0) {
+            stats_record(&e->stats, STATS_TIMER_FRAME, now - e->stats.key_time);
+            e->stats.key_time = 0;
+        }
+        stats_frame(&e->stats);
+    }
+
+    return EDITOR_OK;
+}
+
+int
+editor_key_wait(struct editor* e, int* c)
+{
+    assert(e != NULL);
+    assert(c != NULL);
+
+    if (editor_file_check(e)) editor_draw(e);
+
+    // keep linking in loaded chunks (and showing progress) or reading a
+    // pipe until a key arrives, then pick up whatever gets appended to a
+    // followed file. Otherwise look for outside changes now and then.
+    bool more = false;
+    for (;;) {
+        bool busy = e->loading || e->buffer->following || e->buffer->streaming;
+        long timeout = more ? 0 : busy ? EDITOR_LOAD_POLL_MS : EDITOR_CHECK_POLL_MS;
+        if (term_key_ready(e->input_fd, timeout)) break;
+
+        if (e->loading) {
+            if (editor_load_stitch(e, false)) editor_draw(e);
+        } else if (e->buffer->streaming) {
+            if (editor_stream_read(e, &more)) editor_draw(e);
+        } else if (e->buffer->following) {
+            if (editor_follow_poll(e)) editor_draw(e);
+        } else if (editor_file_check(e)) {
+            editor_draw(e);
+        }
+    }
+
+    if (!term_key_wait(e->input_fd, c)) {
+        fprintf(stderr, "error waiting for input: %s\n", strerror(errno));
+        return EDITOR_ERROR;
+    }
+
+    if (e->stats.enabled) e->stats.key_time = stats_now();
+
+    return EDITOR_OK;
+}
+
+int
+editor_key_process(struct editor* e, int c)
+{
+    assert(e != NULL);
+
+    e->message = NULL;
+
+    // ctrl-r and a register name start recording, ctrl-r again stops
+    if (e->record_pending) {
+        e->record_pending = false;
+        e->recording = macro_register(c);
+        if (e->recording >= 0) macro_clear(&e->macros[e->recording]);
+        return EDITOR_OK;
+    }
+    if (c == CTRL_KEY('r')) {
+        e->record_pending = e->recording < 0;
+        e->recording = -1;
+        return EDITOR_OK;
+    }
+
+    // keys coming from a replay were recorded already (as the :@ that ran it)
+    if (e->recording >= 0 && e->replaying == 0) macro_append(&e->macros[e->recording], c);
+
+    // only ctrl-n right after ctrl-n moves on to the next match
+    if (c != CTRL_KEY('n')) e->completing = false;
+
+    if (e->prompting) return editor_prompt_key(e, c);
+
+    // whatever the key does to the text happens around the cursor
+    editor_cold_touch(e, e->buffer->line, e->buffer->line_index);
+    editor_cold_touch(e, e->buffer->line->prev, e->buffer->line_index - 1);
+
+    // typing and moving along the line goes to every cursor, anything
+    // else leaves just the one
+    if (e->cursors.count > 0 && c != CTRL_KEY('d')) {
+        if (editor_cursors_key(e, c)) return EDITOR_OK;
+        cursors_clear(&e->cursors);
+    }
+
+    int status = EDITOR_OK;
+    switch (c) {
+        case KEY_ARROW_LEFT:
+            status = editor_cursor_left(e);
+            break;
+        case KEY_ARROW_RIGHT:
+            status = editor_cursor_right(e);
+            break;
+        case KEY_ARROW_UP:
+            status = editor_cursor_up(e);
+            break;
+        case KEY_ARROW_DOWN:
+            status = editor_cursor_down(e);
+            break;
+        case KEY_HOME:
+            status = editor_cursor_home(e);
+            break;
+        case KEY_END:
+            status = editor_cursor_end(e);
+            break;
+        case KEY_PAGE_UP:
+            status = editor_cursor_page_up(e);
+            break;
+        case KEY_PAGE_DOWN:
+            status = editor_cursor_page_down(e);
+            break;
+        case KEY_ENTER:
+            status = editor_line_break(e);
+            break;
+        case KEY_BACKSPACE:
+            status = editor_rune_delete(e);
+            break;
+        case CTRL_KEY('w'):
+            status = editor_wrap_toggle(e);
+            break;
+        case CTRL_KEY('g'):
+            status = editor_stats_toggle(e);
+            break;
+        case CTRL_KEY('f'):
+            status = editor_follow_toggle(e);
+            break;
+        case CTRL_KEY('k'):
+            status = editor_line_cut(e);
+            break;
+        case CTRL_KEY('y'):
+            status = editor_put(e);
+            break;
+        case CTRL_KEY('n'):
+            status = editor_complete(e);
+            break;
+        case CTRL_KEY(']'):
+            status = editor_bracket_jump(e);
+            break;
+        case CTRL_KEY('z'):
+            status = editor_fold_toggle(e);
+            break;
+        case CTRL_KEY('o'):
+            status = editor_jump_back(e);
+            break;
+        case CTRL_KEY('t'):
+            status = editor_jump_forward(e);
+            break;
+        case CTRL_KEY('d'):
+            status = editor_cursor_add(e);
+            break;
+        case KEY_ESCAPE:
+            e->prompting = true;
+            e->prompt_size = 0;
+            break;
+        // TODO: handle this in a less naive way
+        case '\t':
+            editor_rune_insert(e, ' ');
+            editor_rune_insert(e, ' ');
+            editor_rune_insert(e, ' ');
+            editor_rune_insert(e, ' ');
+            break;
+        default:
+            if (c < 32 || c > 126) break;
+            status = editor_rune_insert(e, c);
+            break;
+    }
+
+    return status;
+}
+
+// Apply a key to every cursor in one pass down the buffer, in order of
+// line index, with the per-line indexes brought up to date once at the
+// end. Returns false for keys that don't stay on the line, which are
+// left to the single cursor.
+static bool
+editor_cursors_key(struct editor* e, int c)
+{
+    struct buffer* b = e->buffer;
+    bool moves = c == KEY_ARROW_LEFT || c == KEY_ARROW_RIGHT || c == KEY_HOME || c == KEY_END;
+    bool types = c == '\t' || (c >= 32 && c <= 126);
+    if (!moves && !types && c != KEY_BACKSPACE) return false;
+
+    // a tab goes in as spaces, like with one cursor
+    char text[4] = { (char)c };
+    long size = 1;
+    if (c == '\t') {
+        memset(text, ' ', sizeof(text));
+        size = sizeof(text);
+    }
+
+    struct cursors* k = &e->cursors;
+    bool changed = false;
+    for (long i = 0; i < k->count; i++) {
+        struct line* line = k->lines[i];
+        long index = k->indices[i];
+        long pos = k->positions[i];
+
+        if (moves) {
+            if (c == KEY_ARROW_LEFT) pos = MAX(pos - 1, 0);
+            if (c == KEY_ARROW_RIGHT) pos = MIN(pos + 1, line->size);
+            if (c == KEY_HOME) pos = 0;
+            if (c == KEY_END) pos = line->size;
+            k->positions[i] = pos;
+            continue;
+        }
+
+        // backspace stays on the line, cursors at its start don't join it
+        // onto the one above
+        if (c == KEY_BACKSPACE && pos == 0) continue;
+
+        editor_cold_touch(e, line, index);
+        if (types) {
+            words_remove(&b->words, line->buf, line->size, pos, pos);
+            line_insert_buf(line, pos, text, size);
+            mark_chars_insert(&b->marks, index, pos, size);
+            words_add(&b->words, line->buf, line->size, pos, pos + size);
+            k->positions[i] = pos + size;
+        } else {
+            words_remove(&b->words, line->buf, line->size, pos - 1, pos);
+            line_delete(line, pos - 1);
+            mark_chars_delete(&b->marks, index, pos - 1, 1);
+            words_add(&b->words, line->buf, line->size, pos - 1, pos - 1);
+            k->positions[i] = pos - 1;
+        }
+        changed = true;
+    }
+    if (changed) editor_notify_cursors(e);
+
+    // touching many lines may have packed the cursor line away again
+    editor_cold_touch(e, b->line, b->line_index);
+    editor_cold_touch(e, b->line->prev, b->line_index - 1);
+
+    long primary = cursors_find(k, b->line_index);
+    if (primary >= 0) editor_cursor_goto(e, b->line, b->line_index, k->positions[primary]);
+    return true;
+}
+
 int
-editor_init(struct editor* e, int input_fd, int output_fd, const char* path)
+editor_rune_insert(struct editor* e, char rune)
 {
     assert(e != NULL);
 
-    e->file_path = path;
+    struct buffer* b = e->buffer;
+    words_remove(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+    line_insert(b->line, b->line_pos, rune);
+    mark_chars_insert(&b->marks, b->line_index, b->line_pos, 1);
+    words_add(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos + 1);
+    editor_notify_line(e, b->line, b->line_index);
+    editor_cursor_right(e);
 
-    e->input_fd = input_fd;
-    e->output_fd = output_fd;
+    return EDITOR_OK;
+}
 
-    e->scroll_x = 0;
-    e->scroll_y = 0;
-    e->cursor_x = 0;
-    e->cursor_y = 0;
+int
+editor_rune_delete(struct editor* e)
+{
+    assert(e != NULL);
 
-    e->line = calloc(1, sizeof(struct line));
-    line_init(e->line);
+    struct buffer* b = e->buffer;
+    if (b->line_pos == 0 && b->line->prev != NULL) {
+        struct line* prev = b->line->prev;
 
-    e->head = e->line;
-    e->tail = e->line;
+        // joining onto a line hidden in a fold opens it, which moves
+        // everything below it down the screen
+        bool opened = false;
+        long fold = fold_find(&b->folds, b->line_index - 1);
+        if (fold >= 0 && b->folds.ranges[fold].start < b->line_index - 1) {
+            opened = fold_open(&b->folds, b->line_index - 1, b->line_index - 1) > 0;
+        }
 
-    e->line_count = 1;
-    e->line_affinity = 0;
-    e->line_index = 0;
-    e->line_pos = 0;
+        // move cursor and line values to prev line
+        b->line_pos = prev->size;
+        b->line_affinity = prev->size;
 
-    if (path != NULL) {
-        lines_init(&e->head, &e->tail, &e->line_count, path);
-    }
+        // horizontal scrolling?
+        if (b->line_pos >= e->width) {
+            b->scroll_x = b->line_pos - (e->width / 2);
+        }
+        b->cursor_x = prev->size - b->scroll_x;
 
-    term_cursor_save(e->output_fd);
-    term_screen_save(e->output_fd);
+        // move back a line and merge the two, which joins the words
+        // on either side of the break
+        words_remove(&b->words, prev->buf, prev->size, prev->size, prev->size);
+        words_remove(&b->words, b->line->buf, b->line->size, 0, 0);
+        if (b->line == b->tail) b->tail = prev;
+        b->line = b->line->prev;
+        line_merge(b->line, b->line->next);
+        words_add(&b->words, prev->buf, prev->size, b->line_pos, b->line_pos);
 
-    // capture original termios config to restore upon exit
-    if (tcgetattr(input_fd, &e->original_termios) == -1) {
-        fprintf(stderr, "error capturing original termios: %s\n", strerror(errno));
-        return EDITOR_ERROR;
-    }
+        b->line_index--;
+        b->line_count--;
 
-    if (!term_mode_raw(input_fd)) {
-        fprintf(stderr, "error setting terminal to raw mode: %s\n", strerror(errno));
-        return EDITOR_ERROR;
-    }
+        mark_line_merge(&b->marks, b->line_index + 1, b->line_pos, b->line);
+        editor_notify_remove(e, b->line_index + 1, b->line);
+        editor_notify_line(e, b->line, b->line_index);
 
-    // TODO: allow for updating size via sigwinch handler
-    if (!term_size(output_fd, &e->width, &e->height)) {
-        fprintf(stderr, "error getting terminal size: %s\n", strerror(errno));
+        // vertical scrolling
+        if (opened) {
+            editor_cursor_place(e, b->line_pos, MAX(b->cursor_y - 1, 0));
+        } else if (b->cursor_y <= 0) {
+            b->scroll_y--;
+        } else {
+            b->cursor_y--;
+        }
+    } else if (b->line_pos > 0) {
+        editor_cursor_left(e);
+        words_remove(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos + 1);
+        line_delete(b->line, b->line_pos);
+        mark_chars_delete(&b->marks, b->line_index, b->line_pos, 1);
+        words_add(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+        editor_notify_line(e, b->line, b->line_index);
+    } else {
         return EDITOR_ERROR;
     }
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
 int
-editor_free(struct editor* e)
+editor_line_break(struct editor* e)
 {
     assert(e != NULL);
 
-    // restore original termios config
-    tcsetattr(e->input_fd, TCSAFLUSH, &e->original_termios);
+    struct buffer* b = e->buffer;
+    words_remove(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+    line_break(b->line, b->line_pos);
+    mark_line_break(&b->marks, b->line_index, b->line_pos, b->line->next);
+    words_add(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+    words_add(&b->words, b->line->next->buf, b->line->next->size, 0, 0);
+    if (b->line == b->tail) b->tail = b->line->next;
+    editor_notify_line(e, b->line, b->line_index);
+    editor_notify_insert(e, b->line->next, b->line_index + 1, 1);
+
+    b->line = b->line->next;
+    b->line_count++;
+    b->line_index++;
 
-    // restore the terminal before exiting
-    term_screen_restore(e->output_fd);
-    term_cursor_restore(e->output_fd);
+    b->line_affinity = 0;
+    b->line_pos = 0;
 
-    // write the changes
-    lines_write(e->head, e->file_path);
+    // horizontal scrolling
+    b->scroll_x = 0;
+    b->cursor_x = 0;
 
-    // free the DLL of lines
-    lines_free(&e->head, &e->tail);
+    // vertical scrolling
+    if (b->cursor_y >= e->height - 2) {
+        b->scroll_y++;
+    } else {
+        b->cursor_y++;
+    }
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
 int
-editor_draw(const struct editor* e)
+editor_line_cut(struct editor* e)
 {
     assert(e != NULL);
 
-    // TODO optimize this to not redraw everything upon every key input
-    // thats probs too slow. its def inefficient
-    term_erase_screen(e->output_fd);
-    term_cursor_pos_set(e->output_fd, 0, 0);
-    term_cursor_hide(e->output_fd);
+    struct buffer* b = e->buffer;
+    // the register just takes a reference to the text after the cursor
+    if (b->line_pos >= b->line->size) return EDITOR_OK;
+    struct yank* y = &e->registers[0];
+    if (yank_chars(y, b->line, b->line_pos, b->line, b->line->size) != YANK_OK) return EDITOR_ERROR;
 
-    // this is our iterator
-    struct line* line = e->head;
+    words_remove(&b->words, b->line->buf, b->line->size, b->line_pos, b->line->size);
+    mark_chars_delete(&b->marks, b->line_index, b->line_pos, b->line->size - b->line_pos);
+    line_truncate(b->line, b->line_pos);
+    words_add(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+    editor_notify_line(e, b->line, b->line_index);
 
-    // skip lines based on scroll value
-    for (long s = e->scroll_y; s > 0; s--) line = line->next;
+    editor_wrap_scroll(e);
+    return EDITOR_OK;
+}
 
-    // draw the text lines
-    for (long i = 0; i < e->height - 1; i++) {
-        if (line == NULL) break;
-        term_cursor_pos_set(e->output_fd, 0, i);
-        term_write(e->output_fd,
-            line->buf + e->scroll_x,
-            MIN(line->size - e->scroll_x, e->width));
-        line = line->next;
-    }
-
-    // draw the status message
-    char status[128] = { 0 };
-    snprintf(status, sizeof(status),
-        "-- cx: %3ld | cy: %3ld | lp: %3ld | ls: %3ld | la: %3ld | sx: %3ld | sy %3ld --",
-        e->cursor_x,
-        e->cursor_y,
-        e->line_pos,
-        e->line->size,
-        e->line_affinity,
-        e->scroll_x,
-        e->scroll_y);
-    term_cursor_pos_set(e->output_fd, 1, e->height - 1);
-    term_write(e->output_fd, status, strlen(status));
+int
+editor_put(struct editor* e)
+{
+    assert(e != NULL);
 
-    // draw the cursor pos indicator
-    char curpos[64] = { 0 };
-    long curpos_size = snprintf(curpos, sizeof(curpos),
-        "%8ld,%-8ld", e->line_index + 1, e->line_pos + 1);
-    term_cursor_pos_set(e->output_fd, e->width - curpos_size - 1, e->height - 1);
-    term_write(e->output_fd, curpos, strlen(curpos));
+    struct buffer* b = e->buffer;
+    const struct yank* y = &e->registers[0];
+    if (y->count == 0) return EDITOR_OK;
+
+    // lines still being loaded have to stay below whatever is put here
+    editor_load_next(e);
+
+    long added = 0;
+    long index = b->line_index;
+    if (y->mode == YANK_LINEWISE) {
+        // whole lines go below the cursor line, sharing their text
+        int status = yank_put_lines(y, &b->head, &b->tail, b->line, &added);
+        words_add_lines(&b->words, b->line->next, added);
+        b->line_count += added;
+        if (added > 0) {
+            mark_lines_insert(&b->marks, index + 1, added);
+            editor_notify_insert(e, b->line->next, index + 1, added);
+            editor_cursor_goto(e, b->line->next, index + 1, 0);
+        }
+        return status == YANK_OK ? EDITOR_OK : EDITOR_ERROR;
+    }
 
-    term_cursor_pos_set(e->output_fd, e->cursor_x, e->cursor_y);
-    term_cursor_show(e->output_fd);
+    // charwise text goes in at the cursor, which ends up just after it
+    words_remove(&b->words, b->line->buf, b->line->size, b->line_pos, b->line_pos);
+    int status = yank_put_chars(y, &b->tail, b->line, b->line_pos, &added);
+    b->line_count += added;
+    long pos = b->line_pos + y->slices[0].size;
+    if (added == 0) {
+        words_add(&b->words, b->line->buf, b->line->size, b->line_pos, pos);
+        mark_chars_insert(&b->marks, index, b->line_pos, y->slices[0].size);
+        editor_notify_line(e, b->line, index);
+    } else {
+        // the last line put also has the rest of the cursor line on it,
+        // and the marks that were there go along with it
+        struct line* last = b->line;
+        for (long i = 0; i < added; i++) last = last->next;
+        pos = y->slices[y->count - 1].size;
+        words_add(&b->words, b->line->buf, b->line->size, b->line_pos, b->line->size);
+        words_add_lines(&b->words, b->line->next, added - 1);
+        words_add(&b->words, last->buf, last->size, 0, pos);
+        mark_line_break(&b->marks, index, b->line_pos, last);
+        mark_chars_insert(&b->marks, index + 1, 0, pos);
+        mark_lines_insert(&b->marks, index + 1, added - 1);
+
+        editor_notify_line(e, b->line, index);
+        editor_notify_insert(e, b->line->next, index + 1, added);
+        editor_line_seek(e, index + added);
+    }
+    editor_cursor_goto(e, b->line, b->line_index, pos);
 
-    return EDITOR_OK;
+    return status == YANK_OK ? EDITOR_OK : EDITOR_ERROR;
 }
 
+// Complete the word before the cursor with the most frequent word in
+// the buffer that starts with it. Pressed again straight away, it swaps
+// in the next match, and after the last one the word as it was typed.
 int
-editor_key_wait(const struct editor* e, int* c)
+editor_complete(struct editor* e)
 {
     assert(e != NULL);
-    assert(c != NULL);
 
-    if (!term_key_wait(e->input_fd, c)) {
-        fprintf(stderr, "error waiting for input: %s\n", strerror(errno));
-        return EDITOR_ERROR;
+    struct buffer* b = e->buffer;
+    if (!e->completing) {
+        long start = words_prefix(b->line->buf, b->line_pos);
+        long size = b->line_pos - start;
+        if (size == 0 || size > WORDS_MAX_SIZE) return EDITOR_ERROR;
+
+        // after edits that weren't tracked the words get counted again
+        if (b->words.stale) {
+            while (e->loading) editor_load_stitch(e, true);
+            editor_cold_thaw(e);
+            words_build(&b->words, b->head, b->line_count);
+            editor_cold_repack(e);
+        }
+
+        const char* matches[WORDS_MATCH_MAX];
+        long count = words_complete(&b->words, &b->line->buf[start], size, matches, WORDS_MATCH_MAX);
+        if (count == 0) {
+            e->message = "-- no matches --";
+            return EDITOR_ERROR;
+        }
+
+        // the index changes as soon as a match goes in, so keep copies
+        for (long i = 0; i < count; i++) strcpy(e->completions[i], matches[i]);
+        memcpy(e->completions[count], &b->line->buf[start], size);
+        e->completions[count][size] = '\0';
+
+        e->completing = true;
+        e->completion_count = count;
+        e->completion_index = count;
+        e->completion_start = start;
+        e->completion_size = size;
+    }
+
+    // every match starts with what was typed, so only the rest changes
+    long start = e->completion_start;
+    long typed = strlen(e->completions[e->completion_count]);
+    e->completion_index = (e->completion_index + 1) % (e->completion_count + 1);
+    const char* word = e->completions[e->completion_index];
+    long size = strlen(word);
+
+    words_remove(&b->words, b->line->buf, b->line->size, start, start + e->completion_size);
+    for (long i = typed; i < e->completion_size; i++) line_delete(b->line, start + typed);
+    line_insert_buf(b->line, start + typed, word + typed, size - typed);
+    mark_chars_delete(&b->marks, b->line_index, start + typed, e->completion_size - typed);
+    mark_chars_insert(&b->marks, b->line_index, start + typed, size - typed);
+    words_add(&b->words, b->line->buf, b->line->size, start, start + size);
+    editor_notify_line(e, b->line, b->line_index);
+    e->completion_size = size;
+
+    editor_cursor_goto(e, b->line, b->line_index, start + size);
+
+    if (e->completion_index == e->completion_count) {
+        e->message = "-- back at original --";
+    } else {
+        snprintf(e->message_text, sizeof(e->message_text), "-- match %ld of %ld --",
+            e->completion_index + 1, e->completion_count);
+        e->message = e->message_text;
     }
 
     return EDITOR_OK;
 }
 
+// Jump to the bracket matching the one under the cursor, or from
+// anywhere else to the opening bracket of the block the cursor is in.
 int
-editor_rune_insert(struct editor* e, char rune)
+editor_bracket_jump(struct editor* e)
 {
     assert(e != NULL);
 
-    line_insert(e->line, e->line_pos, rune);
-    editor_cursor_right(e);
+    struct buffer* b = e->buffer;
+    bool on_bracket = b->line_pos < b->line->size && strchr("()[]{}", b->line->buf[b->line_pos]) != NULL;
+    editor_cold_thaw(e);
+
+    long index = 0;
+    long pos = 0;
+    for (;;) {
+        if (!b->brackets.built) bracket_build(&b->brackets, b->head, b->line_count);
+
+        int status = on_bracket
+            ? bracket_match(&b->brackets, b->line_index, b->line_pos, &index, &pos)
+            : bracket_enclosing(&b->brackets, b->line_index, b->line_pos, &index, &pos);
+        if (status == BRACKET_OK) break;
+
+        // the match might be in the part of the file still loading
+        if (!e->loading) {
+            e->message = on_bracket ? "-- no matching bracket --" : "-- not inside brackets --";
+            editor_cold_repack(e);
+            return EDITOR_ERROR;
+        }
+        while (e->loading) editor_load_stitch(e, true);
+    }
 
+    mark_jump_push(&b->marks, b->line, b->line_index, b->line_pos);
+    editor_cursor_goto(e, bracket_line(&b->brackets, index), index, pos);
+    editor_cold_repack(e);
     return EDITOR_OK;
 }
 
+// Open the fold the cursor is on. Anywhere else close a fold over the
+// block of lines indented deeper than the cursor line, or failing that
+// the block the cursor line is in.
+static int editor_fold_close(struct editor* e);
+
 int
-editor_rune_delete(struct editor* e)
+editor_fold_toggle(struct editor* e)
 {
     assert(e != NULL);
 
-    if (e->line_pos == 0 && e->line->prev != NULL) {
-        struct line* prev = e->line->prev;
-
-        // move cursor and line values to prev line
-        e->line_pos = prev->size;
-        e->line_affinity = prev->size;
+    struct buffer* b = e->buffer;
+    if (e->wrap_enabled) {
+        e->message = "-- no folding while wrapping --";
+        return EDITOR_ERROR;
+    }
 
-        // horizontal scrolling?
-        if (e->line_pos >= e->width) {
-            e->scroll_x = e->line_pos - (e->width / 2);
-        }
-        e->cursor_x = prev->size - e->scroll_x;
+    if (fold_find(&b->folds, b->line_index) >= 0) {
+        fold_open(&b->folds, b->line_index, b->line_index);
+        return EDITOR_OK;
+    }
 
-        // move back a line and merge the two
-        e->line = e->line->prev;
-        line_merge(e->line, e->line->next);
+    // where a block ends can only be told once the lines after it are in
+    while (e->loading) editor_load_stitch(e, true);
 
-        e->line_index--;
-        e->line_count--;
+    // indents are read from anywhere above and below
+    editor_cold_thaw(e);
+    int status = editor_fold_close(e);
+    editor_cold_repack(e);
+    return status;
+}
 
-        // vertical scrolling
-        if (e->cursor_y <= 0) {
-            e->scroll_y--;
-        } else {
-            e->cursor_y--;
+// close a fold over the block around the cursor, see editor_fold_toggle
+static int
+editor_fold_close(struct editor* e)
+{
+    struct buffer* b = e->buffer;
+    struct line* first = b->line;
+    struct line* last = NULL;
+    long start = b->line_index;
+    long end = fold_block(first, start, &last);
+
+    // the block the cursor line is in starts at the closest line above
+    // that is indented less (any line, for a blank one)
+    long indent = fold_line_indent(b->line);
+    while (end == start || end < b->line_index) {
+        if (first->prev == NULL) {
+            e->message = "-- nothing to fold --";
+            return EDITOR_ERROR;
         }
-    } else if (e->cursor_x > 0) {
-        editor_cursor_left(e);
-        line_delete(e->line, e->line_pos);
+        first = first->prev;
+        start--;
+
+        long above = fold_line_indent(first);
+        if (above < 0 || (indent >= 0 && above >= indent)) continue;
+        end = fold_block(first, start, &last);
+        indent = above;
     }
 
+    if (fold_add(&b->folds, start, end, first, last) != FOLD_OK) return EDITOR_ERROR;
+    editor_cursor_goto(e, first, start, b->line_pos);
     return EDITOR_OK;
 }
 
+// Add a cursor on the line below (in the column the cursor keeps when
+// moving down) for editing a block of lines at once. The first one also
+// keeps a cursor where it was.
 int
-editor_line_break(struct editor* e)
+editor_cursor_add(struct editor* e)
 {
     assert(e != NULL);
 
-    line_break(e->line, e->line_pos);
+    struct buffer* b = e->buffer;
+    struct line* line = b->line;
+    long index = b->line_index;
+    long pos = b->line_pos;
+    if (editor_cursor_down(e) != EDITOR_OK) return EDITOR_ERROR;
 
-    e->line = e->line->next;
-    e->line_count++;
-    e->line_index++;
+    if (e->cursors.count == 0) cursors_add(&e->cursors, line, index, pos);
+    cursors_add(&e->cursors, b->line, b->line_index, b->line_pos);
 
-    e->line_affinity = 0;
-    e->line_pos = 0;
+    return EDITOR_OK;
+}
 
-    // horizontal scrolling
-    e->scroll_x = 0;
-    e->cursor_x = 0;
+// go back to where the cursor was before the last jump (a :N, a search,
+// a mark or ctrl-]), then the one before that
+int
+editor_jump_back(struct editor* e)
+{
+    assert(e != NULL);
 
-    // vertical scrolling
-    if (e->cursor_y >= e->height - 2) {
-        e->scroll_y++;
-    } else {
-        e->cursor_y++;
+    struct buffer* b = e->buffer;
+    struct line* line = b->line;
+    long index = b->line_index;
+    long pos = b->line_pos;
+    if (mark_jump_back(&b->marks, &line, &index, &pos) != MARK_OK) {
+        e->message = "-- no older jump --";
+        return EDITOR_ERROR;
     }
 
+    editor_cursor_goto(e, line, index, pos);
+    return EDITOR_OK;
+}
+
+// undo a ctrl-o
+int
+editor_jump_forward(struct editor* e)
+{
+    assert(e != NULL);
+
+    struct line* line = NULL;
+    long index = 0;
+    long pos = 0;
+    if (mark_jump_forward(&e->buffer->marks, &line, &index, &pos) != MARK_OK) {
+        e->message = "-- no newer jump --";
+        return EDITOR_ERROR;
+    }
+
+    editor_cursor_goto(e, line, index, pos);
     return EDITOR_OK;
 }
 
@@ -238,18 +2477,20 @@ editor_cursor_left(struct editor* e)
 {
     assert(e != NULL);
 
-    // if at start of line, done
-    if (e->line_pos <= 0) return EDITOR_OK;
+    struct buffer* b = e->buffer;
+    // if at start of line, done (this stops a macro being replayed)
+    if (b->line_pos <= 0) return EDITOR_ERROR;
 
-    if (e->cursor_x <= 0) {
-        e->scroll_x--;
+    if (b->cursor_x <= 0) {
+        b->scroll_x--;
     } else {
-        e->cursor_x--;
+        b->cursor_x--;
     }
 
-    e->line_pos--;
-    e->line_affinity = e->line_pos;
+    b->line_pos--;
+    b->line_affinity = b->line_pos;
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -258,18 +2499,20 @@ editor_cursor_right(struct editor* e)
 {
     assert(e != NULL);
 
-    // if at end of line, done
-    if (e->line_pos >= e->line->size) return EDITOR_OK;
+    struct buffer* b = e->buffer;
+    // if at end of line, done (this stops a macro being replayed)
+    if (b->line_pos >= b->line->size) return EDITOR_ERROR;
 
-    if (e->cursor_x >= e->width - 1) {
-        e->scroll_x++;
+    if (b->cursor_x >= e->width - 1) {
+        b->scroll_x++;
     } else {
-        e->cursor_x++;
+        b->cursor_x++;
     }
 
-    e->line_pos++;
-    e->line_affinity = e->line_pos;
+    b->line_pos++;
+    b->line_affinity = b->line_pos;
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -278,36 +2521,43 @@ editor_cursor_up(struct editor* e)
 {
     assert(e != NULL);
 
-    // if at top of lines, done
-    if (e->line->prev == NULL) return EDITOR_OK;
+    struct buffer* b = e->buffer;
+    // if at top of lines, done (this stops a macro being replayed)
+    if (b->line->prev == NULL) return EDITOR_ERROR;
 
     // vertical scrolling
-    if (e->cursor_y <= 0) {
-        e->scroll_y--;
+    if (b->cursor_y <= 0) {
+        b->scroll_y--;
     } else {
-        e->cursor_y--;
+        b->cursor_y--;
     }
 
-    // move to the prev line
-    e->line = e->line->prev;
-    e->line_index--;
+    // move to the prev line, or the first line of a closed fold above
+    b->line = b->line->prev;
+    b->line_index--;
+    long fold = e->wrap_enabled ? -1 : fold_find(&b->folds, b->line_index);
+    if (fold >= 0) {
+        b->line = b->folds.ranges[fold].first;
+        b->line_index = b->folds.ranges[fold].start;
+    }
 
     // handle affinity
-    if (e->line_affinity >= e->line->size) {
-        if (e->line->size >= e->width + e->scroll_x) e->scroll_x = e->line_affinity - e->width + 1;
-        e->cursor_x = e->line->size - e->scroll_x;
-        e->line_pos = e->line->size;
+    if (b->line_affinity >= b->line->size) {
+        if (b->line->size >= e->width + b->scroll_x) b->scroll_x = b->line_affinity - e->width + 1;
+        b->cursor_x = b->line->size - b->scroll_x;
+        b->line_pos = b->line->size;
     } else {
-        e->cursor_x = e->line_affinity - e->scroll_x;
-        e->line_pos = e->line_affinity;
+        b->cursor_x = b->line_affinity - b->scroll_x;
+        b->line_pos = b->line_affinity;
     }
 
     // horizontal scrolling
-    if (e->line_pos < e->scroll_x) {
-        e->scroll_x = MAX(e->line_pos - e->width, 0);
-        e->cursor_x = e->line_pos;
+    if (b->line_pos < b->scroll_x) {
+        b->scroll_x = MAX(b->line_pos - e->width, 0);
+        b->cursor_x = b->line_pos;
     }
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -316,36 +2566,48 @@ editor_cursor_down(struct editor* e)
 {
     assert(e != NULL);
 
-    // if at bottom of lines, done
-    if (e->line->next == NULL) return EDITOR_OK;  
+    struct buffer* b = e->buffer;
+    // a closed fold is stepped over from its first line to after its last
+    struct line* last = b->line;
+    long skip = 0;
+    long fold = e->wrap_enabled ? -1 : fold_find(&b->folds, b->line_index);
+    if (fold >= 0) {
+        last = b->folds.ranges[fold].last;
+        skip = b->folds.ranges[fold].end - b->line_index;
+    }
+
+    // if at bottom of lines, done (but wait for lines still being loaded)
+    while (e->loading && last->next == NULL) editor_load_stitch(e, true);
+    if (last->next == NULL) return EDITOR_ERROR;
 
     // vertical scrolling
-    if (e->cursor_y >= e->height - 2) {
-        e->scroll_y++;
+    if (b->cursor_y >= e->height - 2) {
+        b->scroll_y++;
     } else {
-        e->cursor_y++;
+        b->cursor_y++;
     }
 
     // move to the next line
-    e->line = e->line->next;
-    e->line_index++;
+    b->line = last->next;
+    b->line_index += skip + 1;
 
     // handle affinity
-    if (e->line_affinity >= e->line->size) {
-        if (e->line->size >= e->width + e->scroll_x) e->scroll_x = e->line_affinity - e->width + 1;
-        e->cursor_x = e->line->size - e->scroll_x;
-        e->line_pos = e->line->size;
+    if (b->line_affinity >= b->line->size) {
+        if (b->line->size >= e->width + b->scroll_x) b->scroll_x = b->line_affinity - e->width + 1;
+        b->cursor_x = b->line->size - b->scroll_x;
+        b->line_pos = b->line->size;
     } else {
-        e->cursor_x = e->line_affinity - e->scroll_x;
-        e->line_pos = e->line_affinity;
+        b->cursor_x = b->line_affinity - b->scroll_x;
+        b->line_pos = b->line_affinity;
     }
 
     // horizontal scrolling
-    if (e->line_pos < e->scroll_x) {
-        e->scroll_x = MAX(e->line_pos - e->width, 0);
-        e->cursor_x = e->line_pos;
+    if (b->line_pos < b->scroll_x) {
+        b->scroll_x = MAX(b->line_pos - e->width, 0);
+        b->cursor_x = b->line_pos;
     }
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -354,11 +2616,13 @@ editor_cursor_home(struct editor* e)
 {
     assert(e != NULL);
 
-    e->scroll_x = 0;
-    e->cursor_x = 0;
-    e->line_pos = 0;
-    e->line_affinity = 0;
+    struct buffer* b = e->buffer;
+    b->scroll_x = 0;
+    b->cursor_x = 0;
+    b->line_pos = 0;
+    b->line_affinity = 0;
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -367,14 +2631,16 @@ editor_cursor_end(struct editor* e)
 {
     assert(e != NULL);
 
-    long size = e->line->size;
+    struct buffer* b = e->buffer;
+    long size = b->line->size;
     if (size >= e->width) {
-        e->scroll_x = size - e->width + 1;
+        b->scroll_x = size - e->width + 1;
     }
-    e->cursor_x = MIN(size, e->width - 1);
-    e->line_pos = size;
-    e->line_affinity = size;
+    b->cursor_x = MIN(size, e->width - 1);
+    b->line_pos = size;
+    b->line_affinity = size;
 
+    editor_wrap_scroll(e);
     return EDITOR_OK;
 }
 
@@ -383,6 +2649,11 @@ editor_cursor_page_up(struct editor* e)
 {
     assert(e != NULL);
 
+    if (e->wrap_enabled) {
+        editor_wrap_page(e, -(e->height - 1));
+        return EDITOR_OK;
+    }
+
     for (long i = 0; i < e->height - 1; i++) {
         editor_cursor_up(e);
     }
@@ -395,9 +2666,291 @@ editor_cursor_page_down(struct editor* e)
 {
     assert(e != NULL);
 
+    if (e->wrap_enabled) {
+        editor_wrap_page(e, e->height - 1);
+        return EDITOR_OK;
+    }
+
     for (long i = 0; i < e->height - 1; i++) {
         editor_cursor_down(e);
     }
 
     return EDITOR_OK;
 }
+
+int
+editor_wrap_toggle(struct editor* e)
+{
+    assert(e != NULL);
+
+    struct buffer* b = e->buffer;
+    // the two sides of a diff line up a line to a row
+    if (e->diffing && !e->wrap_enabled) {
+        e->message = "-- no wrapping in diff mode --";
+        return EDITOR_ERROR;
+    }
+
+    e->wrap_enabled = !e->wrap_enabled;
+
+    if (e->wrap_enabled) {
+        // the index isn't maintained while wrapping is off
+        if (wrap_build(&b->wrap, b->head, b->line_count, e->width) != WRAP_OK) {
+            e->wrap_enabled = false;
+            return EDITOR_ERROR;
+        }
+
+        // try to keep the cursor on the same screen row
+        long row = wrap_row(&b->wrap, b->line_index) + b->line_pos / e->width;
+        b->scroll_y = MAX(row - b->cursor_y, 0);
+        editor_wrap_scroll(e);
+    } else {
+        // the cursor may have gone into a fold while it was shown open
+        editor_fold_reveal(e);
+        long row = fold_row(&b->folds, b->line_index);
+        b->cursor_y = MIN(b->cursor_y, row);
+        b->scroll_y = row - b->cursor_y;
+        b->scroll_x = MAX(b->line_pos - e->width + 1, 0);
+        b->cursor_x = b->line_pos - b->scroll_x;
+    }
+
+    return EDITOR_OK;
+}
+
+int
+editor_stats_toggle(struct editor* e)
+{
+    assert(e != NULL);
+
+    // showing the overlay turns collection on if it wasn't already
+    e->stats.overlay = !e->stats.overlay;
+    if (e->stats.overlay && !e->stats.enabled) stats_enable(&e->stats, NULL);
+
+    return EDITOR_OK;
+}
+
+int
+editor_follow_toggle(struct editor* e)
+{
+    assert(e != NULL);
+
+    struct buffer* b = e->buffer;
+    if (b->following) {
+        // resuming later picks up from wherever this left off
+        b->file_size = b->follow.offset;
+        follow_free(&b->follow);
+        b->following = false;
+        return EDITOR_OK;
+    }
+
+    if (b->path == NULL) return EDITOR_ERROR;
+
+    // everything past what the loader saw is new (this catches up on
+    // anything appended since then, too)
+    if (follow_init(&b->follow, b->path, b->file_size) != FOLLOW_OK) {
+        e->message = "-- can't follow this file --";
+        return EDITOR_ERROR;
+    }
+    b->following = true;
+
+    return EDITOR_OK;
+}
+
+int
+editor_stream(struct editor* e, int fd)
+{
+    assert(e != NULL);
+
+    struct buffer* b = e->buffer;
+    // the pipe is drained between keys, so reads must never block
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        fprintf(stderr, "error setting up input stream: %s\n", strerror(errno));
+        return EDITOR_ERROR;
+    }
+
+    b->stream_block = malloc(EDITOR_STREAM_BLOCK);
+    if (b->stream_block == NULL) return EDITOR_ERROR;
+
+    b->streaming = true;
+    b->stream_fd = fd;
+    b->stream_bytes = 0;
+    b->stream_started = stats_now();
+    b->stream_newline = false;
+
+    return EDITOR_OK;
+}
+
+// Pack the shown buffer into cold storage, along with whatever loads
+// from now on (and every buffer opened later)
+int
+editor_cold_enable(struct editor* e)
+{
+    assert(e != NULL);
+
+    e->cold_enabled = true;
+    if (e->loading) load_cold(&e->load);
+    editor_cold_repack(e);
+
+    return EDITOR_OK;
+}
+
+// Show buffers[other] next to the shown buffer, lined up on a diff of
+// the two (see split.h)
+int
+editor_diff(struct editor* e, long other)
+{
+    assert(e != NULL);
+
+    if (other < 0 || other >= e->buffer_count || other == e->buffer_current) {
+        e->message = "-- nothing to diff against --";
+        return EDITOR_ERROR;
+    }
+
+    if (e->wrap_enabled) editor_wrap_toggle(e);
+    if (!e->diffing) {
+        e->diff_width = e->width;
+        e->width = MAX((e->width - 1) / 2, 1);
+    }
+    e->diffing = true;
+    e->diff_other = other;
+    e->diff_shown = e->buffer_current;
+    split_reset(&e->split);
+
+    if (editor_diff_sync(e) != EDITOR_OK) return EDITOR_ERROR;
+    editor_cursor_place(e, e->buffer->line_pos, e->buffer->cursor_y);
+    return EDITOR_OK;
+}
+
+int
+editor_buffer_add(struct editor* e, const char* path)
+{
+    assert(e != NULL);
+
+    if (e->buffer_count >= e->buffer_capacity) {
+        long capacity = e->buffer_capacity > 0
+            ? e->buffer_capacity * EDITOR_BUFFER_CAPACITY_GROWTH
+            : EDITOR_BUFFER_DEFAULT_CAPACITY;
+        struct buffer* buffers = realloc(e->buffers, capacity * sizeof(struct buffer));
+        if (buffers == NULL) {
+            fprintf(stderr, "failed to grow buffer list\n");
+            return EDITOR_ERROR;
+        }
+        e->buffers = buffers;
+        e->buffer_capacity = capacity;
+        e->buffer = &e->buffers[e->buffer_current];
+    }
+
+    // nothing is read until the buffer is first shown
+    struct buffer* b = &e->buffers[e->buffer_count++];
+    memset(b, 0, sizeof(*b));
+    b->path = path != NULL ? strdup(path) : NULL;
+    fold_init(&b->folds);
+    mark_init(&b->marks);
+
+    return EDITOR_OK;
+}
+
+int
+editor_buffer_show(struct editor* e, long index)
+{
+    assert(e != NULL);
+
+    if (index < 0 || index >= e->buffer_count) return EDITOR_ERROR;
+    if (index == e->buffer_current) return EDITOR_OK;
+
+    editor_buffer_hide(e);
+
+    struct buffer* b = &e->buffers[index];
+    e->buffer_current = index;
+    e->buffer = b;
+    b->last_shown = ++e->buffer_clock;
+
+    // switching back is free, unless wrapping was turned on since
+    int status = EDITOR_OK;
+    if (!b->loaded) {
+        status = editor_buffer_reopen(e);
+    } else if (e->wrap_enabled && !b->wrapped) {
+        wrap_build(&b->wrap, b->head, b->line_count, e->width);
+        editor_cursor_place(e, b->line_pos, b->cursor_y);
+    }
+
+    editor_buffer_evict(e);
+    return status;
+}
+
+int
+editor_command(struct editor* e, const char* text)
+{
+    assert(e != NULL);
+    assert(text != NULL);
+
+    // split off the command name, the rest is its argument
+    while (*text == ':' || isspace((unsigned char)*text)) text++;
+
+    // [count]@x replays a macro, @@ the last one again
+    const char* at = text;
+    while (isdigit((unsigned char)*at)) at++;
+    if (*at == '@') {
+        long count = at > text ? atol(text) : 1;
+        long index = at[1] == '@' ? e->replay_last : macro_register(at[1]);
+        return editor_macro_run(e, index, count);
+    }
+    const char* end = text;
+    while (isalpha((unsigned char)*end)) end++;
+    long size = end - text;
+    bool bang = *end == '!';
+    if (bang) end++;
+    const char* arg = end;
+    while (isspace((unsigned char)*arg)) arg++;
+
+    if (editor_command_is(text, size, "e", "edit")) {
+        return editor_command_edit(e, arg);
+    }
+    if (editor_command_is(text, size, "bn", "bnext")) {
+        return editor_buffer_show(e, (e->buffer_current + 1) % e->buffer_count);
+    }
+    if (editor_command_is(text, size, "bp", "bprevious")) {
+        return editor_buffer_show(e, (e->buffer_current + e->buffer_count - 1) % e->buffer_count);
+    }
+    if (editor_command_is(text, size, "b", "buffer")) {
+        if (editor_buffer_show(e, atol(arg) - 1) != EDITOR_OK) {
+            e->message = "-- no such buffer --";
+            return EDITOR_ERROR;
+        }
+        return EDITOR_OK;
+    }
+    if (editor_command_is(text, size, "diffs", "diffsplit")) {
+        return editor_command_diff(e, arg);
+    }
+    if (editor_command_is(text, size, "diffo", "diffoff")) {
+        editor_diff_off(e);
+        return EDITOR_OK;
+    }
+    if (editor_command_is(text, size, "diffu", "diffupdate")) {
+        if (!e->diffing) return EDITOR_OK;
+        split_reset(&e->split);
+        return editor_diff_sync(e);
+    }
+    if (editor_command_is(text, size, "ls", "buffers")) {
+        editor_command_list(e);
+        return EDITOR_OK;
+    }
+    if (editor_command_is(text, size, "reg", "registers")) {
+        editor_command_registers(e);
+        return EDITOR_OK;
+    }
+    if (editor_command_is(text, size, "w", "write")) {
+        return editor_buffer_write(e);
+    }
+    if (editor_command_is(text, size, "q", "quit")) {
+        e->quit = true;
+        e->discard = bang;
+        return EDITOR_OK;
+    }
+    if (editor_command_is(text, size, "x", "wq")) {
+        e->quit = true;
+        return EDITOR_OK;
+    }
+
+    return editor_command_ex(e, text);
+}
@@ -1,24 +1,53 @@
 #ifndef DERZVIM_EDITOR_H_INCLUDED
 #define DERZVIM_EDITOR_H_INCLUDED
 
+#include <stdbool.h>
+
 #include <termios.h>
+#include <time.h>
 
+#include "bracket.h"
+#include "cold.h"
+#include "cursors.h"
+#include "fold.h"
+#include "follow.h"
 #include "line.h"
+#include "load.h"
+#include "macro.h"
+#include "mark.h"
+#include "split.h"
+#include "stats.h"
+#include "syntax.h"
+#include "words.h"
+#include "wrap.h"
+#include "yank.h"
 
-// TODO: impl differ modes
-// a struct of func ptrs, something like:
-// typedef (*mode_handler)(struct editor* e, int c);
-// or use more specific handler for different things?
-// I think the first would scale better and be less restrictive
-struct editor {
-    struct termios original_termios;
-    const char* file_path;
+enum {
+    EDITOR_PROMPT_CAPACITY = 256,
+};
 
-    long input_fd;
-    long output_fd;
+// Everything that belongs to one file rather than to the editor. The
+// editor works on the shown one through its buffer field, switching is
+// just pointing that at another. Unloaded buffers only keep their path,
+// where the cursor was and their marks and folds (by line index), and
+// are read from disk again when shown.
+struct buffer {
+    char* path;
+    bool loaded;
+    long last_shown;
+
+    // what the file looked like when the buffer last matched it, so that
+    // changes made by other programs can be spotted
+    long file_size;
+    long file_inode;
+    struct timespec file_mtime;
+
+    // the buffer has edits that aren't in the file
+    bool modified;
+
+    // the file changed on disk while the buffer had edits of its own
+    bool conflict;
 
-    long width;
-    long height;
     long scroll_x;
     long scroll_y;
     long cursor_x;
@@ -32,6 +61,139 @@ struct editor {
     long line_index;
     long line_pos;
     long line_affinity;
+
+    // soft-wrap mode: scroll_y counts visual rows instead of lines. The
+    // row index is only kept up to date while wrapping is on, wrapped
+    // says whether it was when the buffer was last shown.
+    struct wrap wrap;
+    bool wrapped;
+
+    struct syntax syntax;
+
+    // how often each word shows up, for ctrl-n
+    struct words words;
+
+    // bracket nesting, for ctrl-] (only kept once it has been used)
+    struct bracket brackets;
+
+    // closed folds, shown as one row each (only while not wrapping)
+    struct fold folds;
+
+    // :k marks and the jump list for ctrl-o and ctrl-t, which follow the
+    // text they were set on through edits
+    struct mark marks;
+
+    // lines off screen and away from the cursor are packed into
+    // compressed blocks (only with -z), the runs unpacked last are kept
+    struct cold cold;
+
+    // lines are still arriving from a pipe
+    bool streaming;
+    long stream_fd;
+    long stream_bytes;
+    long stream_started;
+    bool stream_newline;
+    char* stream_block;
+
+    // new bytes appended to the file are read into the buffer as they land
+    bool following;
+    struct follow follow;
+};
+
+// TODO: impl differ modes
+// a struct of func ptrs, something like:
+// typedef (*mode_handler)(struct editor* e, int c);
+// or use more specific handler for different things?
+// I think the first would scale better and be less restrictive
+struct editor {
+    struct termios original_termios;
+
+    // headless editors draw to a virtual screen and leave termios alone
+    bool headless;
+
+    long input_fd;
+    long output_fd;
+
+    long width;
+    long height;
+
+    // the shown buffer, buffers[buffer_current]
+    struct buffer* buffer;
+
+    // soft-wrap mode, for whichever buffer is shown
+    bool wrap_enabled;
+
+    struct stats stats;
+
+    // ctrl-d and :cu add cursors, a key typed while there are some goes
+    // to all of them (only kept until lines move or the key is one that
+    // doesn't stay on the line)
+    struct cursors cursors;
+
+    // -d shows buffers[diff_other] to the right of the shown one, lined
+    // up with it (see split.h). Each side gets half the screen: width is
+    // the left half then, diff_width all of it.
+    bool diffing;
+    long diff_other;
+    long diff_shown;
+    long diff_width;
+    struct split split;
+
+    // the line of the other side drawn last, to walk on from
+    struct line* diff_line;
+    long diff_index;
+
+    // lines off screen and away from the cursor are packed into
+    // compressed blocks (only with -z), see cold.h
+    bool cold_enabled;
+
+    // lines of the shown buffer are still arriving from the background
+    // loader
+    bool loading;
+    struct load load;
+
+    // one-off notice shown in the status line until the next key
+    const char* message;
+    char message_text[EDITOR_PROMPT_CAPACITY];
+
+    // every file given or opened with :e, buffers[buffer_current] is shown
+    struct buffer* buffers;
+    long buffer_count;
+    long buffer_capacity;
+    long buffer_current;
+    long buffer_clock;
+
+    // inactive buffers are dropped (oldest first) to stay under this
+    long buffer_budget;
+
+    // shared by all buffers, 0 is the unnamed register (see yank.h)
+    struct yank registers[YANK_REGISTER_COUNT];
+
+    // ctrl-r records keys into a macro (recording is its register, or
+    // -1), :[count]@x replays them without drawing in between
+    struct macro macros[MACRO_REGISTER_COUNT];
+    long recording;
+    bool record_pending;
+    long replaying;
+    long replay_last;
+
+    // ctrl-n completes the word before the cursor, pressing it again
+    // swaps in the next match and finally the word as it was typed
+    bool completing;
+    char completions[WORDS_MATCH_MAX + 1][WORDS_MAX_SIZE + 1];
+    long completion_count;
+    long completion_index;
+    long completion_start;
+    long completion_size;
+
+    // a line typed after ESC, run as a command on enter
+    bool prompting;
+    char prompt[EDITOR_PROMPT_CAPACITY];
+    long prompt_size;
+
+    // set by :q, the main loop exits (without saving after :q!)
+    bool quit;
+    bool discard;
 };
 
 enum editor_status {
@@ -40,15 +202,26 @@ enum editor_status {
 };
 
 int editor_init(struct editor* e, int input_fd, int output_fd, const char* path);
+int editor_init_headless(struct editor* e, int input_fd, int output_fd, const char* path,
+    long width, long height);
 int editor_free(struct editor* e);
 
-int editor_draw(const struct editor* e);
-int editor_key_wait(const struct editor* e, int* c);
+int editor_draw(struct editor* e);
+int editor_key_wait(struct editor* e, int* c);
+int editor_key_process(struct editor* e, int c);
 
 int editor_rune_insert(struct editor* e, char rune);
 int editor_rune_delete(struct editor* e);
 
 int editor_line_break(struct editor* e);
+int editor_line_cut(struct editor* e);
+int editor_put(struct editor* e);
+int editor_complete(struct editor* e);
+int editor_bracket_jump(struct editor* e);
+int editor_fold_toggle(struct editor* e);
+int editor_jump_back(struct editor* e);
+int editor_jump_forward(struct editor* e);
+int editor_cursor_add(struct editor* e);
 
 int editor_cursor_left(struct editor* e);
 int editor_cursor_right(struct editor* e);
@@ -60,4 +233,15 @@ int editor_cursor_end(struct editor* e);
 int editor_cursor_page_up(struct editor* e);
 int editor_cursor_page_down(struct editor* e);
 
+int editor_wrap_toggle(struct editor* e);
+int editor_stats_toggle(struct editor* e);
+int editor_follow_toggle(struct editor* e);
+int editor_stream(struct editor* e, int fd);
+int editor_cold_enable(struct editor* e);
+int editor_diff(struct editor* e, long other);
+
+int editor_buffer_add(struct editor* e, const char* path);
+int editor_buffer_show(struct editor* e, long index);
+int editor_command(struct editor* e, const char* text);
+
 #endif
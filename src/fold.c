@@ -0,0 +1,338 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "line.h"
+
+enum {
+    FOLD_DEFAULT_CAPACITY = 64,
+    FOLD_CAPACITY_GROWTH = 2,
+    FOLD_TAB_WIDTH = 8,
+};
+
+static int
+fold_reserve(struct fold* f, long count)
+{
+    if (count <= f->capacity) return FOLD_OK;
+
+    long capacity = f->capacity > 0 ? f->capacity : FOLD_DEFAULT_CAPACITY;
+    while (capacity < count) capacity *= FOLD_CAPACITY_GROWTH;
+
+    struct fold_range* ranges = realloc(f->ranges, capacity * sizeof(struct fold_range));
+    if (ranges == NULL) return FOLD_ERROR;
+    f->ranges = ranges;
+
+    long* hidden = realloc(f->hidden, capacity * sizeof(long));
+    if (hidden == NULL) return FOLD_ERROR;
+    f->hidden = hidden;
+
+    f->capacity = capacity;
+    return FOLD_OK;
+}
+
+// add up the hidden lines before each fold again after some were opened
+static void
+fold_rebuild(struct fold* f)
+{
+    if (!f->dirty) return;
+
+    long hidden = 0;
+    for (long i = 0; i < f->count; i++) {
+        f->hidden[i] = hidden;
+        hidden += f->ranges[i].end - f->ranges[i].start;
+    }
+
+    f->dirty = false;
+}
+
+// the last fold starting at or before index, or -1
+static long
+fold_search(const struct fold* f, long index)
+{
+    long lo = 0;
+    long hi = f->count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (f->ranges[mid].start <= index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+// drop the folds in [from, to) from the array
+static void
+fold_delete(struct fold* f, long from, long to)
+{
+    if (from >= to) return;
+
+    memmove(&f->ranges[from], &f->ranges[to], (f->count - to) * sizeof(struct fold_range));
+    f->count -= to - from;
+    f->dirty = true;
+}
+
+int
+fold_init(struct fold* f)
+{
+    assert(f != NULL);
+
+    f->ranges = NULL;
+    f->hidden = NULL;
+    f->count = 0;
+    f->capacity = 0;
+    f->dirty = false;
+
+    return FOLD_OK;
+}
+
+int
+fold_free(struct fold* f)
+{
+    assert(f != NULL);
+
+    free(f->ranges);
+    free(f->hidden);
+    fold_init(f);
+
+    return FOLD_OK;
+}
+
+// close start to end (first and last are those lines), swallowing any
+// folds it overlaps
+int
+fold_add(struct fold* f, long start, long end, struct line* first, struct line* last)
+{
+    assert(f != NULL);
+    assert(start >= 0 && start < end);
+    assert(first != NULL && last != NULL);
+
+    // the folds that overlap [start, end] are [lo, hi)
+    long hi = fold_search(f, end) + 1;
+    long lo = hi;
+    while (lo > 0 && f->ranges[lo - 1].end >= start) lo--;
+
+    if (lo < hi && f->ranges[lo].start < start) {
+        start = f->ranges[lo].start;
+        first = f->ranges[lo].first;
+    }
+    if (lo < hi && f->ranges[hi - 1].end > end) {
+        end = f->ranges[hi - 1].end;
+        last = f->ranges[hi - 1].last;
+    }
+    fold_delete(f, lo, hi);
+
+    if (fold_reserve(f, f->count + 1) != FOLD_OK) {
+        fprintf(stderr, "fold: failed to grow folds\n");
+        return FOLD_ERROR;
+    }
+    memmove(&f->ranges[lo + 1], &f->ranges[lo], (f->count - lo) * sizeof(struct fold_range));
+    f->ranges[lo] = (struct fold_range){ start, end, first, last };
+    f->count++;
+    f->dirty = true;
+
+    return FOLD_OK;
+}
+
+// open every fold that has a line in [start, end], returns how many
+long
+fold_open(struct fold* f, long start, long end)
+{
+    assert(f != NULL);
+
+    long hi = fold_search(f, end) + 1;
+    long lo = hi;
+    while (lo > 0 && f->ranges[lo - 1].end >= start) lo--;
+
+    fold_delete(f, lo, hi);
+    return hi - lo;
+}
+
+// How far the lines are indented, with tabs going to the next stop, or
+// -1 for a line that is blank (blank lines go with whatever is around)
+long
+fold_line_indent(const struct line* line)
+{
+    assert(line != NULL);
+
+    long indent = 0;
+    for (long i = 0; i < line->size; i++) {
+        char c = line->buf[i];
+        if (c == ' ') indent++;
+        else if (c == '\t') indent += FOLD_TAB_WIDTH - indent % FOLD_TAB_WIDTH;
+        else return indent;
+    }
+    return -1;
+}
+
+// The end of the block of lines indented deeper than line (at index),
+// or index itself when the next line isn't. last is set to that line.
+long
+fold_block(struct line* line, long index, struct line** last)
+{
+    assert(line != NULL);
+    assert(last != NULL);
+
+    *last = line;
+    long end = index;
+
+    long indent = fold_line_indent(line);
+    if (indent < 0) return end;
+
+    long i = index + 1;
+    for (struct line* next = line->next; next != NULL; next = next->next, i++) {
+        long deeper = fold_line_indent(next);
+        if (deeper < 0) continue;
+        if (deeper <= indent) break;
+
+        *last = next;
+        end = i;
+    }
+
+    return end;
+}
+
+// close a fold over each outermost indented block whose first line is
+// one of the count lines from line (at index) on
+int
+fold_indent(struct fold* f, struct line* line, long index, long count)
+{
+    assert(f != NULL);
+
+    long stop = index + count;
+    while (line != NULL && index < stop) {
+        struct line* last = NULL;
+        long end = fold_block(line, index, &last);
+        if (end > index) {
+            if (fold_add(f, index, end, line, last) != FOLD_OK) return FOLD_ERROR;
+            line = last;
+            index = end;
+        }
+        line = line->next;
+        index++;
+    }
+
+    return FOLD_OK;
+}
+
+// count lines were linked in at index: folds after them move down and
+// one they landed inside of opens
+int
+fold_insert(struct fold* f, long index, long count)
+{
+    assert(f != NULL);
+
+    long i = fold_search(f, index - 1);
+    if (i >= 0 && f->ranges[i].end >= index) {
+        fold_delete(f, i, i + 1);
+    } else {
+        i++;
+    }
+
+    for (; i < f->count; i++) {
+        f->ranges[i].start += count;
+        f->ranges[i].end += count;
+    }
+
+    return FOLD_OK;
+}
+
+// count lines from index on were unlinked: folds after them move up and
+// the ones that lost lines open
+int
+fold_remove(struct fold* f, long index, long count)
+{
+    assert(f != NULL);
+
+    fold_open(f, index, index + count - 1);
+    for (long i = fold_search(f, index) + 1; i < f->count; i++) {
+        f->ranges[i].start -= count;
+        f->ranges[i].end -= count;
+    }
+
+    return FOLD_OK;
+}
+
+// After lines were changed in ways that weren't tracked, keep the folds
+// where they are (as far as the buffer still reaches) and find their
+// first and last lines again
+int
+fold_relink(struct fold* f, struct line* head, long count)
+{
+    assert(f != NULL);
+
+    long kept = 0;
+    for (long i = 0; i < f->count; i++) {
+        struct fold_range r = f->ranges[i];
+        if (r.end >= count) r.end = count - 1;
+        if (r.start < r.end) f->ranges[kept++] = r;
+    }
+    if (kept != f->count) {
+        f->count = kept;
+        f->dirty = true;
+    }
+
+    long index = 0;
+    struct line* line = head;
+    for (long i = 0; i < f->count && line != NULL; i++) {
+        struct fold_range* r = &f->ranges[i];
+        for (; index < r->start; index++) line = line->next;
+        r->first = line;
+        for (; index < r->end; index++) line = line->next;
+        r->last = line;
+    }
+
+    return FOLD_OK;
+}
+
+// the fold that starts at or hides line index, or -1
+long
+fold_find(const struct fold* f, long index)
+{
+    assert(f != NULL);
+
+    long i = fold_search(f, index);
+    if (i >= 0 && index <= f->ranges[i].end) return i;
+    return -1;
+}
+
+// the visible row line index is shown on (that of its fold if hidden)
+long
+fold_row(struct fold* f, long index)
+{
+    assert(f != NULL);
+
+    long i = fold_search(f, index);
+    if (i < 0) return index;
+
+    fold_rebuild(f);
+    const struct fold_range* r = &f->ranges[i];
+    if (index <= r->end) return r->start - f->hidden[i];
+    return index - f->hidden[i] - (r->end - r->start);
+}
+
+// the line shown on a visible row
+long
+fold_line(struct fold* f, long row)
+{
+    assert(f != NULL);
+
+    fold_rebuild(f);
+
+    // the last fold whose first line is shown at or above row
+    long lo = 0;
+    long hi = f->count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (f->ranges[mid].start - f->hidden[mid] <= row) lo = mid + 1;
+        else hi = mid;
+    }
+
+    long i = lo - 1;
+    if (i < 0) return row;
+
+    const struct fold_range* r = &f->ranges[i];
+    if (row == r->start - f->hidden[i]) return r->start;
+    return row + f->hidden[i] + (r->end - r->start);
+}
@@ -0,0 +1,55 @@
+#ifndef DERZVIM_FOLD_H_INCLUDED
+#define DERZVIM_FOLD_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+// a closed fold: start is still shown (as one row), start + 1 to end are hidden
+struct fold_range {
+    long start;
+    long end;
+    struct line* first;
+    struct line* last;
+};
+
+// Closed folds of a buffer. Folds never overlap and are kept sorted by
+// their first line, each with how many lines the folds before it hide,
+// so mapping between line indices and visible rows is a binary search
+// (O(log n) in the number of folds, however many lines they hide). The
+// first and last line of every fold are kept too, so walking the lines
+// steps over a fold in one go. Inserting or removing lines shifts the
+// folds after them, which is linear in the number of folds. Opening
+// one marks the hidden counts dirty and they're added up again before
+// the next query.
+struct fold {
+    struct fold_range* ranges;
+    long* hidden;
+    long count;
+    long capacity;
+    bool dirty;
+};
+
+enum fold_status {
+    FOLD_OK = 0,
+    FOLD_ERROR,
+};
+
+int fold_init(struct fold* f);
+int fold_free(struct fold* f);
+
+int fold_add(struct fold* f, long start, long end, struct line* first, struct line* last);
+long fold_open(struct fold* f, long start, long end);
+long fold_block(struct line* line, long index, struct line** last);
+int fold_indent(struct fold* f, struct line* line, long index, long count);
+
+int fold_insert(struct fold* f, long index, long count);
+int fold_remove(struct fold* f, long index, long count);
+int fold_relink(struct fold* f, struct line* head, long count);
+
+long fold_find(const struct fold* f, long index);
+long fold_line_indent(const struct line* line);
+long fold_row(struct fold* f, long index);
+long fold_line(struct fold* f, long row);
+
+#endif
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "follow.h"
+#include "line.h"
+
+enum {
+    FOLLOW_BLOCK = 1024 * 1024,
+    FOLLOW_EVENTS = 4096,
+};
+
+static int
+follow_open(struct follow* f)
+{
+    f->fd = open(f->path, O_RDONLY);
+    if (f->fd == -1) return FOLLOW_ERROR;
+
+    struct stat st;
+    if (fstat(f->fd, &st) == -1) {
+        close(f->fd);
+        f->fd = -1;
+        return FOLLOW_ERROR;
+    }
+    f->inode = st.st_ino;
+
+    // watch the inode we actually have open
+    if (f->watch != -1) inotify_rm_watch(f->notify_fd, f->watch);
+    f->watch = inotify_add_watch(f->notify_fd, f->path,
+        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+
+    return FOLLOW_OK;
+}
+
+// read everything between offset and the current end of the file
+static int
+follow_drain(struct follow* f, struct line** tail, long* count)
+{
+    char* block = malloc(FOLLOW_BLOCK);
+    if (block == NULL) return FOLLOW_ERROR;
+
+    long n = 0;
+    while ((n = pread(f->fd, block, FOLLOW_BLOCK, f->offset)) > 0) {
+        if (lines_append(tail, count, &f->newline, block, n) != LINE_OK) break;
+        f->offset += n;
+    }
+
+    free(block);
+    return n < 0 ? FOLLOW_ERROR : FOLLOW_OK;
+}
+
+int
+follow_init(struct follow* f, const char* path, long offset)
+{
+    assert(f != NULL);
+    assert(path != NULL);
+
+    f->path = path;
+    f->fd = -1;
+    f->watch = -1;
+    f->offset = offset;
+    f->newline = false;
+    f->modified = true;
+    f->reopen = false;
+
+    f->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f->notify_fd == -1) {
+        fprintf(stderr, "failed to init inotify: %s\n", strerror(errno));
+        return FOLLOW_ERROR;
+    }
+
+    if (follow_open(f) != FOLLOW_OK) {
+        fprintf(stderr, "failed to open file: %s\n", path);
+        close(f->notify_fd);
+        return FOLLOW_ERROR;
+    }
+
+    // a complete last line means new bytes start a new line
+    char last = 0;
+    if (offset > 0 && pread(f->fd, &last, 1, offset - 1) == 1) {
+        f->newline = last == '\n';
+    }
+
+    return FOLLOW_OK;
+}
+
+int
+follow_free(struct follow* f)
+{
+    assert(f != NULL);
+
+    if (f->fd != -1) close(f->fd);
+    close(f->notify_fd);
+    f->fd = -1;
+
+    return FOLLOW_OK;
+}
+
+int
+follow_read(struct follow* f, struct line** tail, long* count, int* events)
+{
+    assert(f != NULL);
+    assert(tail != NULL);
+    assert(count != NULL);
+    assert(events != NULL);
+
+    *events = 0;
+
+    // collect what inotify has seen since last time
+    char buf[FOLLOW_EVENTS];
+    long n = 0;
+    while ((n = read(f->notify_fd, buf, sizeof(buf))) > 0) {
+        for (long i = 0; i < n;) {
+            struct inotify_event* event = (struct inotify_event*)&buf[i];
+            if (event->mask & IN_MODIFY) f->modified = true;
+            if (event->mask & (IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)) f->reopen = true;
+            i += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    // a different inode at the path means the file was rotated. If
+    // nothing is there yet keep checking until the new file shows up.
+    struct stat st;
+    if (f->reopen && stat(f->path, &st) == 0) {
+        f->reopen = false;
+        if ((long)st.st_ino != f->inode) {
+            // finish off the old file before switching
+            follow_drain(f, tail, count);
+            close(f->fd);
+
+            f->offset = 0;
+            f->newline = true;
+            f->modified = true;
+            if (follow_open(f) != FOLLOW_OK) return FOLLOW_ERROR;
+            *events |= FOLLOW_EVENT_ROTATED;
+        }
+    }
+
+    if (!f->modified) return FOLLOW_OK;
+    f->modified = false;
+
+    if (fstat(f->fd, &st) == -1) return FOLLOW_ERROR;
+
+    // a shrinking file was truncated (copytruncate rotation, > redirects)
+    if (st.st_size < f->offset) {
+        f->offset = 0;
+        f->newline = true;
+        *events |= FOLLOW_EVENT_TRUNCATED;
+    }
+
+    return follow_drain(f, tail, count);
+}
@@ -0,0 +1,39 @@
+#ifndef DERZVIM_FOLLOW_H_INCLUDED
+#define DERZVIM_FOLLOW_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum follow_event {
+    FOLLOW_EVENT_TRUNCATED = 1 << 0,
+    FOLLOW_EVENT_ROTATED = 1 << 1,
+};
+
+// Tails a growing file (like tail -F). Only bytes past offset are ever
+// read, and they're split into lines with the same rules as loading.
+// Truncation restarts from the top of the file, rotation finishes the
+// old file and then switches to whatever now lives at the path.
+struct follow {
+    const char* path;
+    int fd;
+    int notify_fd;
+    int watch;
+    long inode;
+    long offset;
+    bool newline;
+    bool modified;
+    bool reopen;
+};
+
+enum follow_status {
+    FOLLOW_OK = 0,
+    FOLLOW_ERROR,
+};
+
+int follow_init(struct follow* f, const char* path, long offset);
+int follow_free(struct follow* f);
+
+int follow_read(struct follow* f, struct line** tail, long* count, int* events);
+
+#endif
@@ -1,25 +1,80 @@
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cold.h"
 #include "line.h"
 
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
 enum {
     LINE_DEFAULT_CAPACITY = 256,
     LINE_CAPACITY_GROWTH = 2,
+    LINE_READ_BLOCK = 64 * 1024,
+    LINE_WRITE_BUFFER = 64 * 1024,
 };
 
+// running total of heap allocations made for line storage (loader and
+// batch threads allocate lines too)
+static atomic_long line_allocations = 0;
+
+static void
+line_allocated(void)
+{
+    atomic_fetch_add_explicit(&line_allocations, 1, memory_order_relaxed);
+}
+
+// Make sure the line has a block of its own with room for capacity
+// chars. Shared text is copied out first, so nobody else sees the edit.
+static int
+line_reserve(struct line* line, long capacity)
+{
+    assert(!line_frozen(line));
+
+    bool owned = line->text != NULL && line->text->refs == 1 && line->buf == line->text->buf;
+    if (owned && capacity <= line->capacity) return LINE_OK;
+
+    if (owned) {
+        struct line_text* grown = realloc(line->text, sizeof(struct line_text) + capacity);
+        if (grown == NULL) return LINE_ERROR;
+        line_allocated();
+        line->text = grown;
+        line->buf = grown->buf;
+        line->capacity = capacity;
+        return LINE_OK;
+    }
+
+    struct line_text* text = malloc(sizeof(struct line_text) + capacity);
+    if (text == NULL) return LINE_ERROR;
+    line_allocated();
+    text->refs = 1;
+    if (line->size > 0) memcpy(text->buf, line->buf, line->size);
+
+    if (line->text != NULL) line_text_release(line->text);
+    line->text = text;
+    line->buf = text->buf;
+    line->capacity = capacity;
+
+    return LINE_OK;
+}
+
 int
 line_init(struct line* line)
 {
     assert(line != NULL);
 
-    line->capacity = LINE_DEFAULT_CAPACITY;
+    line->capacity = 0;
     line->size = 0;
-    line->buf = malloc(LINE_DEFAULT_CAPACITY);
-    if (line->buf == NULL) {
+    line->buf = NULL;
+    line->text = NULL;
+    if (line_reserve(line, LINE_DEFAULT_CAPACITY) != LINE_OK) {
         fprintf(stderr, "line: failed to allocate initial buffer\n");
         return LINE_ERROR;
     }
@@ -27,11 +82,28 @@ line_init(struct line* line)
     return LINE_OK;
 }
 
+// A new empty line of its own, not linked to anything (or NULL when out
+// of memory)
+struct line*
+line_new(void)
+{
+    struct line* line = calloc(1, sizeof(struct line));
+    if (line == NULL) return NULL;
+    line_allocated();
+
+    if (line_init(line) != LINE_OK) {
+        free(line);
+        return NULL;
+    }
+
+    return line;
+}
+
 int
 line_free(struct line* line)
 {
     assert(line != NULL);
-    free(line->buf);
+    if (line->text != NULL) line_text_release(line->text);
     return LINE_OK;
 }
 
@@ -55,6 +127,48 @@ line_append(struct line* line, char c)
     return LINE_OK;
 }
 
+int
+line_append_buf(struct line* line, const char* buf, long size)
+{
+    assert(line != NULL);
+    assert(size >= 0);
+
+    return line_insert_buf(line, line->size, buf, size);
+}
+
+int
+line_insert_buf(struct line* line, long pos, const char* buf, long size)
+{
+    assert(line != NULL);
+    assert(pos >= 0);
+    assert(pos <= line->size);
+    assert(size >= 0);
+
+    // grow the buffer once for the whole run of chars
+    long capacity = MAX(line->capacity, LINE_DEFAULT_CAPACITY);
+    while (capacity < line->size + size) capacity *= LINE_CAPACITY_GROWTH;
+    if (line_reserve(line, capacity) != LINE_OK) return LINE_ERROR;
+
+    memmove(&line->buf[pos + size], &line->buf[pos], line->size - pos);
+    memcpy(&line->buf[pos], buf, size);
+    line->size += size;
+
+    return LINE_OK;
+}
+
+int
+line_truncate(struct line* line, long size)
+{
+    assert(line != NULL);
+    assert(size >= 0);
+    assert(size <= line->size);
+
+    // the chars before size don't change, so shared text can stay shared
+    line->size = size;
+
+    return LINE_OK;
+}
+
 int
 line_insert(struct line* line, long pos, char c)
 {
@@ -63,11 +177,9 @@ line_insert(struct line* line, long pos, char c)
     assert(pos <= line->size); // pos can equal size here to imply inserting at the end
 
     // grow the buffer if current capacity is reached
-    if (line->size >= line->capacity) {
-        line->capacity *= LINE_CAPACITY_GROWTH;
-        line->buf = realloc(line->buf, line->capacity);
-        if (line->buf == NULL) return LINE_ERROR;
-    }
+    long capacity = line->capacity;
+    if (line->size >= capacity) capacity = MAX(capacity * LINE_CAPACITY_GROWTH, LINE_DEFAULT_CAPACITY);
+    if (line_reserve(line, capacity) != LINE_OK) return LINE_ERROR;
 
     // shift buffer contents up
     memmove(&line->buf[pos + 1], &line->buf[pos], line->size - pos);
@@ -86,8 +198,10 @@ line_delete(struct line* line, long pos)
     assert(pos >= 0);
     assert(pos < line->size);
 
+    if (line_reserve(line, line->capacity) != LINE_OK) return LINE_ERROR;
+
     // shift buffer contents down
-    memmove(&line->buf[pos], &line->buf[pos + 1], line->size - pos);
+    memmove(&line->buf[pos], &line->buf[pos + 1], line->size - pos - 1);
     line->size--;
 
     return LINE_OK;
@@ -100,18 +214,12 @@ line_break(struct line* line, long pos)
     assert(pos >= 0);
     assert(pos <= line->size);
 
-    struct line* new = calloc(1, sizeof(struct line));
-    line_init(new);
-
-    // copy rest of existing line into the new one
-    for (long i = pos; i < line->size; i++) {
-        line_append(new, line_get(line, i));
-    }
+    struct line* new = line_new();
+    if (new == NULL) return LINE_ERROR;
 
-    // delete rest of existing line
-    for (long i = line->size - 1; i >= pos; i--) {
-        line_delete(line, i);
-    }
+    // move the rest of the existing line into the new one
+    line_append_buf(new, &line->buf[pos], line->size - pos);
+    line_truncate(line, pos);
 
     // link the new line in
     new->prev = line;
@@ -129,9 +237,7 @@ line_merge(struct line* dest, struct line* src)
     assert(src != NULL);
 
     // append src line to dest line
-    for (long i = 0; i < src->size; i++) {
-        line_append(dest, line_get(src, i));
-    }
+    line_append_buf(dest, src->buf, src->size);
 
     // unlink and free the src line
     if (src->next != NULL) src->next->prev = src->prev;
@@ -156,40 +262,63 @@ lines_init(struct line** head, struct line** tail, long* count, const char* path
         return LINE_ERROR;
     }
 
-    // read through each character in the file
-    int c = 0;
+    // read the file in blocks and split each block into lines
+    char block[LINE_READ_BLOCK];
     bool newline = false;
-    while ((c = fgetc(fp)) != EOF) {
-        if (newline) {
-            struct line* line = calloc(1, sizeof(struct line));
-            line_init(line);
+    long n = 0;
+    while ((n = fread(block, 1, sizeof(block), fp)) > 0) {
+        if (lines_append(tail, count, &newline, block, n) != LINE_OK) {
+            fclose(fp);
+            return LINE_ERROR;
+        }
+    }
+
+    if (ferror(fp)) {
+        fprintf(stderr, "IO error while reading file: %s\n", path);
+        fclose(fp);
+        return LINE_ERROR;
+    }
+
+    fclose(fp);
+    return LINE_OK;
+}
+
+int
+lines_append(struct line** tail, long* count, bool* newline, const char* buf, long size)
+{
+    assert(tail != NULL);
+    assert(*tail != NULL);
+    assert(count != NULL);
+    assert(newline != NULL);
+
+    long i = 0;
+    while (i < size) {
+        // only add a line if text comes after the NL (handles trailing NL)
+        if (*newline) {
+            struct line* line = line_new();
+            if (line == NULL) return LINE_ERROR;
             line->prev = *tail;
             (*tail)->next = line;
             *tail = line;
 
-            newline = false;
-            *count++;
+            *newline = false;
+            (*count)++;
         }
 
-        // only add a line if text comes after the NL (handles trailing NL)
-        if (c == '\n') {
-            newline = true;
-        } else if (c == '\t') {
-            line_append(*tail, ' ');
-            line_append(*tail, ' ');
-            line_append(*tail, ' ');
-            line_append(*tail, ' ');
+        // copy everything up to the next NL or tab in one go
+        long j = i;
+        while (j < size && buf[j] != '\n' && buf[j] != '\t') j++;
+        if (line_append_buf(*tail, buf + i, j - i) != LINE_OK) return LINE_ERROR;
+        if (j == size) break;
+
+        if (buf[j] == '\n') {
+            *newline = true;
         } else {
-            line_append(*tail, c);
+            line_append_buf(*tail, "    ", 4);
         }
+        i = j + 1;
     }
 
-    if (ferror(fp)) {
-        fprintf(stderr, "IO error while reading file: %s\n", path);
-        return LINE_ERROR;
-    }
-
-    fclose(fp);
     return LINE_OK;
 }
 
@@ -210,6 +339,100 @@ lines_free(struct line** head, struct line** tail)
     return LINE_OK;
 }
 
+// take a reference to the text of a line (for a register to hold on to)
+struct line_text*
+line_share(const struct line* line)
+{
+    assert(line != NULL);
+    assert(line->text != NULL);
+    assert(!line_frozen(line));
+
+    line->text->refs++;
+    return line->text;
+}
+
+// set up a line showing size chars of shared text starting at buf
+int
+line_init_shared(struct line* line, struct line_text* text, const char* buf, long size)
+{
+    assert(line != NULL);
+    assert(text != NULL);
+
+    text->refs++;
+    line->text = text;
+    line->buf = (char*)buf;
+    line->size = size;
+
+    // nothing past size belongs to this line, so any growth copies
+    line->capacity = size;
+
+    return LINE_OK;
+}
+
+int
+line_text_release(struct line_text* text)
+{
+    assert(text != NULL);
+    assert(text->refs > 0);
+
+    if (--text->refs == 0) free(text);
+    return LINE_OK;
+}
+
+// whether the text of the line is packed away in cold storage
+bool
+line_frozen(const struct line* line)
+{
+    assert(line != NULL);
+    return line->buf == NULL && line->text != NULL;
+}
+
+// rough heap footprint of count lines holding bytes of text in total
+long
+lines_memory(long count, long bytes)
+{
+    return count * (long)(sizeof(struct line) + LINE_DEFAULT_CAPACITY) + bytes;
+}
+
+long
+line_allocation_count(void)
+{
+    return atomic_load_explicit(&line_allocations, memory_order_relaxed);
+}
+
+// Write each line and a NL. Frozen runs are unpacked into a scratch
+// buffer one at a time rather than thawed, so saving doesn't warm up
+// the whole buffer.
+static int
+lines_put(const struct line* head, FILE* fp)
+{
+    char* scratch = NULL;
+    long capacity = 0;
+    const struct line* line = head;
+    while (line != NULL) {
+        if (!line_frozen(line)) {
+            fwrite(line->buf, line->size, 1, fp);
+            fputc('\n', fp);
+            line = line->next;
+            continue;
+        }
+
+        const struct line_text* text = line->text;
+        if (cold_read(text, &scratch, &capacity) != COLD_OK) {
+            free(scratch);
+            return LINE_ERROR;
+        }
+        for (long offset = 0; line != NULL && line->text == text; line = line->next) {
+            fwrite(scratch + offset, line->size, 1, fp);
+            fputc('\n', fp);
+            offset += line->size;
+        }
+    }
+
+    free(scratch);
+    return LINE_OK;
+}
+
 int
 lines_write(const struct line* head, const char* path)
 {
@@ -219,11 +442,64 @@ lines_write(const struct line* head, const char* path)
         return LINE_ERROR;
     }
 
-    for (const struct line* line = head; line != NULL; line = line->next) {
-        fwrite(line->buf, line->size, 1, fp);
-        fputc('\n', fp);
+    if (lines_put(head, fp) != LINE_OK) {
+        fclose(fp);
+        return LINE_ERROR;
     }
 
     fclose(fp);
     return LINE_OK;
 }
+
+// Write the lines to a temp file next to path and rename it into place,
+// so the file is only ever seen whole: either the old or the new one.
+int
+lines_save(const struct line* head, const char* path)
+{
+    assert(path != NULL);
+
+    // renaming over a symlink would replace the link, so write through it
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) return lines_write(head, path);
+
+    long size = strlen(path) + sizeof(".XXXXXX");
+    char* temp = malloc(size);
+    if (temp == NULL) return LINE_ERROR;
+    snprintf(temp, size, "%s.XXXXXX", path);
+
+    int fd = mkstemp(temp);
+    FILE* fp = fd != -1 ? fdopen(fd, "w") : NULL;
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open output file: %s\n", temp);
+        if (fd != -1) {
+            close(fd);
+            unlink(temp);
+        }
+        free(temp);
+        return LINE_ERROR;
+    }
+
+    // mkstemp files are private, keep the mode of the file being replaced
+    if (stat(path, &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    setvbuf(fp, NULL, _IOFBF, LINE_WRITE_BUFFER);
+    bool ok = lines_put(head, fp) == LINE_OK;
+
+    // the data has to be on disk before the rename makes it visible
+    ok = ok && fflush(fp) == 0 && !ferror(fp) && fsync(fd) == 0;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "failed to save file: %s\n", path);
+        unlink(temp);
+    }
+
+    free(temp);
+    return ok ? LINE_OK : LINE_ERROR;
+}
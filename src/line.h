@@ -1,12 +1,26 @@
 #ifndef DERZVIM_LINE_H_INLCLUDED
 #define DERZVIM_LINE_H_INLCLUDED
 
+#include <stdbool.h>
+
+// The text of a line lives in a reference counted block, so that it can
+// be shared with registers (see yank.c) without copying. A shared block
+// is read-only: the first edit through any line copies it.
+struct line_text {
+    long refs;
+    char buf[];
+};
+
 struct line {
     struct line* prev;
     struct line* next;
     long capacity;
     long size;
     char* buf;
+
+    // buf points somewhere into text (lines without one own nothing). A
+    // frozen line (see cold.h) has no buf and its text is packed away.
+    struct line_text* text;
 };
 
 enum line_status {
@@ -14,20 +28,36 @@ enum line_status {
     LINE_ERROR,
 };
 
+struct line* line_new(void);
 int line_init(struct line* line);
 int line_free(struct line* line);
 
 char line_get(const struct line* line, long index);
 int line_append(struct line* line, char c);
+int line_append_buf(struct line* line, const char* buf, long size);
 int line_insert(struct line* line, long pos, char c);
 int line_delete(struct line* line, long pos);
 
+int line_insert_buf(struct line* line, long pos, const char* buf, long size);
+int line_truncate(struct line* line, long size);
+
 int line_break(struct line* line, long pos);
 int line_merge(struct line* dest, struct line* src);
 
 int lines_init(struct line** head, struct line** tail, long* count, const char* path);
+int lines_append(struct line** tail, long* count, bool* newline, const char* buf, long size);
 int lines_free(struct line** head, struct line** tail);
 
 int lines_write(const struct line* head, const char* path);
+int lines_save(const struct line* head, const char* path);
+
+long lines_memory(long count, long bytes);
+
+struct line_text* line_share(const struct line* line);
+int line_init_shared(struct line* line, struct line_text* text, const char* buf, long size);
+int line_text_release(struct line_text* text);
+bool line_frozen(const struct line* line);
+
+long line_allocation_count(void);
 
 #endif
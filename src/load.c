@@ -0,0 +1,300 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cold.h"
+#include "line.h"
+#include "load.h"
+#include "stats.h"
+#include "words.h"
+
+enum {
+    LOAD_FIRST_CHUNK = 64 * 1024,
+    LOAD_CHUNK = 8 * 1024 * 1024,
+    LOAD_BLOCK = 1024 * 1024,
+    LOAD_MAX_THREADS = 8,
+};
+
+// find where the first line starting at or after pos begins
+static long
+load_chunk_begin(struct load* l, long pos, char* block)
+{
+    if (pos == 0) return 0;
+
+    char prev = 0;
+    if (pread(l->fd, &prev, 1, pos - 1) != 1) return -1;
+    if (prev == '\n') return pos;
+
+    while (pos < l->size) {
+        long n = pread(l->fd, block, LOAD_BLOCK, pos);
+        if (n <= 0) return n == 0 ? l->size : -1;
+
+        char* nl = memchr(block, '\n', n);
+        if (nl != NULL) return pos + (nl - block) + 1;
+        pos += n;
+    }
+
+    return l->size;
+}
+
+static int
+load_chunk_parse(struct load* l, struct load_chunk* c, char* block, bool cold)
+{
+    long pos = load_chunk_begin(l, c->start, block);
+    if (pos < 0) return LOAD_ERROR;
+
+    // an empty file still has its one empty line
+    bool empty = pos >= c->end || pos >= l->size;
+    if (empty && c->start != 0) return LOAD_OK;
+
+    c->head = line_new();
+    if (c->head == NULL) return LOAD_ERROR;
+    c->tail = c->head;
+    c->count = 1;
+
+    bool newline = false;
+    while (pos < l->size) {
+        long n = pread(l->fd, block, LOAD_BLOCK, pos);
+        if (n < 0) return LOAD_ERROR;
+        if (n == 0) break;
+
+        // stop after the NL that ends the last line starting in range
+        long feed = n;
+        bool last = false;
+        if (pos + n >= c->end) {
+            long from = c->end - 1 - pos > 0 ? c->end - 1 - pos : 0;
+            char* nl = memchr(block + from, '\n', n - from);
+            if (nl != NULL) {
+                feed = nl - block + 1;
+                last = true;
+            }
+        }
+
+        if (lines_append(&c->tail, &c->count, &newline, block, feed) != LINE_OK) {
+            return LOAD_ERROR;
+        }
+
+        pos += feed;
+        if (last) break;
+    }
+
+    if (words_add_lines(&c->words, c->head, c->count) != WORDS_OK) return LOAD_ERROR;
+
+    // packing is done here too, so the editor never holds the text warm
+    if (cold && cold_pack(c->head, c->count) != COLD_OK) return LOAD_ERROR;
+
+    return LOAD_OK;
+}
+
+static void*
+load_worker(void* arg)
+{
+    struct load* l = arg;
+
+    char* block = malloc(LOAD_BLOCK);
+
+    for (;;) {
+        pthread_mutex_lock(&l->mutex);
+        long index = -1;
+        if (!l->cancel && l->claimed < l->chunk_count) index = l->claimed++;
+        bool cold = l->cold;
+        pthread_mutex_unlock(&l->mutex);
+        if (index < 0) break;
+
+        struct load_chunk* c = &l->chunks[index];
+        bool failed = block == NULL || load_chunk_parse(l, c, block, cold) != LOAD_OK;
+
+        pthread_mutex_lock(&l->mutex);
+        c->done = true;
+        c->failed = failed;
+        pthread_cond_broadcast(&l->cond);
+        pthread_mutex_unlock(&l->mutex);
+    }
+
+    free(block);
+    return NULL;
+}
+
+int
+load_init(struct load* l, const char* path)
+{
+    assert(l != NULL);
+    assert(path != NULL);
+
+    memset(l, 0, sizeof(*l));
+    l->started = stats_now();
+
+    l->fd = open(path, O_RDONLY);
+    if (l->fd == -1) {
+        fprintf(stderr, "failed to open file: %s\n", path);
+        return LOAD_ERROR;
+    }
+
+    struct stat st;
+    if (fstat(l->fd, &st) == -1) {
+        fprintf(stderr, "failed to stat file: %s\n", path);
+        close(l->fd);
+        return LOAD_ERROR;
+    }
+    l->size = st.st_size;
+
+    // one small chunk up front, then big ones for throughput
+    l->chunk_count = 1;
+    if (l->size > LOAD_FIRST_CHUNK) {
+        l->chunk_count += (l->size - LOAD_FIRST_CHUNK + LOAD_CHUNK - 1) / LOAD_CHUNK;
+    }
+
+    l->chunks = calloc(l->chunk_count, sizeof(struct load_chunk));
+    if (l->chunks == NULL) {
+        close(l->fd);
+        return LOAD_ERROR;
+    }
+
+    for (long i = 0; i < l->chunk_count; i++) {
+        struct load_chunk* c = &l->chunks[i];
+        c->start = i == 0 ? 0 : LOAD_FIRST_CHUNK + (i - 1) * LOAD_CHUNK;
+        c->end = i == 0 ? LOAD_FIRST_CHUNK : c->start + LOAD_CHUNK;
+        if (c->end > l->size) c->end = l->size;
+        words_init(&c->words);
+    }
+
+    // an empty file still needs its chunk to produce the empty line
+    if (l->chunks[0].end == 0) l->chunks[0].end = 1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    l->thread_count = cpus > 0 ? cpus : 1;
+    if (l->thread_count > LOAD_MAX_THREADS) l->thread_count = LOAD_MAX_THREADS;
+    if (l->thread_count > l->chunk_count) l->thread_count = l->chunk_count;
+
+    pthread_mutex_init(&l->mutex, NULL);
+    pthread_cond_init(&l->cond, NULL);
+
+    l->threads = calloc(l->thread_count, sizeof(pthread_t));
+    if (l->threads == NULL) {
+        load_free(l);
+        return LOAD_ERROR;
+    }
+
+    for (long i = 0; i < l->thread_count; i++) {
+        if (pthread_create(&l->threads[i], NULL, load_worker, l) != 0) {
+            fprintf(stderr, "failed to start loader thread: %s\n", strerror(errno));
+            l->thread_count = i;
+            break;
+        }
+    }
+
+    if (l->thread_count == 0) {
+        load_free(l);
+        return LOAD_ERROR;
+    }
+
+    return LOAD_OK;
+}
+
+int
+load_free(struct load* l)
+{
+    assert(l != NULL);
+
+    if (l->threads != NULL) {
+        pthread_mutex_lock(&l->mutex);
+        l->cancel = true;
+        pthread_mutex_unlock(&l->mutex);
+
+        for (long i = 0; i < l->thread_count; i++) {
+            pthread_join(l->threads[i], NULL);
+        }
+        free(l->threads);
+        l->threads = NULL;
+    }
+
+    // anything that was parsed but never taken is ours to free
+    for (long i = l->taken; i < l->chunk_count; i++) {
+        struct line* tail = l->chunks[i].tail;
+        lines_free(&l->chunks[i].head, &tail);
+        words_free(&l->chunks[i].words);
+    }
+
+    free(l->chunks);
+    l->chunks = NULL;
+    l->chunk_count = 0;
+
+    pthread_mutex_destroy(&l->mutex);
+    pthread_cond_destroy(&l->cond);
+    close(l->fd);
+
+    return LOAD_OK;
+}
+
+int
+load_take(struct load* l, bool wait, struct line** head, struct line** tail, long* count,
+    struct words* words)
+{
+    assert(l != NULL);
+    assert(head != NULL);
+    assert(tail != NULL);
+    assert(count != NULL);
+
+    if (l->taken >= l->chunk_count) return LOAD_PENDING;
+
+    struct load_chunk* c = &l->chunks[l->taken];
+
+    pthread_mutex_lock(&l->mutex);
+    while (wait && !c->done) pthread_cond_wait(&l->cond, &l->mutex);
+    bool done = c->done;
+    pthread_mutex_unlock(&l->mutex);
+
+    if (!done) return LOAD_PENDING;
+
+    *head = c->head;
+    *tail = c->tail;
+    *count = c->count;
+
+    // the counts of every chunk add up to those of the whole file
+    if (words != NULL) words_merge(words, &c->words);
+    words_free(&c->words);
+
+    c->head = NULL;
+    c->tail = NULL;
+    l->taken++;
+    l->bytes_taken = c->end;
+
+    return c->failed ? LOAD_ERROR : LOAD_OK;
+}
+
+// pack the lines of chunks parsed from now on into cold storage
+int
+load_cold(struct load* l)
+{
+    assert(l != NULL);
+
+    pthread_mutex_lock(&l->mutex);
+    l->cold = true;
+    pthread_mutex_unlock(&l->mutex);
+
+    return LOAD_OK;
+}
+
+bool
+load_done(const struct load* l)
+{
+    assert(l != NULL);
+    return l->taken >= l->chunk_count;
+}
+
+long
+load_progress(const struct load* l)
+{
+    assert(l != NULL);
+
+    if (l->size == 0) return 100;
+    return l->bytes_taken * 100 / l->size;
+}
@@ -0,0 +1,69 @@
+#ifndef DERZVIM_LOAD_H_INCLUDED
+#define DERZVIM_LOAD_H_INCLUDED
+
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#include "line.h"
+#include "words.h"
+
+// A chunk owns every line that starts inside its byte range. Workers
+// build each chunk's lines independently, the owner of the load then
+// takes them back in file order and links them onto its list.
+struct load_chunk {
+    long start;
+    long end;
+
+    struct line* head;
+    struct line* tail;
+    long count;
+
+    // the words in the chunk, counted on the worker too
+    struct words words;
+
+    bool done;
+    bool failed;
+};
+
+// Background loader that splits a file into byte ranges and parses
+// them on worker threads. The first chunk is kept small so the first
+// screen is ready quickly; later chunks are claimed in order so the
+// front of the file finishes before the back.
+struct load {
+    int fd;
+    long size;
+    long started;
+
+    struct load_chunk* chunks;
+    long chunk_count;
+    long claimed;
+    long taken;
+    long bytes_taken;
+    bool cancel;
+
+    // whether workers pack the lines they parse, see cold.h
+    bool cold;
+
+    pthread_t* threads;
+    long thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+enum load_status {
+    LOAD_OK = 0,
+    LOAD_ERROR,
+    LOAD_PENDING,
+};
+
+int load_init(struct load* l, const char* path);
+int load_free(struct load* l);
+
+int load_take(struct load* l, bool wait, struct line** head, struct line** tail, long* count,
+    struct words* words);
+int load_cold(struct load* l);
+bool load_done(const struct load* l);
+long load_progress(const struct load* l);
+
+#endif
@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "macro.h"
+
+enum {
+    MACRO_DEFAULT_CAPACITY = 64,
+    MACRO_CAPACITY_GROWTH = 2,
+};
+
+int
+macro_init(struct macro* m)
+{
+    assert(m != NULL);
+
+    m->keys = NULL;
+    m->count = 0;
+    m->capacity = 0;
+
+    return MACRO_OK;
+}
+
+int
+macro_free(struct macro* m)
+{
+    assert(m != NULL);
+
+    free(m->keys);
+    macro_init(m);
+
+    return MACRO_OK;
+}
+
+int
+macro_clear(struct macro* m)
+{
+    assert(m != NULL);
+
+    // keep the storage around for the next recording
+    m->count = 0;
+
+    return MACRO_OK;
+}
+
+int
+macro_append(struct macro* m, int key)
+{
+    assert(m != NULL);
+
+    if (m->count >= m->capacity) {
+        long capacity = m->capacity > 0 ? m->capacity * MACRO_CAPACITY_GROWTH : MACRO_DEFAULT_CAPACITY;
+        int* keys = realloc(m->keys, capacity * sizeof(int));
+        if (keys == NULL) {
+            fprintf(stderr, "macro: failed to grow key list\n");
+            return MACRO_ERROR;
+        }
+        m->keys = keys;
+        m->capacity = capacity;
+    }
+
+    m->keys[m->count++] = key;
+    return MACRO_OK;
+}
+
+// the register index for a name (a to z), or -1
+long
+macro_register(char name)
+{
+    if (name >= 'a' && name <= 'z') return name - 'a';
+    return -1;
+}
@@ -0,0 +1,29 @@
+#ifndef DERZVIM_MACRO_H_INCLUDED
+#define DERZVIM_MACRO_H_INCLUDED
+
+enum {
+    // one macro for each of a to z
+    MACRO_REGISTER_COUNT = 26,
+};
+
+// the keys recorded into one register, exactly as they were processed
+struct macro {
+    int* keys;
+    long count;
+    long capacity;
+};
+
+enum macro_status {
+    MACRO_OK = 0,
+    MACRO_ERROR,
+};
+
+int macro_init(struct macro* m);
+int macro_free(struct macro* m);
+
+int macro_clear(struct macro* m);
+int macro_append(struct macro* m, int key);
+
+long macro_register(char name);
+
+#endif
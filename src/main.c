@@ -4,9 +4,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include "batch.h"
+#include "command.h"
 #include "editor.h"
 #include "line.h"
 #include "term.h"
@@ -14,22 +17,162 @@
 // TODO delete key
 // TODO tabs
 
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-f] [-z] [file | -] [file ...]\n", prog);
+    fprintf(stderr, "       %s -d [-z] file file\n", prog);
+    fprintf(stderr, "       %s -s script [-j threads] [file ...]\n", prog);
+}
+
+// -s: run an ex script over every file (listed one per line on stdin
+// when none are given) without a terminal, like vim -es
+static int
+batch_main(const char* script_path, long threads, char** paths, long count)
+{
+    FILE* fp = fopen(script_path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open script: %s\n", script_path);
+        return EXIT_FAILURE;
+    }
+
+    char* text = NULL;
+    size_t text_size = 0;
+    FILE* mem = open_memstream(&text, &text_size);
+    char block[4096];
+    long n = 0;
+    while ((n = fread(block, 1, sizeof(block), fp)) > 0) fwrite(block, 1, n, mem);
+    fclose(mem);
+    fclose(fp);
+
+    struct command_script script = { 0 };
+    command_script_init(&script);
+    const char* error = NULL;
+    long error_line = 0;
+    if (command_parse(&script, text, text_size, &error, &error_line) != COMMAND_OK) {
+        fprintf(stderr, "%s: line %ld: %s\n", script_path, error_line, error);
+        free(text);
+        return EXIT_FAILURE;
+    }
+    free(text);
+
+    // read the list of files from stdin if there are none on the command line
+    char* line = NULL;
+    size_t line_capacity = 0;
+    long capacity = count;
+    char** list = NULL;
+    if (count == 0) {
+        long size = 0;
+        while ((size = getline(&line, &line_capacity, stdin)) > 0) {
+            if (line[size - 1] == '\n') line[--size] = '\0';
+            if (size == 0) continue;
+            if (count >= capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 64;
+                list = realloc(list, capacity * sizeof(char*));
+            }
+            list[count++] = strdup(line);
+        }
+        free(line);
+        paths = list;
+    }
+
+    struct batch_file* files = calloc(count > 0 ? count : 1, sizeof(struct batch_file));
+    for (long i = 0; i < count; i++) files[i].path = paths[i];
+
+    long start = stats_now();
+    int status = batch_run(&script, files, count, threads);
+    batch_report(stdout, files, count, stats_now() - start);
+
+    for (long i = 0; list != NULL && i < count; i++) free(list[i]);
+    free(list);
+    free(files);
+    command_script_free(&script);
+
+    return status == BATCH_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int
 main(int argc, char* argv[])
 {
+    bool follow = false;
+    bool cold = false;
+    bool diff = false;
+    const char* script = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "dfzs:j:")) != -1) {
+        switch (opt) {
+            case 'd': diff = true; break;
+            case 'f': follow = true; break;
+            case 'z': cold = true; break;
+            case 's': script = optarg; break;
+            case 'j': threads = atol(optarg); break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (script != NULL) {
+        return batch_main(script, threads > 0 ? threads : 1, &argv[optind], argc - optind);
+    }
+
     char* path = NULL;
-    if (argc == 2) {
-        path = argv[1];
+    if (optind < argc) {
+        path = argv[optind];
+    }
+
+    // "-" reads the buffer from a pipe and keys from the terminal
+    bool stream = path != NULL && strcmp(path, "-") == 0;
+    if ((follow && (path == NULL || stream)) || (diff && (argc - optind != 2 || stream))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int input_fd = STDIN_FILENO;
+    if (stream) {
+        path = NULL;
+        input_fd = open("/dev/tty", O_RDWR);
+        if (input_fd == -1) {
+            fprintf(stderr, "failed to open terminal: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
     }
 
     struct editor e = { 0 };
-    if (editor_init(&e, STDIN_FILENO, STDOUT_FILENO, path) != EDITOR_OK) {
+    if (editor_init(&e, input_fd, STDOUT_FILENO, path) != EDITOR_OK) {
         fprintf(stderr, "failed to init editor\n");
         return EXIT_FAILURE;
     }
 
+    // DERZVIM_STATS=<path> collects frame stats and dumps them on exit
+    const char* stats_path = getenv("DERZVIM_STATS");
+    if (stats_path != NULL) stats_enable(&e.stats, stats_path);
+
+    // the other files are only read once they are first shown (:bn)
+    for (int i = optind + 1; i < argc; i++) editor_buffer_add(&e, argv[i]);
+
+    // DERZVIM_BUFFER_BUDGET=<MB> caps the memory used by hidden buffers
+    const char* budget = getenv("DERZVIM_BUFFER_BUDGET");
+    if (budget != NULL) e.buffer_budget = atol(budget) * 1024 * 1024;
+
+    // -z keeps the text of lines away from the cursor compressed
+    if (cold) editor_cold_enable(&e);
+
+    // -d shows the second file next to the first, lined up on a diff
+    if (diff && editor_diff(&e, 1) != EDITOR_OK) {
+        editor_free(&e);
+        fprintf(stderr, "failed to diff %s and %s\n", argv[optind], argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+
+    // -f follows a growing file like tail -f (also toggled with ctrl-f)
+    if (follow) editor_follow_toggle(&e);
+    if (stream) editor_stream(&e, STDIN_FILENO);
+
     bool running = true;
-    while (running) {
+    while (running && !e.quit) {
         // draw current editor state to the terminal
         editor_draw(&e);
 
@@ -45,46 +188,8 @@ main(int argc, char* argv[])
             case CTRL_KEY('q'):
                 running = false;
                 break;
-            case KEY_ARROW_LEFT:
-                editor_cursor_left(&e);
-                break;
-            case KEY_ARROW_RIGHT:
-                editor_cursor_right(&e);
-                break;
-            case KEY_ARROW_UP:
-                editor_cursor_up(&e);
-                break;
-            case KEY_ARROW_DOWN:
-                editor_cursor_down(&e);
-                break;
-            case KEY_HOME:
-                editor_cursor_home(&e);
-                break;
-            case KEY_END:
-                editor_cursor_end(&e);
-                break;
-            case KEY_PAGE_UP:
-                editor_cursor_page_up(&e);
-                break;
-            case KEY_PAGE_DOWN:
-                editor_cursor_page_down(&e);
-                break;
-            case KEY_ENTER:
-                editor_line_break(&e);
-                break;
-            case KEY_BACKSPACE:
-                editor_rune_delete(&e);
-                break;
-            // TODO: handle this in a less naive way
-            case '\t':
-                editor_rune_insert(&e, ' ');
-                editor_rune_insert(&e, ' ');
-                editor_rune_insert(&e, ' ');
-                editor_rune_insert(&e, ' ');
-                break;
             default:
-                if (c < 32 || c > 126) break;
-                editor_rune_insert(&e, c);
+                editor_key_process(&e, c);
                 break;
         }
     }
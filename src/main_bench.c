@@ -0,0 +1,307 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "editor.h"
+#include "line.h"
+#include "term.h"
+
+// Replays keystroke scripts against a headless editor and reports how
+// long each key took (input, dispatch and redraw) and how many bytes
+// each redraw emitted. Scripts are raw terminal input, exactly what a
+// recording of a real session would contain.
+
+struct bench_options {
+    long lines;
+    long width;
+    long height;
+};
+
+struct bench_scenario {
+    const char* name;
+    void (*script)(FILE* fp, const struct bench_options* opts);
+};
+
+static const char BENCH_TEXT[] = "the quick brown fox jumps over the lazy dog";
+
+static void
+bench_script_typing(FILE* fp, const struct bench_options* opts)
+{
+    for (long i = 0; i < 200; i++) {
+        fputs(BENCH_TEXT, fp);
+        fputc(KEY_ENTER, fp);
+    }
+}
+
+static void
+bench_script_paste(FILE* fp, const struct bench_options* opts)
+{
+    // a paste is just one big burst of keys with CRs for the newlines
+    for (long i = 0; i < 64 * 1024 / (long)sizeof(BENCH_TEXT); i++) {
+        fputs(BENCH_TEXT, fp);
+        fputc(KEY_ENTER, fp);
+    }
+}
+
+static void
+bench_script_scroll(FILE* fp, const struct bench_options* opts)
+{
+    for (long i = 0; i < 5000; i++) fputs("\033[B", fp);
+    for (long i = 0; i < 5000; i++) fputs("\033[A", fp);
+}
+
+static void
+bench_script_page_down(FILE* fp, const struct bench_options* opts)
+{
+    long pages = opts->lines / (opts->height - 1) + 1;
+    for (long i = 0; i < pages; i++) fputs("\033[6~", fp);
+}
+
+static void
+bench_script_page_down_wrap(FILE* fp, const struct bench_options* opts)
+{
+    fputc(CTRL_KEY('w'), fp);
+    bench_script_page_down(fp, opts);
+}
+
+static void
+bench_script_macro(FILE* fp, const struct bench_options* opts)
+{
+    // record "insert a char at the start and go down", then run it over
+    // every line with a single :@ (the replay stops at the last line)
+    fputc(CTRL_KEY('r'), fp);
+    fputc('a', fp);
+    fputs("\033[Hx\033[B", fp);
+    fputc(CTRL_KEY('r'), fp);
+    fputc(KEY_ESCAPE, fp);
+    fprintf(fp, ":%ld@a", opts->lines);
+    fputc(KEY_ENTER, fp);
+}
+
+static void
+bench_script_complete(FILE* fp, const struct bench_options* opts)
+{
+    // start a word on a new line and complete it from the whole file
+    for (long i = 0; i < 200; i++) {
+        fputs("qu", fp);
+        fputc(CTRL_KEY('n'), fp);
+        fputc(CTRL_KEY('n'), fp);
+        fputc(KEY_ENTER, fp);
+    }
+}
+
+static const struct bench_scenario BENCH_SCENARIOS[] = {
+    { "typing",         bench_script_typing },
+    { "paste",          bench_script_paste },
+    { "scroll",         bench_script_scroll },
+    { "page-down",      bench_script_page_down },
+    { "page-down-wrap", bench_script_page_down_wrap },
+    { "macro",          bench_script_macro },
+    { "complete",       bench_script_complete },
+};
+
+static long
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int
+bench_compare_long(const void* a, const void* b)
+{
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static long
+bench_percentile(const long* sorted, long count, long pct)
+{
+    if (count == 0) return 0;
+    long index = (count - 1) * pct / 100;
+    return sorted[index];
+}
+
+static bool
+bench_file_generate(const char* path, long lines)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) return false;
+
+    // vary the lengths a bit so that wrapping has something to do
+    for (long i = 0; i < lines; i++) {
+        fprintf(fp, "%08ld %s", i, BENCH_TEXT);
+        for (long j = 0; j < i % 5; j++) fprintf(fp, " %s", BENCH_TEXT);
+        fputc('\n', fp);
+    }
+
+    return fclose(fp) == 0;
+}
+
+static bool
+bench_run(const char* name, const char* script_path, const struct bench_options* opts)
+{
+    char file_path[] = "/tmp/derzvim_bench_file_XXXXXX";
+    char output_path[] = "/tmp/derzvim_bench_output_XXXXXX";
+
+    int file_fd = mkstemp(file_path);
+    int output_fd = mkstemp(output_path);
+    int input_fd = open(script_path, O_RDONLY);
+    if (file_fd == -1 || output_fd == -1 || input_fd == -1) {
+        fprintf(stderr, "bench: failed to set up files: %s\n", strerror(errno));
+        return false;
+    }
+    close(file_fd);
+
+    struct stat st;
+    fstat(input_fd, &st);
+    long script_size = st.st_size;
+
+    if (!bench_file_generate(file_path, opts->lines)) {
+        fprintf(stderr, "bench: failed to generate %s\n", file_path);
+        return false;
+    }
+
+    long load_start = bench_now();
+    struct editor e = { 0 };
+    editor_init_headless(&e, input_fd, output_fd, file_path, opts->width, opts->height);
+    long load_time = bench_now() - load_start;
+
+    editor_draw(&e);
+
+    // one sample per key: latency and bytes emitted by the redraw
+    long capacity = script_size + 1;
+    long* latencies = malloc(capacity * sizeof(long));
+    long* frames = malloc(capacity * sizeof(long));
+    long keys = 0;
+
+    while (lseek(input_fd, 0, SEEK_CUR) < script_size) {
+        long start = bench_now();
+
+        int c = 0;
+        if (editor_key_wait(&e, &c) != EDITOR_OK) break;
+        editor_key_process(&e, c);
+
+        long before = lseek(output_fd, 0, SEEK_CUR);
+        editor_draw(&e);
+        long after = lseek(output_fd, 0, SEEK_CUR);
+
+        latencies[keys] = bench_now() - start;
+        frames[keys] = after - before;
+        keys++;
+
+        // don't let the virtual screen grow without bound
+        if (after > 64 * 1024 * 1024) {
+            ftruncate(output_fd, 0);
+            lseek(output_fd, 0, SEEK_SET);
+        }
+    }
+
+    editor_free(&e);
+
+    qsort(latencies, keys, sizeof(long), bench_compare_long);
+
+    long bytes = 0;
+    long bytes_max = 0;
+    for (long i = 0; i < keys; i++) {
+        bytes += frames[i];
+        if (frames[i] > bytes_max) bytes_max = frames[i];
+    }
+
+    printf("%-16s %9ld %9.1f %9.1f %9.1f %9.1f %9.1f %11ld %11ld\n",
+        name,
+        keys,
+        load_time / 1000000.0,
+        bench_percentile(latencies, keys, 50) / 1000.0,
+        bench_percentile(latencies, keys, 90) / 1000.0,
+        bench_percentile(latencies, keys, 99) / 1000.0,
+        keys > 0 ? latencies[keys - 1] / 1000.0 : 0.0,
+        keys > 0 ? bytes / keys : 0,
+        bytes_max);
+
+    free(latencies);
+    free(frames);
+
+    close(input_fd);
+    close(output_fd);
+    unlink(file_path);
+    unlink(output_path);
+
+    return true;
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-n lines] [-W width] [-H height] [script ...]\n", prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    struct bench_options opts = {
+        .lines = 100000,
+        .width = 80,
+        .height = 24,
+    };
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "n:W:H:")) != -1) {
+        switch (opt) {
+            case 'n': opts.lines = atol(optarg); break;
+            case 'W': opts.width = atol(optarg); break;
+            case 'H': opts.height = atol(optarg); break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.lines < 1 || opts.width < 1 || opts.height < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-16s %9s %9s %9s %9s %9s %9s %11s %11s\n",
+        "scenario", "keys", "load ms", "p50 us", "p90 us", "p99 us", "max us",
+        "bytes/frame", "max bytes");
+
+    bool ok = true;
+
+    // recorded scripts given on the command line replace the built-in ones
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) {
+            ok = bench_run(argv[i], argv[i], &opts) && ok;
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    long num_scenarios = sizeof(BENCH_SCENARIOS) / sizeof(*BENCH_SCENARIOS);
+    for (long i = 0; i < num_scenarios; i++) {
+        const struct bench_scenario* scenario = &BENCH_SCENARIOS[i];
+
+        char script_path[] = "/tmp/derzvim_bench_script_XXXXXX";
+        int fd = mkstemp(script_path);
+        FILE* fp = fd == -1 ? NULL : fdopen(fd, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "bench: failed to create script: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        scenario->script(fp, &opts);
+        fclose(fp);
+
+        ok = bench_run(scenario->name, script_path, &opts) && ok;
+        unlink(script_path);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "line.h"
+
+// Micro-benchmarks for the primitives in line.c. Results are printed
+// as CSV or JSON (one record per measurement) so they can be collected
+// and compared across versions.
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+enum {
+    BENCH_BATCH = 16,
+    BENCH_CORPUS_MIN = 1024,
+    BENCH_CORPUS_GROWTH = 4,
+};
+
+enum bench_format {
+    BENCH_FORMAT_CSV = 0,
+    BENCH_FORMAT_JSON,
+};
+
+struct bench_options {
+    int format;
+    long max_bytes;
+    long ops;
+};
+
+struct bench_result {
+    const char* name;
+    const char* variant;
+    long param;
+    long ops;
+    long bytes;
+    long nanos;
+};
+
+static const char BENCH_TEXT[] = "the quick brown fox jumps over the lazy dog\n";
+
+static long bench_results_written = 0;
+
+static long
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void
+bench_report(const struct bench_options* opts, const struct bench_result* r)
+{
+    double ns_per_op = r->ops > 0 ? (double)r->nanos / r->ops : 0.0;
+    double mb_per_s = r->nanos > 0 ? (r->bytes / 1048576.0) / (r->nanos / 1e9) : 0.0;
+
+    if (opts->format == BENCH_FORMAT_JSON) {
+        printf("%s\n  {\"name\": \"%s\", \"variant\": \"%s\", \"param\": %ld, "
+            "\"ops\": %ld, \"bytes\": %ld, \"ns\": %ld, \"ns_per_op\": %.2f, "
+            "\"mb_per_s\": %.2f}",
+            bench_results_written == 0 ? "[" : ",",
+            r->name, r->variant, r->param, r->ops, r->bytes, r->nanos, ns_per_op, mb_per_s);
+    } else {
+        if (bench_results_written == 0) {
+            printf("name,variant,param,ops,bytes,ns,ns_per_op,mb_per_s\n");
+        }
+        printf("%s,%s,%ld,%ld,%ld,%ld,%.2f,%.2f\n",
+            r->name, r->variant, r->param, r->ops, r->bytes, r->nanos, ns_per_op, mb_per_s);
+    }
+
+    fflush(stdout);
+    bench_results_written++;
+}
+
+static void
+bench_finish(const struct bench_options* opts)
+{
+    if (opts->format != BENCH_FORMAT_JSON) return;
+    printf("%s]\n", bench_results_written == 0 ? "[" : "\n");
+}
+
+static void
+bench_line_fill(struct line* line, long size)
+{
+    line_init(line);
+    for (long i = 0; i < size; i++) {
+        line_append(line, 'a' + i % 26);
+    }
+}
+
+static long
+bench_position(const char* variant, long size)
+{
+    if (strcmp(variant, "start") == 0) return 0;
+    if (strcmp(variant, "middle") == 0) return size / 2;
+    return size;
+}
+
+static void
+bench_insert_delete(const struct bench_options* opts)
+{
+    static const long sizes[] = { 80, 1024, 64 * 1024 };
+    static const char* const positions[] = { "start", "middle", "end" };
+
+    for (long s = 0; s < (long)(sizeof(sizes) / sizeof(*sizes)); s++) {
+        for (long p = 0; p < (long)(sizeof(positions) / sizeof(*positions)); p++) {
+            struct line line = { 0 };
+            bench_line_fill(&line, sizes[s]);
+
+            // alternate small batches of inserts and deletes so that the
+            // line length stays close to the target without timing every op
+            long pos = bench_position(positions[p], sizes[s]);
+
+            long insert_nanos = 0;
+            long delete_nanos = 0;
+            for (long i = 0; i < opts->ops; i += BENCH_BATCH) {
+                long start = bench_now();
+                for (long j = 0; j < BENCH_BATCH; j++) line_insert(&line, pos, 'x');
+                long middle = bench_now();
+                for (long j = 0; j < BENCH_BATCH; j++) line_delete(&line, pos);
+                long end = bench_now();
+
+                insert_nanos += middle - start;
+                delete_nanos += end - middle;
+            }
+
+            long ops = (opts->ops + BENCH_BATCH - 1) / BENCH_BATCH * BENCH_BATCH;
+            struct bench_result r = { "line_insert", positions[p], sizes[s], ops, 0, insert_nanos };
+            bench_report(opts, &r);
+            r.name = "line_delete";
+            r.nanos = delete_nanos;
+            bench_report(opts, &r);
+
+            line_free(&line);
+        }
+    }
+}
+
+static void
+bench_break_merge(const struct bench_options* opts)
+{
+    static const long sizes[] = { 80, 1024, 64 * 1024 };
+
+    for (long s = 0; s < (long)(sizeof(sizes) / sizeof(*sizes)); s++) {
+        struct line line = { 0 };
+        bench_line_fill(&line, sizes[s]);
+
+        // big lines are slow to split, so scale the op count down
+        long ops = opts->ops / (sizes[s] / 80);
+        if (ops < 10) ops = 10;
+
+        long break_nanos = 0;
+        long merge_nanos = 0;
+        for (long i = 0; i < ops; i++) {
+            long start = bench_now();
+            line_break(&line, sizes[s] / 2);
+            long middle = bench_now();
+            line_merge(&line, line.next);
+            long end = bench_now();
+
+            break_nanos += middle - start;
+            merge_nanos += end - middle;
+        }
+
+        struct bench_result r = { "line_break", "middle", sizes[s], ops, 0, break_nanos };
+        bench_report(opts, &r);
+        r.name = "line_merge";
+        r.nanos = merge_nanos;
+        bench_report(opts, &r);
+
+        line_free(&line);
+    }
+}
+
+static bool
+bench_corpus_generate(const char* path, long bytes)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) return false;
+
+    // write in big blocks so generating multi-GB corpora stays quick
+    char block[64 * 1024];
+    long text = sizeof(BENCH_TEXT) - 1;
+    for (long i = 0; i < (long)sizeof(block); i++) block[i] = BENCH_TEXT[i % text];
+
+    for (long written = 0; written < bytes;) {
+        long n = bytes - written < (long)sizeof(block) ? bytes - written : (long)sizeof(block);
+        if (fwrite(block, 1, n, fp) != (size_t)n) {
+            fclose(fp);
+            return false;
+        }
+        written += n;
+    }
+
+    return fclose(fp) == 0;
+}
+
+static void
+bench_load_save(const struct bench_options* opts)
+{
+    char input_path[] = "/tmp/derzvim_line_bench_in_XXXXXX";
+    char output_path[] = "/tmp/derzvim_line_bench_out_XXXXXX";
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    if (input_fd == -1 || output_fd == -1) {
+        fprintf(stderr, "bench: failed to create temp files: %s\n", strerror(errno));
+        return;
+    }
+    close(input_fd);
+    close(output_fd);
+
+    // corpora grow by 4x from 1 KB, the last one is the configured maximum
+    long bytes = MIN(BENCH_CORPUS_MIN, opts->max_bytes);
+    for (;;) {
+        if (!bench_corpus_generate(input_path, bytes)) {
+            fprintf(stderr, "bench: failed to generate %ld byte corpus\n", bytes);
+            break;
+        }
+
+        struct line* head = calloc(1, sizeof(struct line));
+        line_init(head);
+        struct line* tail = head;
+        long count = 1;
+
+        long start = bench_now();
+        lines_init(&head, &tail, &count, input_path);
+        long loaded = bench_now();
+        lines_write(head, output_path);
+        long saved = bench_now();
+        lines_free(&head, &tail);
+        long freed = bench_now();
+
+        struct bench_result r = { "lines_init", "corpus", bytes, count, bytes, loaded - start };
+        bench_report(opts, &r);
+        r.name = "lines_write";
+        r.nanos = saved - loaded;
+        bench_report(opts, &r);
+        r.name = "lines_free";
+        r.nanos = freed - saved;
+        bench_report(opts, &r);
+
+        if (bytes == opts->max_bytes) break;
+        bytes = MIN(bytes * BENCH_CORPUS_GROWTH, opts->max_bytes);
+    }
+
+    unlink(input_path);
+    unlink(output_path);
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-f csv|json] [-m max_bytes] [-n ops]\n", prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    struct bench_options opts = {
+        .format = BENCH_FORMAT_CSV,
+        .max_bytes = 64L * 1024 * 1024,
+        .ops = 100000,
+    };
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "f:m:n:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (strcmp(optarg, "json") == 0) {
+                    opts.format = BENCH_FORMAT_JSON;
+                } else if (strcmp(optarg, "csv") == 0) {
+                    opts.format = BENCH_FORMAT_CSV;
+                } else {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm': opts.max_bytes = atol(optarg); break;
+            case 'n': opts.ops = atol(optarg); break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.ops < 1 || opts.max_bytes < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench_insert_delete(&opts);
+    bench_break_merge(&opts);
+    bench_load_save(&opts);
+    bench_finish(&opts);
+
+    return EXIT_SUCCESS;
+}
@@ -1,15 +1,1210 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "cold.h"
+#include "command.h"
+#include "diff.h"
+#include "editor.h"
+#include "fold.h"
+#include "follow.h"
+#include "line.h"
+#include "load.h"
+#include "sort.h"
+#include "split.h"
+#include "syntax.h"
+#include "term.h"
+#include "words.h"
+#include "wrap.h"
+#include "yank.h"
 
 typedef bool(*test_func)(void);
 
 bool test_foo(void) { return true; }
 bool test_bar(void) { return false; }
 
+bool
+test_wrap_find(void)
+{
+    struct wrap w = { 0 };
+    wrap_init(&w);
+
+    // three lines of 5, 25 and 0 chars at width 10: rows 1, 3 and 1
+    struct line lines[3] = { 0 };
+    lines[0].size = 5;
+    lines[1].size = 25;
+    lines[2].size = 0;
+    lines[0].next = &lines[1];
+    lines[1].next = &lines[2];
+    wrap_build(&w, &lines[0], 3, 10);
+
+    bool ok = true;
+    long offset = 0;
+    ok = ok && wrap_total(&w) == 5;
+    ok = ok && wrap_row(&w, 2) == 4;
+    ok = ok && wrap_find(&w, 0, &offset) == 0 && offset == 0;
+    ok = ok && wrap_find(&w, 3, &offset) == 1 && offset == 2;
+    ok = ok && wrap_find(&w, 4, &offset) == 2 && offset == 0;
+
+    // growing a line shifts every row after it
+    wrap_update(&w, 0, 15);
+    ok = ok && wrap_row(&w, 2) == 5;
+
+    // inserting a line shifts the rows after it
+    wrap_insert(&w, 1, 30);
+    ok = ok && wrap_row(&w, 2) == 6;
+    ok = ok && wrap_find(&w, 5, &offset) == 1 && offset == 3;
+
+    wrap_remove(&w, 1);
+    ok = ok && wrap_total(&w) == 6;
+
+    // enough inserts in one place to split blocks, and removes to drop them
+    for (long i = 0; i < 3 * WRAP_BLOCK; i++) wrap_insert(&w, 1, 10);
+    ok = ok && w.block_count > 1 && wrap_total(&w) == 6 + 6 * WRAP_BLOCK;
+    ok = ok && wrap_row(&w, 3 * WRAP_BLOCK + 2) == 5 + 6 * WRAP_BLOCK;
+    ok = ok && wrap_find(&w, 2 * WRAP_BLOCK + 3, &offset) == WRAP_BLOCK + 1 && offset == 1;
+    for (long i = 0; i < 3 * WRAP_BLOCK; i++) wrap_remove(&w, 1);
+    ok = ok && wrap_total(&w) == 6 && wrap_find(&w, 4, &offset) == 1 && offset == 2;
+
+    // many lines at once cut the block and fill new ones in between
+    struct line many[3 * WRAP_BLOCK] = { 0 };
+    for (long i = 0; i < 3 * WRAP_BLOCK; i++) {
+        many[i].size = 10;
+        if (i > 0) many[i - 1].next = &many[i];
+    }
+    wrap_insert_lines(&w, 1, many, 3 * WRAP_BLOCK);
+    ok = ok && w.count == 3 + 3 * WRAP_BLOCK && wrap_total(&w) == 6 + 6 * WRAP_BLOCK;
+    ok = ok && wrap_row(&w, 3 * WRAP_BLOCK + 2) == 5 + 6 * WRAP_BLOCK;
+    ok = ok && wrap_find(&w, 2 * WRAP_BLOCK + 3, &offset) == WRAP_BLOCK + 1 && offset == 1;
+
+    wrap_free(&w);
+    return ok;
+}
+
+bool
+test_syntax_cache(void)
+{
+    const char* text[] = { "int a; /* open", "still comment", "done */ int b;", "int c;" };
+    struct line lines[4] = { 0 };
+    for (long i = 0; i < 4; i++) {
+        lines[i].buf = (char*)text[i];
+        lines[i].size = strlen(text[i]);
+        if (i > 0) lines[i].prev = &lines[i - 1];
+        if (i < 3) lines[i].next = &lines[i + 1];
+    }
+
+    struct syntax s = { 0 };
+    syntax_init(&s, "test.c");
+
+    bool ok = true;
+    unsigned char* classes = NULL;
+
+    // highlighting the last line has to lex everything above it first
+    ok = ok && syntax_sync(&s, &lines[3], 3) == SYNTAX_OK && s.valid == 3;
+    ok = ok && syntax_highlight(&s, &lines[2], 2, &classes) == SYNTAX_OK;
+    ok = ok && classes[0] == SYNTAX_CLASS_COMMENT && classes[9] == SYNTAX_CLASS_TYPE;
+
+    // an edit that keeps the end state converges without touching later lines
+    syntax_highlight(&s, &lines[3], 3, &classes);
+    ok = ok && s.valid == 4;
+    syntax_line_changed(&s, 1);
+    ok = ok && s.valid == 1 && s.known == 4;
+    ok = ok && syntax_sync(&s, &lines[2], 2) == SYNTAX_OK && s.valid == 4;
+
+    // breaking a line keeps the states below it, so re-lexing the two
+    // halves converges again at the old end state
+    struct line half = { .buf = (char*)text[0] + 6, .size = 8, .prev = &lines[0], .next = &lines[1] };
+    lines[0].size = 6;
+    lines[0].next = &half;
+    lines[1].prev = &half;
+    syntax_line_split(&s, 0, 1);
+    ok = ok && s.valid == 0 && s.known == 5;
+    ok = ok && syntax_sync(&s, &lines[2], 3) == SYNTAX_OK && s.valid == 5;
+
+    syntax_free(&s);
+    return ok;
+}
+
+bool
+test_syntax_far(void)
+{
+    static struct line lines[3000];
+    for (long i = 0; i < 3000; i++) {
+        lines[i].buf = "int b;";
+        lines[i].size = 6;
+        lines[i].prev = i > 0 ? &lines[i - 1] : NULL;
+        lines[i].next = i < 2999 ? &lines[i + 1] : NULL;
+    }
+
+    // stateless lines need nothing lexed above the one shown
+    struct syntax s = { 0 };
+    syntax_init(&s, "test.log");
+    bool ok = syntax_sync(&s, &lines[2999], 2999) == SYNTAX_OK && s.valid == 2999;
+    syntax_free(&s);
+
+    // far down a C file only a bounded stretch above is lexed, on a guess
+    unsigned char* classes = NULL;
+    syntax_init(&s, "test.c");
+    ok = ok && syntax_sync(&s, &lines[2999], 2999) == SYNTAX_OK && s.valid == 0;
+    ok = ok && s.guess > 0 && s.guess < 2999 && s.known == 2999;
+    ok = ok && syntax_highlight(&s, &lines[2999], 2999, &classes) == SYNTAX_OK;
+    ok = ok && classes != NULL && classes[0] == SYNTAX_CLASS_TYPE && s.known == 3000;
+    ok = ok && syntax_sync(&s, &lines[2990], 2990) == SYNTAX_OK && s.known == 3000;
+
+    // lexing down from the top takes over the guess once it agrees
+    for (long i = 400; ok && i <= 2400; i += 400) ok = syntax_sync(&s, &lines[i], i) == SYNTAX_OK;
+    ok = ok && s.valid == 2400;
+    for (long i = 2400; ok && i < 2600; i++) ok = syntax_highlight(&s, &lines[i], i, &classes) == SYNTAX_OK;
+    ok = ok && s.valid == 3000 && s.guess == 0;
+
+    syntax_free(&s);
+    return ok;
+}
+
+bool
+test_load_chunks(void)
+{
+    char path[] = "/tmp/derzvim_test_load_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+
+    // long enough to span several chunks, with tabs and empty lines
+    FILE* fp = fdopen(fd, "w");
+    for (long i = 0; i < 20000; i++) {
+        for (long j = 0; j < i % 37; j++) fputc(j % 7 == 0 ? '\t' : 'a' + j % 26, fp);
+        fputc('\n', fp);
+    }
+    fputs("no trailing newline", fp);
+    fclose(fp);
+
+    struct line* head = calloc(1, sizeof(struct line));
+    line_init(head);
+    struct line* tail = head;
+    long count = 1;
+    lines_init(&head, &tail, &count, path);
+
+    struct load l = { 0 };
+    bool ok = load_init(&l, path) == LOAD_OK;
+
+    // take every chunk and compare it against the serial loader
+    struct line* expected = head;
+    long total = 0;
+    while (ok && !load_done(&l)) {
+        struct line* chunk_head = NULL;
+        struct line* chunk_tail = NULL;
+        long chunk_count = 0;
+        ok = load_take(&l, true, &chunk_head, &chunk_tail, &chunk_count, NULL) == LOAD_OK;
+        for (struct line* line = chunk_head; ok && line != NULL; line = line->next) {
+            ok = expected != NULL && line->size == expected->size;
+            ok = ok && memcmp(line->buf, expected->buf, line->size) == 0;
+            expected = expected->next;
+        }
+        total += chunk_count;
+        lines_free(&chunk_head, &chunk_tail);
+    }
+    ok = ok && expected == NULL && total == count && count == 20001;
+
+    load_free(&l);
+    lines_free(&head, &tail);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_follow_append(void)
+{
+    char path[] = "/tmp/derzvim_test_follow_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    write(fd, "one\ntw", 6);
+
+    struct line* head = calloc(1, sizeof(struct line));
+    line_init(head);
+    struct line* tail = head;
+    long count = 1;
+    lines_init(&head, &tail, &count, path);
+
+    struct follow f = { 0 };
+    bool ok = follow_init(&f, path, 6) == FOLLOW_OK;
+
+    // the partial last line is finished off before new lines are added
+    int events = 0;
+    write(fd, "o\nthree\n", 8);
+    ok = ok && follow_read(&f, &tail, &count, &events) == FOLLOW_OK;
+    ok = ok && count == 3 && events == 0;
+    ok = ok && head->next->size == 3 && memcmp(head->next->buf, "two", 3) == 0;
+    ok = ok && tail->size == 5 && memcmp(tail->buf, "three", 5) == 0;
+
+    // truncating starts over from the top without touching old lines
+    ftruncate(fd, 0);
+    pwrite(fd, "four\n", 5, 0);
+    ok = ok && follow_read(&f, &tail, &count, &events) == FOLLOW_OK;
+    ok = ok && (events & FOLLOW_EVENT_TRUNCATED) && count == 4;
+    ok = ok && tail->size == 4 && memcmp(tail->buf, "four", 4) == 0;
+
+    follow_free(&f);
+    lines_free(&head, &tail);
+    close(fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_diff_hunks(void)
+{
+    struct diff d = { 0 };
+    diff_init(&d);
+
+    const uint64_t a[] = { 1, 2, 3, 4, 5, 6 };
+    const uint64_t b[] = { 1, 9, 3, 4, 6, 7 };
+    bool ok = diff_compute(&d, a, 6, b, 6) == DIFF_OK && d.count == 3;
+    ok = ok && d.hunks[0].a_start == 1 && d.hunks[0].a_count == 1 && d.hunks[0].b_count == 1;
+    ok = ok && d.hunks[1].a_start == 4 && d.hunks[1].a_count == 1 && d.hunks[1].b_count == 0;
+    ok = ok && d.hunks[2].a_start == 6 && d.hunks[2].a_count == 0 && d.hunks[2].b_count == 1;
+
+    // random edits: applying the hunks to a has to give back b
+    uint64_t x[200];
+    uint64_t y[200];
+    uint64_t z[400];
+    srand(1);
+    for (long round = 0; ok && round < 200; round++) {
+        long n = rand() % 200;
+        long m = rand() % 200;
+        for (long i = 0; i < n; i++) x[i] = rand() % 8;
+        for (long i = 0; i < m; i++) y[i] = rand() % 8;
+        ok = diff_compute(&d, x, n, y, m) == DIFF_OK;
+
+        long size = 0;
+        long pos = 0;
+        for (long i = 0; ok && i < d.count; i++) {
+            const struct diff_hunk* h = &d.hunks[i];
+            while (pos < h->a_start) z[size++] = x[pos++];
+            for (long j = 0; j < h->b_count; j++) z[size++] = y[h->b_start + j];
+            pos += h->a_count;
+        }
+        while (pos < n) z[size++] = x[pos++];
+        ok = ok && size == m && memcmp(z, y, m * sizeof(uint64_t)) == 0;
+    }
+
+    diff_free(&d);
+    return ok;
+}
+
+bool
+test_command_script(void)
+{
+    struct line* head = calloc(1, sizeof(struct line));
+    line_init(head);
+    struct line* tail = head;
+    long count = 1;
+    bool newline = false;
+    lines_append(&tail, &count, &newline, "a\nbob\nc\nd\n", 10);
+
+    const char text[] = "%s/b/B/g\n2,3d\n0a\ntop\n.\n$a end\n/^a/s/a/x&\\0/\n";
+    struct command_script script = { 0 };
+    command_script_init(&script);
+    const char* error = NULL;
+    long error_line = 0;
+    bool ok = command_parse(&script, text, sizeof(text) - 1, &error, &error_line) == COMMAND_OK;
+
+    struct command_buffer b = { 0 };
+    command_buffer_init(&b, head, tail, count);
+    ok = ok && command_run(&script, &b, &error) == COMMAND_OK && error == NULL;
+
+    const char* expected[] = { "top", "xaa", "d", "end" };
+    struct line* line = b.head;
+    for (long i = 0; ok && i < 4; i++, line = line->next) {
+        ok = line != NULL && line->size == (long)strlen(expected[i]);
+        ok = ok && memcmp(line->buf, expected[i], line->size) == 0;
+    }
+    ok = ok && line == NULL && b.count == 4 && b.modified && b.first_changed == 0;
+
+    lines_free(&b.head, &b.tail);
+    command_script_free(&script);
+    return ok;
+}
+
+bool
+test_batch_run(void)
+{
+    // a few files on a few workers, which all allocate lines at once
+    char paths[3][40];
+    struct batch_file files[3] = { 0 };
+    for (long i = 0; i < 3; i++) {
+        strcpy(paths[i], "/tmp/derzvim_test_batch_XXXXXX");
+        int fd = mkstemp(paths[i]);
+        if (fd == -1) return false;
+        FILE* fp = fdopen(fd, "w");
+        for (long j = 0; j < 1000 * (i + 1); j++) fprintf(fp, "b%ld\n", j);
+        fclose(fp);
+        files[i].path = paths[i];
+    }
+
+    const char text[] = "%s/b/x/\n1d\nw\n";
+    struct command_script script = { 0 };
+    command_script_init(&script);
+    const char* error = NULL;
+    long error_line = 0;
+    bool ok = command_parse(&script, text, sizeof(text) - 1, &error, &error_line) == COMMAND_OK;
+    ok = ok && batch_run(&script, files, 3, 3) == BATCH_OK;
+
+    for (long i = 0; i < 3; i++) {
+        ok = ok && files[i].saved && files[i].error == NULL && files[i].lines == 1000 * (i + 1) - 1;
+
+        char buf[8] = { 0 };
+        FILE* fp = fopen(paths[i], "r");
+        ok = ok && fp != NULL && fread(buf, 1, 6, fp) == 6 && strcmp(buf, "x1\nx2\n") == 0;
+        if (fp != NULL) fclose(fp);
+        unlink(paths[i]);
+    }
+
+    command_script_free(&script);
+    return ok;
+}
+
+bool
+test_buffer_switch(void)
+{
+    char a[] = "/tmp/derzvim_test_buffer_a_XXXXXX";
+    char b[] = "/tmp/derzvim_test_buffer_b_XXXXXX";
+    int a_fd = mkstemp(a);
+    int b_fd = mkstemp(b);
+    if (a_fd == -1 || b_fd == -1) return false;
+    write(a_fd, "a1\na2\na3\n", 9);
+    write(b_fd, "b1\n", 3);
+    close(a_fd);
+    close(b_fd);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, a, 80, 24);
+    editor_command(&e, "1,2fold");
+    editor_cursor_down(&e);
+    editor_command(&e, "k a");
+    editor_cursor_right(&e);
+
+    // with no budget at all the untouched buffer is dropped on switching
+    e.buffer_budget = 0;
+    char command[64];
+    snprintf(command, sizeof(command), "e %s", b);
+    bool ok = editor_command(&e, command) == EDITOR_OK;
+    ok = ok && e.buffer_count == 2 && e.buffer_current == 1 && !e.buffers[0].loaded;
+    ok = ok && e.buffer->line->size == 2 && memcmp(e.buffer->line->buf, "b1", 2) == 0;
+    editor_rune_insert(&e, 'x');
+
+    // it comes back with the cursor where it was, the edited one stays
+    ok = ok && editor_command(&e, "bn") == EDITOR_OK && e.buffer_current == 0;
+    ok = ok && e.buffer->line_index == 2 && e.buffer->line_pos == 1 && memcmp(e.buffer->line->buf, "a3", 2) == 0;
+
+    // and so do its marks and folds, on the lines read in again
+    struct line* line = NULL;
+    long index = 0;
+    long pos = 0;
+    ok = ok && mark_get(&e.buffer->marks, mark_name('a'), &line, &index, &pos) == MARK_OK;
+    ok = ok && index == 2 && line == e.buffer->line;
+    ok = ok && e.buffer->folds.count == 1 && e.buffer->folds.ranges[0].first == e.buffer->head;
+    ok = ok && e.buffer->folds.ranges[0].last == e.buffer->head->next;
+    ok = ok && e.buffers[1].loaded && e.buffers[1].modified;
+    ok = ok && editor_command(&e, "b 2") == EDITOR_OK && e.buffer->line_pos == 1;
+    ok = ok && e.buffer->line->size == 3 && memcmp(e.buffer->line->buf, "xb1", 3) == 0;
+    editor_free(&e);
+
+    char text[8] = { 0 };
+    int fd = open(b, O_RDONLY);
+    ok = ok && read(fd, text, sizeof(text)) == 4 && memcmp(text, "xb1\n", 4) == 0;
+
+    close(fd);
+    close(null_fd);
+    unlink(a);
+    unlink(b);
+    return ok;
+}
+
+bool
+test_macro_replay(void)
+{
+    char path[] = "/tmp/derzvim_test_macro_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    for (long i = 0; i < 1000; i++) fprintf(fp, "line %ld\n", i);
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // record "x at the start, then down" into a
+    const int keys[] = { CTRL_KEY('r'), 'a', KEY_HOME, 'x', KEY_ARROW_DOWN, CTRL_KEY('r') };
+    for (long i = 0; i < (long)(sizeof(keys) / sizeof(*keys)); i++) editor_key_process(&e, keys[i]);
+    bool ok = e.recording == -1 && e.macros[0].count == 3 && e.buffer->line_index == 1;
+
+    // far more runs than lines: it stops when down fails on the last line
+    ok = ok && editor_command(&e, "5000@a") == EDITOR_ERROR && e.buffer->line_index == 999;
+    long marked = 0;
+    for (struct line* line = e.buffer->head; line != NULL; line = line->next) {
+        if (line->size > 0 && line->buf[0] == 'x') marked++;
+    }
+    ok = ok && marked == 1000 && e.buffer->line_count == 1000;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+static bool
+test_line_is(const struct line* line, const char* text)
+{
+    return line != NULL && line->size == (long)strlen(text) && memcmp(line->buf, text, line->size) == 0;
+}
+
+// write each block into the pipe once the last one has been read out of
+// it, then press a key
+static void*
+test_stream_feed(void* arg)
+{
+    const int* fds = arg;
+    const char* blocks[] = { "one\ntw", "o\nthree" };
+    for (long i = 0; i < 2; i++) {
+        write(fds[0], blocks[i], strlen(blocks[i]));
+        int pending = 0;
+        while (ioctl(fds[0], FIONREAD, &pending) == 0 && pending > 0) {
+            nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+        }
+    }
+    write(fds[1], "q", 1);
+    return NULL;
+}
+
+bool
+test_stream_blocks(void)
+{
+    int stream[2];
+    int keys[2];
+    if (pipe(stream) == -1) return false;
+    if (pipe(keys) == -1) return false;
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, keys[0], null_fd, NULL, 80, 24);
+    bool ok = editor_stream(&e, stream[0]) == EDITOR_OK;
+
+    // the pipe is read between keys, and "two" comes in two blocks
+    int fds[2] = { stream[1], keys[1] };
+    pthread_t feeder;
+    ok = ok && pthread_create(&feeder, NULL, test_stream_feed, fds) == 0;
+    int c = 0;
+    ok = ok && editor_key_wait(&e, &c) == EDITOR_OK && c == 'q';
+    pthread_join(feeder, NULL);
+
+    // the last line is there without a newline after it
+    ok = ok && e.buffer->streaming && e.buffer->line_count == 3 && e.buffer->stream_bytes == 13;
+    ok = ok && test_line_is(e.buffer->head, "one") && test_line_is(e.buffer->head->next, "two");
+    ok = ok && e.buffer->tail == e.buffer->head->next->next && test_line_is(e.buffer->tail, "three");
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    for (long i = 0; i < 2; i++) {
+        close(stream[i]);
+        close(keys[i]);
+    }
+    return ok;
+}
+
+bool
+test_yank_share(void)
+{
+    struct line* head = calloc(1, sizeof(struct line));
+    line_init(head);
+    struct line* tail = head;
+    long count = 1;
+    bool newline = false;
+    lines_append(&tail, &count, &newline, "one\ntwo\nthree", 13);
+
+    // yanking and putting lines shares their text
+    struct yank y = { 0 };
+    yank_init(&y);
+    long added = 0;
+    long bytes = 0;
+    long shared = 0;
+    bool ok = yank_lines(&y, head, 2) == YANK_OK && y.count == 2;
+    ok = ok && yank_put_lines(&y, &head, &tail, tail, &added) == YANK_OK && added == 2;
+    ok = ok && count + added == 5 && test_line_is(tail, "two") && tail->buf == head->next->buf;
+    ok = ok && yank_memory(&y, &bytes, &shared) == YANK_OK && bytes == 6 && shared == 6;
+
+    // until one of them is edited
+    line_insert(tail, 0, 't');
+    ok = ok && test_line_is(tail, "ttwo") && test_line_is(head->next, "two");
+    ok = ok && tail->buf != head->next->buf;
+
+    // charwise text from "e" in one to "th" in three, put into ttwo
+    struct yank c = { 0 };
+    yank_init(&c);
+    ok = ok && yank_chars(&c, head, 2, head->next->next, 2) == YANK_OK && c.count == 3;
+    ok = ok && yank_put_chars(&c, &tail, tail, 1, &added) == YANK_OK && added == 2;
+    const char* expected[] = { "one", "two", "three", "one", "te", "two", "thtwo" };
+    struct line* line = head;
+    for (long i = 0; ok && i < 7; i++, line = line->next) ok = test_line_is(line, expected[i]);
+    ok = ok && line == NULL && test_line_is(tail, "thtwo");
+
+    // the register keeps the text alive after everything else is gone
+    lines_free(&head, &tail);
+    yank_free(&y);
+    ok = ok && yank_memory(&c, &bytes, &shared) == YANK_OK && bytes == 6 && shared == 0;
+    ok = ok && memcmp(c.slices[1].buf, "two", 3) == 0;
+
+    yank_free(&c);
+    return ok;
+}
+
+bool
+test_put_lines(void)
+{
+    char path[] = "/tmp/derzvim_test_put_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "{\n");
+    for (long i = 1; i < 999; i++) fprintf(fp, "%*ld\n", (int)(i * 37 % 250), i);
+    fprintf(fp, "}\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // get every index going before the lines are put
+    bool ok = editor_command(&e, "2,601y") == EDITOR_OK;
+    ok = ok && editor_wrap_toggle(&e) == EDITOR_OK;
+    editor_command(&e, "1");
+    editor_key_process(&e, CTRL_KEY(']'));
+    ok = ok && e.buffer->line_index == 999;
+    editor_command(&e, "700");
+    editor_command(&e, "k a");
+
+    // far more lines than fit in a wrap block or a bracket chunk
+    editor_command(&e, "300");
+    ok = ok && editor_put(&e) == EDITOR_OK && e.buffer->line_count == 1600 && e.buffer->line_index == 300;
+    ok = ok && e.buffer->line->size == 37 && e.buffer->line->buf[36] == '1';
+
+    struct wrap w = { 0 };
+    wrap_init(&w);
+    wrap_build(&w, e.buffer->head, e.buffer->line_count, e.width);
+    ok = ok && e.buffer->wrap.count == w.count && wrap_total(&e.buffer->wrap) == wrap_total(&w);
+    for (long i = 0; ok && i < e.buffer->line_count; i += 7) ok = wrap_row(&e.buffer->wrap, i) == wrap_row(&w, i);
+    wrap_free(&w);
+
+    struct line* line = NULL;
+    long index = 0;
+    long pos = 0;
+    ok = ok && mark_get(&e.buffer->marks, mark_name('a'), &line, &index, &pos) == MARK_OK && index == 1299;
+    editor_command(&e, "1");
+    editor_key_process(&e, CTRL_KEY(']'));
+    ok = ok && e.buffer->line_index == 1599;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_words_complete(void)
+{
+    char path[] = "/tmp/derzvim_test_words_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "alpha alpha alphabet\nalps beta\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // the most frequent match first, ties in order, then back to "al"
+    const int keys[] = { KEY_ARROW_DOWN, KEY_END, ' ', 'a', 'l', CTRL_KEY('n') };
+    for (long i = 0; i < (long)(sizeof(keys) / sizeof(*keys)); i++) editor_key_process(&e, keys[i]);
+    bool ok = test_line_is(e.buffer->line, "alps beta alpha") && e.buffer->line_pos == 15;
+    editor_key_process(&e, CTRL_KEY('n'));
+    ok = ok && test_line_is(e.buffer->line, "alps beta alphabet");
+    editor_key_process(&e, CTRL_KEY('n'));
+    ok = ok && test_line_is(e.buffer->line, "alps beta alps");
+    editor_key_process(&e, CTRL_KEY('n'));
+    ok = ok && test_line_is(e.buffer->line, "alps beta al");
+
+    // edits keep the counts the same as counting from scratch
+    const int edits[] = { 'x', KEY_ENTER, 'b', 'e', KEY_HOME, KEY_BACKSPACE, KEY_BACKSPACE,
+        KEY_ARROW_UP, KEY_END, ' ', 'b', 'e', 't', CTRL_KEY('k') };
+    for (long i = 0; i < (long)(sizeof(edits) / sizeof(*edits)); i++) editor_key_process(&e, edits[i]);
+    struct words fresh = { 0 };
+    words_build(&fresh, e.buffer->head, e.buffer->line_count);
+    const char* prefixes[] = { "a", "b", "al" };
+    for (long i = 0; i < 3; i++) {
+        const char* got[WORDS_MATCH_MAX];
+        const char* want[WORDS_MATCH_MAX];
+        long size = strlen(prefixes[i]);
+        long count = words_complete(&e.buffer->words, prefixes[i], size, got, WORDS_MATCH_MAX);
+        ok = ok && count == words_complete(&fresh, prefixes[i], size, want, WORDS_MATCH_MAX);
+        for (long j = 0; ok && j < count; j++) ok = strcmp(got[j], want[j]) == 0;
+    }
+    words_free(&fresh);
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_bracket_match(void)
+{
+    char path[] = "/tmp/derzvim_test_bracket_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "f(a) {\n  x[1];\n}\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // from the open brace to its match and back
+    for (long i = 0; i < 5; i++) editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, CTRL_KEY(']'));
+    bool ok = e.buffer->line_index == 2 && e.buffer->line_pos == 0;
+    editor_key_process(&e, CTRL_KEY(']'));
+    ok = ok && e.buffer->line_index == 0 && e.buffer->line_pos == 5;
+
+    // off a bracket it goes to the one the cursor is inside of
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, KEY_HOME);
+    editor_key_process(&e, CTRL_KEY(']'));
+    ok = ok && e.buffer->line_index == 0 && e.buffer->line_pos == 5;
+
+    // the index follows new lines and merged ones
+    const int edits[] = { KEY_ARROW_DOWN, KEY_HOME, KEY_ENTER, '{', KEY_ENTER, '}', KEY_ARROW_UP,
+        KEY_HOME, KEY_BACKSPACE, KEY_ARROW_UP, KEY_HOME };
+    for (long i = 0; i < (long)(sizeof(edits) / sizeof(*edits)); i++) editor_key_process(&e, edits[i]);
+    for (long i = 0; i < 5; i++) editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, CTRL_KEY(']'));
+    ok = ok && e.buffer->line_index == 3 && e.buffer->line_pos == 0;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_fold_skip(void)
+{
+    char path[] = "/tmp/derzvim_test_fold_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "a\n  b\n  c\nd\n  e\nf\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // a closed fold is one row, motions step over it in one go
+    editor_key_process(&e, CTRL_KEY('z'));
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    bool ok = e.buffer->line_index == 3 && e.buffer->cursor_y == 1;
+
+    // inside a block, the line starting it folds too
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, CTRL_KEY('z'));
+    ok = ok && e.buffer->line_index == 3 && e.buffer->cursor_y == 1;
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    ok = ok && e.buffer->line_index == 5 && e.buffer->cursor_y == 2 && fold_line(&e.buffer->folds, 2) == 5;
+    editor_draw(&e);
+    editor_key_process(&e, KEY_ARROW_UP);
+    editor_key_process(&e, KEY_ARROW_UP);
+    ok = ok && e.buffer->line_index == 0 && e.buffer->cursor_y == 0;
+
+    // the same folds from the indentation, then one over both
+    editor_command(&e, "%foldopen");
+    ok = ok && e.buffer->folds.count == 0;
+    editor_command(&e, "foldindent");
+    ok = ok && e.buffer->folds.count == 2 && fold_row(&e.buffer->folds, 5) == 2;
+    editor_command(&e, "2,5fold");
+    ok = ok && e.buffer->folds.count == 1 && e.buffer->folds.ranges[0].end == 4 && e.buffer->line_index == 0;
+
+    // a line broken off inside a fold opens it
+    editor_key_process(&e, KEY_END);
+    editor_key_process(&e, KEY_ENTER);
+    ok = ok && e.buffer->folds.count == 0 && e.buffer->line_index == 1 && e.buffer->cursor_y == 1;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_mark_follow(void)
+{
+    char path[] = "/tmp/derzvim_test_mark_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "one\ntwo\nthree\nfour\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // mark the r in three, then jump away from it
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_command(&e, "k a");
+    editor_command(&e, "1");
+
+    // breaking and joining lines above it moves it down and back up
+    editor_key_process(&e, 'x');
+    editor_key_process(&e, KEY_ENTER);
+    struct line* line = NULL;
+    long index = 0;
+    long pos = 0;
+    bool ok = mark_get(&e.buffer->marks, mark_name('a'), &line, &index, &pos) == MARK_OK
+        && index == 3 && pos == 2 && test_line_is(line, "three");
+    editor_key_process(&e, KEY_BACKSPACE);
+    editor_command(&e, "'a");
+    ok = ok && e.buffer->line_index == 2 && e.buffer->line_pos == 2;
+
+    // typing in front of it on its line moves it along
+    editor_key_process(&e, 'a');
+    editor_key_process(&e, 'b');
+    editor_command(&e, "'a");
+    ok = ok && e.buffer->line_index == 2 && e.buffer->line_pos == 4;
+
+    // ctrl-o goes back through the jumps, ctrl-t forward again
+    editor_key_process(&e, CTRL_KEY('o'));
+    ok = ok && e.buffer->line_index == 0 && e.buffer->line_pos == 1;
+    editor_key_process(&e, CTRL_KEY('o'));
+    ok = ok && e.buffer->line_index == 2 && e.buffer->line_pos == 4;
+    ok = ok && editor_key_process(&e, CTRL_KEY('o')) == EDITOR_ERROR;
+    editor_key_process(&e, CTRL_KEY('t'));
+    ok = ok && e.buffer->line_index == 0 && e.buffer->line_pos == 1;
+    editor_key_process(&e, CTRL_KEY('t'));
+    ok = ok && e.buffer->line_index == 2 && e.buffer->line_pos == 4;
+    ok = ok && editor_key_process(&e, CTRL_KEY('t')) == EDITOR_ERROR;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_cold_pack(void)
+{
+    // text that repeats itself packs small and comes back the same
+    char text[4096];
+    for (long i = 0; i < (long)sizeof(text); i++) text[i] = "static int x;\n"[i % 14];
+    char packed[4096 + 64];
+    char unpacked[4096];
+    long size = cold_compress(text, sizeof(text), packed);
+    bool ok = size < (long)sizeof(text) / 10
+        && cold_decompress(packed, size, unpacked, sizeof(unpacked)) == COLD_OK
+        && memcmp(unpacked, text, sizeof(text)) == 0;
+
+    // a few blocks worth of lines
+    char path[] = "/tmp/derzvim_test_cold_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    for (long i = 1; i <= 10000; i++) fprintf(fp, "line %05ld of the file\n", i);
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+    while (e.loading) editor_key_process(&e, KEY_PAGE_DOWN);
+    editor_command(&e, "1");
+    editor_cold_enable(&e);
+
+    // only the run the cursor is in stays unpacked
+    ok = ok && !line_frozen(e.buffer->line) && line_frozen(e.buffer->tail);
+
+    // editing a packed line thaws it first
+    editor_command(&e, "5000");
+    ok = ok && line_frozen(e.buffer->line);
+    editor_key_process(&e, 'x');
+    ok = ok && test_line_is(e.buffer->line, "xline 05000 of the file");
+
+    // saving reads packed lines without thawing them
+    editor_command(&e, "w");
+    ok = ok && line_frozen(e.buffer->tail);
+    fp = fopen(path, "r");
+    char buf[64];
+    for (long i = 1; ok && i <= 10000; i++) {
+        char want[64];
+        snprintf(want, sizeof(want), "%sline %05ld of the file\n", i == 5000 ? "x" : "", i);
+        ok = fgets(buf, sizeof(buf), fp) != NULL && strcmp(buf, want) == 0;
+    }
+    ok = ok && fgets(buf, sizeof(buf), fp) == NULL;
+    fclose(fp);
+
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+// the file as test_file_reload rewrites it: lines 5001 to 5010 gone,
+// three new ones after 8000 and 9500 changed
+static void
+test_reload_text(FILE* fp, bool rewritten)
+{
+    for (long i = 1; i <= 10000; i++) {
+        if (rewritten && i > 5000 && i <= 5010) continue;
+        if (rewritten && i == 9500) fprintf(fp, "changed\n");
+        else fprintf(fp, "line %05ld of the file\n", i);
+        if (rewritten && i == 8000) fprintf(fp, "new a\nnew b\nnew c\n");
+    }
+}
+
+bool
+test_file_reload(void)
+{
+    char path[] = "/tmp/derzvim_test_reload_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    test_reload_text(fp, false);
+    fclose(fp);
+
+    int keys[2];
+    if (pipe(keys) == -1) return false;
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, keys[0], null_fd, path, 80, 24);
+    while (e.loading) editor_key_process(&e, KEY_PAGE_DOWN);
+    editor_cold_enable(&e);
+    editor_wrap_toggle(&e);
+
+    // one mark below every hunk, one on a line that goes away
+    editor_command(&e, "9000");
+    editor_command(&e, "k a");
+    editor_command(&e, "5005");
+    editor_command(&e, "k b");
+    editor_command(&e, "1");
+
+    fp = fopen(path, "w");
+    test_reload_text(fp, true);
+    fclose(fp);
+
+    // the reload happens while waiting for a key
+    write(keys[1], "q", 1);
+    int c = 0;
+    bool ok = editor_key_wait(&e, &c) == EDITOR_OK && c == 'q';
+    ok = ok && e.buffer->line_count == 9993 && !e.buffer->modified && wrap_total(&e.buffer->wrap) == 9993;
+
+    // the marks are still on their lines (which may be packed)
+    struct line* at = e.buffer->head;
+    for (long i = 0; i < 5000; i++) at = at->next;
+    editor_command(&e, "'b");
+    ok = ok && e.buffer->line_index == 5000 && e.buffer->line == at;
+    for (long i = 5000; i < 8992; i++) at = at->next;
+    editor_command(&e, "'a");
+    ok = ok && e.buffer->line_index == 8992 && e.buffer->line == at;
+
+    // the packed runs the hunks cut through still hold the right text
+    editor_command(&e, "w");
+    fp = fopen(path, "r");
+    FILE* want = tmpfile();
+    test_reload_text(want, true);
+    rewind(want);
+    char buf[64];
+    char line[64];
+    while (ok && fgets(line, sizeof(line), want) != NULL) {
+        ok = fgets(buf, sizeof(buf), fp) != NULL && strcmp(buf, line) == 0;
+    }
+    ok = ok && fgets(buf, sizeof(buf), fp) == NULL;
+    fclose(want);
+    fclose(fp);
+
+    editor_free(&e);
+    close(null_fd);
+    close(keys[0]);
+    close(keys[1]);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_cursors_block(void)
+{
+    char path[] = "/tmp/derzvim_test_cursors_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "int a;\nint bc;\n\nint d;\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path, 80, 24);
+
+    // ctrl-d twice puts a cursor on each of the first three lines
+    editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, KEY_ARROW_RIGHT);
+    editor_key_process(&e, CTRL_KEY('d'));
+    editor_key_process(&e, CTRL_KEY('d'));
+    bool ok = e.cursors.count == 3 && e.buffer->line_index == 2 && e.buffer->line_pos == 0;
+
+    // typing goes to all of them, on the empty line at its end
+    editor_key_process(&e, 'x');
+    editor_key_process(&e, 'y');
+    editor_key_process(&e, KEY_BACKSPACE);
+    struct line* line = e.buffer->head;
+    ok = ok && test_line_is(line, "intx a;");
+    ok = ok && test_line_is(line->next, "intx bc;");
+    ok = ok && test_line_is(line->next->next, "x");
+    ok = ok && e.buffer->line_pos == 1 && e.buffer->modified;
+
+    // moving along the line keeps them, anything else leaves one
+    editor_key_process(&e, KEY_END);
+    editor_key_process(&e, ';');
+    ok = ok && test_line_is(line, "intx a;;") && test_line_is(line->next, "intx bc;;");
+    editor_key_process(&e, KEY_ARROW_UP);
+    editor_key_process(&e, 'z');
+    ok = ok && e.cursors.count == 0 && test_line_is(line->next, "inztx bc;;");
+
+    // :cu over a range, the cursor staying in its column
+    editor_command(&e, "2,4cu");
+    editor_key_process(&e, KEY_HOME);
+    editor_key_process(&e, '/');
+    ok = ok && e.cursors.count == 3 && e.buffer->line_index == 3;
+    ok = ok && test_line_is(line, "intx a;;") && test_line_is(line->next, "/inztx bc;;");
+    ok = ok && test_line_is(line->next->next, "/x;") && test_line_is(e.buffer->tail, "/int d;");
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path);
+    return ok;
+}
+
+bool
+test_diff_split(void)
+{
+    char path_a[] = "/tmp/derzvim_test_split_a_XXXXXX";
+    char path_b[] = "/tmp/derzvim_test_split_b_XXXXXX";
+    int fd_a = mkstemp(path_a);
+    int fd_b = mkstemp(path_b);
+    if (fd_a == -1 || fd_b == -1) return false;
+    FILE* fp = fdopen(fd_a, "w");
+    fprintf(fp, "a\nb\nc\nd\n");
+    fclose(fp);
+    fp = fdopen(fd_b, "w");
+    fprintf(fp, "a\nx\nc\nd\ne\n");
+    fclose(fp);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    struct editor e = { 0 };
+    editor_init_headless(&e, null_fd, null_fd, path_a, 80, 24);
+
+    // b against x, and e only on the right with a filler next to it
+    char command[64];
+    snprintf(command, sizeof(command), "diffsplit %s", path_b);
+    bool ok = editor_command(&e, command) == EDITOR_OK && e.width == 39;
+    ok = ok && e.split.diff.count == 2;
+    long a = 0;
+    long b = 0;
+    ok = ok && split_line(&e.split, 1, &a, &b) && a == 1 && b == 1;
+    ok = ok && !split_line(&e.split, 2, &a, &b) && a == 2 && b == 2;
+    ok = ok && split_line(&e.split, 4, &a, &b) && a == -1 && b == 4;
+
+    // edits only diff the lines around them again
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, KEY_END);
+    editor_key_process(&e, KEY_BACKSPACE);
+    editor_key_process(&e, 'x');
+    editor_draw(&e);
+    ok = ok && e.split.diff.count == 1 && split_row(&e.split, 3) == 3;
+    editor_key_process(&e, KEY_ARROW_UP);
+    editor_key_process(&e, 'z');
+    editor_key_process(&e, KEY_ARROW_DOWN);
+    editor_key_process(&e, KEY_ENTER);
+    editor_draw(&e);
+    ok = ok && e.split.diff.count == 3 && split_row(&e.split, 4) == 4;
+    ok = ok && split_line(&e.split, 2, &a, &b) && a == 2 && b == -1;
+
+    // showing the other side swaps them over, :diffoff goes back to one
+    editor_command(&e, "bn");
+    editor_draw(&e);
+    ok = ok && e.diffing && e.split.a_count == 5 && e.split.b_count == 5;
+    editor_command(&e, "diffoff");
+    ok = ok && !e.diffing && e.width == 80;
+
+    e.discard = true;
+    editor_free(&e);
+    close(null_fd);
+    unlink(path_a);
+    unlink(path_b);
+    return ok;
+}
+
+bool
+test_split_pending(void)
+{
+    struct line* a = calloc(1, sizeof(struct line));
+    struct line* b = calloc(1, sizeof(struct line));
+    line_init(a);
+    line_init(b);
+    struct line* a_tail = a;
+    struct line* b_tail = b;
+    long a_count = 1;
+    long b_count = 1;
+    bool a_newline = false;
+    bool b_newline = false;
+    for (long i = 0; i < 20; i++) {
+        char text[16];
+        long size = snprintf(text, sizeof(text), "line %ld\n", i);
+        lines_append(&a_tail, &a_count, &a_newline, text, size);
+        lines_append(&b_tail, &b_count, &b_newline, text, size);
+    }
+
+    struct split s = { 0 };
+    split_init(&s);
+    bool ok = split_build(&s, a, a_count, b, b_count) == SPLIT_OK && s.diff.count == 0;
+
+    // edit line 15, then join lines 5 and 6 above it before syncing
+    struct line* line = a;
+    for (long i = 0; i < 15; i++) line = line->next;
+    line_insert(line, 0, 'x');
+    split_change(&s, 15, 16);
+    line = a;
+    for (long i = 0; i < 5; i++) line = line->next;
+    line_merge(line, line->next);
+    a_count--;
+    split_remove(&s, 6, 1);
+
+    // both hunks show up, the edit now being on line 14
+    ok = ok && s.start == 5 && s.end == 15;
+    ok = ok && split_sync(&s, a, 0, a_count) == SPLIT_OK && s.diff.count == 2;
+    ok = ok && s.diff.hunks[1].a_start == 14 && s.diff.hunks[1].b_start == 15;
+
+    // and the same going the other way, breaking the joined line again
+    // above another edit
+    line_insert(line->next->next, 0, 'y');
+    split_change(&s, 7, 8);
+    line_break(line, 6);
+    a_count++;
+    split_insert(&s, 6, 1);
+    ok = ok && s.start == 5 && s.end == 9;
+    ok = ok && split_sync(&s, a, 0, a_count) == SPLIT_OK && s.diff.count == 2;
+    ok = ok && s.diff.hunks[0].a_start == 8 && s.diff.hunks[1].a_start == 15;
+
+    split_free(&s);
+    lines_free(&a, &a_tail);
+    lines_free(&b, &b_tail);
+    return ok;
+}
+
+bool
+test_sort_lines(void)
+{
+    struct line* head = calloc(1, sizeof(struct line));
+    line_init(head);
+    struct line* tail = head;
+    long count = 1;
+    bool newline = false;
+    lines_append(&tail, &count, &newline, "b10\na\nc2\nb2\na\nz\n", 17);
+
+    const char text[] = "sort u\nsort! n\ng/2/d\n2,$sort!\nv/^[az]$/d\n";
+    struct command_script script = { 0 };
+    command_script_init(&script);
+    const char* error = NULL;
+    long error_line = 0;
+    bool ok = command_parse(&script, text, sizeof(text) - 1, &error, &error_line) == COMMAND_OK;
+
+    struct command_buffer b = { 0 };
+    command_buffer_init(&b, head, tail, count);
+    ok = ok && command_run(&script, &b, &error) == COMMAND_OK && error == NULL;
+    ok = ok && b.count == 2 && b.head->next == b.tail && b.tail->prev == b.head;
+    ok = ok && test_line_is(b.head, "z") && test_line_is(b.tail, "a") && b.first_changed == 0;
+    lines_free(&b.head, &b.tail);
+    command_script_free(&script);
+
+    // enough lines for a few runs to be sorted apart and merged, with
+    // each number twice to see that equal lines keep their order
+    long n = 150000;
+    struct line* lines = calloc(n, sizeof(struct line));
+    struct line** sorted = malloc(n * sizeof(struct line*));
+    for (long i = 0; i < n; i++) {
+        char buf[32];
+        int size = snprintf(buf, sizeof(buf), "x%ld", (i * 7919) % (n / 2));
+        line_init(&lines[i]);
+        line_append_buf(&lines[i], buf, size);
+        sorted[i] = &lines[i];
+    }
+    ok = ok && sort_lines(sorted, n, SORT_NUMERIC, 4) == SORT_OK;
+    for (long i = 1; ok && i < n; i++) {
+        int order = sort_compare(sorted[i - 1], sorted[i], SORT_NUMERIC);
+        ok = order < 0 || (order == 0 && sorted[i - 1] < sorted[i]);
+    }
+
+    for (long i = 0; i < n; i++) line_free(&lines[i]);
+    free(lines);
+    free(sorted);
+    return ok;
+}
+
 static const test_func TESTS[] = {
     test_foo,
     test_bar,
+    test_wrap_find,
+    test_syntax_cache,
+    test_syntax_far,
+    test_load_chunks,
+    test_follow_append,
+    test_stream_blocks,
+    test_diff_hunks,
+    test_command_script,
+    test_batch_run,
+    test_buffer_switch,
+    test_yank_share,
+    test_put_lines,
+    test_macro_replay,
+    test_words_complete,
+    test_bracket_match,
+    test_fold_skip,
+    test_mark_follow,
+    test_cold_pack,
+    test_file_reload,
+    test_cursors_block,
+    test_diff_split,
+    test_split_pending,
+    test_sort_lines,
 };
 
 int
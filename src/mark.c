@@ -0,0 +1,403 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line.h"
+#include "mark.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// add delta to the gap in front of slot i (and so to the line of every
+// mark from i on)
+static void
+mark_shift(struct mark* m, long i, long delta)
+{
+    if (i >= m->count || delta == 0) return;
+
+    m->gaps[i] += delta;
+    for (long k = i + 1; k <= m->count; k += k & -k) m->tree[k] += delta;
+}
+
+// the line index of the mark in slot i
+static long
+mark_index(const struct mark* m, long i)
+{
+    long index = 0;
+    for (long k = i + 1; k > 0; k -= k & -k) index += m->tree[k];
+    return index;
+}
+
+// the first slot with a mark on line index or below it, or count
+static long
+mark_lower(const struct mark* m, long index)
+{
+    long step = 1;
+    while (step * 2 <= m->count) step *= 2;
+
+    // gaps are never negative, so the prefix sums only go up
+    long i = 0;
+    long left = index;
+    for (; step > 0; step /= 2) {
+        if (i + step <= m->count && m->tree[i + step] < left) {
+            i += step;
+            left -= m->tree[i];
+        }
+    }
+    return i;
+}
+
+// the slots with marks on line index are [*first, return value)
+static long
+mark_line_slots(const struct mark* m, long index, long* first)
+{
+    long i = mark_lower(m, index);
+    *first = i;
+    if (i >= m->count || mark_index(m, i) != index) return i;
+
+    i++;
+    while (i < m->count && m->gaps[i] == 0) i++;
+    return i;
+}
+
+// put the slots, with the line index of each, back in order and redo
+// the gaps, the tree and where every id is
+static void
+mark_rebuild(struct mark* m, long* indices)
+{
+    // insertion sort, the slots are nearly always in order already
+    for (long i = 1; i < m->count; i++) {
+        struct mark_slot slot = m->slots[i];
+        long index = indices[i];
+        long k = i;
+        while (k > 0 && (indices[k - 1] > index || (indices[k - 1] == index && m->slots[k - 1].pos > slot.pos))) {
+            m->slots[k] = m->slots[k - 1];
+            indices[k] = indices[k - 1];
+            k--;
+        }
+        m->slots[k] = slot;
+        indices[k] = index;
+    }
+
+    for (long id = 0; id < MARK_COUNT; id++) m->where[id] = -1;
+    memset(m->tree, 0, sizeof(m->tree));
+    for (long i = 0; i < m->count; i++) {
+        m->where[m->slots[i].id] = i;
+        m->gaps[i] = indices[i] - (i > 0 ? indices[i - 1] : 0);
+
+        // each node adds its own gap and passes the sum on to its parent
+        m->tree[i + 1] += m->gaps[i];
+        long parent = (i + 1) + ((i + 1) & -(i + 1));
+        if (parent <= m->count) m->tree[parent] += m->tree[i + 1];
+    }
+}
+
+// the line index of every slot, in order
+static void
+mark_indices(const struct mark* m, long* indices)
+{
+    long index = 0;
+    for (long i = 0; i < m->count; i++) {
+        index += m->gaps[i];
+        indices[i] = index;
+    }
+}
+
+// the id of entry i of the jump list (0 is the oldest)
+static long
+mark_jump_id(const struct mark* m, long i)
+{
+    return MARK_NAMED + (m->jump_first + i) % MARK_JUMPS;
+}
+
+int
+mark_init(struct mark* m)
+{
+    assert(m != NULL);
+
+    m->count = 0;
+    memset(m->tree, 0, sizeof(m->tree));
+    for (long id = 0; id < MARK_COUNT; id++) m->where[id] = -1;
+
+    m->jump_first = 0;
+    m->jump_count = 0;
+    m->jump_current = 0;
+
+    return MARK_OK;
+}
+
+int
+mark_set(struct mark* m, long id, struct line* line, long index, long pos)
+{
+    assert(m != NULL);
+    assert(id >= 0 && id < MARK_COUNT);
+    assert(line != NULL);
+    assert(index >= 0 && pos >= 0);
+
+    long indices[MARK_COUNT];
+    mark_indices(m, indices);
+
+    long i = m->where[id];
+    if (i < 0) i = m->count++;
+    m->slots[i] = (struct mark_slot){ id, pos, line };
+    indices[i] = index;
+
+    mark_rebuild(m, indices);
+    return MARK_OK;
+}
+
+int
+mark_clear(struct mark* m, long id)
+{
+    assert(m != NULL);
+    assert(id >= 0 && id < MARK_COUNT);
+
+    long i = m->where[id];
+    if (i < 0) return MARK_OK;
+
+    long indices[MARK_COUNT];
+    mark_indices(m, indices);
+    m->count--;
+    memmove(&m->slots[i], &m->slots[i + 1], (m->count - i) * sizeof(struct mark_slot));
+    memmove(&indices[i], &indices[i + 1], (m->count - i) * sizeof(long));
+
+    mark_rebuild(m, indices);
+    return MARK_OK;
+}
+
+int
+mark_get(const struct mark* m, long id, struct line** line, long* index, long* pos)
+{
+    assert(m != NULL);
+    assert(id >= 0 && id < MARK_COUNT);
+
+    long i = m->where[id];
+    if (i < 0) return MARK_ERROR;
+
+    *line = m->slots[i].line;
+    *index = mark_index(m, i);
+    *pos = m->slots[i].pos;
+    return MARK_OK;
+}
+
+// the line index of the last mark, or -1 if there are none
+long
+mark_last(const struct mark* m)
+{
+    assert(m != NULL);
+    return m->count > 0 ? mark_index(m, m->count - 1) : -1;
+}
+
+// the id of the mark named c, or -1
+long
+mark_name(char c)
+{
+    if (c >= 'a' && c <= 'z') return c - 'a';
+    return -1;
+}
+
+// count chars went in at pos on line index: marks from there on move right
+int
+mark_chars_insert(struct mark* m, long index, long pos, long count)
+{
+    assert(m != NULL);
+
+    long first = 0;
+    long end = mark_line_slots(m, index, &first);
+    for (long i = first; i < end; i++) {
+        if (m->slots[i].pos >= pos) m->slots[i].pos += count;
+    }
+
+    return MARK_OK;
+}
+
+// count chars from pos on were deleted from line index: marks on them
+// end up at pos and the ones after them move left
+int
+mark_chars_delete(struct mark* m, long index, long pos, long count)
+{
+    assert(m != NULL);
+
+    long first = 0;
+    long end = mark_line_slots(m, index, &first);
+    for (long i = first; i < end; i++) {
+        struct mark_slot* s = &m->slots[i];
+        if (s->pos >= pos + count) s->pos -= count;
+        else if (s->pos > pos) s->pos = pos;
+    }
+
+    return MARK_OK;
+}
+
+// line index was broken at pos, the rest of it is now next: marks from
+// pos on go with the rest and the marks below move down a line
+int
+mark_line_break(struct mark* m, long index, long pos, struct line* next)
+{
+    assert(m != NULL);
+    assert(next != NULL);
+
+    long first = 0;
+    long end = mark_line_slots(m, index, &first);
+    long moved = first;
+    while (moved < end && m->slots[moved].pos < pos) moved++;
+
+    for (long i = moved; i < end; i++) {
+        m->slots[i].pos -= pos;
+        m->slots[i].line = next;
+    }
+    mark_shift(m, moved, 1);
+
+    return MARK_OK;
+}
+
+// line index was joined onto the end of into, which had size chars:
+// its marks go along and the marks below move up a line
+int
+mark_line_merge(struct mark* m, long index, long size, struct line* into)
+{
+    assert(m != NULL);
+    assert(index > 0);
+    assert(into != NULL);
+
+    long first = 0;
+    long end = mark_line_slots(m, index, &first);
+
+    // marks past the end of into are pulled back so the line stays in order
+    if (first > 0 && mark_index(m, first - 1) == index - 1) {
+        for (long i = first - 1; i >= 0; i--) {
+            m->slots[i].pos = MIN(m->slots[i].pos, size);
+            if (m->gaps[i] != 0) break;
+        }
+    }
+    for (long i = first; i < end; i++) {
+        m->slots[i].pos += size;
+        m->slots[i].line = into;
+    }
+    mark_shift(m, first, -1);
+
+    return MARK_OK;
+}
+
+// count lines were linked in at index: marks from there on move down
+int
+mark_lines_insert(struct mark* m, long index, long count)
+{
+    assert(m != NULL);
+
+    mark_shift(m, mark_lower(m, index), count);
+    return MARK_OK;
+}
+
+// Lines [index, index + count) were swapped for added others from first
+// (at least one). Marks on the old lines go to the new line as far down,
+// or the last one, and the marks below move along.
+int
+mark_lines_replace(struct mark* m, long index, long count, long added, struct line* first)
+{
+    assert(m != NULL);
+    assert(added > 0);
+    assert(first != NULL);
+
+    long lo = mark_lower(m, index);
+    long hi = mark_lower(m, index + count);
+    if (lo == hi) {
+        mark_shift(m, lo, added - count);
+        return MARK_OK;
+    }
+
+    long indices[MARK_COUNT];
+    mark_indices(m, indices);
+
+    struct line* line = first;
+    long offset = 0;
+    for (long i = lo; i < hi; i++) {
+        for (; offset < MIN(indices[i] - index, added - 1); offset++) line = line->next;
+        indices[i] = index + offset;
+        m->slots[i].line = line;
+    }
+    for (long i = hi; i < m->count; i++) indices[i] += added - count;
+
+    mark_rebuild(m, indices);
+    return MARK_OK;
+}
+
+// After lines were changed in ways that weren't tracked, keep the marks
+// on the same line numbers (as far as the buffer still reaches) and
+// find their lines again
+int
+mark_relink(struct mark* m, struct line* head, long count)
+{
+    assert(m != NULL);
+    assert(head != NULL);
+
+    long indices[MARK_COUNT];
+    mark_indices(m, indices);
+
+    long index = 0;
+    struct line* line = head;
+    for (long i = 0; i < m->count; i++) {
+        indices[i] = MIN(indices[i], count - 1);
+        for (; index < indices[i] && line->next != NULL; index++) line = line->next;
+        m->slots[i].line = line;
+    }
+
+    mark_rebuild(m, indices);
+    return MARK_OK;
+}
+
+// Remember a position being jumped away from. Anything that was gone
+// back through is dropped, and the oldest entry once the list is full.
+int
+mark_jump_push(struct mark* m, struct line* line, long index, long pos)
+{
+    assert(m != NULL);
+
+    while (m->jump_count > m->jump_current) {
+        m->jump_count--;
+        mark_clear(m, mark_jump_id(m, m->jump_count));
+    }
+
+    if (m->jump_count == MARK_JUMPS) {
+        mark_clear(m, mark_jump_id(m, 0));
+        m->jump_first = (m->jump_first + 1) % MARK_JUMPS;
+        m->jump_count--;
+    }
+
+    mark_set(m, mark_jump_id(m, m->jump_count), line, index, pos);
+    m->jump_count++;
+    m->jump_current = m->jump_count;
+
+    return MARK_OK;
+}
+
+// Step back to an older entry. line, index and pos say where the cursor
+// is (which is remembered too when leaving the newest end, so it can be
+// come back to) and are set to where to go.
+int
+mark_jump_back(struct mark* m, struct line** line, long* index, long* pos)
+{
+    assert(m != NULL);
+
+    if (m->jump_current == 0) return MARK_ERROR;
+
+    if (m->jump_current == m->jump_count) {
+        mark_jump_push(m, *line, *index, *pos);
+        m->jump_current--;
+    }
+
+    m->jump_current--;
+    return mark_get(m, mark_jump_id(m, m->jump_current), line, index, pos);
+}
+
+// step forward to a newer entry after going back
+int
+mark_jump_forward(struct mark* m, struct line** line, long* index, long* pos)
+{
+    assert(m != NULL);
+
+    if (m->jump_current + 1 >= m->jump_count) return MARK_ERROR;
+
+    m->jump_current++;
+    return mark_get(m, mark_jump_id(m, m->jump_current), line, index, pos);
+}
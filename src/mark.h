@@ -0,0 +1,80 @@
+#ifndef DERZVIM_MARK_H_INCLUDED
+#define DERZVIM_MARK_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum {
+    // a to z, set with :k and jumped to with the address 'x
+    MARK_NAMED = 26,
+
+    // the jump list, oldest first, gets the ids after the named marks
+    MARK_JUMPS = 100,
+    MARK_COUNT = MARK_NAMED + MARK_JUMPS,
+};
+
+// a remembered position, kept on its line as the text around it changes
+struct mark_slot {
+    long id;
+    long pos;
+    struct line* line;
+};
+
+// Named marks and the jump list of a buffer. Marks are kept sorted by
+// position, but rather than its line index each one stores how many
+// lines it is below the mark before it, with a Fenwick tree over those
+// gaps. A mark's line index is a prefix sum and finding the first mark
+// at or after a line is a descent of the tree, both O(log marks). An
+// edit that moves lines up or down only changes the gap in front of the
+// first mark it moves, so breaking or joining lines costs O(log marks)
+// however many marks are below. Typing or deleting chars only touches
+// the marks on that line. Each mark also points at its line, so jumping
+// to it doesn't walk the buffer. Setting or clearing a mark puts the
+// gaps back together in O(marks).
+//
+// Edits that aren't tracked (ex commands) leave the marks on the same
+// line numbers, see mark_relink. Marks past the end of a line that got
+// shorter are only pulled back when jumped to.
+struct mark {
+    struct mark_slot slots[MARK_COUNT];
+    long gaps[MARK_COUNT];
+    long tree[MARK_COUNT + 1];
+    long count;
+
+    // slot of each id, or -1 when it isn't set
+    long where[MARK_COUNT];
+
+    // jumps[jump_first] is the oldest entry, current is one past the
+    // newest unless the list was gone back through
+    long jump_first;
+    long jump_count;
+    long jump_current;
+};
+
+enum mark_status {
+    MARK_OK = 0,
+    MARK_ERROR,
+};
+
+int mark_init(struct mark* m);
+
+int mark_set(struct mark* m, long id, struct line* line, long index, long pos);
+int mark_clear(struct mark* m, long id);
+int mark_get(const struct mark* m, long id, struct line** line, long* index, long* pos);
+long mark_name(char c);
+long mark_last(const struct mark* m);
+
+int mark_chars_insert(struct mark* m, long index, long pos, long count);
+int mark_chars_delete(struct mark* m, long index, long pos, long count);
+int mark_line_break(struct mark* m, long index, long pos, struct line* next);
+int mark_line_merge(struct mark* m, long index, long size, struct line* into);
+int mark_lines_insert(struct mark* m, long index, long count);
+int mark_lines_replace(struct mark* m, long index, long count, long added, struct line* first);
+int mark_relink(struct mark* m, struct line* head, long count);
+
+int mark_jump_push(struct mark* m, struct line* line, long index, long pos);
+int mark_jump_back(struct mark* m, struct line** line, long* index, long* pos);
+int mark_jump_forward(struct mark* m, struct line** line, long* index, long* pos);
+
+#endif
@@ -0,0 +1,276 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "line.h"
+#include "sort.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// numbers this big or bigger only sort by their prefix
+#define SORT_NUMBER_MAX INT64_C(1000000000000000000)
+
+enum {
+    // stretches this short are sorted by insertion before merging
+    SORT_INSERTION = 16,
+
+    // fewer lines than this per thread aren't worth starting one for
+    SORT_CHUNK = 64 * 1024,
+    SORT_MAX_THREADS = 16,
+    SORT_NUMBER_DIGITS = 18,
+};
+
+// A line along with a prefix of what it sorts by (its first 8 bytes, or
+// its number), so most comparisons never have to go to the line itself
+struct sort_key {
+    uint64_t prefix;
+    struct line* line;
+};
+
+// Sort keys[0, count) (made from lines) using out as scratch, or merge
+// the sorted runs [0, split) and [split, count) of keys into out
+struct sort_job {
+    struct line** lines;
+    struct sort_key* keys;
+    struct sort_key* out;
+    long count;
+    long split;
+    int flags;
+};
+
+// The first decimal number in a line: its digits without the leading
+// zeros, and whether a - comes right before it
+static bool
+sort_number(const struct line* line, const char** digits, long* count, bool* negative)
+{
+    long i = 0;
+    while (i < line->size && !isdigit((unsigned char)line->buf[i])) i++;
+    if (i == line->size) return false;
+
+    *negative = i > 0 && line->buf[i - 1] == '-';
+    while (i < line->size && line->buf[i] == '0') i++;
+    long start = i;
+    while (i < line->size && isdigit((unsigned char)line->buf[i])) i++;
+
+    *digits = line->buf + start;
+    *count = i - start;
+    if (*count == 0) *negative = false;
+    return true;
+}
+
+// like vim's :sort n, lines without a number go first (numbers are
+// compared digit by digit so there is no limit to their size)
+static int
+sort_compare_numbers(const struct line* a, const struct line* b)
+{
+    const char* a_digits = NULL;
+    const char* b_digits = NULL;
+    long a_count = 0;
+    long b_count = 0;
+    bool a_negative = false;
+    bool b_negative = false;
+    bool a_found = sort_number(a, &a_digits, &a_count, &a_negative);
+    bool b_found = sort_number(b, &b_digits, &b_count, &b_negative);
+    if (!a_found || !b_found) return (int)a_found - (int)b_found;
+    if (a_negative != b_negative) return a_negative ? -1 : 1;
+
+    int order = a_count != b_count ? (a_count < b_count ? -1 : 1) : memcmp(a_digits, b_digits, a_count);
+    return a_negative ? -order : order;
+}
+
+// Less than, equal to or greater than zero as a goes before, with or
+// after b
+int
+sort_compare(const struct line* a, const struct line* b, int flags)
+{
+    assert(a != NULL && !line_frozen(a));
+    assert(b != NULL && !line_frozen(b));
+
+    int order = 0;
+    if (flags & SORT_NUMERIC) {
+        order = sort_compare_numbers(a, b);
+    } else {
+        long size = MIN(a->size, b->size);
+        order = size > 0 ? memcmp(a->buf, b->buf, size) : 0;
+        if (order == 0) order = (a->size > b->size) - (a->size < b->size);
+    }
+
+    order = (order > 0) - (order < 0);
+    return flags & SORT_REVERSE ? -order : order;
+}
+
+static struct sort_key
+sort_key_make(struct line* line, int flags)
+{
+    struct sort_key key = { 0, line };
+    if (!(flags & SORT_NUMERIC)) {
+        for (long i = 0; i < 8; i++) key.prefix = key.prefix << 8 | (i < line->size ? (unsigned char)line->buf[i] : 0);
+        return key;
+    }
+
+    // lines without a number go first, then numbers in order (ones too
+    // big to fit all tie on the biggest prefix)
+    const char* digits = NULL;
+    long count = 0;
+    bool negative = false;
+    int64_t number = INT64_MIN;
+    if (sort_number(line, &digits, &count, &negative)) {
+        number = 0;
+        for (long i = 0; i < MIN(count, SORT_NUMBER_DIGITS); i++) number = number * 10 + (digits[i] - '0');
+        if (count > SORT_NUMBER_DIGITS) number = SORT_NUMBER_MAX;
+        if (negative) number = -number;
+    }
+    key.prefix = (uint64_t)number ^ ((uint64_t)1 << 63);
+    return key;
+}
+
+static int
+sort_compare_keys(const struct sort_key* a, const struct sort_key* b, int flags)
+{
+    int order = (a->prefix > b->prefix) - (a->prefix < b->prefix);
+    if (order != 0) return flags & SORT_REVERSE ? -order : order;
+
+    // the same number is only worth a closer look if it was cut short
+    if (flags & SORT_NUMERIC) {
+        int64_t number = (int64_t)(a->prefix ^ ((uint64_t)1 << 63));
+        if (number != SORT_NUMBER_MAX && number != -SORT_NUMBER_MAX) return 0;
+    }
+    return sort_compare(a->line, b->line, flags);
+}
+
+static void
+sort_merge(struct sort_key* out, struct sort_key* a, long a_count, struct sort_key* b, long b_count, int flags)
+{
+    // ties go to a, which keeps the sort stable
+    long i = 0;
+    long j = 0;
+    while (i < a_count && j < b_count) {
+        if (sort_compare_keys(&b[j], &a[i], flags) < 0) *out++ = b[j++];
+        else *out++ = a[i++];
+    }
+    memcpy(out, a + i, (a_count - i) * sizeof(*out));
+    memcpy(out + a_count - i, b + j, (b_count - j) * sizeof(*out));
+}
+
+// make the keys for one run and sort them in place, out is scratch
+// space as big as they are
+static void*
+sort_run_worker(void* arg)
+{
+    struct sort_job* job = arg;
+    struct sort_key* keys = job->keys;
+    long count = job->count;
+    for (long i = 0; i < count; i++) keys[i] = sort_key_make(job->lines[i], job->flags);
+
+    for (long start = 0; start < count; start += SORT_INSERTION) {
+        long end = MIN(start + SORT_INSERTION, count);
+        for (long i = start + 1; i < end; i++) {
+            struct sort_key key = keys[i];
+            long j = i;
+            for (; j > start && sort_compare_keys(&key, &keys[j - 1], job->flags) < 0; j--) keys[j] = keys[j - 1];
+            keys[j] = key;
+        }
+    }
+
+    // then merge them up, back and forth between the two arrays
+    struct sort_key* from = keys;
+    struct sort_key* to = job->out;
+    for (long width = SORT_INSERTION; width < count; width *= 2) {
+        for (long start = 0; start < count; start += 2 * width) {
+            long mid = MIN(start + width, count);
+            long end = MIN(start + 2 * width, count);
+            sort_merge(to + start, from + start, mid - start, from + mid, end - mid, job->flags);
+        }
+        struct sort_key* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != keys) memcpy(keys, from, count * sizeof(*keys));
+
+    return NULL;
+}
+
+static void*
+sort_merge_worker(void* arg)
+{
+    struct sort_job* job = arg;
+    sort_merge(job->out, job->keys, job->split, job->keys + job->split, job->count - job->split, job->flags);
+    return NULL;
+}
+
+// run each job on a thread of its own, the first one here
+static void
+sort_spawn(void* (*worker)(void*), struct sort_job* jobs, long count)
+{
+    pthread_t workers[SORT_MAX_THREADS];
+    bool started[SORT_MAX_THREADS] = { false };
+    for (long k = 1; k < count; k++) started[k] = pthread_create(&workers[k], NULL, worker, &jobs[k]) == 0;
+
+    worker(&jobs[0]);
+    for (long k = 1; k < count; k++) {
+        if (started[k]) pthread_join(workers[k], NULL);
+        else worker(&jobs[k]);
+    }
+}
+
+// Sort count lines by their text (or by the first number in them), in
+// runs over up to threads threads
+int
+sort_lines(struct line** lines, long count, int flags, long threads)
+{
+    assert(lines != NULL || count == 0);
+
+    if (count < 2) return SORT_OK;
+    struct sort_key* keys = malloc(count * sizeof(*keys));
+    struct sort_key* scratch = malloc(count * sizeof(*scratch));
+    if (keys == NULL || scratch == NULL) {
+        free(keys);
+        free(scratch);
+        return SORT_ERROR;
+    }
+
+    long runs = (count + SORT_CHUNK - 1) / SORT_CHUNK;
+    runs = MIN(runs, MIN(threads, SORT_MAX_THREADS));
+    if (runs < 1) runs = 1;
+
+    long bounds[SORT_MAX_THREADS + 1];
+    struct sort_job jobs[SORT_MAX_THREADS];
+    for (long k = 0; k <= runs; k++) bounds[k] = count * k / runs;
+    for (long k = 0; k < runs; k++) {
+        long start = bounds[k];
+        jobs[k] = (struct sort_job){ lines + start, keys + start, scratch + start, bounds[k + 1] - start, 0, flags };
+    }
+    sort_spawn(sort_run_worker, jobs, runs);
+
+    // merge neighbouring runs two at a time until there is only one (an
+    // odd one out is just copied over)
+    struct sort_key* from = keys;
+    struct sort_key* to = scratch;
+    while (runs > 1) {
+        long pairs = 0;
+        for (long k = 0; k < runs; k += 2) {
+            long start = bounds[k];
+            long split = bounds[MIN(k + 1, runs)];
+            long end = bounds[MIN(k + 2, runs)];
+            jobs[pairs] = (struct sort_job){ NULL, from + start, to + start, end - start, split - start, flags };
+            bounds[pairs++] = start;
+        }
+        bounds[pairs] = count;
+        sort_spawn(sort_merge_worker, jobs, pairs);
+
+        runs = pairs;
+        struct sort_key* swap = from;
+        from = to;
+        to = swap;
+    }
+    for (long i = 0; i < count; i++) lines[i] = from[i].line;
+
+    free(keys);
+    free(scratch);
+    return SORT_OK;
+}
@@ -0,0 +1,26 @@
+#ifndef DERZVIM_SORT_H_INCLUDED
+#define DERZVIM_SORT_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+// Sorting for :sort, done on an array of pointers to the lines so that
+// no text is ever copied; the caller links them back up in their new
+// order. It's a stable merge sort: the array is cut into one run per
+// thread, each run is sorted on its own, then pairs of runs are merged
+// (in parallel too) until one is left.
+enum {
+    SORT_NUMERIC = 1 << 0,
+    SORT_REVERSE = 1 << 1,
+};
+
+enum sort_status {
+    SORT_OK = 0,
+    SORT_ERROR,
+};
+
+int sort_compare(const struct line* a, const struct line* b, int flags);
+int sort_lines(struct line** lines, long count, int flags, long threads);
+
+#endif
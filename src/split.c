@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "diff.h"
+#include "line.h"
+#include "split.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum {
+    SPLIT_DEFAULT_CAPACITY = 64,
+    SPLIT_CAPACITY_GROWTH = 2,
+};
+
+static int
+split_reserve(void** buf, long* capacity, long count, long size)
+{
+    if (count <= *capacity) return SPLIT_OK;
+
+    long grown_capacity = *capacity > 0 ? *capacity : SPLIT_DEFAULT_CAPACITY;
+    while (grown_capacity < count) grown_capacity *= SPLIT_CAPACITY_GROWTH;
+    void* grown = realloc(*buf, grown_capacity * size);
+    if (grown == NULL) return SPLIT_ERROR;
+    *buf = grown;
+    *capacity = grown_capacity;
+
+    return SPLIT_OK;
+}
+
+// nothing changed since the hunks were worked out, so line them up
+static int
+split_settle(struct split* s)
+{
+    s->start = 0;
+    s->end = 0;
+    s->delta = 0;
+    s->stale = false;
+
+    const struct diff* d = &s->diff;
+    if (split_reserve((void**)&s->rows, &s->rows_capacity, d->count, sizeof(long)) != SPLIT_OK) {
+        s->stale = true;
+        return SPLIT_ERROR;
+    }
+
+    // the rows fillers add on the shorter side of each hunk
+    long extra = 0;
+    for (long i = 0; i < d->count; i++) {
+        const struct diff_hunk* h = &d->hunks[i];
+        s->rows[i] = h->a_start + extra;
+        extra += MAX(h->a_count, h->b_count) - h->a_count;
+    }
+
+    return SPLIT_OK;
+}
+
+int
+split_init(struct split* s)
+{
+    assert(s != NULL);
+
+    diff_init(&s->diff);
+    s->a = NULL;
+    s->a_count = 0;
+    s->a_capacity = 0;
+    s->b = NULL;
+    s->b_count = 0;
+    s->b_capacity = 0;
+    s->rows = NULL;
+    s->rows_capacity = 0;
+
+    s->start = 0;
+    s->end = 0;
+    s->delta = 0;
+    s->stale = true;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    s->threads = cpus > 0 ? cpus : 1;
+
+    return SPLIT_OK;
+}
+
+int
+split_free(struct split* s)
+{
+    assert(s != NULL);
+
+    diff_free(&s->diff);
+    free(s->a);
+    free(s->b);
+    free(s->rows);
+    split_init(s);
+
+    return SPLIT_OK;
+}
+
+// hash both sides from scratch and diff them
+int
+split_build(struct split* s, const struct line* a, long a_count, const struct line* b, long b_count)
+{
+    assert(s != NULL);
+
+    s->stale = true;
+    if (split_reserve((void**)&s->a, &s->a_capacity, a_count, sizeof(uint64_t)) != SPLIT_OK) return SPLIT_ERROR;
+    if (split_reserve((void**)&s->b, &s->b_capacity, b_count, sizeof(uint64_t)) != SPLIT_OK) return SPLIT_ERROR;
+    if (diff_hash_lines(a, a_count, s->a, s->threads) != DIFF_OK) return SPLIT_ERROR;
+    if (diff_hash_lines(b, b_count, s->b, s->threads) != DIFF_OK) return SPLIT_ERROR;
+    s->a_count = a_count;
+    s->b_count = b_count;
+
+    if (diff_compute(&s->diff, s->a, a_count, s->b, b_count) != DIFF_OK) return SPLIT_ERROR;
+    return split_settle(s);
+}
+
+// Catch up with the edits to a (now a_count lines, line is any of them
+// at index): hash the lines that changed and diff around them again
+int
+split_sync(struct split* s, const struct line* line, long index, long a_count)
+{
+    assert(s != NULL);
+    assert(line != NULL);
+    assert(!s->stale);
+
+    if (s->start >= s->end) return SPLIT_OK;
+    assert(s->a_count + s->delta == a_count);
+    assert(s->end <= a_count);
+
+    // the unchanged hashes past the edits move to where their lines are
+    long start = s->start;
+    long end = s->end;
+    long old_end = end - s->delta;
+    s->stale = true;
+    if (split_reserve((void**)&s->a, &s->a_capacity, a_count, sizeof(uint64_t)) != SPLIT_OK) return SPLIT_ERROR;
+    if (end != old_end) memmove(s->a + end, s->a + old_end, (s->a_count - old_end) * sizeof(uint64_t));
+    s->a_count = a_count;
+
+    for (; index > start; index--) line = line->prev;
+    for (; index < start; index++) line = line->next;
+    if (diff_hash_lines(line, end - start, s->a + start, s->threads) != DIFF_OK) return SPLIT_ERROR;
+
+    if (diff_update(&s->diff, s->a, a_count, s->b, s->b_count, start, old_end, end) != DIFF_OK) {
+        return SPLIT_ERROR;
+    }
+    return split_settle(s);
+}
+
+// the text of lines [start, end) of a changed
+int
+split_change(struct split* s, long start, long end)
+{
+    assert(s != NULL);
+    assert(start <= end);
+
+    if (s->start >= s->end) {
+        s->start = start;
+        s->end = end;
+    } else {
+        s->start = MIN(s->start, start);
+        s->end = MAX(s->end, end);
+    }
+
+    return SPLIT_OK;
+}
+
+// count lines were linked in at index, changing the one before them
+int
+split_insert(struct split* s, long index, long count)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    // whatever is pending past index moves down with the lines
+    if (s->start < s->end) {
+        if (s->start >= index) s->start += count;
+        if (s->end > index) s->end += count;
+    }
+    s->delta += count;
+    return split_change(s, MAX(index - 1, 0), index + count);
+}
+
+// count lines at index were unlinked, joined onto the one before them
+int
+split_remove(struct split* s, long index, long count)
+{
+    assert(s != NULL);
+    assert(index > 0);
+
+    // and up with them here, so a pending change past index stays on
+    // its line rather than dropping out of the range
+    if (s->start < s->end) {
+        if (s->start > index) s->start = MAX(s->start - count, index);
+        if (s->end > index) s->end = MAX(s->end - count, index);
+    }
+    s->delta -= count;
+    return split_change(s, index - 1, index);
+}
+
+// count lines at index were swapped for added others
+int
+split_replace(struct split* s, long index, long count, long added)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    // a pending change past them moves with the lines after them
+    if (s->start < s->end) {
+        if (s->start > index) s->start = MAX(s->start + added - count, index);
+        if (s->end > index) s->end = MAX(s->end + added - count, index + added);
+    }
+    s->delta += added - count;
+
+    // with none added, a line next to the gap stands in for the change
+    long start = added > 0 || index == 0 ? index : index - 1;
+    return split_change(s, start, MAX(index + added, start + 1));
+}
+
+// a changed in ways that weren't tracked
+int
+split_reset(struct split* s)
+{
+    assert(s != NULL);
+
+    s->stale = true;
+    return SPLIT_OK;
+}
+
+// the last hunk starting at or before n, going by a_start or by row
+static long
+split_hunk(const struct split* s, long n, bool rows)
+{
+    long lo = 0;
+    long hi = s->diff.count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        long at = rows ? s->rows[mid] : s->diff.hunks[mid].a_start;
+        if (at <= n) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+// the row line index of a is shown on
+long
+split_row(const struct split* s, long index)
+{
+    assert(s != NULL);
+    assert(!s->stale);
+
+    long i = split_hunk(s, index, false);
+    if (i < 0) return index;
+
+    const struct diff_hunk* h = &s->diff.hunks[i];
+    if (index < h->a_start + h->a_count) return s->rows[i] + index - h->a_start;
+    return s->rows[i] + MAX(h->a_count, h->b_count) + index - h->a_start - h->a_count;
+}
+
+// The lines of a and b shown on row (-1 for a filler or past the end).
+// Returns whether the row is part of a hunk.
+bool
+split_line(const struct split* s, long row, long* a, long* b)
+{
+    assert(s != NULL);
+    assert(!s->stale);
+    assert(a != NULL && b != NULL);
+
+    bool changed = false;
+    long i = split_hunk(s, row, true);
+    if (i < 0) {
+        *a = row;
+        *b = row;
+    } else {
+        const struct diff_hunk* h = &s->diff.hunks[i];
+        long k = row - s->rows[i];
+        long rows = MAX(h->a_count, h->b_count);
+        changed = k < rows;
+        if (changed) {
+            *a = k < h->a_count ? h->a_start + k : -1;
+            *b = k < h->b_count ? h->b_start + k : -1;
+        } else {
+            *a = h->a_start + h->a_count + k - rows;
+            *b = h->b_start + h->b_count + k - rows;
+        }
+    }
+
+    if (row < 0 || *a >= s->a_count) *a = -1;
+    if (row < 0 || *b >= s->b_count) *b = -1;
+    return changed;
+}
@@ -0,0 +1,65 @@
+#ifndef DERZVIM_SPLIT_H_INCLUDED
+#define DERZVIM_SPLIT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "diff.h"
+#include "line.h"
+
+// Two buffers side by side (a, the shown one, against b) lined up on a
+// diff of their line hashes. Rows of the aligned view pair a line of a
+// with the same line of b, or inside a hunk either side with a filler
+// when that side ran out first, so a hunk takes as many rows as its
+// longer side. rows[i] is where hunk i starts, which makes mapping
+// between lines and rows a binary search over the hunks.
+//
+// Both sides are hashed in parallel and diffed once. After that edits
+// to a only mark which lines changed, and the next sync hashes just
+// those and diffs again only between the equal lines around them (see
+// diff_update), so a keystroke costs about the size of its hunk.
+struct split {
+    struct diff diff;
+
+    uint64_t* a;
+    long a_count;
+    long a_capacity;
+    uint64_t* b;
+    long b_count;
+    long b_capacity;
+
+    long* rows;
+    long rows_capacity;
+
+    // lines [start, end) of a changed since the last sync, with delta
+    // lines added in all (start >= end for none), or stale if it all
+    // has to be done again
+    long start;
+    long end;
+    long delta;
+    bool stale;
+
+    long threads;
+};
+
+enum split_status {
+    SPLIT_OK = 0,
+    SPLIT_ERROR,
+};
+
+int split_init(struct split* s);
+int split_free(struct split* s);
+
+int split_build(struct split* s, const struct line* a, long a_count, const struct line* b, long b_count);
+int split_sync(struct split* s, const struct line* line, long index, long a_count);
+
+int split_change(struct split* s, long start, long end);
+int split_insert(struct split* s, long index, long count);
+int split_remove(struct split* s, long index, long count);
+int split_replace(struct split* s, long index, long count, long added);
+int split_reset(struct split* s);
+
+long split_row(const struct split* s, long index);
+bool split_line(const struct split* s, long row, long* a, long* b);
+
+#endif
@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+#include "line.h"
+#include "stats.h"
+#include "term.h"
+
+static const char* const STATS_TIMER_NAMES[STATS_TIMER_COUNT] = {
+    [STATS_TIMER_FRAME] = "frame",
+    [STATS_TIMER_DRAW]  = "draw",
+    [STATS_TIMER_LOAD]  = "load",
+    [STATS_TIMER_SAVE]  = "save",
+};
+
+static long
+stats_bucket(long nanos)
+{
+    long us = nanos / 1000;
+
+    long bucket = 0;
+    while (us > 0 && bucket < STATS_HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+int
+stats_init(struct stats* s)
+{
+    assert(s != NULL);
+
+    memset(s, 0, sizeof(*s));
+    return STATS_OK;
+}
+
+int
+stats_enable(struct stats* s, const char* path)
+{
+    assert(s != NULL);
+
+    s->enabled = true;
+    if (path != NULL) s->path = path;
+
+    // start counting from here rather than from process start
+    term_counters(&s->bytes_written, &s->write_calls);
+    s->allocations = line_allocation_count();
+
+    return STATS_OK;
+}
+
+long
+stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int
+stats_record(struct stats* s, int timer, long nanos)
+{
+    assert(s != NULL);
+    assert(timer >= 0 && timer < STATS_TIMER_COUNT);
+
+    struct stats_histogram* h = &s->timers[timer];
+    h->buckets[stats_bucket(nanos)]++;
+    h->count++;
+    h->total += nanos;
+    if (nanos > h->max) h->max = nanos;
+
+    return STATS_OK;
+}
+
+int
+stats_frame(struct stats* s)
+{
+    assert(s != NULL);
+
+    long bytes = 0;
+    long writes = 0;
+    term_counters(&bytes, &writes);
+    long allocations = line_allocation_count();
+
+    s->frame_bytes = bytes - s->bytes_written;
+    s->frame_writes = writes - s->write_calls;
+    s->frame_allocations = allocations - s->allocations;
+    if (s->frame_bytes > s->frame_bytes_max) s->frame_bytes_max = s->frame_bytes;
+
+    s->bytes_written = bytes;
+    s->write_calls = writes;
+    s->allocations = allocations;
+    s->frames++;
+
+    return STATS_OK;
+}
+
+long
+stats_percentile(const struct stats* s, int timer, long pct)
+{
+    assert(s != NULL);
+    assert(timer >= 0 && timer < STATS_TIMER_COUNT);
+
+    const struct stats_histogram* h = &s->timers[timer];
+    if (h->count == 0) return 0;
+
+    // report the upper bound (in nanoseconds) of the bucket holding pct
+    long target = (h->count * pct + 99) / 100;
+    long seen = 0;
+    for (long i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target) return (1L << i) * 1000;
+    }
+
+    return h->max;
+}
+
+int
+stats_dump(const struct stats* s)
+{
+    assert(s != NULL);
+
+    if (s->path == NULL) return STATS_OK;
+
+    FILE* fp = fopen(s->path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open stats file: %s\n", s->path);
+        return STATS_ERROR;
+    }
+
+    fprintf(fp, "frames %ld\n", s->frames);
+    fprintf(fp, "bytes_written %ld\n", s->bytes_written);
+    fprintf(fp, "write_calls %ld\n", s->write_calls);
+    fprintf(fp, "allocations %ld\n", s->allocations);
+    fprintf(fp, "frame_bytes_max %ld\n", s->frame_bytes_max);
+
+    for (long t = 0; t < STATS_TIMER_COUNT; t++) {
+        const struct stats_histogram* h = &s->timers[t];
+        fprintf(fp, "\n%s count %ld total_us %ld max_us %ld p50_us %ld p90_us %ld p99_us %ld\n",
+            STATS_TIMER_NAMES[t],
+            h->count,
+            h->total / 1000,
+            h->max / 1000,
+            stats_percentile(s, t, 50) / 1000,
+            stats_percentile(s, t, 90) / 1000,
+            stats_percentile(s, t, 99) / 1000);
+
+        for (long i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            if (h->buckets[i] == 0) continue;
+            fprintf(fp, "  <%ldus %ld\n", 1L << i, h->buckets[i]);
+        }
+    }
+
+    fclose(fp);
+    return STATS_OK;
+}
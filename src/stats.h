@@ -0,0 +1,67 @@
+#ifndef DERZVIM_STATS_H_INCLUDED
+#define DERZVIM_STATS_H_INCLUDED
+
+#include <stdbool.h>
+
+enum stats_timer {
+    STATS_TIMER_FRAME = 0,  // key arrival until the frame is painted
+    STATS_TIMER_DRAW,
+    STATS_TIMER_LOAD,
+    STATS_TIMER_SAVE,
+    STATS_TIMER_COUNT,
+};
+
+enum {
+    // bucket i holds samples in [2^(i-1), 2^i) microseconds
+    STATS_HISTOGRAM_BUCKETS = 32,
+};
+
+struct stats_histogram {
+    long buckets[STATS_HISTOGRAM_BUCKETS];
+    long count;
+    long total;
+    long max;
+};
+
+// Per-frame performance counters. Collection is off unless enabled,
+// in which case the hot paths pay for a couple of clock reads and
+// counter snapshots per frame. Bytes and write syscalls come from
+// term.c, allocations from the line storage in line.c.
+struct stats {
+    bool enabled;
+    bool overlay;
+    const char* path;
+
+    struct stats_histogram timers[STATS_TIMER_COUNT];
+
+    long key_time;
+    long frames;
+
+    // totals as of the end of the previous frame
+    long bytes_written;
+    long write_calls;
+    long allocations;
+
+    // deltas for the most recent frame
+    long frame_bytes;
+    long frame_writes;
+    long frame_allocations;
+    long frame_bytes_max;
+};
+
+enum stats_status {
+    STATS_OK = 0,
+    STATS_ERROR,
+};
+
+int stats_init(struct stats* s);
+int stats_enable(struct stats* s, const char* path);
+
+long stats_now(void);
+int stats_record(struct stats* s, int timer, long nanos);
+int stats_frame(struct stats* s);
+long stats_percentile(const struct stats* s, int timer, long pct);
+
+int stats_dump(const struct stats* s);
+
+#endif
@@ -0,0 +1,632 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <strings.h>
+
+#include "line.h"
+#include "syntax.h"
+
+enum {
+    SYNTAX_DEFAULT_CAPACITY = 1024,
+    SYNTAX_CAPACITY_GROWTH = 2,
+
+    // how far back lexing starts from when the trusted states end further
+    // up than this
+    SYNTAX_SYNC_LINES = 512,
+};
+
+// lexer states that can carry over from one line to the next
+enum {
+    SYNTAX_STATE_NORMAL = 0,
+    SYNTAX_STATE_BLOCK_COMMENT,
+    SYNTAX_STATE_DQUOTE,
+    SYNTAX_STATE_SQUOTE,
+
+    // never comes out of the lexer, so nothing converges on it
+    SYNTAX_STATE_UNKNOWN = 0xff,
+};
+
+static const char* const SYNTAX_C_KEYWORDS[] = {
+    "break", "case", "continue", "default", "do", "else", "for", "goto",
+    "if", "return", "sizeof", "switch", "while", "static", "const", "extern",
+    "inline", "register", "restrict", "volatile", "typedef", NULL,
+};
+
+static const char* const SYNTAX_C_TYPES[] = {
+    "bool", "char", "double", "enum", "float", "int", "long", "short",
+    "signed", "struct", "union", "unsigned", "void", "size_t", "ssize_t",
+    "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t",
+    "uint32_t", "uint64_t", "FILE", NULL,
+};
+
+static const char* const SYNTAX_SHELL_KEYWORDS[] = {
+    "if", "then", "else", "elif", "fi", "for", "while", "until", "do",
+    "done", "case", "esac", "in", "function", "return", "local", "export",
+    "readonly", "set", "unset", "shift", "exit", NULL,
+};
+
+static const char* const SYNTAX_JSON_KEYWORDS[] = {
+    "true", "false", "null", NULL,
+};
+
+static const char* const SYNTAX_LOG_ERRORS[] = {
+    "error", "err", "fatal", "crit", "critical", "panic", "fail", "failed", NULL,
+};
+
+static const char* const SYNTAX_LOG_WARNINGS[] = {
+    "warn", "warning", NULL,
+};
+
+static const char* const SYNTAX_LOG_INFOS[] = {
+    "info", "notice", NULL,
+};
+
+static const char* const SYNTAX_LOG_DEBUGS[] = {
+    "debug", "trace", NULL,
+};
+
+static bool
+syntax_word_in(const char* const* words, const char* buf, long size, bool nocase)
+{
+    for (long i = 0; words[i] != NULL; i++) {
+        if ((long)strlen(words[i]) != size) continue;
+        if (nocase && strncasecmp(words[i], buf, size) == 0) return true;
+        if (!nocase && strncmp(words[i], buf, size) == 0) return true;
+    }
+    return false;
+}
+
+static bool
+syntax_is_word(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static void
+syntax_paint(unsigned char* classes, long start, long end, int class)
+{
+    if (classes == NULL) return;
+    for (long i = start; i < end; i++) classes[i] = class;
+}
+
+// paint a quoted string starting at i and return the index just past it
+static long
+syntax_string(const char* buf, long size, long i, unsigned char* classes, int class)
+{
+    char quote = buf[i];
+    long j = i + 1;
+    while (j < size && buf[j] != quote) {
+        if (buf[j] == '\\') j++;
+        j++;
+    }
+    if (j < size) j++;
+    if (j > size) j = size;
+
+    syntax_paint(classes, i, j, class);
+    return j;
+}
+
+// paint a number-ish token starting at i and return the index just past it
+static long
+syntax_number(const char* buf, long size, long i, unsigned char* classes)
+{
+    long j = i;
+    while (j < size && (syntax_is_word(buf[j]) || buf[j] == '.')) j++;
+
+    syntax_paint(classes, i, j, SYNTAX_CLASS_NUMBER);
+    return j;
+}
+
+static int
+syntax_lex_c(int state, const char* buf, long size, unsigned char* classes)
+{
+    long i = 0;
+
+    // preprocessor directives color the whole line
+    if (state == SYNTAX_STATE_NORMAL) {
+        while (i < size && isspace((unsigned char)buf[i])) i++;
+        if (i < size && buf[i] == '#') {
+            syntax_paint(classes, i, size, SYNTAX_CLASS_PREPROC);
+            return SYNTAX_STATE_NORMAL;
+        }
+    }
+
+    while (i < size) {
+        if (state == SYNTAX_STATE_BLOCK_COMMENT) {
+            long start = i;
+            while (i < size && !(buf[i] == '*' && i + 1 < size && buf[i + 1] == '/')) i++;
+            if (i < size) {
+                i += 2;
+                state = SYNTAX_STATE_NORMAL;
+            }
+            syntax_paint(classes, start, i, SYNTAX_CLASS_COMMENT);
+            continue;
+        }
+
+        char c = buf[i];
+        if (c == '/' && i + 1 < size && buf[i + 1] == '/') {
+            syntax_paint(classes, i, size, SYNTAX_CLASS_COMMENT);
+            break;
+        } else if (c == '/' && i + 1 < size && buf[i + 1] == '*') {
+            syntax_paint(classes, i, i + 2, SYNTAX_CLASS_COMMENT);
+            state = SYNTAX_STATE_BLOCK_COMMENT;
+            i += 2;
+        } else if (c == '"' || c == '\'') {
+            i = syntax_string(buf, size, i, classes, SYNTAX_CLASS_STRING);
+        } else if (isdigit((unsigned char)c)) {
+            i = syntax_number(buf, size, i, classes);
+        } else if (syntax_is_word(c)) {
+            long start = i;
+            while (i < size && syntax_is_word(buf[i])) i++;
+            if (syntax_word_in(SYNTAX_C_KEYWORDS, buf + start, i - start, false)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_KEYWORD);
+            } else if (syntax_word_in(SYNTAX_C_TYPES, buf + start, i - start, false)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_TYPE);
+            }
+        } else {
+            i++;
+        }
+    }
+
+    return state;
+}
+
+static int
+syntax_lex_shell(int state, const char* buf, long size, unsigned char* classes)
+{
+    long i = 0;
+    while (i < size) {
+        // strings are allowed to span lines in shell
+        if (state == SYNTAX_STATE_DQUOTE || state == SYNTAX_STATE_SQUOTE) {
+            char quote = state == SYNTAX_STATE_DQUOTE ? '"' : '\'';
+            long start = i;
+            while (i < size && buf[i] != quote) {
+                if (buf[i] == '\\' && quote == '"') i++;
+                i++;
+            }
+            if (i < size) {
+                i++;
+                state = SYNTAX_STATE_NORMAL;
+            }
+            if (i > size) i = size;
+            syntax_paint(classes, start, i, SYNTAX_CLASS_STRING);
+            continue;
+        }
+
+        char c = buf[i];
+        if (c == '#' && (i == 0 || isspace((unsigned char)buf[i - 1]))) {
+            syntax_paint(classes, i, size, SYNTAX_CLASS_COMMENT);
+            break;
+        } else if (c == '"' || c == '\'') {
+            syntax_paint(classes, i, i + 1, SYNTAX_CLASS_STRING);
+            state = c == '"' ? SYNTAX_STATE_DQUOTE : SYNTAX_STATE_SQUOTE;
+            i++;
+        } else if (c == '\\') {
+            i += 2;
+        } else if (c == '$') {
+            long start = i++;
+            if (i < size && buf[i] == '{') {
+                while (i < size && buf[i] != '}') i++;
+                if (i < size) i++;
+            } else if (i < size && !syntax_is_word(buf[i])) {
+                i++;
+            } else {
+                while (i < size && syntax_is_word(buf[i])) i++;
+            }
+            syntax_paint(classes, start, i, SYNTAX_CLASS_TYPE);
+        } else if (isdigit((unsigned char)c)) {
+            i = syntax_number(buf, size, i, classes);
+        } else if (syntax_is_word(c)) {
+            long start = i;
+            while (i < size && (syntax_is_word(buf[i]) || buf[i] == '-')) i++;
+            if (syntax_word_in(SYNTAX_SHELL_KEYWORDS, buf + start, i - start, false)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_KEYWORD);
+            }
+        } else {
+            i++;
+        }
+    }
+
+    return state;
+}
+
+static int
+syntax_lex_json(int state, const char* buf, long size, unsigned char* classes)
+{
+    long i = 0;
+    while (i < size) {
+        char c = buf[i];
+        if (c == '"') {
+            long start = i;
+            i = syntax_string(buf, size, i, classes, SYNTAX_CLASS_STRING);
+
+            // object keys are strings followed by a colon
+            long j = i;
+            while (j < size && isspace((unsigned char)buf[j])) j++;
+            if (j < size && buf[j] == ':') {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_TYPE);
+            }
+        } else if (c == '-' || isdigit((unsigned char)c)) {
+            long start = i++;
+            while (i < size && (isdigit((unsigned char)buf[i]) || strchr(".eE+-", buf[i]) != NULL)) i++;
+            syntax_paint(classes, start, i, SYNTAX_CLASS_NUMBER);
+        } else if (isalpha((unsigned char)c)) {
+            long start = i;
+            while (i < size && isalpha((unsigned char)buf[i])) i++;
+            if (syntax_word_in(SYNTAX_JSON_KEYWORDS, buf + start, i - start, false)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_KEYWORD);
+            }
+        } else {
+            i++;
+        }
+    }
+
+    return state;
+}
+
+static int
+syntax_lex_log(int state, const char* buf, long size, unsigned char* classes)
+{
+    long i = 0;
+
+    // leading timestamps (dates, times, offsets) are colored as numbers
+    if (size > 0 && isdigit((unsigned char)buf[0])) {
+        while (i < size) {
+            if (isdigit((unsigned char)buf[i]) || strchr("-:.,TZ+/", buf[i]) != NULL) {
+                i++;
+            } else if (buf[i] == ' ' && i + 1 < size && isdigit((unsigned char)buf[i + 1])) {
+                i++;
+            } else {
+                break;
+            }
+        }
+        syntax_paint(classes, 0, i, SYNTAX_CLASS_NUMBER);
+    }
+
+    while (i < size) {
+        char c = buf[i];
+        if (c == '"') {
+            i = syntax_string(buf, size, i, classes, SYNTAX_CLASS_STRING);
+        } else if (isalpha((unsigned char)c)) {
+            long start = i;
+            while (i < size && isalpha((unsigned char)buf[i])) i++;
+            long len = i - start;
+            if (syntax_word_in(SYNTAX_LOG_ERRORS, buf + start, len, true)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_ERROR);
+            } else if (syntax_word_in(SYNTAX_LOG_WARNINGS, buf + start, len, true)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_WARNING);
+            } else if (syntax_word_in(SYNTAX_LOG_INFOS, buf + start, len, true)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_INFO);
+            } else if (syntax_word_in(SYNTAX_LOG_DEBUGS, buf + start, len, true)) {
+                syntax_paint(classes, start, i, SYNTAX_CLASS_COMMENT);
+            }
+        } else {
+            i++;
+        }
+    }
+
+    return state;
+}
+
+static int
+syntax_reserve(struct syntax* s, long count)
+{
+    if (count <= s->capacity) return SYNTAX_OK;
+
+    long capacity = s->capacity > 0 ? s->capacity : SYNTAX_DEFAULT_CAPACITY;
+    while (capacity < count) capacity *= SYNTAX_CAPACITY_GROWTH;
+
+    unsigned char* states = realloc(s->states, capacity);
+    if (states == NULL) return SYNTAX_ERROR;
+
+    s->states = states;
+    s->capacity = capacity;
+    return SYNTAX_OK;
+}
+
+// languages whose lines all start out the same, whatever came before
+static bool
+syntax_stateless(int lang)
+{
+    return lang == SYNTAX_LANG_JSON || lang == SYNTAX_LANG_LOG;
+}
+
+// a guessed run is only kept while it is ahead of the trusted states
+// and still cached
+static void
+syntax_guess_check(struct syntax* s)
+{
+    if (s->guess <= s->valid || s->guess > s->known) s->guess = 0;
+}
+
+static bool
+syntax_guessing(const struct syntax* s, long index)
+{
+    return s->guess > 0 && s->guess <= index && index <= s->known;
+}
+
+// the state line index starts in (a guess starts out normal)
+static int
+syntax_start(const struct syntax* s, long index)
+{
+    int state = index > 0 ? s->states[index - 1] : SYNTAX_STATE_NORMAL;
+    return state == SYNTAX_STATE_UNKNOWN ? SYNTAX_STATE_NORMAL : state;
+}
+
+// Store the end state of the line at index, extending the trusted prefix
+// (or the guessed run). Returns false if nothing was extended.
+static bool
+syntax_record(struct syntax* s, long index, int state)
+{
+    bool guessed = index > s->valid && index == s->known && syntax_guessing(s, index);
+    if (index != s->valid && !guessed) return false;
+    if (syntax_reserve(s, index + 1) != SYNTAX_OK) return false;
+
+    if (guessed) {
+        s->states[index] = state;
+        s->known++;
+        return true;
+    }
+
+    // same state as before means nothing after this line changed
+    bool converged = index < s->known && s->states[index] == state;
+    s->states[index] = state;
+
+    s->valid = converged ? s->known : index + 1;
+    if (s->known < s->valid) s->known = s->valid;
+    syntax_guess_check(s);
+    return true;
+}
+
+int
+syntax_init(struct syntax* s, const char* path)
+{
+    assert(s != NULL);
+
+    s->lang = SYNTAX_LANG_NONE;
+    s->states = NULL;
+    s->capacity = 0;
+    s->valid = 0;
+    s->known = 0;
+    s->guess = 0;
+    s->classes = NULL;
+    s->classes_capacity = 0;
+
+    if (path == NULL) return SYNTAX_OK;
+
+    const char* ext = strrchr(path, '.');
+    if (ext == NULL) return SYNTAX_OK;
+
+    if (strcmp(ext, ".c") == 0 || strcmp(ext, ".h") == 0) {
+        s->lang = SYNTAX_LANG_C;
+    } else if (strcmp(ext, ".sh") == 0 || strcmp(ext, ".bash") == 0) {
+        s->lang = SYNTAX_LANG_SHELL;
+    } else if (strcmp(ext, ".json") == 0) {
+        s->lang = SYNTAX_LANG_JSON;
+    } else if (strcmp(ext, ".log") == 0) {
+        s->lang = SYNTAX_LANG_LOG;
+    }
+
+    return SYNTAX_OK;
+}
+
+int
+syntax_free(struct syntax* s)
+{
+    assert(s != NULL);
+
+    free(s->states);
+    free(s->classes);
+    s->states = NULL;
+    s->classes = NULL;
+    s->capacity = 0;
+    s->classes_capacity = 0;
+    s->valid = 0;
+    s->known = 0;
+    s->guess = 0;
+
+    return SYNTAX_OK;
+}
+
+int
+syntax_lex(int lang, int state, const char* buf, long size, unsigned char* classes)
+{
+    syntax_paint(classes, 0, size, SYNTAX_CLASS_NORMAL);
+
+    switch (lang) {
+        case SYNTAX_LANG_C: return syntax_lex_c(state, buf, size, classes);
+        case SYNTAX_LANG_SHELL: return syntax_lex_shell(state, buf, size, classes);
+        case SYNTAX_LANG_JSON: return syntax_lex_json(state, buf, size, classes);
+        case SYNTAX_LANG_LOG: return syntax_lex_log(state, buf, size, classes);
+    }
+
+    return SYNTAX_STATE_NORMAL;
+}
+
+int
+syntax_line_changed(struct syntax* s, long index)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    if (index < s->valid) {
+        // the old first untrusted line may have changed too
+        s->known = s->valid;
+        s->valid = index;
+    } else if (index > s->valid && index < s->known) {
+        s->known = index;
+    }
+    syntax_guess_check(s);
+
+    return SYNTAX_OK;
+}
+
+// Line index was broken into count + 1 lines (or count lines were put
+// in after it). The end states after it move down count, the last line
+// taking over the one the whole line had, so re-lexing can still
+// converge once it's past the break. The lines before it have no end
+// state to compare against.
+int
+syntax_line_split(struct syntax* s, long index, long count)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+    assert(count >= 0);
+
+    syntax_line_changed(s, index);
+    if (index >= s->known) return SYNTAX_OK;
+    if (syntax_reserve(s, s->known + count) != SYNTAX_OK) return syntax_lines_changed(s, index + 1);
+
+    memmove(&s->states[index + count], &s->states[index], s->known - index);
+    memset(&s->states[index], SYNTAX_STATE_UNKNOWN, count);
+    s->known += count;
+    if (s->guess > index) s->guess += count;
+
+    return SYNTAX_OK;
+}
+
+// The line after index was joined onto it. The joined line ends the way
+// the second one did, so the end states after index move up by one.
+int
+syntax_line_join(struct syntax* s, long index)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    syntax_line_changed(s, index);
+    if (index + 1 >= s->known) return SYNTAX_OK;
+
+    memmove(&s->states[index], &s->states[index + 1], s->known - index - 1);
+    s->known--;
+    if (s->guess > index) s->guess--;
+    syntax_guess_check(s);
+
+    return SYNTAX_OK;
+}
+
+// Lines [index, index + count) were swapped for added others. Their end
+// states are unknown, and the ones after them move along so re-lexing
+// can still converge past the new lines.
+int
+syntax_lines_replace(struct syntax* s, long index, long count, long added)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+    assert(count >= 0 && added >= 0);
+
+    syntax_line_changed(s, index);
+    if (index >= s->known) return SYNTAX_OK;
+    if (index + count > s->known) return syntax_lines_changed(s, index);
+    if (syntax_reserve(s, s->known + added) != SYNTAX_OK) return syntax_lines_changed(s, index);
+
+    memmove(&s->states[index + added], &s->states[index + count], s->known - index - count);
+    memset(&s->states[index], SYNTAX_STATE_UNKNOWN, added);
+    s->known += added - count;
+    if (s->guess >= index + count) s->guess += added - count;
+    else if (s->guess > index) s->guess = index + added;
+    syntax_guess_check(s);
+
+    return SYNTAX_OK;
+}
+
+int
+syntax_lines_changed(struct syntax* s, long index)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    // lines were inserted or removed so every cached index from here on shifted
+    if (s->valid > index) s->valid = index;
+    if (s->known > index) s->known = index;
+    syntax_guess_check(s);
+
+    return SYNTAX_OK;
+}
+
+// The first line that has to be lexed before line index can be
+// highlighted. Lines of stateless languages need nothing before them.
+// Far below the trusted states lexing starts SYNTAX_SYNC_LINES above
+// index instead, guessing that the line there starts out normal. The
+// guessed states are cached, and the lines between are marked unknown
+// so re-lexing from above only converges once it reaches them.
+long
+syntax_sync_start(struct syntax* s, long index)
+{
+    assert(s != NULL);
+    assert(index >= 0);
+
+    if (s->lang == SYNTAX_LANG_NONE || index <= s->valid) return index;
+
+    if (syntax_stateless(s->lang)) {
+        if (syntax_reserve(s, index) != SYNTAX_OK) return s->valid;
+        memset(&s->states[s->valid], SYNTAX_STATE_NORMAL, index - s->valid);
+        s->valid = index;
+        if (s->known < index) s->known = index;
+        syntax_guess_check(s);
+        return index;
+    }
+
+    if (syntax_guessing(s, index)) return index;
+    if (s->guess > s->valid && s->guess <= index && index - s->known <= SYNTAX_SYNC_LINES) return s->known;
+    if (index - s->valid <= SYNTAX_SYNC_LINES) return s->valid;
+
+    long guess = index - SYNTAX_SYNC_LINES;
+    if (syntax_reserve(s, guess) != SYNTAX_OK) return s->valid;
+    memset(&s->states[s->valid], SYNTAX_STATE_UNKNOWN, guess - s->valid);
+    s->known = guess;
+    s->guess = guess;
+    return guess;
+}
+
+int
+syntax_sync(struct syntax* s, const struct line* line, long index)
+{
+    assert(s != NULL);
+    assert(line != NULL);
+
+    long start = syntax_sync_start(s, index);
+    if (start >= index) return SYNTAX_OK;
+
+    // walk back to the first line to lex
+    for (long i = index; i > start; i--) line = line->prev;
+
+    // and lex forward until line index can be highlighted
+    for (long at = start; at < index && s->valid < index;) {
+        int state = syntax_lex(s->lang, syntax_start(s, at), line->buf, line->size, NULL);
+        if (!syntax_record(s, at, state)) return SYNTAX_ERROR;
+
+        // a convergence can skip over many lines at once
+        long next = at + 1 > s->valid ? at + 1 : s->valid;
+        for (; at < next && at < index; at++) line = line->next;
+    }
+
+    return SYNTAX_OK;
+}
+
+int
+syntax_highlight(struct syntax* s, const struct line* line, long index, unsigned char** classes)
+{
+    assert(s != NULL);
+    assert(line != NULL);
+    assert(classes != NULL);
+
+    *classes = NULL;
+    if (s->lang == SYNTAX_LANG_NONE) return SYNTAX_OK;
+    if (index > s->valid && !syntax_guessing(s, index)) return SYNTAX_ERROR;
+
+    if (line->size > s->classes_capacity) {
+        unsigned char* buf = realloc(s->classes, line->size);
+        if (buf == NULL) return SYNTAX_ERROR;
+        s->classes = buf;
+        s->classes_capacity = line->size;
+    }
+
+    syntax_record(s, index, syntax_lex(s->lang, syntax_start(s, index), line->buf, line->size, s->classes));
+
+    *classes = s->classes;
+    return SYNTAX_OK;
+}
@@ -0,0 +1,73 @@
+#ifndef DERZVIM_SYNTAX_H_INCLUDED
+#define DERZVIM_SYNTAX_H_INCLUDED
+
+#include "line.h"
+
+enum syntax_lang {
+    SYNTAX_LANG_NONE = 0,
+    SYNTAX_LANG_C,
+    SYNTAX_LANG_SHELL,
+    SYNTAX_LANG_JSON,
+    SYNTAX_LANG_LOG,
+};
+
+enum syntax_class {
+    SYNTAX_CLASS_NORMAL = 0,
+    SYNTAX_CLASS_KEYWORD,
+    SYNTAX_CLASS_TYPE,
+    SYNTAX_CLASS_STRING,
+    SYNTAX_CLASS_NUMBER,
+    SYNTAX_CLASS_COMMENT,
+    SYNTAX_CLASS_PREPROC,
+    SYNTAX_CLASS_ERROR,
+    SYNTAX_CLASS_WARNING,
+    SYNTAX_CLASS_INFO,
+    SYNTAX_CLASS_COUNT,
+};
+
+// Lexer state cache. The state at the end of each line is stored so
+// that highlighting a line only needs the line before it. Entries in
+// [0, valid) are trusted. Entries in [valid, known) belong to lines
+// that haven't changed (except the one at valid itself), so when a
+// re-lex produces the same state as the cached one everything up to
+// known becomes trusted again without lexing it.
+//
+// Jumping far below the trusted lines doesn't lex everything above:
+// [guess, known) are lexed from a guess a bounded distance up (see
+// syntax_sync_start), and can be highlighted until re-lexing from above
+// catches up with them. Lines of stateless languages are never lexed
+// just to find out how the next one starts.
+struct syntax {
+    int lang;
+    unsigned char* states;
+    long capacity;
+    long valid;
+    long known;
+    long guess;
+
+    // scratch space for per-char classes of the line being drawn
+    unsigned char* classes;
+    long classes_capacity;
+};
+
+enum syntax_status {
+    SYNTAX_OK = 0,
+    SYNTAX_ERROR,
+};
+
+int syntax_init(struct syntax* s, const char* path);
+int syntax_free(struct syntax* s);
+
+int syntax_lex(int lang, int state, const char* buf, long size, unsigned char* classes);
+
+int syntax_line_changed(struct syntax* s, long index);
+int syntax_lines_changed(struct syntax* s, long index);
+int syntax_line_split(struct syntax* s, long index, long count);
+int syntax_line_join(struct syntax* s, long index);
+int syntax_lines_replace(struct syntax* s, long index, long count, long added);
+
+long syntax_sync_start(struct syntax* s, long index);
+int syntax_sync(struct syntax* s, const struct line* line, long index);
+int syntax_highlight(struct syntax* s, const struct line* line, long index, unsigned char** classes);
+
+#endif
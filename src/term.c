@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
@@ -47,6 +48,38 @@
 #define TERM_COLOR_BG_CYAN    "\033[46m"
 #define TERM_COLOR_BG_WHITE   "\033[47m"
 
+static const char* const TERM_COLORS[] = {
+    [COLOR_RESET]      = TERM_COLOR_RESET,
+    [COLOR_BLACK]      = TERM_COLOR_BLACK,
+    [COLOR_RED]        = TERM_COLOR_RED,
+    [COLOR_GREEN]      = TERM_COLOR_GREEN,
+    [COLOR_YELLOW]     = TERM_COLOR_YELLOW,
+    [COLOR_BLUE]       = TERM_COLOR_BLUE,
+    [COLOR_MAGENTA]    = TERM_COLOR_MAGENTA,
+    [COLOR_CYAN]       = TERM_COLOR_CYAN,
+    [COLOR_WHITE]      = TERM_COLOR_WHITE,
+    [COLOR_BG_BLACK]   = TERM_COLOR_BG_BLACK,
+    [COLOR_BG_RED]     = TERM_COLOR_BG_RED,
+    [COLOR_BG_GREEN]   = TERM_COLOR_BG_GREEN,
+    [COLOR_BG_YELLOW]  = TERM_COLOR_BG_YELLOW,
+    [COLOR_BG_BLUE]    = TERM_COLOR_BG_BLUE,
+    [COLOR_BG_MAGENTA] = TERM_COLOR_BG_MAGENTA,
+    [COLOR_BG_CYAN]    = TERM_COLOR_BG_CYAN,
+    [COLOR_BG_WHITE]   = TERM_COLOR_BG_WHITE,
+};
+
+// running totals of everything written to the terminal
+static long term_bytes_written = 0;
+static long term_write_calls = 0;
+
+static long
+term_output(int output_fd, const char* buf, long size)
+{
+    term_bytes_written += size;
+    term_write_calls++;
+    return write(output_fd, buf, size);
+}
+
 bool
 term_mode_raw(int input_fd)
 {
@@ -73,7 +106,7 @@ bool
 term_screen_save(int output_fd)
 {
     long size = strlen(TERM_SCREEN_SAVE);
-    if (write(output_fd, TERM_SCREEN_SAVE, size) != size) return false;
+    if (term_output(output_fd, TERM_SCREEN_SAVE, size) != size) return false;
     return true;
 }
 
@@ -81,7 +114,7 @@ bool
 term_screen_restore(int output_fd)
 {
     long size = strlen(TERM_SCREEN_RESTORE);
-    if (write(output_fd, TERM_SCREEN_RESTORE, size) != size) return false;
+    if (term_output(output_fd, TERM_SCREEN_RESTORE, size) != size) return false;
     return true;
 }
 
@@ -92,7 +125,7 @@ term_cursor_pos_get(int input_fd, int output_fd, long* cx, long* cy)
     // read an escape sequence back on input_fd
 
     long size = strlen(TERM_CURSOR_POS_GET);
-    if (write(output_fd, TERM_CURSOR_POS_GET, size) != size) return false;
+    if (term_output(output_fd, TERM_CURSOR_POS_GET, size) != size) return false;
 
     char buf[32] = { 0 };
     unsigned long i = 0;
@@ -119,7 +152,7 @@ term_cursor_pos_set(int output_fd, long cx, long cy)
 {
     char buf[80] = { 0 };
     long size = snprintf(buf, sizeof(buf), TERM_CURSOR_POS_SET, cy + 1, cx + 1);
-    if(write(output_fd, buf, size) != size) return false;
+    if (term_output(output_fd, buf, size) != size) return false;
     return true;
 }
 
@@ -127,7 +160,7 @@ bool
 term_cursor_show(int output_fd)
 {
     long size = strlen(TERM_CURSOR_SHOW);
-    if (write(output_fd, TERM_CURSOR_SHOW, size) != size) return false;
+    if (term_output(output_fd, TERM_CURSOR_SHOW, size) != size) return false;
     return true;
 }
 
@@ -135,7 +168,7 @@ bool
 term_cursor_hide(int output_fd)
 {
     long size = strlen(TERM_CURSOR_HIDE);
-    if (write(output_fd, TERM_CURSOR_HIDE, size) != size) return false;
+    if (term_output(output_fd, TERM_CURSOR_HIDE, size) != size) return false;
     return true;
 }
 
@@ -143,7 +176,7 @@ bool
 term_cursor_save(int output_fd)
 {
     long size = strlen(TERM_CURSOR_SAVE);
-    if (write(output_fd, TERM_CURSOR_SAVE, size) != size) return false;
+    if (term_output(output_fd, TERM_CURSOR_SAVE, size) != size) return false;
     return true;
 }
 
@@ -151,7 +184,7 @@ bool
 term_cursor_restore(int output_fd)
 {
     long size = strlen(TERM_CURSOR_RESTORE);
-    if (write(output_fd, TERM_CURSOR_RESTORE, size) != size) return false;
+    if (term_output(output_fd, TERM_CURSOR_RESTORE, size) != size) return false;
     return true;
 }
 
@@ -159,7 +192,7 @@ bool
 term_erase_line(int output_fd)
 {
     long size = strlen(TERM_ERASE_LINE);
-    if (write(output_fd, TERM_ERASE_LINE, size) != size) return false;
+    if (term_output(output_fd, TERM_ERASE_LINE, size) != size) return false;
     return true;
 }
 
@@ -167,17 +200,34 @@ bool
 term_erase_screen(int output_fd)
 {
     long size = strlen(TERM_ERASE_SCREEN);
-    if (write(output_fd, TERM_ERASE_SCREEN, size) != size) return false;
+    if (term_output(output_fd, TERM_ERASE_SCREEN, size) != size) return false;
+    return true;
+}
+
+bool
+term_color_set(int output_fd, int color)
+{
+    if (color < 0 || color > COLOR_BG_WHITE) return false;
+
+    long size = strlen(TERM_COLORS[color]);
+    if (term_output(output_fd, TERM_COLORS[color], size) != size) return false;
     return true;
 }
 
 bool
 term_write(int output_fd, char* buf, long size)
 {
-    if (write(output_fd, buf, size) != size) return false;
+    if (term_output(output_fd, buf, size) != size) return false;
     return true;
 }
 
+void
+term_counters(long* bytes, long* writes)
+{
+    *bytes = term_bytes_written;
+    *writes = term_write_calls;
+}
+
 bool
 term_size(int output_fd, long* width, long* height)
 {
@@ -194,16 +244,33 @@ term_size(int output_fd, long* width, long* height)
     return true;
 }
 
+// a key that came in right behind a lone escape, returned by the next wait
+static int term_key_pending = -1;
+
+bool
+term_key_ready(int input_fd, long timeout)
+{
+    if (term_key_pending != -1) return true;
+
+    struct pollfd pfd = { .fd = input_fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout) > 0;
+}
+
 bool
 term_key_wait(int input_fd, int* c)
 {
     if (c == NULL) return false;
     *c = 0;
 
-    long n = 0;
-    while ((n = read(input_fd, c, 1)) != 1) {
-        if (n == -1 && errno != EAGAIN) {
-            return false;
+    if (term_key_pending != -1) {
+        *c = term_key_pending;
+        term_key_pending = -1;
+    } else {
+        long n = 0;
+        while ((n = read(input_fd, c, 1)) != 1) {
+            if (n == -1 && errno != EAGAIN) {
+                return false;
+            }
         }
     }
 
@@ -212,6 +279,12 @@ term_key_wait(int input_fd, int* c)
     if (*c == KEY_ESCAPE) {
         char seq[3] = { 0 };
         if (read(input_fd, &seq[0], 1) != 1) return true;
+
+        // keys typed (or pasted) quickly after escape aren't a sequence
+        if (seq[0] != '[' && seq[0] != 'O') {
+            term_key_pending = (unsigned char)seq[0];
+            return true;
+        }
         if (read(input_fd, &seq[1], 1) != 1) return true;
         if (seq[0] == '[') {
             if (seq[1] >= '0' && seq[1] <= '9') {
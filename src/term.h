@@ -21,6 +21,26 @@ enum key {
     KEY_DEL,
 };
 
+enum color {
+    COLOR_RESET = 0,
+    COLOR_BLACK,
+    COLOR_RED,
+    COLOR_GREEN,
+    COLOR_YELLOW,
+    COLOR_BLUE,
+    COLOR_MAGENTA,
+    COLOR_CYAN,
+    COLOR_WHITE,
+    COLOR_BG_BLACK,
+    COLOR_BG_RED,
+    COLOR_BG_GREEN,
+    COLOR_BG_YELLOW,
+    COLOR_BG_BLUE,
+    COLOR_BG_MAGENTA,
+    COLOR_BG_CYAN,
+    COLOR_BG_WHITE,
+};
+
 bool term_mode_raw(int input_fd);
 
 bool term_screen_save(int output_fd);
@@ -36,8 +56,12 @@ bool term_cursor_restore(int output_fd);
 bool term_erase_line(int output_fd);
 bool term_erase_screen(int output_fd);
 
+bool term_color_set(int output_fd, int color);
+
 bool term_write(int output_fd, char* buf, long size);
+void term_counters(long* bytes, long* writes);
 bool term_size(int output_fd, long* width, long* height);
 bool term_key_wait(int input_fd, int* c);
+bool term_key_ready(int input_fd, long timeout);
 
 #endif
@@ -0,0 +1,529 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line.h"
+#include "words.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+enum {
+    WORDS_DEFAULT_CAPACITY = 1024,
+    WORDS_CAPACITY_GROWTH = 2,
+
+    // new words past this many get sorted in before a query
+    WORDS_PENDING_MAX = 4096,
+};
+
+// bytes of UTF-8 sequences count too, so accented words stay whole
+static bool WORDS_CHARS[256];
+
+static bool
+words_char(char c)
+{
+    return WORDS_CHARS[(unsigned char)c];
+}
+
+static void
+words_chars_init(void)
+{
+    if (WORDS_CHARS['a']) return;
+    for (int c = 0; c < 256; c++) WORDS_CHARS[c] = isalnum(c) || c == '_' || c >= 0x80;
+}
+
+static uint64_t
+words_hash(const char* word, long size)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (long i = 0; i < size; i++) {
+        hash ^= (unsigned char)word[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int
+words_compare(const char* a, long a_size, const char* b, long b_size)
+{
+    int c = memcmp(a, b, MIN(a_size, b_size));
+    if (c != 0) return c;
+    return (a_size > b_size) - (a_size < b_size);
+}
+
+static int
+words_entry_compare(const void* a, const void* b)
+{
+    const struct words_entry* x = a;
+    const struct words_entry* y = b;
+    return words_compare(x->word, x->size, y->word, y->size);
+}
+
+// the slot holding word, or the empty one it would go in
+static long
+words_find(const struct words* w, const char* word, long size, uint64_t hash)
+{
+    long mask = w->slot_count - 1;
+    long slot = hash & mask;
+    for (;;) {
+        const struct words_slot* s = &w->slots[slot];
+        if (s->index < 0) return slot;
+
+        if (s->hash == hash) {
+            const struct words_entry* entry = &w->entries[s->index];
+            if (entry->size == size && memcmp(entry->word, word, size) == 0) return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+static int
+words_rehash(struct words* w, long slot_count)
+{
+    struct words_slot* slots = malloc(slot_count * sizeof(struct words_slot));
+    if (slots == NULL) {
+        fprintf(stderr, "words: failed to grow hash table\n");
+        return WORDS_ERROR;
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->slot_count = slot_count;
+
+    // every word is different, so a free slot is all that's needed
+    long mask = slot_count - 1;
+    for (long i = 0; i < slot_count; i++) slots[i] = (struct words_slot){ .hash = 0, .index = -1 };
+    for (long i = 0; i < w->count; i++) {
+        uint64_t hash = w->entries[i].hash;
+        long slot = hash & mask;
+        while (slots[slot].index >= 0) slot = (slot + 1) & mask;
+        slots[slot] = (struct words_slot){ .hash = hash, .index = i };
+    }
+
+    return WORDS_OK;
+}
+
+static void
+words_tree_set(struct words* w, long index)
+{
+    long node = w->leaves + index;
+    w->tree[node] = w->entries[index].count;
+    for (node /= 2; node > 0; node /= 2) {
+        long left = w->tree[2 * node];
+        long right = w->tree[2 * node + 1];
+        w->tree[node] = left > right ? left : right;
+    }
+}
+
+static void
+words_tree_build(struct words* w)
+{
+    long* tree = w->tree;
+    for (long i = 0; i < w->leaves; i++) tree[w->leaves + i] = i < w->sorted ? w->entries[i].count : 0;
+    for (long node = w->leaves - 1; node > 0; node--) {
+        long left = tree[2 * node];
+        long right = tree[2 * node + 1];
+        tree[node] = left > right ? left : right;
+    }
+}
+
+// Merge the unsorted words on the end in with the rest, drop the ones
+// nothing uses any more and rebuild the hash table and the max tree.
+static int
+words_sort(struct words* w)
+{
+    long pending = w->count - w->sorted;
+    qsort(&w->entries[w->sorted], pending, sizeof(struct words_entry), words_entry_compare);
+
+    long capacity = w->count > 0 ? w->count : 1;
+    struct words_entry* entries = malloc(capacity * sizeof(struct words_entry));
+    if (entries == NULL) {
+        fprintf(stderr, "words: failed to sort words\n");
+        return WORDS_ERROR;
+    }
+
+    long count = 0;
+    long a = 0;
+    long b = w->sorted;
+    while (a < w->sorted || b < w->count) {
+        struct words_entry* next = NULL;
+        if (b >= w->count) next = &w->entries[a++];
+        else if (a >= w->sorted) next = &w->entries[b++];
+        else if (words_entry_compare(&w->entries[a], &w->entries[b]) < 0) next = &w->entries[a++];
+        else next = &w->entries[b++];
+
+        if (next->count > 0) entries[count++] = *next;
+        else free(next->word);
+    }
+
+    free(w->entries);
+    w->entries = entries;
+    w->count = count;
+    w->capacity = capacity;
+    w->sorted = count;
+
+    long leaves = 1;
+    while (leaves < count) leaves *= 2;
+    long* tree = realloc(w->tree, 2 * leaves * sizeof(long));
+    if (tree == NULL) {
+        fprintf(stderr, "words: failed to grow tree\n");
+        return WORDS_ERROR;
+    }
+    w->tree = tree;
+    w->leaves = leaves;
+    words_tree_build(w);
+
+    if (w->slot_count == 0) return WORDS_OK;
+    return words_rehash(w, w->slot_count);
+}
+
+// Count (or uncount) a single word. The tree is left to the caller, as
+// many changes at once are cheaper to apply with one rebuild.
+static long
+words_count(struct words* w, const char* word, long size, uint64_t hash, long delta)
+{
+    if ((w->count + 1) * 2 > w->slot_count) {
+        long slot_count = w->slot_count > 0 ? w->slot_count : WORDS_DEFAULT_CAPACITY;
+        while ((w->count + 1) * 2 > slot_count) slot_count *= WORDS_CAPACITY_GROWTH;
+        if (words_rehash(w, slot_count) != WORDS_OK) return -1;
+    }
+
+    long slot = words_find(w, word, size, hash);
+    long index = w->slots[slot].index;
+    if (index < 0) {
+        if (delta <= 0) return -1;
+
+        if (w->count >= w->capacity) {
+            long capacity = w->capacity > 0 ? w->capacity : WORDS_DEFAULT_CAPACITY;
+            while (capacity <= w->count) capacity *= WORDS_CAPACITY_GROWTH;
+
+            struct words_entry* entries = realloc(w->entries, capacity * sizeof(struct words_entry));
+            if (entries == NULL) {
+                fprintf(stderr, "words: failed to grow word list\n");
+                return -1;
+            }
+            w->entries = entries;
+            w->capacity = capacity;
+        }
+
+        char* copy = malloc(size + 1);
+        if (copy == NULL) {
+            fprintf(stderr, "words: failed to copy word\n");
+            return -1;
+        }
+        memcpy(copy, word, size);
+        copy[size] = '\0';
+
+        index = w->count++;
+        w->entries[index] = (struct words_entry){ .word = copy, .size = size, .count = 0, .hash = hash };
+        w->slots[slot] = (struct words_slot){ .hash = hash, .index = index };
+    }
+
+    struct words_entry* entry = &w->entries[index];
+    entry->count += delta;
+    if (entry->count < 0) entry->count = 0;
+
+    return index;
+}
+
+// recount every word overlapping from..to, widened to whole words
+static int
+words_scan(struct words* w, const char* buf, long size, long from, long to, long delta)
+{
+    if (w->stale) return WORDS_OK;
+
+    long start = from < 0 ? 0 : MIN(from, size);
+    long end = to < start ? start : MIN(to, size);
+    while (start > 0 && words_char(buf[start - 1])) start--;
+    while (end < size && words_char(buf[end])) end++;
+
+    for (long i = start; i < end;) {
+        if (!words_char(buf[i])) {
+            i++;
+            continue;
+        }
+
+        long j = i;
+        while (j < end && words_char(buf[j])) j++;
+        long size = j - i;
+        if (size >= WORDS_MIN_SIZE && size <= WORDS_MAX_SIZE && !isdigit((unsigned char)buf[i])) {
+            long index = words_count(w, &buf[i], size, words_hash(&buf[i], size), delta);
+            if (index >= 0 && index < w->sorted) words_tree_set(w, index);
+        }
+        i = j;
+    }
+
+    return WORDS_OK;
+}
+
+static bool
+words_heap_push(struct words* w, long* size, long node)
+{
+    if (*size >= w->heap_capacity) {
+        long capacity = w->heap_capacity > 0 ? w->heap_capacity * WORDS_CAPACITY_GROWTH : 64;
+        long* heap = realloc(w->heap, capacity * sizeof(long));
+        if (heap == NULL) return false;
+        w->heap = heap;
+        w->heap_capacity = capacity;
+    }
+
+    long i = (*size)++;
+    while (i > 0 && w->tree[w->heap[(i - 1) / 2]] < w->tree[node]) {
+        w->heap[i] = w->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    w->heap[i] = node;
+
+    return true;
+}
+
+static long
+words_heap_pop(struct words* w, long* size)
+{
+    long top = w->heap[0];
+    long node = w->heap[--(*size)];
+
+    long i = 0;
+    for (;;) {
+        long child = 2 * i + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && w->tree[w->heap[child + 1]] > w->tree[w->heap[child]]) child++;
+        if (w->tree[w->heap[child]] <= w->tree[node]) break;
+        w->heap[i] = w->heap[child];
+        i = child;
+    }
+    if (*size > 0) w->heap[i] = node;
+
+    return top;
+}
+
+// keep the best max matches so far, most frequent first
+static long
+words_rank(const struct words* w, long* ranked, long count, long max, long index)
+{
+    const struct words_entry* entry = &w->entries[index];
+
+    long i = count < max ? count++ : max;
+    while (i > 0) {
+        const struct words_entry* other = &w->entries[ranked[i - 1]];
+        bool before = entry->count > other->count ||
+            (entry->count == other->count && words_entry_compare(entry, other) < 0);
+        if (!before) break;
+        if (i < max) ranked[i] = ranked[i - 1];
+        i--;
+    }
+    if (i < max) ranked[i] = index;
+
+    return count;
+}
+
+int
+words_init(struct words* w)
+{
+    assert(w != NULL);
+
+    words_chars_init();
+
+    w->entries = NULL;
+    w->count = 0;
+    w->capacity = 0;
+    w->sorted = 0;
+
+    w->slots = NULL;
+    w->slot_count = 0;
+
+    w->tree = NULL;
+    w->leaves = 0;
+    w->heap = NULL;
+    w->heap_capacity = 0;
+
+    w->stale = false;
+
+    return WORDS_OK;
+}
+
+int
+words_free(struct words* w)
+{
+    assert(w != NULL);
+
+    for (long i = 0; i < w->count; i++) free(w->entries[i].word);
+    free(w->entries);
+    free(w->slots);
+    free(w->tree);
+    free(w->heap);
+    words_init(w);
+
+    return WORDS_OK;
+}
+
+// the words of buf (size bytes) overlapping from..to, widened to whole
+// words, start being counted. Call before and after changing some text
+// with the range it covers to keep the counts right.
+int
+words_add(struct words* w, const char* buf, long size, long from, long to)
+{
+    assert(w != NULL);
+    return words_scan(w, buf, size, from, to, 1);
+}
+
+int
+words_remove(struct words* w, const char* buf, long size, long from, long to)
+{
+    assert(w != NULL);
+    return words_scan(w, buf, size, from, to, -1);
+}
+
+int
+words_add_lines(struct words* w, const struct line* line, long count)
+{
+    assert(w != NULL);
+
+    for (long i = 0; i < count && line != NULL; i++, line = line->next) {
+        if (words_scan(w, line->buf, line->size, 0, line->size, 1) != WORDS_OK) return WORDS_ERROR;
+    }
+
+    return WORDS_OK;
+}
+
+int
+words_remove_lines(struct words* w, const struct line* line, long count)
+{
+    assert(w != NULL);
+
+    for (long i = 0; i < count && line != NULL; i++, line = line->next) {
+        if (words_scan(w, line->buf, line->size, 0, line->size, -1) != WORDS_OK) return WORDS_ERROR;
+    }
+
+    return WORDS_OK;
+}
+
+// add the counts of another index (from a chunk counted elsewhere)
+int
+words_merge(struct words* w, const struct words* other)
+{
+    assert(w != NULL);
+    assert(other != NULL);
+
+    if (w->stale) return WORDS_OK;
+
+    for (long i = 0; i < other->count; i++) {
+        const struct words_entry* entry = &other->entries[i];
+        if (entry->count == 0) continue;
+        if (words_count(w, entry->word, entry->size, entry->hash, entry->count) < 0) return WORDS_ERROR;
+    }
+
+    // a load adds new words far faster than they get queried
+    if (w->count - w->sorted > WORDS_PENDING_MAX && w->count - w->sorted > w->sorted) {
+        return words_sort(w);
+    }
+    if (w->sorted > 0) words_tree_build(w);
+
+    return WORDS_OK;
+}
+
+int
+words_invalidate(struct words* w)
+{
+    assert(w != NULL);
+
+    w->stale = true;
+    return WORDS_OK;
+}
+
+int
+words_build(struct words* w, const struct line* head, long count)
+{
+    assert(w != NULL);
+
+    words_free(w);
+    if (words_add_lines(w, head, count) != WORDS_OK) return WORDS_ERROR;
+    return words_sort(w);
+}
+
+// where the word ending at pos starts (pos itself if there is none)
+long
+words_prefix(const char* buf, long pos)
+{
+    long start = pos;
+    while (start > 0 && words_char(buf[start - 1])) start--;
+    return start;
+}
+
+// Find up to max words that start with prefix (but are longer), most
+// frequent first. The matches point into the index and stay valid until
+// it next changes. Returns how many were found.
+long
+words_complete(struct words* w, const char* prefix, long size, const char** matches, long max)
+{
+    assert(w != NULL);
+    assert(prefix != NULL);
+    assert(matches != NULL);
+
+    if (w->stale || max <= 0) return 0;
+    if (max > WORDS_MATCH_MAX) max = WORDS_MATCH_MAX;
+    if (w->count - w->sorted > WORDS_PENDING_MAX) {
+        if (words_sort(w) != WORDS_OK) return 0;
+    }
+
+    // the words starting with prefix sit in one range of the sorted ones
+    long lo = 0;
+    long hi = w->sorted;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        const struct words_entry* entry = &w->entries[mid];
+        if (words_compare(entry->word, entry->size, prefix, size) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    long first = lo;
+    hi = w->sorted;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        const struct words_entry* entry = &w->entries[mid];
+        if (entry->size >= size && memcmp(entry->word, prefix, size) == 0) lo = mid + 1;
+        else hi = mid;
+    }
+    long last = lo;
+
+    long ranked[WORDS_MATCH_MAX];
+    long count = 0;
+
+    // take the most frequent leaves of the tree over that range in order,
+    // the first max longer than the prefix itself are the best ones
+    long heap_size = 0;
+    long found = 0;
+    for (long l = first + w->leaves, r = last + w->leaves; l < r; l /= 2, r /= 2) {
+        long nodes[2] = { (l & 1) ? l++ : 0, (r & 1) ? --r : 0 };
+        for (long i = 0; i < 2; i++) {
+            if (nodes[i] == 0 || w->tree[nodes[i]] == 0) continue;
+            if (!words_heap_push(w, &heap_size, nodes[i])) return 0;
+        }
+    }
+    while (heap_size > 0 && found < max) {
+        long node = words_heap_pop(w, &heap_size);
+        if (node >= w->leaves) {
+            long index = node - w->leaves;
+            if (w->entries[index].size == size) continue;
+            count = words_rank(w, ranked, count, max, index);
+            found++;
+            continue;
+        }
+        for (long child = 2 * node; child <= 2 * node + 1; child++) {
+            if (w->tree[child] > 0 && !words_heap_push(w, &heap_size, child)) return 0;
+        }
+    }
+
+    // and the few new words that haven't been sorted in yet
+    for (long i = w->sorted; i < w->count; i++) {
+        const struct words_entry* entry = &w->entries[i];
+        if (entry->count == 0 || entry->size <= size) continue;
+        if (memcmp(entry->word, prefix, size) != 0) continue;
+        count = words_rank(w, ranked, count, max, i);
+    }
+
+    for (long i = 0; i < count; i++) matches[i] = w->entries[ranked[i]].word;
+    return count;
+}
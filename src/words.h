@@ -0,0 +1,77 @@
+#ifndef DERZVIM_WORDS_H_INCLUDED
+#define DERZVIM_WORDS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "line.h"
+
+enum {
+    // shorter and longer runs of word chars aren't worth completing
+    WORDS_MIN_SIZE = 2,
+    WORDS_MAX_SIZE = 64,
+
+    // most matches a completion query gives back
+    WORDS_MATCH_MAX = 16,
+};
+
+struct words_entry {
+    char* word;
+    long size;
+    long count;
+    uint64_t hash;
+};
+
+// the hash is kept next to the index so most probes never leave the table
+struct words_slot {
+    uint64_t hash;
+    long index;
+};
+
+// How often each word shows up in a buffer, for completion. Words are
+// found through a hash table and kept sorted so that the ones starting
+// with a prefix form a range, with a max tree over their counts that
+// gives the most frequent few in O(log n) each. New words go on the end
+// unsorted and are only merged in (dropping the ones that went to zero)
+// once there are too many of them to scan. Edits only ever recount the
+// words around where they happened.
+struct words {
+    struct words_entry* entries;
+    long count;
+    long capacity;
+    long sorted;
+
+    // open addressing, -1 is an empty slot
+    struct words_slot* slots;
+    long slot_count;
+
+    long* tree;
+    long leaves;
+    long* heap;
+    long heap_capacity;
+
+    // after changes that weren't tracked, rebuilt before the next query
+    bool stale;
+};
+
+enum words_status {
+    WORDS_OK = 0,
+    WORDS_ERROR,
+};
+
+int words_init(struct words* w);
+int words_free(struct words* w);
+
+int words_add(struct words* w, const char* buf, long size, long from, long to);
+int words_remove(struct words* w, const char* buf, long size, long from, long to);
+int words_add_lines(struct words* w, const struct line* line, long count);
+int words_remove_lines(struct words* w, const struct line* line, long count);
+int words_merge(struct words* w, const struct words* other);
+
+int words_invalidate(struct words* w);
+int words_build(struct words* w, const struct line* head, long count);
+
+long words_prefix(const char* buf, long pos);
+long words_complete(struct words* w, const char* prefix, long size, const char** matches, long max);
+
+#endif
@@ -0,0 +1,464 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line.h"
+#include "wrap.h"
+
+enum {
+    WRAP_DEFAULT_CAPACITY = 64,
+    WRAP_CAPACITY_GROWTH = 2,
+};
+
+static int
+wrap_reserve(struct wrap* w, long count)
+{
+    if (count <= w->block_capacity) return WRAP_OK;
+
+    long capacity = w->block_capacity > 0 ? w->block_capacity : WRAP_DEFAULT_CAPACITY;
+    while (capacity < count) capacity *= WRAP_CAPACITY_GROWTH;
+
+    struct wrap_block** blocks = realloc(w->blocks, capacity * sizeof(struct wrap_block*));
+    if (blocks == NULL) return WRAP_ERROR;
+    w->blocks = blocks;
+
+    // fenwick trees are 1-based so they need an extra slot
+    long* lines = realloc(w->lines, (capacity + 1) * sizeof(long));
+    if (lines == NULL) return WRAP_ERROR;
+    w->lines = lines;
+    long* rows = realloc(w->rows, (capacity + 1) * sizeof(long));
+    if (rows == NULL) return WRAP_ERROR;
+    w->rows = rows;
+
+    w->block_capacity = capacity;
+    return WRAP_OK;
+}
+
+static void
+wrap_tree_add(long* tree, long count, long block, long delta)
+{
+    for (long i = block + 1; i <= count; i += i & -i) tree[i] += delta;
+}
+
+static long
+wrap_tree_sum(const long* tree, long block)
+{
+    long sum = 0;
+    for (long i = block; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+// rebuild both trees from the blocks in linear time, after blocks were
+// split or dropped
+static void
+wrap_tree_build(struct wrap* w)
+{
+    for (long i = 1; i <= w->block_count; i++) {
+        w->lines[i] = w->blocks[i - 1]->count;
+        w->rows[i] = w->blocks[i - 1]->sum;
+    }
+    for (long i = 1; i <= w->block_count; i++) {
+        long parent = i + (i & -i);
+        if (parent > w->block_count) continue;
+        w->lines[parent] += w->lines[i];
+        w->rows[parent] += w->rows[i];
+    }
+}
+
+// add an empty block on the end, extending the trees over it
+static struct wrap_block*
+wrap_block_push(struct wrap* w)
+{
+    if (wrap_reserve(w, w->block_count + 1) != WRAP_OK) return NULL;
+    struct wrap_block* block = malloc(sizeof(struct wrap_block));
+    if (block == NULL) return NULL;
+    block->count = 0;
+    block->sum = 0;
+
+    // the new node covers the blocks after the one its range starts at
+    long i = ++w->block_count;
+    w->blocks[i - 1] = block;
+    w->lines[i] = wrap_tree_sum(w->lines, i - 1) - wrap_tree_sum(w->lines, i - (i & -i));
+    w->rows[i] = wrap_tree_sum(w->rows, i - 1) - wrap_tree_sum(w->rows, i - (i & -i));
+
+    return block;
+}
+
+// make room for count empty blocks from at on (the trees are left to
+// the caller)
+static int
+wrap_blocks_add(struct wrap* w, long at, long count)
+{
+    if (wrap_reserve(w, w->block_count + count) != WRAP_OK) return WRAP_ERROR;
+    memmove(&w->blocks[at + count], &w->blocks[at], (w->block_count - at) * sizeof(struct wrap_block*));
+
+    for (long i = 0; i < count; i++) {
+        struct wrap_block* block = malloc(sizeof(struct wrap_block));
+        if (block == NULL) {
+            for (long j = 0; j < i; j++) free(w->blocks[at + j]);
+            memmove(&w->blocks[at], &w->blocks[at + count], (w->block_count - at) * sizeof(struct wrap_block*));
+            return WRAP_ERROR;
+        }
+        block->count = 0;
+        block->sum = 0;
+        w->blocks[at + i] = block;
+    }
+    w->block_count += count;
+
+    return WRAP_OK;
+}
+
+// The block line index is in and where in it, along with how many rows
+// come before the block. An index just past the end is in the last block.
+static long
+wrap_locate(const struct wrap* w, long index, long* pos, long* row)
+{
+    long block = 0;
+    long step = 1;
+    while (step * 2 <= w->block_count) step *= 2;
+
+    *pos = index;
+    *row = 0;
+    for (; step > 0; step /= 2) {
+        long next = block + step;
+        if (next <= w->block_count && w->lines[next] <= *pos) {
+            block = next;
+            *pos -= w->lines[next];
+            *row += w->rows[next];
+        }
+    }
+
+    if (block == w->block_count && block > 0) {
+        block--;
+        *pos += w->blocks[block]->count;
+        *row -= w->blocks[block]->sum;
+    }
+    return block;
+}
+
+int
+wrap_init(struct wrap* w)
+{
+    assert(w != NULL);
+
+    w->blocks = NULL;
+    w->block_count = 0;
+    w->block_capacity = 0;
+    w->lines = NULL;
+    w->rows = NULL;
+    w->count = 0;
+    w->width = 1;
+
+    return WRAP_OK;
+}
+
+int
+wrap_free(struct wrap* w)
+{
+    assert(w != NULL);
+
+    for (long i = 0; i < w->block_count; i++) free(w->blocks[i]);
+    free(w->blocks);
+    free(w->lines);
+    free(w->rows);
+    wrap_init(w);
+
+    return WRAP_OK;
+}
+
+int
+wrap_build(struct wrap* w, const struct line* head, long count, long width)
+{
+    assert(w != NULL);
+    assert(width > 0);
+
+    for (long i = 0; i < w->block_count; i++) free(w->blocks[i]);
+    w->block_count = 0;
+    w->count = 0;
+    w->width = width;
+
+    // count is only a hint, the list itself is the source of truth
+    if (wrap_reserve(w, (count + WRAP_BLOCK - 1) / WRAP_BLOCK) != WRAP_OK) {
+        fprintf(stderr, "wrap: failed to allocate row index\n");
+        return WRAP_ERROR;
+    }
+    return wrap_append(w, head, LONG_MAX);
+}
+
+int
+wrap_update(struct wrap* w, long index, long size)
+{
+    assert(w != NULL);
+    assert(index >= 0);
+    assert(index < w->count);
+
+    long pos = 0;
+    long row = 0;
+    long b = wrap_locate(w, index, &pos, &row);
+    struct wrap_block* block = w->blocks[b];
+
+    long rows = wrap_line_rows(w, size);
+    long delta = rows - block->rows[pos];
+    if (delta == 0) return WRAP_OK;
+
+    block->rows[pos] = rows;
+    block->sum += delta;
+    wrap_tree_add(w->rows, w->block_count, b, delta);
+
+    return WRAP_OK;
+}
+
+int
+wrap_insert(struct wrap* w, long index, long size)
+{
+    assert(w != NULL);
+    assert(index >= 0);
+    assert(index <= w->count);
+
+    if (w->block_count == 0 && wrap_block_push(w) == NULL) {
+        fprintf(stderr, "wrap: failed to grow row index\n");
+        return WRAP_ERROR;
+    }
+
+    long pos = 0;
+    long row = 0;
+    long b = wrap_locate(w, index, &pos, &row);
+    struct wrap_block* block = w->blocks[b];
+
+    // a full block gives its second half to a new one after it
+    if (block->count == WRAP_BLOCK) {
+        struct wrap_block* half = malloc(sizeof(struct wrap_block));
+        if (half == NULL || wrap_reserve(w, w->block_count + 1) != WRAP_OK) {
+            free(half);
+            fprintf(stderr, "wrap: failed to grow row index\n");
+            return WRAP_ERROR;
+        }
+
+        half->count = WRAP_BLOCK / 2;
+        half->sum = 0;
+        memcpy(half->rows, &block->rows[WRAP_BLOCK / 2], half->count * sizeof(long));
+        for (long i = 0; i < half->count; i++) half->sum += half->rows[i];
+        block->count -= half->count;
+        block->sum -= half->sum;
+
+        memmove(&w->blocks[b + 2], &w->blocks[b + 1], (w->block_count - b - 1) * sizeof(struct wrap_block*));
+        w->blocks[b + 1] = half;
+        w->block_count++;
+        wrap_tree_build(w);
+
+        if (pos > block->count) {
+            pos -= block->count;
+            block = half;
+            b++;
+        }
+    }
+
+    long rows = wrap_line_rows(w, size);
+    memmove(&block->rows[pos + 1], &block->rows[pos], (block->count - pos) * sizeof(long));
+    block->rows[pos] = rows;
+    block->count++;
+    block->sum += rows;
+    wrap_tree_add(w->lines, w->block_count, b, 1);
+    wrap_tree_add(w->rows, w->block_count, b, rows);
+    w->count++;
+
+    return WRAP_OK;
+}
+
+// count lines from line on were linked in at index
+int
+wrap_insert_lines(struct wrap* w, long index, const struct line* line, long count)
+{
+    assert(w != NULL);
+    assert(index >= 0);
+    assert(index <= w->count);
+
+    if (count <= 0) return WRAP_OK;
+    if (count == 1) return wrap_insert(w, index, line->size);
+    if (index == w->count) return wrap_append(w, line, count);
+
+    long pos = 0;
+    long row = 0;
+    long b = wrap_locate(w, index, &pos, &row);
+    struct wrap_block* block = w->blocks[b];
+
+    // lines that fit go in among the rest of the block
+    if (block->count + count <= WRAP_BLOCK) {
+        memmove(&block->rows[pos + count], &block->rows[pos], (block->count - pos) * sizeof(long));
+        long rows = 0;
+        for (long i = 0; i < count; i++, line = line->next) {
+            block->rows[pos + i] = wrap_line_rows(w, line->size);
+            rows += block->rows[pos + i];
+        }
+        block->count += count;
+        block->sum += rows;
+        wrap_tree_add(w->lines, w->block_count, b, count);
+        wrap_tree_add(w->rows, w->block_count, b, rows);
+        w->count += count;
+        return WRAP_OK;
+    }
+
+    // otherwise the block is cut at pos, the lines fill it up and as many
+    // new blocks as they need, and the rest of it goes in one behind them
+    long room = WRAP_BLOCK - pos;
+    long added = (count > room ? (count - room + WRAP_BLOCK - 1) / WRAP_BLOCK : 0) + 1;
+    if (wrap_blocks_add(w, b + 1, added) != WRAP_OK) {
+        fprintf(stderr, "wrap: failed to grow row index\n");
+        return WRAP_ERROR;
+    }
+
+    struct wrap_block* rest = w->blocks[b + added];
+    rest->count = block->count - pos;
+    memcpy(rest->rows, &block->rows[pos], rest->count * sizeof(long));
+    for (long i = 0; i < rest->count; i++) rest->sum += rest->rows[i];
+    block->count = pos;
+    block->sum -= rest->sum;
+
+    for (long i = 0; i < count; i++, line = line->next) {
+        if (block->count == WRAP_BLOCK) block = w->blocks[++b];
+        long rows = wrap_line_rows(w, line->size);
+        block->rows[block->count++] = rows;
+        block->sum += rows;
+    }
+    w->count += count;
+    wrap_tree_build(w);
+
+    return WRAP_OK;
+}
+
+int
+wrap_remove(struct wrap* w, long index)
+{
+    assert(w != NULL);
+    assert(index >= 0);
+    assert(index < w->count);
+
+    long pos = 0;
+    long row = 0;
+    long b = wrap_locate(w, index, &pos, &row);
+    struct wrap_block* block = w->blocks[b];
+
+    long rows = block->rows[pos];
+    memmove(&block->rows[pos], &block->rows[pos + 1], (block->count - pos - 1) * sizeof(long));
+    block->count--;
+    block->sum -= rows;
+    w->count--;
+
+    if (block->count > 0) {
+        wrap_tree_add(w->lines, w->block_count, b, -1);
+        wrap_tree_add(w->rows, w->block_count, b, -rows);
+        return WRAP_OK;
+    }
+
+    // an empty block is dropped
+    free(block);
+    memmove(&w->blocks[b], &w->blocks[b + 1], (w->block_count - b - 1) * sizeof(struct wrap_block*));
+    w->block_count--;
+    wrap_tree_build(w);
+
+    return WRAP_OK;
+}
+
+int
+wrap_append(struct wrap* w, const struct line* line, long count)
+{
+    assert(w != NULL);
+
+    for (long i = 0; i < count && line != NULL;) {
+        struct wrap_block* block = w->block_count > 0 ? w->blocks[w->block_count - 1] : NULL;
+        if (block == NULL || block->count == WRAP_BLOCK) block = wrap_block_push(w);
+        if (block == NULL) {
+            fprintf(stderr, "wrap: failed to grow row index\n");
+            return WRAP_ERROR;
+        }
+
+        // fill up the last block, then add it all to the trees at once
+        long lines = 0;
+        long rows = 0;
+        for (; i < count && line != NULL && block->count < WRAP_BLOCK; i++, line = line->next) {
+            long r = wrap_line_rows(w, line->size);
+            block->rows[block->count++] = r;
+            lines++;
+            rows += r;
+        }
+        block->sum += rows;
+        wrap_tree_add(w->lines, w->block_count, w->block_count - 1, lines);
+        wrap_tree_add(w->rows, w->block_count, w->block_count - 1, rows);
+        w->count += lines;
+    }
+
+    return WRAP_OK;
+}
+
+long
+wrap_line_rows(const struct wrap* w, long size)
+{
+    assert(w != NULL);
+
+    // always leave room for the cursor sitting just past the last char
+    return size / w->width + 1;
+}
+
+long
+wrap_row(const struct wrap* w, long index)
+{
+    assert(w != NULL);
+    assert(index >= 0);
+    assert(index <= w->count);
+
+    if (w->block_count == 0) return 0;
+
+    long pos = 0;
+    long row = 0;
+    long b = wrap_locate(w, index, &pos, &row);
+    for (long i = 0; i < pos; i++) row += w->blocks[b]->rows[i];
+
+    return row;
+}
+
+long
+wrap_find(const struct wrap* w, long row, long* offset)
+{
+    assert(w != NULL);
+    assert(offset != NULL);
+    assert(w->count > 0);
+
+    // clamp rows beyond the end onto the last row of the last line
+    long total = wrap_total(w);
+    if (row >= total) row = total - 1;
+    if (row < 0) row = 0;
+
+    long step = 1;
+    while (step * 2 <= w->block_count) step *= 2;
+
+    // descend the tree looking for the block the row is in
+    long block = 0;
+    long index = 0;
+    long remaining = row;
+    for (; step > 0; step /= 2) {
+        long next = block + step;
+        if (next <= w->block_count && w->rows[next] <= remaining) {
+            block = next;
+            index += w->lines[next];
+            remaining -= w->rows[next];
+        }
+    }
+
+    // then along the block to its line
+    const struct wrap_block* b = w->blocks[block];
+    long pos = 0;
+    while (remaining >= b->rows[pos]) remaining -= b->rows[pos++];
+
+    *offset = remaining;
+    return index + pos;
+}
+
+long
+wrap_total(const struct wrap* w)
+{
+    assert(w != NULL);
+    return wrap_tree_sum(w->rows, w->block_count);
+}
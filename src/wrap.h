@@ -0,0 +1,65 @@
+#ifndef DERZVIM_WRAP_H_INCLUDED
+#define DERZVIM_WRAP_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum {
+    WRAP_BLOCK = 256,
+};
+
+// up to WRAP_BLOCK consecutive lines' row counts, and their sum
+struct wrap_block {
+    long count;
+    long sum;
+    long rows[WRAP_BLOCK];
+};
+
+// Visual row index for soft-wrap mode. Each line occupies one or more
+// screen rows. The row counts are kept in order in blocks, and two
+// Fenwick trees over the blocks sum up the lines and the rows before
+// each one, so mapping between rows and line indices is a descent of a
+// tree and a scan of one block. Changing the size of a line, inserting
+// or removing one only touches its block and O(log n) tree nodes. A
+// block that fills up is split in two and an emptied one is dropped,
+// which rebuilds the trees (over WRAP_BLOCK times fewer blocks than
+// there are lines). Many lines inserted at once cut their block in two
+// and fill new blocks in between, rebuilding the trees only once. Lines
+// appended on the end fill up the last block and extend the trees in
+// place.
+struct wrap {
+    struct wrap_block** blocks;
+    long block_count;
+    long block_capacity;
+
+    // fenwick trees (1-based) over the line counts and row sums
+    long* lines;
+    long* rows;
+
+    long count;
+    long width;
+};
+
+enum wrap_status {
+    WRAP_OK = 0,
+    WRAP_ERROR,
+};
+
+int wrap_init(struct wrap* w);
+int wrap_free(struct wrap* w);
+
+int wrap_build(struct wrap* w, const struct line* head, long count, long width);
+
+int wrap_update(struct wrap* w, long index, long size);
+int wrap_insert(struct wrap* w, long index, long size);
+int wrap_insert_lines(struct wrap* w, long index, const struct line* line, long count);
+int wrap_remove(struct wrap* w, long index);
+int wrap_append(struct wrap* w, const struct line* line, long count);
+
+long wrap_line_rows(const struct wrap* w, long size);
+long wrap_row(const struct wrap* w, long index);
+long wrap_find(const struct wrap* w, long row, long* offset);
+long wrap_total(const struct wrap* w);
+
+#endif
@@ -0,0 +1,219 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "line.h"
+#include "yank.h"
+
+enum {
+    YANK_DEFAULT_CAPACITY = 16,
+    YANK_CAPACITY_GROWTH = 2,
+};
+
+// drop the old contents and make room for count slices
+static int
+yank_reset(struct yank* y, int mode, long count)
+{
+    for (long i = 0; i < y->count; i++) line_text_release(y->slices[i].text);
+    y->count = 0;
+    y->mode = mode;
+
+    if (count <= y->capacity) return YANK_OK;
+
+    long capacity = y->capacity > 0 ? y->capacity : YANK_DEFAULT_CAPACITY;
+    while (capacity < count) capacity *= YANK_CAPACITY_GROWTH;
+
+    struct yank_slice* slices = realloc(y->slices, capacity * sizeof(struct yank_slice));
+    if (slices == NULL) {
+        fprintf(stderr, "yank: failed to grow register\n");
+        return YANK_ERROR;
+    }
+    y->slices = slices;
+    y->capacity = capacity;
+
+    return YANK_OK;
+}
+
+static void
+yank_slice_add(struct yank* y, const struct line* line, long start, long end)
+{
+    struct yank_slice* s = &y->slices[y->count++];
+    s->text = line_share(line);
+    s->buf = line->buf + start;
+    s->size = end - start;
+}
+
+// a new line showing the text of a slice, without copying it
+static struct line*
+yank_slice_line(const struct yank_slice* s)
+{
+    struct line* line = calloc(1, sizeof(struct line));
+    if (line == NULL) return NULL;
+    line_init_shared(line, s->text, s->buf, s->size);
+    return line;
+}
+
+int
+yank_init(struct yank* y)
+{
+    assert(y != NULL);
+
+    y->mode = YANK_LINEWISE;
+    y->slices = NULL;
+    y->count = 0;
+    y->capacity = 0;
+
+    return YANK_OK;
+}
+
+int
+yank_free(struct yank* y)
+{
+    assert(y != NULL);
+
+    yank_reset(y, YANK_LINEWISE, 0);
+    free(y->slices);
+    yank_init(y);
+
+    return YANK_OK;
+}
+
+// the register index for a name ('"' or a to z), or -1
+long
+yank_register(char name)
+{
+    if (name == '"') return 0;
+    if (name >= 'a' && name <= 'z') return 1 + name - 'a';
+    return -1;
+}
+
+int
+yank_lines(struct yank* y, const struct line* first, long count)
+{
+    assert(y != NULL);
+    assert(first != NULL);
+
+    if (yank_reset(y, YANK_LINEWISE, count) != YANK_OK) return YANK_ERROR;
+
+    const struct line* line = first;
+    for (long i = 0; i < count && line != NULL; i++, line = line->next) {
+        yank_slice_add(y, line, 0, line->size);
+    }
+
+    return YANK_OK;
+}
+
+int
+yank_chars(struct yank* y, const struct line* first, long pos, const struct line* last, long end)
+{
+    assert(y != NULL);
+    assert(first != NULL);
+    assert(last != NULL);
+
+    long count = 1;
+    for (const struct line* line = first; line != last; line = line->next) {
+        assert(line->next != NULL);
+        count++;
+    }
+    if (yank_reset(y, YANK_CHARWISE, count) != YANK_OK) return YANK_ERROR;
+
+    // from pos to the end of the first line, whole lines, then up to end
+    const struct line* line = first;
+    for (long i = 0; i < count; i++, line = line->next) {
+        long start = i == 0 ? pos : 0;
+        long stop = i == count - 1 ? end : line->size;
+        yank_slice_add(y, line, start, stop);
+    }
+
+    return YANK_OK;
+}
+
+int
+yank_put_lines(const struct yank* y, struct line** head, struct line** tail,
+    struct line* after, long* added)
+{
+    assert(y != NULL);
+    assert(head != NULL);
+    assert(tail != NULL);
+    assert(added != NULL);
+
+    // every slice becomes a line of its own (NULL after puts them on top)
+    *added = 0;
+    struct line* prev = after;
+    for (long i = 0; i < y->count; i++) {
+        struct line* line = yank_slice_line(&y->slices[i]);
+        if (line == NULL) return YANK_ERROR;
+
+        struct line* next = prev != NULL ? prev->next : *head;
+        line->prev = prev;
+        line->next = next;
+        if (prev != NULL) prev->next = line; else *head = line;
+        if (next != NULL) next->prev = line; else *tail = line;
+
+        prev = line;
+        (*added)++;
+    }
+
+    return YANK_OK;
+}
+
+int
+yank_put_chars(const struct yank* y, struct line** tail, struct line* line, long pos,
+    long* added)
+{
+    assert(y != NULL);
+    assert(tail != NULL);
+    assert(line != NULL);
+    assert(added != NULL);
+
+    *added = 0;
+    if (y->count == 0) return YANK_OK;
+
+    // text within a line has to be copied in
+    const struct yank_slice* first = &y->slices[0];
+    if (y->count == 1) return line_insert_buf(line, pos, first->buf, first->size);
+
+    // otherwise split the line, the lines in between are shared as they are
+    if (line_break(line, pos) != LINE_OK) return YANK_ERROR;
+    struct line* rest = line->next;
+    if (line == *tail) *tail = rest;
+    if (line_append_buf(line, first->buf, first->size) != LINE_OK) return YANK_ERROR;
+
+    struct line* prev = line;
+    for (long i = 1; i < y->count - 1; i++) {
+        struct line* middle = yank_slice_line(&y->slices[i]);
+        if (middle == NULL) return YANK_ERROR;
+        middle->prev = prev;
+        middle->next = rest;
+        prev->next = middle;
+        rest->prev = middle;
+        prev = middle;
+    }
+
+    const struct yank_slice* last = &y->slices[y->count - 1];
+    if (line_insert_buf(rest, 0, last->buf, last->size) != LINE_OK) return YANK_ERROR;
+    *added = y->count - 1;
+
+    return YANK_OK;
+}
+
+// how many bytes the register holds, and how many of those are also
+// held by lines or other registers (and so cost nothing extra)
+int
+yank_memory(const struct yank* y, long* bytes, long* shared)
+{
+    assert(y != NULL);
+    assert(bytes != NULL);
+    assert(shared != NULL);
+
+    *bytes = 0;
+    *shared = 0;
+    for (long i = 0; i < y->count; i++) {
+        const struct yank_slice* s = &y->slices[i];
+        *bytes += s->size;
+        if (s->text->refs > 1) *shared += s->size;
+    }
+
+    return YANK_OK;
+}
@@ -0,0 +1,56 @@
+#ifndef DERZVIM_YANK_H_INCLUDED
+#define DERZVIM_YANK_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "line.h"
+
+enum {
+    // the unnamed register ("), then "a to "z
+    YANK_REGISTER_COUNT = 27,
+};
+
+enum yank_mode {
+    YANK_LINEWISE = 0,
+    YANK_CHARWISE,
+};
+
+// a run of chars inside some line's text, held by reference
+struct yank_slice {
+    struct line_text* text;
+    const char* buf;
+    long size;
+};
+
+// One register. It shares the text of the lines it was yanked from, so
+// yanking and putting cost a pointer per line no matter how long they
+// are. Charwise registers start and end mid-line, with one slice for
+// each line they span.
+struct yank {
+    int mode;
+    struct yank_slice* slices;
+    long count;
+    long capacity;
+};
+
+enum yank_status {
+    YANK_OK = 0,
+    YANK_ERROR,
+};
+
+int yank_init(struct yank* y);
+int yank_free(struct yank* y);
+
+long yank_register(char name);
+
+int yank_lines(struct yank* y, const struct line* first, long count);
+int yank_chars(struct yank* y, const struct line* first, long pos, const struct line* last, long end);
+
+int yank_put_lines(const struct yank* y, struct line** head, struct line** tail,
+    struct line* after, long* added);
+int yank_put_chars(const struct yank* y, struct line** tail, struct line* line, long pos,
+    long* added);
+
+int yank_memory(const struct yank* y, long* bytes, long* shared);
+
+#endif